@@ -8,10 +8,13 @@
 #cmakedefine HAVE_LIBEXECINFO
 #cmakedefine HAVE_CXXABI_H
 #cmakedefine HAVE_NICE
+#cmakedefine HAVE_EPOLL
 #cmakedefine HAVE_EDITLINE
 #cmakedefine HAVE_SYSTEMD
 
 #cmakedefine ICINGA2_UNITY_BUILD
+#cmakedefine ICINGA2_LOCK_PROFILING
+#cmakedefine ICINGA2_STRING_INTERNING
 
 #define ICINGA_CONFIGDIR "${ICINGA2_FULL_CONFIGDIR}"
 #define ICINGA_DATADIR "${ICINGA2_FULL_DATADIR}"
@@ -8,6 +8,7 @@
 #include "base/configwriter.hpp"
 #include "base/convert.hpp"
 #include "base/exception.hpp"
+#include <boost/thread/lock_types.hpp>
 
 using namespace icinga;
 
@@ -35,7 +36,7 @@ Array::Array(std::initializer_list<Value> init)
  */
 Value Array::Get(SizeType index) const
 {
-	ObjectLock olock(this);
+	boost::shared_lock<RWLock> lock (m_DataLock);
 
 	return m_Data.at(index);
 }
@@ -50,6 +51,7 @@ Value Array::Get(SizeType index) const
 void Array::Set(SizeType index, const Value& value, bool overrideFrozen)
 {
 	ObjectLock olock(this);
+	boost::unique_lock<RWLock> wlock (m_DataLock);
 
 	if (m_Frozen && !overrideFrozen)
 		BOOST_THROW_EXCEPTION(std::invalid_argument("Value in array must not be modified."));
@@ -67,6 +69,7 @@ void Array::Set(SizeType index, const Value& value, bool overrideFrozen)
 void Array::Set(SizeType index, Value&& value, bool overrideFrozen)
 {
 	ObjectLock olock(this);
+	boost::unique_lock<RWLock> wlock (m_DataLock);
 
 	if (m_Frozen && !overrideFrozen)
 		BOOST_THROW_EXCEPTION(std::invalid_argument("Array must not be modified."));
@@ -83,6 +86,7 @@ void Array::Set(SizeType index, Value&& value, bool overrideFrozen)
 void Array::Add(Value value, bool overrideFrozen)
 {
 	ObjectLock olock(this);
+	boost::unique_lock<RWLock> wlock (m_DataLock);
 
 	if (m_Frozen && !overrideFrozen)
 		BOOST_THROW_EXCEPTION(std::invalid_argument("Array must not be modified."));
@@ -94,6 +98,8 @@ void Array::Add(Value value, bool overrideFrozen)
  * Returns an iterator to the beginning of the array.
  *
  * Note: Caller must hold the object lock while using the iterator.
+ * Other threads may still read the array concurrently, so elements
+ * must be modified through Set() rather than through the iterator.
  *
  * @returns An iterator.
  */
@@ -125,7 +131,7 @@ Array::Iterator Array::End()
  */
 size_t Array::GetLength() const
 {
-	ObjectLock olock(this);
+	boost::shared_lock<RWLock> lock (m_DataLock);
 
 	return m_Data.size();
 }
@@ -138,7 +144,7 @@ size_t Array::GetLength() const
  */
 bool Array::Contains(const Value& value) const
 {
-	ObjectLock olock(this);
+	boost::shared_lock<RWLock> lock (m_DataLock);
 
 	return (std::find(m_Data.begin(), m_Data.end(), value) != m_Data.end());
 }
@@ -153,6 +159,7 @@ bool Array::Contains(const Value& value) const
 void Array::Insert(SizeType index, Value value, bool overrideFrozen)
 {
 	ObjectLock olock(this);
+	boost::unique_lock<RWLock> wlock (m_DataLock);
 
 	ASSERT(index <= m_Data.size());
 
@@ -171,6 +178,7 @@ void Array::Insert(SizeType index, Value value, bool overrideFrozen)
 void Array::Remove(SizeType index, bool overrideFrozen)
 {
 	ObjectLock olock(this);
+	boost::unique_lock<RWLock> wlock (m_DataLock);
 
 	if (m_Frozen && !overrideFrozen)
 		BOOST_THROW_EXCEPTION(std::invalid_argument("Array must not be modified."));
@@ -194,12 +202,15 @@ void Array::Remove(Array::Iterator it, bool overrideFrozen)
 	if (m_Frozen && !overrideFrozen)
 		BOOST_THROW_EXCEPTION(std::invalid_argument("Array must not be modified."));
 
+	boost::unique_lock<RWLock> wlock (m_DataLock);
+
 	m_Data.erase(it);
 }
 
 void Array::Resize(SizeType newSize, bool overrideFrozen)
 {
 	ObjectLock olock(this);
+	boost::unique_lock<RWLock> wlock (m_DataLock);
 
 	if (m_Frozen && !overrideFrozen)
 		BOOST_THROW_EXCEPTION(std::invalid_argument("Array must not be modified."));
@@ -210,6 +221,7 @@ void Array::Resize(SizeType newSize, bool overrideFrozen)
 void Array::Clear(bool overrideFrozen)
 {
 	ObjectLock olock(this);
+	boost::unique_lock<RWLock> wlock (m_DataLock);
 
 	if (m_Frozen && !overrideFrozen)
 		BOOST_THROW_EXCEPTION(std::invalid_argument("Array must not be modified."));
@@ -220,6 +232,7 @@ void Array::Clear(bool overrideFrozen)
 void Array::Reserve(SizeType newSize, bool overrideFrozen)
 {
 	ObjectLock olock(this);
+	boost::unique_lock<RWLock> wlock (m_DataLock);
 
 	if (m_Frozen && !overrideFrozen)
 		BOOST_THROW_EXCEPTION(std::invalid_argument("Array must not be modified."));
@@ -235,6 +248,8 @@ void Array::CopyTo(const Array::Ptr& dest) const
 	if (dest->m_Frozen)
 		BOOST_THROW_EXCEPTION(std::invalid_argument("Array must not be modified."));
 
+	boost::unique_lock<RWLock> wlock (dest->m_DataLock);
+
 	std::copy(m_Data.begin(), m_Data.end(), std::back_inserter(dest->m_Data));
 }
 
@@ -260,7 +275,7 @@ Object::Ptr Array::Clone() const
 {
 	ArrayData arr;
 
-	ObjectLock olock(this);
+	boost::shared_lock<RWLock> lock (m_DataLock);
 	for (const Value& val : m_Data) {
 		arr.push_back(val.Clone());
 	}
@@ -283,6 +298,7 @@ Array::Ptr Array::Reverse() const
 void Array::Sort(bool overrideFrozen)
 {
 	ObjectLock olock(this);
+	boost::unique_lock<RWLock> wlock (m_DataLock);
 
 	if (m_Frozen && !overrideFrozen)
 		BOOST_THROW_EXCEPTION(std::invalid_argument("Array must not be modified."));
@@ -330,10 +346,32 @@ Array::Ptr Array::Unique() const
 	return Array::FromSet(result);
 }
 
-void Array::Freeze()
+/**
+ * Returns an immutable copy of the array's items which can be read
+ * without holding any lock, e.g. to pass it to another thread.
+ *
+ * @returns The snapshot.
+ */
+Array::Snapshot Array::GetSnapshot() const
 {
-	ObjectLock olock(this);
-	m_Frozen = true;
+	boost::shared_lock<RWLock> lock (m_DataLock);
+
+	return Shared<ArrayData>::Make(m_Data.begin(), m_Data.end());
+}
+
+/**
+ * Prevents further modifications of the array.
+ *
+ * @returns A snapshot of the final items.
+ */
+Array::Snapshot Array::Freeze()
+{
+	{
+		ObjectLock olock(this);
+		m_Frozen = true;
+	}
+
+	return GetSnapshot();
 }
 
 Value Array::GetFieldByName(const String& field, bool sandboxed, const DebugInfo& debugInfo) const
@@ -346,12 +384,12 @@ Value Array::GetFieldByName(const String& field, bool sandboxed, const DebugInfo
 		return Object::GetFieldByName(field, sandboxed, debugInfo);
 	}
 
-	ObjectLock olock(this);
+	boost::shared_lock<RWLock> lock (m_DataLock);
 
-	if (index < 0 || static_cast<size_t>(index) >= GetLength())
+	if (index < 0 || static_cast<size_t>(index) >= m_Data.size())
 		BOOST_THROW_EXCEPTION(ScriptError("Array index '" + Convert::ToString(index) + "' is out of bounds.", debugInfo));
 
-	return Get(index);
+	return m_Data[index];
 }
 
 void Array::SetFieldByName(const String& field, const Value& value, bool overrideFrozen, const DebugInfo& debugInfo)
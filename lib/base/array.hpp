@@ -6,6 +6,8 @@
 #include "base/i2-base.hpp"
 #include "base/objectlock.hpp"
 #include "base/value.hpp"
+#include "base/rwlock.hpp"
+#include "base/snapshot.hpp"
 #include <boost/range/iterator.hpp>
 #include <vector>
 #include <set>
@@ -32,6 +34,11 @@ public:
 
 	typedef std::vector<Value>::size_type SizeType;
 
+	/**
+	 * An immutable copy of the array's items.
+	 */
+	typedef icinga::Snapshot<ArrayData> Snapshot;
+
 	Array() = default;
 	Array(const ArrayData& other);
 	Array(ArrayData&& other);
@@ -60,6 +67,8 @@ public:
 	void CopyTo(const Array::Ptr& dest) const;
 	Array::Ptr ShallowClone() const;
 
+	Snapshot GetSnapshot() const;
+
 	static Object::Ptr GetPrototype();
 
 	template<typename T>
@@ -97,7 +106,7 @@ public:
 	Value Join(const Value& separator) const;
 
 	Array::Ptr Unique() const;
-	void Freeze();
+	Snapshot Freeze();
 
 	Value GetFieldByName(const String& field, bool sandboxed, const DebugInfo& debugInfo) const override;
 	void SetFieldByName(const String& field, const Value& value, bool overrideFrozen, const DebugInfo& debugInfo) override;
@@ -105,6 +114,7 @@ public:
 private:
 	std::vector<Value> m_Data; /**< The data for the array. */
 	bool m_Frozen{false};
+	mutable RWLock m_DataLock; /**< Serializes readers with writers which also hold the object lock. */
 };
 
 Array::Iterator begin(const Array::Ptr& x);
@@ -16,13 +16,33 @@
 #include "base/workqueue.hpp"
 #include "base/context.hpp"
 #include "base/application.hpp"
+#include "base/configuration.hpp"
+#include "base/object-packer.hpp"
+#include <algorithm>
+#include <cstdint>
 #include <fstream>
+#include <map>
+#include <memory>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
 #include <boost/exception/errinfo_api_function.hpp>
 #include <boost/exception/errinfo_errno.hpp>
 #include <boost/exception/errinfo_file_name.hpp>
 
 using namespace icinga;
 
+/* The magic bytes the binary state file format starts and ends with. */
+static const char l_BinaryStateMagic[] = "I2STATE\x01";
+
+/* The number of objects in a block of the binary state file format, blocks are restored in parallel. */
+static const size_t l_BinaryStateBlockSize = 1024;
+
+/* The generation of the current state file. The state journal starts with the
+ * generation of the state file it belongs to, see RestoreObjectsJournal().
+ */
+static boost::mutex l_StateGenerationMutex;
+static String l_StateGeneration;
+
 REGISTER_TYPE_WITH_PROTOTYPE(ConfigObject, ConfigObject::GetPrototype());
 
 boost::signals2::signal<void (const ConfigObject::Ptr&)> ConfigObject::OnStateChanged;
@@ -468,6 +488,8 @@ void ConfigObject::DumpObjects(const String& filename, int attributeTypes)
 	Log(LogInformation, "ConfigObject")
 		<< "Dumping program state to file '" << filename << "'";
 
+	String generation = Utility::NewUniqueID();
+
 	std::fstream fp;
 	String tempFilename = Utility::CreateTempFile(filename + ".XXXXXX", 0600, fp);
 	fp.exceptions(std::ofstream::failbit | std::ofstream::badbit);
@@ -475,8 +497,126 @@ void ConfigObject::DumpObjects(const String& filename, int attributeTypes)
 	if (!fp)
 		BOOST_THROW_EXCEPTION(std::runtime_error("Could not open '" + tempFilename + "' file"));
 
+	if (Configuration::StateFormat == "binary") {
+		fp.close();
+		fp.open(tempFilename.CStr(), std::ios_base::trunc | std::ios_base::out | std::ios_base::binary);
+
+		DumpObjectsBinary(fp, attributeTypes, generation);
+	} else {
+		StdioStream::Ptr sfp = new StdioStream(&fp, false);
+
+		NetString::WriteStringToStream(sfp, JsonEncode(new Dictionary({ { "generation", generation } })));
+
+		for (const Type::Ptr& type : Type::GetAllTypes()) {
+			auto *dtype = dynamic_cast<ConfigType *>(type.get());
+
+			if (!dtype)
+				continue;
+
+			for (const ConfigObject::Ptr& object : dtype->GetObjects()) {
+				object->m_StateDirty.store(false);
+
+				Dictionary::Ptr update = Serialize(object, attributeTypes);
+
+				if (!update)
+					continue;
+
+				Dictionary::Ptr persistentObject = new Dictionary({
+					{ "type", type->GetName() },
+					{ "name", object->GetName() },
+					{ "update", update }
+				});
+
+				String json = JsonEncode(persistentObject);
+
+				NetString::WriteStringToStream(sfp, json);
+			}
+		}
+
+		sfp->Close();
+	}
+
+	fp.close();
+
+	Utility::RenameFile(tempFilename, filename);
+
+	{
+		boost::mutex::scoped_lock lock (l_StateGenerationMutex);
+		l_StateGeneration = generation;
+	}
+
+	/* The journal is superseded by the new state file. If Icinga crashes before
+	 * it's removed, RestoreObjects() ignores it as it belongs to the previous generation.
+	 */
+	String journalFilename = filename + ".journal";
+
+	if (Utility::PathExists(journalFilename))
+		Utility::Remove(journalFilename);
+}
+
+/**
+ * Atomically replaces the state journal with a new one which starts with the
+ * current state file generation.
+ *
+ * @param journalFilename The journal's path
+ * @param entries The already encoded entries
+ */
+static void CreateStateJournal(const String& journalFilename, const std::vector<String>& entries)
+{
+	String generation;
+
+	{
+		boost::mutex::scoped_lock lock (l_StateGenerationMutex);
+		generation = l_StateGeneration;
+	}
+
+	std::fstream fp;
+	String tempFilename = Utility::CreateTempFile(journalFilename + ".XXXXXX", 0600, fp);
+
+	if (!fp)
+		BOOST_THROW_EXCEPTION(std::runtime_error("Could not open '" + tempFilename + "' file"));
+
+	fp.exceptions(std::ofstream::failbit | std::ofstream::badbit);
+
+	StdioStream::Ptr sfp = new StdioStream(&fp, false);
+
+	NetString::WriteStringToStream(sfp, JsonEncode(new Dictionary({ { "generation", generation } })));
+
+	for (const String& entry : entries)
+		NetString::WriteStringToStream(sfp, entry);
+
+	sfp->Close();
+	fp.close();
+
+	Utility::RenameFile(tempFilename, journalFilename);
+}
+
+/**
+ * Appends the state of all objects which have changed since they were dumped
+ * the last time to the state journal (the state file's path plus ".journal").
+ *
+ * The journal starts with the generation of the state file it belongs to.
+ * It is replayed by RestoreObjects() after the state file and removed by DumpObjects().
+ */
+void ConfigObject::DumpDirtyObjects(const String& filename, int attributeTypes)
+{
+	String journalFilename = filename + ".journal";
+
+	if (!Utility::PathExists(journalFilename))
+		CreateStateJournal(journalFilename, std::vector<String>());
+
+	std::fstream fp;
+	fp.open(journalFilename.CStr(), std::ios_base::out | std::ios_base::app);
+
+	if (!fp)
+		BOOST_THROW_EXCEPTION(std::runtime_error("Could not open '" + journalFilename + "' file"));
+
+	fp.exceptions(std::ofstream::failbit | std::ofstream::badbit);
+
 	StdioStream::Ptr sfp = new StdioStream(&fp, false);
 
+	unsigned long dumped = 0;
+
 	for (const Type::Ptr& type : Type::GetAllTypes()) {
 		auto *dtype = dynamic_cast<ConfigType *>(type.get());
 
@@ -484,6 +624,9 @@ void ConfigObject::DumpObjects(const String& filename, int attributeTypes)
 			continue;
 
 		for (const ConfigObject::Ptr& object : dtype->GetObjects()) {
+			if (!object->m_StateDirty.exchange(false))
+				continue;
+
 			Dictionary::Ptr update = Serialize(object, attributeTypes);
 
 			if (!update)
@@ -495,9 +638,8 @@ void ConfigObject::DumpObjects(const String& filename, int attributeTypes)
 				{ "update", update }
 			});
 
-			String json = JsonEncode(persistentObject);
-
-			NetString::WriteStringToStream(sfp, json);
+			NetString::WriteStringToStream(sfp, JsonEncode(persistentObject));
+			dumped++;
 		}
 	}
 
@@ -505,7 +647,81 @@ void ConfigObject::DumpObjects(const String& filename, int attributeTypes)
 
 	fp.close();
 
-	Utility::RenameFile(tempFilename, filename);
+	Log(LogInformation, "ConfigObject")
+		<< "Dumped the state of " << dumped << " changed objects to the state journal '" << journalFilename << "'.";
+}
+
+/**
+ * Writes the state of all objects in the binary state file format.
+ *
+ * The file consists of blocks of up to l_BinaryStateBlockSize objects of the same type,
+ * each object being a name and an update dictionary packed with PackObject().
+ * The blocks are followed by an index which lists the blocks (offset, length, count)
+ * per type as well as the file's generation ("@generation"), the index's offset and
+ * the magic bytes the file also starts with.
+ */
+void ConfigObject::DumpObjectsBinary(std::ostream& fp, int attributeTypes, const String& generation)
+{
+	fp.write(l_BinaryStateMagic, 8);
+
+	uint_least64_t offset = 8;
+	DictionaryData index;
+
+	for (const Type::Ptr& type : Type::GetAllTypes()) {
+		auto *dtype = dynamic_cast<ConfigType *>(type.get());
+
+		if (!dtype)
+			continue;
+
+		ArrayData blocks;
+		String block;
+		size_t count = 0;
+
+		auto finishBlock ([&fp, &offset, &blocks, &block, &count]() {
+			fp.write(block.CStr(), block.GetLength());
+
+			blocks.emplace_back(new Array({ (double)offset, (double)block.GetLength(), (double)count }));
+
+			offset += block.GetLength();
+			block.Clear();
+			count = 0;
+		});
+
+		for (const ConfigObject::Ptr& object : dtype->GetObjects()) {
+			object->m_StateDirty.store(false);
+
+			Dictionary::Ptr update = Serialize(object, attributeTypes);
+
+			if (!update)
+				continue;
+
+			block += PackObject(object->GetName());
+			block += PackObject(update);
+
+			if (++count >= l_BinaryStateBlockSize)
+				finishBlock();
+		}
+
+		if (count)
+			finishBlock();
+
+		if (!blocks.empty())
+			index.emplace_back(type->GetName(), new Array(std::move(blocks)));
+	}
+
+	index.emplace_back("@generation", generation);
+
+	String packedIndex = PackObject(new Dictionary(std::move(index)));
+	fp.write(packedIndex.CStr(), packedIndex.GetLength());
+
+	char trailer[8];
+
+	for (int i = 0; i < 8; i++) {
+		trailer[i] = (offset >> (56u - 8u * i)) & 0xFFu;
+	}
+
+	fp.write(trailer, 8);
+	fp.write(l_BinaryStateMagic, 8);
 }
 
 void ConfigObject::RestoreObject(const String& message, int attributeTypes)
@@ -520,11 +736,15 @@ void ConfigObject::RestoreObject(const String& message, int attributeTypes)
 	if (!object)
 		return;
 
+	RestoreObject(object, persistentObject->Get("update"), attributeTypes);
+}
+
+void ConfigObject::RestoreObject(const ConfigObject::Ptr& object, const Dictionary::Ptr& update, int attributeTypes)
+{
 #ifdef I2_DEBUG
 	Log(LogDebug, "ConfigObject")
-		<< "Restoring object '" << name << "' of type '" << type << "'.";
+		<< "Restoring object '" << object->GetName() << "' of type '" << object->GetReflectionType()->GetName() << "'.";
 #endif /* I2_DEBUG */
-	Dictionary::Ptr update = persistentObject->Get("update");
 	Deserialize(object, update, false, attributeTypes);
 	object->OnStateLoaded();
 	object->SetStateLoaded(true);
@@ -539,34 +759,64 @@ void ConfigObject::RestoreObjects(const String& filename, int attributeTypes)
 		<< "Restoring program state from file '" << filename << "'";
 
 	std::fstream fp;
-	fp.open(filename.CStr(), std::ios_base::in);
+	fp.open(filename.CStr(), std::ios_base::in | std::ios_base::binary);
 
-	StdioStream::Ptr sfp = new StdioStream (&fp, false);
+	char magic[8] = { 0 };
+	fp.read(magic, 8);
 
 	unsigned long restored = 0;
+	String generation;
 
 	WorkQueue upq(25000, Configuration::Concurrency);
 	upq.SetName("ConfigObject::RestoreObjects");
 
-	String message;
-	StreamReadContext src;
-	for (;;) {
-		StreamReadStatus srs = NetString::ReadStringFromStream(sfp, &message, src);
+	if (fp.gcount() == 8 && std::equal(magic, magic + 8, l_BinaryStateMagic)) {
+		fp.close();
 
-		if (srs == StatusEof)
-			break;
+		restored = RestoreObjectsBinary(filename, upq, attributeTypes, generation);
+	} else {
+		fp.close();
+		fp.open(filename.CStr(), std::ios_base::in);
 
-		if (srs != StatusNewItem)
-			continue;
+		StdioStream::Ptr sfp = new StdioStream (&fp, false);
 
-		upq.Enqueue(std::bind(&ConfigObject::RestoreObject, message, attributeTypes));
-		restored++;
-	}
+		String message;
+		StreamReadContext src;
+		for (;;) {
+			StreamReadStatus srs = NetString::ReadStringFromStream(sfp, &message, src);
 
-	sfp->Close();
+			if (srs == StatusEof)
+				break;
+
+			if (srs != StatusNewItem)
+				continue;
+
+			/* State files written by older versions don't start with their generation. */
+			if (restored == 0 && generation.IsEmpty()) {
+				Dictionary::Ptr header = JsonDecode(message);
+
+				if (header->Contains("generation")) {
+					generation = header->Get("generation");
+					continue;
+				}
+			}
+
+			upq.Enqueue([message, attributeTypes]() { RestoreObject(message, attributeTypes); });
+			restored++;
+		}
+
+		sfp->Close();
+	}
 
 	upq.Join();
 
+	{
+		boost::mutex::scoped_lock lock (l_StateGenerationMutex);
+		l_StateGeneration = generation;
+	}
+
+	unsigned long journaled = RestoreObjectsJournal(filename, generation, upq, attributeTypes);
+
 	unsigned long no_state = 0;
 
 	for (const Type::Ptr& type : Type::GetAllTypes()) {
@@ -582,11 +832,210 @@ void ConfigObject::RestoreObjects(const String& filename, int attributeTypes)
 
 				no_state++;
 			}
+
+			/* The restored state doesn't have to be dumped again. */
+			object->m_StateDirty.store(false);
 		}
 	}
 
 	Log(LogInformation, "ConfigObject")
-		<< "Restored " << restored << " objects. Loaded " << no_state << " new objects without state.";
+		<< "Restored " << restored << " objects (" << journaled << " from the journal). Loaded " << no_state << " new objects without state.";
+}
+
+/**
+ * Replays the state journal written by DumpDirtyObjects().
+ *
+ * Only the most recent entry per object is restored. A journal which doesn't
+ * belong to the state file's generation is outdated and removed. A journal
+ * whose last entry has been written only partially is rewritten without it,
+ * so that further entries can be appended.
+ *
+ * @param filename The state file's path
+ * @param generation The state file's generation
+ * @returns The number of objects restored from the journal
+ */
+unsigned long ConfigObject::RestoreObjectsJournal(const String& filename, const String& generation, WorkQueue& upq, int attributeTypes)
+{
+	String journalFilename = filename + ".journal";
+
+	if (!Utility::PathExists(journalFilename))
+		return 0;
+
+	std::fstream fp;
+	fp.open(journalFilename.CStr(), std::ios_base::in);
+
+	StdioStream::Ptr sfp = new StdioStream (&fp, false);
+
+	std::map<std::pair<String, String>, Dictionary::Ptr> updates;
+	std::map<std::pair<String, String>, String> messages;
+	unsigned long entries = 0;
+	bool current = false;
+	bool truncated = false;
+
+	try {
+		String message;
+		StreamReadContext src;
+		for (;;) {
+			StreamReadStatus srs = NetString::ReadStringFromStream(sfp, &message, src);
+
+			if (srs == StatusEof) {
+				if (src.Size > 0) {
+					truncated = true;
+
+					Log(LogWarning, "ConfigObject")
+						<< "Ignoring the partially written last entry of the state journal '" << journalFilename << "' after " << entries << " entries.";
+				}
+
+				break;
+			}
+
+			if (srs != StatusNewItem)
+				continue;
+
+			Dictionary::Ptr persistentObject = JsonDecode(message);
+
+			if (!current) {
+				current = persistentObject->Contains("generation") && persistentObject->Get("generation") == generation;
+
+				if (!current)
+					break;
+
+				continue;
+			}
+
+			auto key (std::make_pair(persistentObject->Get("type"), persistentObject->Get("name")));
+
+			updates[key] = persistentObject->Get("update");
+			messages[key] = message;
+			entries++;
+		}
+	} catch (const std::exception& ex) {
+		truncated = true;
+
+		/* Most likely the last entry has been written only partially. */
+		Log(LogWarning, "ConfigObject")
+			<< "Ignoring the rest of the state journal '" << journalFilename << "' after " << entries << " entries: " << DiagnosticInformation(ex, false);
+	}
+
+	sfp->Close();
+	fp.close();
+
+	if (!current) {
+		Log(LogWarning, "ConfigObject")
+			<< "Ignoring the state journal '" << journalFilename << "' as it doesn't belong to the state file '" << filename << "'.";
+
+		Utility::Remove(journalFilename);
+		return 0;
+	}
+
+	if (truncated) {
+		std::vector<String> remaining;
+		remaining.reserve(messages.size());
+
+		for (auto& kv : messages)
+			remaining.emplace_back(std::move(kv.second));
+
+		CreateStateJournal(journalFilename, remaining);
+	}
+
+	for (auto& kv : updates) {
+		ConfigObject::Ptr object = GetObject(kv.first.first, kv.first.second);
+
+		if (!object)
+			continue;
+
+		Dictionary::Ptr update = kv.second;
+
+		upq.Enqueue([object, update, attributeTypes]() { RestoreObject(object, update, attributeTypes); });
+	}
+
+	upq.Join();
+
+	return updates.size();
+}
+
+static inline uint_least64_t ReadBinaryStateUInt64(const char *begin)
+{
+	uint_least64_t i = 0;
+
+	for (int n = 0; n < 8; n++) {
+		i = (i << 8u) | (unsigned char)begin[n];
+	}
+
+	return i;
+}
+
+/**
+ * Restores the objects in a state file written by DumpObjectsBinary().
+ *
+ * The file is mapped into memory and its blocks are restored in parallel.
+ *
+ * @returns The number of objects in the file
+ */
+unsigned long ConfigObject::RestoreObjectsBinary(const String& filename, WorkQueue& upq, int attributeTypes, String& generation)
+{
+	namespace ip = boost::interprocess;
+
+	auto file (std::make_shared<ip::file_mapping>(filename.CStr(), ip::read_only));
+	auto region (std::make_shared<ip::mapped_region>(*file, ip::read_only));
+
+	auto begin (static_cast<const char *>(region->get_address()));
+	auto size (region->get_size());
+
+	if (size < 24 || !std::equal(begin + size - 8, begin + size, l_BinaryStateMagic))
+		BOOST_THROW_EXCEPTION(std::runtime_error("State file '" + filename + "' is truncated."));
+
+	uint_least64_t indexOffset = ReadBinaryStateUInt64(begin + size - 16);
+
+	if (indexOffset < 8 || indexOffset > size - 16)
+		BOOST_THROW_EXCEPTION(std::runtime_error("State file '" + filename + "' has an invalid index offset."));
+
+	const char *indexBegin = begin + indexOffset;
+	Dictionary::Ptr index = UnpackObject(indexBegin, begin + size - 16);
+
+	generation = index->Get("@generation");
+
+	unsigned long restored = 0;
+
+	ObjectLock olock(index);
+	for (const Dictionary::Pair& kv : index) {
+		Type::Ptr type = Type::GetByName(kv.first);
+		auto *dtype = dynamic_cast<ConfigType *>(type.get());
+
+		if (!dtype)
+			continue;
+
+		Array::Ptr blocks = kv.second;
+		ObjectLock blocksLock(blocks);
+
+		for (const Array::Ptr& block : blocks) {
+			uint_least64_t offset = block->Get(0);
+			uint_least64_t length = block->Get(1);
+
+			if (offset < 8 || offset > indexOffset || length > indexOffset - offset)
+				BOOST_THROW_EXCEPTION(std::runtime_error("State file '" + filename + "' has an invalid block offset."));
+
+			restored += (unsigned long)block->Get(2);
+
+			/* The blocks share the mapping, it's released once all of them have been restored. */
+			upq.Enqueue([file, region, dtype, begin, offset, length, attributeTypes]() {
+				const char *current = begin + offset;
+				const char *end = current + length;
+
+				while (current < end) {
+					String name = UnpackObject(current, end);
+					Dictionary::Ptr update = UnpackObject(current, end);
+
+					ConfigObject::Ptr object = dtype->GetObject(name);
+
+					if (object)
+						RestoreObject(object, update, attributeTypes);
+				}
+			});
+		}
+	}
+
+	return restored;
 }
 
 void ConfigObject::StopObjects()
@@ -692,6 +1141,16 @@ ConfigObject::Ptr ConfigObject::GetZone() const
 	return m_Zone;
 }
 
+/**
+ * Marks the object's state as changed, i.e. as to be dumped to the state journal.
+ *
+ * Called by the generated setters of all state attributes.
+ */
+void ConfigObject::MarkStateDirty()
+{
+	m_StateDirty.store(true, std::memory_order_relaxed);
+}
+
 Dictionary::Ptr ConfigObject::GetSourceLocation() const
 {
 	DebugInfo di = GetDebugInfo();
@@ -8,12 +8,15 @@
 #include "base/object.hpp"
 #include "base/type.hpp"
 #include "base/dictionary.hpp"
+#include <atomic>
 #include <boost/signals2.hpp>
+#include <iosfwd>
 
 namespace icinga
 {
 
 class ConfigType;
+class WorkQueue;
 
 /**
  * A dynamic object that can be instantiated from the configuration file.
@@ -71,7 +74,10 @@ public:
 
 	static ConfigObject::Ptr GetObject(const String& type, const String& name);
 
+	void MarkStateDirty();
+
 	static void DumpObjects(const String& filename, int attributeTypes = FAState);
+	static void DumpDirtyObjects(const String& filename, int attributeTypes = FAState);
 	static void RestoreObjects(const String& filename, int attributeTypes = FAState);
 	static void StopObjects();
 
@@ -81,8 +87,14 @@ public:
 
 private:
 	ConfigObject::Ptr m_Zone;
+	std::atomic<bool> m_StateDirty{false};
 
 	static void RestoreObject(const String& message, int attributeTypes);
+	static void RestoreObject(const ConfigObject::Ptr& object, const Dictionary::Ptr& update, int attributeTypes);
+
+	static void DumpObjectsBinary(std::ostream& fp, int attributeTypes, const String& generation);
+	static unsigned long RestoreObjectsBinary(const String& filename, WorkQueue& upq, int attributeTypes, String& generation);
+	static unsigned long RestoreObjectsJournal(const String& filename, const String& generation, WorkQueue& upq, int attributeTypes);
 };
 
 #define DECLARE_OBJECTNAME(klass)						\
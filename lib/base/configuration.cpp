@@ -31,6 +31,7 @@ int Configuration::RLimitStack;
 String Configuration::RunAsGroup;
 String Configuration::RunAsUser;
 String Configuration::SpoolDir;
+String Configuration::StateFormat{"json"};
 String Configuration::StatePath;
 double Configuration::TlsHandshakeTimeout{10};
 String Configuration::VarsPath;
@@ -283,6 +284,16 @@ void Configuration::SetSpoolDir(const String& val, bool suppress_events, const V
 	HandleUserWrite("SpoolDir", &Configuration::SpoolDir, val, m_ReadOnly);
 }
 
+String Configuration::GetStateFormat() const
+{
+	return Configuration::StateFormat;
+}
+
+void Configuration::SetStateFormat(const String& val, bool suppress_events, const Value& cookie)
+{
+	HandleUserWrite("StateFormat", &Configuration::StateFormat, val, m_ReadOnly);
+}
+
 String Configuration::GetStatePath() const
 {
 	return Configuration::StatePath;
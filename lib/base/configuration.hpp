@@ -88,6 +88,9 @@ public:
 	String GetSpoolDir() const override;
 	void SetSpoolDir(const String& value, bool suppress_events = false, const Value& cookie = Empty) override;
 
+	String GetStateFormat() const override;
+	void SetStateFormat(const String& value, bool suppress_events = false, const Value& cookie = Empty) override;
+
 	String GetStatePath() const override;
 	void SetStatePath(const String& value, bool suppress_events = false, const Value& cookie = Empty) override;
 
@@ -136,6 +139,7 @@ public:
 	static String RunAsGroup;
 	static String RunAsUser;
 	static String SpoolDir;
+	static String StateFormat;
 	static String StatePath;
 	static double TlsHandshakeTimeout;
 	static String VarsPath;
@@ -5,30 +5,62 @@
 #include "base/debug.hpp"
 #include "base/primitivetype.hpp"
 #include "base/configwriter.hpp"
+#include <boost/thread/lock_types.hpp>
+#include <algorithm>
 #include <sstream>
 
 using namespace icinga;
 
-template class std::map<String, Value>;
-
 REGISTER_PRIMITIVE_TYPE(Dictionary, Object, Dictionary::GetPrototype());
 
+const Dictionary::SizeType Dictionary::SmallLimit;
+
 Dictionary::Dictionary(const DictionaryData& other)
-{
-	for (const auto& kv : other)
-		m_Data.insert(kv);
-}
+	: Dictionary(DictionaryData(other))
+{ }
 
 Dictionary::Dictionary(DictionaryData&& other)
 {
-	for (auto& kv : other)
-		m_Data.insert(std::move(kv));
+	/* Just like std::map::insert() the first one of several equal keys wins. */
+	std::stable_sort(other.begin(), other.end(), KeyLess());
+
+	other.erase(std::unique(other.begin(), other.end(), [](const Pair& lhs, const Pair& rhs) {
+		return lhs.first == rhs.first;
+	}), other.end());
+
+	if (other.size() <= SmallLimit) {
+		m_Small = std::move(other);
+		m_Small.shrink_to_fit();
+	} else {
+		m_Large.reset(new LargeData(boost::container::ordered_unique_range,
+			std::make_move_iterator(other.begin()), std::make_move_iterator(other.end())));
+	}
 }
 
 Dictionary::Dictionary(std::initializer_list<Dictionary::Pair> init)
-	: m_Data(init)
+	: Dictionary(DictionaryData(init))
 { }
 
+/**
+ * Looks up the value of a key. Caller must hold m_DataLock.
+ *
+ * @param key The key.
+ * @returns The value or nullptr if the key was not found.
+ */
+const Value *Dictionary::Find(const String& key) const
+{
+	if (m_Large) {
+		auto it (m_Large->find(key));
+
+		return it == m_Large->end() ? nullptr : &it->second;
+	}
+
+	/* Searching a few adjacent items is cheaper than chasing tree nodes. */
+	auto it (std::lower_bound(m_Small.begin(), m_Small.end(), key, KeyLess()));
+
+	return it == m_Small.end() || it->first != key ? nullptr : &it->second;
+}
+
 /**
  * Retrieves a value from a dictionary.
  *
@@ -37,14 +69,14 @@ Dictionary::Dictionary(std::initializer_list<Dictionary::Pair> init)
  */
 Value Dictionary::Get(const String& key) const
 {
-	ObjectLock olock(this);
+	boost::shared_lock<RWLock> lock (m_DataLock);
 
-	auto it = m_Data.find(key);
+	const Value *value = Find(key);
 
-	if (it == m_Data.end())
+	if (!value)
 		return Empty;
 
-	return it->second;
+	return *value;
 }
 
 /**
@@ -56,14 +88,14 @@ Value Dictionary::Get(const String& key) const
  */
 bool Dictionary::Get(const String& key, Value *result) const
 {
-	ObjectLock olock(this);
+	boost::shared_lock<RWLock> lock (m_DataLock);
 
-	auto it = m_Data.find(key);
+	const Value *value = Find(key);
 
-	if (it == m_Data.end())
+	if (!value)
 		return false;
 
-	*result = it->second;
+	*result = *value;
 	return true;
 }
 
@@ -77,11 +109,55 @@ bool Dictionary::Get(const String& key, Value *result) const
 void Dictionary::Set(const String& key, Value value, bool overrideFrozen)
 {
 	ObjectLock olock(this);
+	boost::unique_lock<RWLock> wlock (m_DataLock);
 
 	if (m_Frozen && !overrideFrozen)
 		BOOST_THROW_EXCEPTION(std::invalid_argument("Value in dictionary must not be modified."));
 
-	m_Data[key] = std::move(value);
+	if (m_Large) {
+		auto it (m_Large->lower_bound(key));
+
+		if (it != m_Large->end() && it->first == key)
+			const_cast<Value&>(it->second) = std::move(value);
+		else
+			m_Large->emplace_hint(it, key.Intern(StringOriginDictionaryKey), std::move(value));
+
+		return;
+	}
+
+	auto it (std::lower_bound(m_Small.begin(), m_Small.end(), key, KeyLess()));
+
+	if (it != m_Small.end() && it->first == key) {
+		it->second = std::move(value);
+		return;
+	}
+
+	if (m_Small.size() < SmallLimit) {
+		/* Most dictionaries are filled once and read often, so don't reserve
+		 * space for items which are likely never added.
+		 */
+		if (m_Small.size() == m_Small.capacity()) {
+			SmallData data;
+			data.reserve(m_Small.size() + 1u);
+			data.insert(data.end(), std::make_move_iterator(m_Small.begin()), std::make_move_iterator(it));
+			data.emplace_back(key.Intern(StringOriginDictionaryKey), std::move(value));
+			data.insert(data.end(), std::make_move_iterator(it), std::make_move_iterator(m_Small.end()));
+			m_Small.swap(data);
+		} else {
+			m_Small.emplace(it, key.Intern(StringOriginDictionaryKey), std::move(value));
+		}
+
+		return;
+	}
+
+	/* Too many items for a linear memory layout, switch over to a tree. */
+	std::unique_ptr<LargeData> large (new LargeData(boost::container::ordered_unique_range,
+		std::make_move_iterator(m_Small.begin()), std::make_move_iterator(m_Small.end())));
+
+	large->emplace(key.Intern(StringOriginDictionaryKey), std::move(value));
+
+	m_Large = std::move(large);
+	SmallData().swap(m_Small);
 }
 
 /**
@@ -91,9 +167,9 @@ void Dictionary::Set(const String& key, Value value, bool overrideFrozen)
  */
 size_t Dictionary::GetLength() const
 {
-	ObjectLock olock(this);
+	boost::shared_lock<RWLock> lock (m_DataLock);
 
-	return m_Data.size();
+	return m_Large ? m_Large->size() : m_Small.size();
 }
 
 /**
@@ -104,15 +180,18 @@ size_t Dictionary::GetLength() const
  */
 bool Dictionary::Contains(const String& key) const
 {
-	ObjectLock olock(this);
+	boost::shared_lock<RWLock> lock (m_DataLock);
 
-	return (m_Data.find(key) != m_Data.end());
+	return Find(key) != nullptr;
 }
 
 /**
  * Returns an iterator to the beginning of the dictionary.
  *
  * Note: Caller must hold the object lock while using the iterator.
+ * Other threads may still read the dictionary concurrently, so values
+ * must be modified through Set() rather than through the iterator.
+ * Adding items invalidates all iterators.
  *
  * @returns An iterator.
  */
@@ -120,7 +199,10 @@ Dictionary::Iterator Dictionary::Begin()
 {
 	ASSERT(OwnsLock());
 
-	return m_Data.begin();
+	if (m_Large)
+		return Iterator(m_Large->begin());
+
+	return Iterator(m_Small.begin());
 }
 
 /**
@@ -134,7 +216,10 @@ Dictionary::Iterator Dictionary::End()
 {
 	ASSERT(OwnsLock());
 
-	return m_Data.end();
+	if (m_Large)
+		return Iterator(m_Large->end());
+
+	return Iterator(m_Small.end());
 }
 
 /**
@@ -142,15 +227,21 @@ Dictionary::Iterator Dictionary::End()
  *
  * @param it The iterator.
  * @param overrideFrozen Whether to allow modifying frozen dictionaries.
+ * @returns An iterator to the item following the removed one.
  */
-void Dictionary::Remove(Dictionary::Iterator it, bool overrideFrozen)
+Dictionary::Iterator Dictionary::Remove(Dictionary::Iterator it, bool overrideFrozen)
 {
 	ASSERT(OwnsLock());
 
 	if (m_Frozen && !overrideFrozen)
 		BOOST_THROW_EXCEPTION(std::invalid_argument("Dictionary must not be modified."));
 
-	m_Data.erase(it);
+	boost::unique_lock<RWLock> wlock (m_DataLock);
+
+	if (it.m_IsLarge)
+		return Iterator(m_Large->erase(it.m_Large));
+
+	return Iterator(m_Small.erase(it.m_Small));
 }
 
 /**
@@ -162,17 +253,24 @@ void Dictionary::Remove(Dictionary::Iterator it, bool overrideFrozen)
 void Dictionary::Remove(const String& key, bool overrideFrozen)
 {
 	ObjectLock olock(this);
+	boost::unique_lock<RWLock> wlock (m_DataLock);
 
 	if (m_Frozen && !overrideFrozen)
 		BOOST_THROW_EXCEPTION(std::invalid_argument("Dictionary must not be modified."));
 
-	Dictionary::Iterator it;
-	it = m_Data.find(key);
+	if (m_Large) {
+		auto it (m_Large->find(key));
+
+		if (it != m_Large->end())
+			m_Large->erase(it);
 
-	if (it == m_Data.end())
 		return;
+	}
+
+	auto it (std::lower_bound(m_Small.begin(), m_Small.end(), key, KeyLess()));
 
-	m_Data.erase(it);
+	if (it != m_Small.end() && it->first == key)
+		m_Small.erase(it);
 }
 
 /**
@@ -183,20 +281,22 @@ void Dictionary::Remove(const String& key, bool overrideFrozen)
 void Dictionary::Clear(bool overrideFrozen)
 {
 	ObjectLock olock(this);
+	boost::unique_lock<RWLock> wlock (m_DataLock);
 
 	if (m_Frozen && !overrideFrozen)
 		BOOST_THROW_EXCEPTION(std::invalid_argument("Dictionary must not be modified."));
 
-	m_Data.clear();
+	m_Small.clear();
+	m_Large.reset();
 }
 
 void Dictionary::CopyTo(const Dictionary::Ptr& dest) const
 {
 	ObjectLock olock(this);
 
-	for (const Dictionary::Pair& kv : m_Data) {
+	ForEach([&dest](const Pair& kv) {
 		dest->Set(kv.first, kv.second);
-	}
+	});
 }
 
 /**
@@ -222,13 +322,13 @@ Object::Ptr Dictionary::Clone() const
 	DictionaryData dict;
 
 	{
-		ObjectLock olock(this);
+		boost::shared_lock<RWLock> lock (m_DataLock);
 
-		dict.reserve(GetLength());
+		dict.reserve(m_Large ? m_Large->size() : m_Small.size());
 
-		for (const Dictionary::Pair& kv : m_Data) {
+		ForEach([&dict](const Pair& kv) {
 			dict.emplace_back(kv.first, kv.second.Clone());
-		}
+		});
 	}
 
 	return new Dictionary(std::move(dict));
@@ -242,13 +342,15 @@ Object::Ptr Dictionary::Clone() const
  */
 std::vector<String> Dictionary::GetKeys() const
 {
-	ObjectLock olock(this);
+	boost::shared_lock<RWLock> lock (m_DataLock);
 
 	std::vector<String> keys;
 
-	for (const Dictionary::Pair& kv : m_Data) {
+	keys.reserve(m_Large ? m_Large->size() : m_Small.size());
+
+	ForEach([&keys](const Pair& kv) {
 		keys.push_back(kv.first);
-	}
+	});
 
 	return keys;
 }
@@ -260,10 +362,35 @@ String Dictionary::ToString() const
 	return msgbuf.str();
 }
 
-void Dictionary::Freeze()
+/**
+ * Returns an immutable copy of the dictionary's items which can be read
+ * without holding any lock, e.g. to pass it to another thread.
+ *
+ * @returns The snapshot.
+ */
+Dictionary::Snapshot Dictionary::GetSnapshot() const
 {
-	ObjectLock olock(this);
-	m_Frozen = true;
+	boost::shared_lock<RWLock> lock (m_DataLock);
+
+	if (m_Large)
+		return Shared<DictionaryData>::Make(m_Large->begin(), m_Large->end());
+
+	return Shared<DictionaryData>::Make(m_Small.begin(), m_Small.end());
+}
+
+/**
+ * Prevents further modifications of the dictionary.
+ *
+ * @returns A snapshot of the final items.
+ */
+Dictionary::Snapshot Dictionary::Freeze()
+{
+	{
+		ObjectLock olock(this);
+		m_Frozen = true;
+	}
+
+	return GetSnapshot();
 }
 
 Value Dictionary::GetFieldByName(const String& field, bool, const DebugInfo& debugInfo) const
@@ -6,8 +6,13 @@
 #include "base/i2-base.hpp"
 #include "base/object.hpp"
 #include "base/value.hpp"
+#include "base/rwlock.hpp"
+#include "base/snapshot.hpp"
+#include <boost/container/set.hpp>
 #include <boost/range/iterator.hpp>
+#include <iterator>
 #include <map>
+#include <memory>
 #include <vector>
 
 namespace icinga
@@ -25,14 +30,138 @@ class Dictionary final : public Object
 public:
 	DECLARE_OBJECT(Dictionary);
 
+	typedef size_t SizeType;
+
+	typedef std::pair<String, Value> Pair;
+
+private:
 	/**
-	 * An iterator that can be used to iterate over dictionary elements.
+	 * Orders items by their keys and allows looking them up by key.
 	 */
-	typedef std::map<String, Value>::iterator Iterator;
+	struct KeyLess
+	{
+		typedef void is_transparent;
+
+		bool operator()(const Pair& lhs, const Pair& rhs) const
+		{
+			return lhs.first < rhs.first;
+		}
+
+		bool operator()(const Pair& lhs, const String& rhs) const
+		{
+			return lhs.first < rhs;
+		}
 
-	typedef std::map<String, Value>::size_type SizeType;
+		bool operator()(const String& lhs, const Pair& rhs) const
+		{
+			return lhs < rhs.first;
+		}
+	};
 
-	typedef std::map<String, Value>::value_type Pair;
+	typedef std::vector<Pair> SmallData;
+	typedef boost::container::set<Pair, KeyLess> LargeData;
+
+public:
+	/**
+	 * An iterator that can be used to iterate over dictionary elements
+	 * in the order of their keys.
+	 *
+	 * Keys must not be modified through the iterator.
+	 */
+	class Iterator
+	{
+	public:
+		typedef std::bidirectional_iterator_tag iterator_category;
+		typedef Pair value_type;
+		typedef std::ptrdiff_t difference_type;
+		typedef Pair *pointer;
+		typedef Pair& reference;
+
+		Iterator() = default;
+
+		Pair& operator*() const
+		{
+			/* The set only hands out const references to keep its order intact,
+			 * the items themselves aren't const.
+			 */
+			return m_IsLarge ? const_cast<Pair&>(*m_Large) : *m_Small;
+		}
+
+		Pair *operator->() const
+		{
+			return &**this;
+		}
+
+		Iterator& operator++()
+		{
+			if (m_IsLarge)
+				++m_Large;
+			else
+				++m_Small;
+
+			return *this;
+		}
+
+		Iterator operator++(int)
+		{
+			Iterator it (*this);
+			++*this;
+			return it;
+		}
+
+		Iterator& operator--()
+		{
+			if (m_IsLarge)
+				--m_Large;
+			else
+				--m_Small;
+
+			return *this;
+		}
+
+		Iterator operator--(int)
+		{
+			Iterator it (*this);
+			--*this;
+			return it;
+		}
+
+		bool operator==(const Iterator& other) const
+		{
+			return m_IsLarge ? m_Large == other.m_Large : m_Small == other.m_Small;
+		}
+
+		bool operator!=(const Iterator& other) const
+		{
+			return !(*this == other);
+		}
+
+	private:
+		friend class Dictionary;
+
+		SmallData::iterator m_Small;
+		LargeData::iterator m_Large;
+		bool m_IsLarge{false};
+
+		Iterator(SmallData::iterator it)
+			: m_Small(it)
+		{ }
+
+		Iterator(LargeData::iterator it)
+			: m_Large(it), m_IsLarge(true)
+		{ }
+	};
+
+	/**
+	 * Dictionaries with at most this many items keep them in a sorted
+	 * vector instead of a tree.
+	 */
+	static const SizeType SmallLimit = 16;
+
+	/**
+	 * An immutable, flat copy of the dictionary's items sorted by key.
+	 */
+	typedef icinga::Snapshot<DictionaryData> Snapshot;
 
 	Dictionary() = default;
 	Dictionary(const DictionaryData& other);
@@ -51,7 +180,7 @@ public:
 
 	void Remove(const String& key, bool overrideFrozen = false);
 
-	void Remove(Iterator it, bool overrideFrozen = false);
+	Iterator Remove(Iterator it, bool overrideFrozen = false);
 
 	void Clear(bool overrideFrozen = false);
 
@@ -60,13 +189,15 @@ public:
 
 	std::vector<String> GetKeys() const;
 
+	Snapshot GetSnapshot() const;
+
 	static Object::Ptr GetPrototype();
 
 	Object::Ptr Clone() const override;
 
 	String ToString() const override;
 
-	void Freeze();
+	Snapshot Freeze();
 
 	Value GetFieldByName(const String& field, bool sandboxed, const DebugInfo& debugInfo) const override;
 	void SetFieldByName(const String& field, const Value& value, bool overrideFrozen, const DebugInfo& debugInfo) override;
@@ -74,8 +205,24 @@ public:
 	bool GetOwnField(const String& field, Value *result) const override;
 
 private:
-	std::map<String, Value> m_Data; /**< The data for the dictionary. */
+	const Value *Find(const String& key) const;
+
+	template<typename F>
+	void ForEach(const F& func) const
+	{
+		if (m_Large) {
+			for (const Pair& kv : *m_Large)
+				func(kv);
+		} else {
+			for (const Pair& kv : m_Small)
+				func(kv);
+		}
+	}
+
+	SmallData m_Small; /**< The sorted items while there are at most SmallLimit of them. */
+	std::unique_ptr<LargeData> m_Large; /**< The items once there were more than SmallLimit of them. */
 	bool m_Frozen{false};
+	mutable RWLock m_DataLock; /**< Serializes readers with writers which also hold the object lock. */
 };
 
 Dictionary::Iterator begin(const Dictionary::Ptr& x);
@@ -83,6 +230,4 @@ Dictionary::Iterator end(const Dictionary::Ptr& x);
 
 }
 
-extern template class std::map<icinga::String, icinga::Value>;
-
 #endif /* DICTIONARY_H */
@@ -0,0 +1,268 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "base/eventbus.hpp"
+#include "base/exception.hpp"
+#include "base/logger.hpp"
+#include <boost/thread/tss.hpp>
+#include <set>
+
+using namespace icinga;
+
+static boost::mutex l_SubscribersMutex;
+static std::set<EventSubscriberBase *> l_Subscribers;
+
+/* The subscriber whose events are delivered by the current thread, if any. Not owned. */
+static boost::thread_specific_ptr<EventSubscriberBase> l_DeliveringSubscriber ([](EventSubscriberBase *) { });
+
+/**
+ * Constructor for the EventSubscriberBase class.
+ *
+ * @param name The name which is used for logging and statistics.
+ * @param capacity The maximum number of queued events before producers block.
+ * @param maxBatch The maximum number of events delivered at once.
+ */
+EventSubscriberBase::EventSubscriberBase(String name, size_t capacity, size_t maxBatch)
+	: m_Name(std::move(name)), m_Capacity(capacity > 0 ? capacity : 1), m_MaxBatch(maxBatch > 0 ? maxBatch : 1),
+	m_Latency({ 0.001, 0.01, 0.1, 1, 10 })
+{ }
+
+EventSubscriberBase::~EventSubscriberBase()
+{
+	ASSERT(!m_Running);
+}
+
+String EventSubscriberBase::GetName() const
+{
+	return m_Name;
+}
+
+size_t EventSubscriberBase::GetMaxBatch() const
+{
+	return m_MaxBatch;
+}
+
+size_t EventSubscriberBase::GetPending() const
+{
+	return m_Pending.load();
+}
+
+/**
+ * Registers the subscriber. The delivery thread is spawned once the first
+ * event is published (which also avoids spawning it before daemonizing) and
+ * keeps a reference to the subscriber until Stop() was called and all queued
+ * events were delivered.
+ */
+void EventSubscriberBase::Start()
+{
+	{
+		boost::mutex::scoped_lock lock(m_Mutex);
+		m_Stopped = false;
+	}
+
+	boost::mutex::scoped_lock subscribersLock (l_SubscribersMutex);
+	l_Subscribers.insert(this);
+}
+
+void EventSubscriberBase::SpawnThread()
+{
+	boost::mutex::scoped_lock lock(m_Mutex);
+
+	if (m_Running || m_Stopped)
+		return;
+
+	m_Running = true;
+
+	EventSubscriberBase::Ptr self (this);
+	boost::thread thread ([self]() { self->ThreadProc(); });
+	thread.detach();
+
+	m_Spawned = true;
+}
+
+/**
+ * Stops the delivery thread after all queued events were delivered.
+ */
+void EventSubscriberBase::Stop()
+{
+	{
+		boost::mutex::scoped_lock subscribersLock (l_SubscribersMutex);
+		l_Subscribers.erase(this);
+	}
+
+	boost::mutex::scoped_lock lock(m_Mutex);
+
+	m_Stopped = true;
+	m_CVEvents.notify_all();
+	m_CVSpace.notify_all();
+
+	/* Stopping from within a handler must not wait for the handler to return. */
+	if (IsDeliveryThread())
+		return;
+
+	while (m_Running)
+		m_CVStopped.wait(lock);
+}
+
+/**
+ * Reserves a queue slot for a new event. Blocks the producer while the
+ * queue is full, unless the producer is the delivery thread itself.
+ */
+void EventSubscriberBase::ReserveSlot()
+{
+	if (!m_Spawned.load())
+		SpawnThread();
+
+	m_Published++;
+
+	size_t pending = ++m_Pending;
+	size_t maxPending = m_MaxPending.load();
+
+	while (pending > maxPending && !m_MaxPending.compare_exchange_weak(maxPending, pending))
+		; /* empty loop body */
+
+	if (pending <= m_Capacity || IsDeliveryThread())
+		return;
+
+	m_Blocked++;
+
+	double start = Utility::GetTime();
+
+	boost::mutex::scoped_lock lock(m_Mutex);
+
+	while (m_Pending.load() > m_Capacity && !m_Stopped) {
+		m_SpaceWaiters = true;
+		m_CVSpace.timed_wait(lock, boost::posix_time::milliseconds(100));
+	}
+
+	m_BlockedTime += Utility::GetTime() - start;
+}
+
+/**
+ * Wakes up the delivery thread if it is waiting for new events.
+ */
+void EventSubscriberBase::NotifyDelivery()
+{
+	/* Pairs with the m_Sleeping/HasEvents() check in ThreadProc(). */
+	if (m_Sleeping.load()) {
+		boost::mutex::scoped_lock lock(m_Mutex);
+		m_CVEvents.notify_one();
+	}
+}
+
+void EventSubscriberBase::ReleaseSlots(size_t count)
+{
+	m_Pending -= count;
+	m_Delivered += count;
+
+	if (m_SpaceWaiters.load()) {
+		boost::mutex::scoped_lock lock(m_Mutex);
+		m_SpaceWaiters = false;
+		m_CVSpace.notify_all();
+	}
+}
+
+/**
+ * Checks whether the caller runs on this subscriber's delivery thread.
+ */
+bool EventSubscriberBase::IsDeliveryThread() const
+{
+	return l_DeliveringSubscriber.get() == this;
+}
+
+void EventSubscriberBase::RecordLatency(double latency)
+{
+	m_Latency.InsertValue(latency);
+}
+
+void EventSubscriberBase::RecordBatch(const std::exception_ptr& error)
+{
+	m_Batches++;
+
+	if (!error)
+		return;
+
+	m_Errors++;
+
+	try {
+		std::rethrow_exception(error);
+	} catch (const std::exception& ex) {
+		Log(LogWarning, "EventBus")
+			<< "Event handler '" << m_Name << "' failed: " << DiagnosticInformation(ex, false);
+	} catch (...) {
+		Log(LogWarning, "EventBus")
+			<< "Event handler '" << m_Name << "' failed with an unknown exception.";
+	}
+}
+
+void EventSubscriberBase::ThreadProc()
+{
+	Utility::SetThreadName("EventBus");
+
+	l_DeliveringSubscriber.reset(this);
+
+	for (;;) {
+		{
+			boost::mutex::scoped_lock lock(m_Mutex);
+
+			m_Sleeping = true;
+
+			while (!HasEvents() && !m_Stopped)
+				m_CVEvents.timed_wait(lock, boost::posix_time::seconds(1));
+
+			m_Sleeping = false;
+
+			if (!HasEvents()) {
+				m_Running = false;
+				m_CVStopped.notify_all();
+				return;
+			}
+		}
+
+		ReleaseSlots(DeliverEvents());
+	}
+}
+
+/**
+ * Returns the queue and delivery statistics of this subscriber.
+ *
+ * @returns The statistics.
+ */
+Dictionary::Ptr EventSubscriberBase::GetStats() const
+{
+	double blockedTime;
+
+	{
+		boost::mutex::scoped_lock lock(m_Mutex);
+		blockedTime = m_BlockedTime;
+	}
+
+	return new Dictionary({
+		{ "capacity", m_Capacity },
+		{ "pending", m_Pending.load() },
+		{ "max_pending", m_MaxPending.load() },
+		{ "published", m_Published.load() },
+		{ "delivered", m_Delivered.load() },
+		{ "batches", m_Batches.load() },
+		{ "errors", m_Errors.load() },
+		{ "blocked", m_Blocked.load() },
+		{ "blocked_time", blockedTime },
+		{ "latency", m_Latency.GetStats() }
+	});
+}
+
+/**
+ * Returns the statistics of all running subscribers keyed by their names.
+ *
+ * @returns The statistics.
+ */
+Dictionary::Ptr EventSubscriberBase::GetAllStats()
+{
+	Dictionary::Ptr stats = new Dictionary();
+
+	boost::mutex::scoped_lock lock(l_SubscribersMutex);
+
+	for (EventSubscriberBase *subscriber : l_Subscribers)
+		stats->Set(subscriber->GetName(), subscriber->GetStats());
+
+	return stats;
+}
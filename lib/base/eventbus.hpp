@@ -0,0 +1,285 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef EVENTBUS_H
+#define EVENTBUS_H
+
+#include "base/i2-base.hpp"
+#include "base/dictionary.hpp"
+#include "base/histogram.hpp"
+#include "base/utility.hpp"
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace icinga
+{
+
+/**
+ * The type-independent part of an event bus subscriber: a bounded queue
+ * which is drained in batches by a dedicated delivery thread.
+ *
+ * @ingroup base
+ */
+class EventSubscriberBase : public Object
+{
+public:
+	DECLARE_PTR_TYPEDEFS(EventSubscriberBase);
+
+	~EventSubscriberBase() override;
+
+	String GetName() const;
+	size_t GetPending() const;
+	Dictionary::Ptr GetStats() const;
+
+	void Stop();
+
+	static Dictionary::Ptr GetAllStats();
+
+protected:
+	EventSubscriberBase(String name, size_t capacity, size_t maxBatch);
+
+	size_t GetMaxBatch() const;
+
+	void Start();
+	void ReserveSlot();
+	void NotifyDelivery();
+	void RecordLatency(double latency);
+	void RecordBatch(const std::exception_ptr& error);
+
+	virtual bool HasEvents() const = 0;
+	virtual size_t DeliverEvents() = 0;
+
+private:
+	String m_Name;
+	size_t m_Capacity;
+	size_t m_MaxBatch;
+
+	mutable boost::mutex m_Mutex;
+	boost::condition_variable m_CVEvents;
+	boost::condition_variable m_CVSpace;
+	boost::condition_variable m_CVStopped;
+	bool m_Running{false};
+	bool m_Stopped{false};
+
+	std::atomic<size_t> m_Pending{0};
+	std::atomic<bool> m_Spawned{false};
+	std::atomic<bool> m_Sleeping{false};
+	std::atomic<bool> m_SpaceWaiters{false};
+
+	std::atomic<uint_fast64_t> m_Published{0};
+	std::atomic<uint_fast64_t> m_Delivered{0};
+	std::atomic<uint_fast64_t> m_Batches{0};
+	std::atomic<uint_fast64_t> m_Blocked{0};
+	std::atomic<uint_fast64_t> m_Errors{0};
+	std::atomic<size_t> m_MaxPending{0};
+	double m_BlockedTime{0};
+	Histogram m_Latency;
+
+	void SpawnThread();
+	void ThreadProc();
+	void ReleaseSlots(size_t count);
+	bool IsDeliveryThread() const;
+};
+
+/**
+ * A subscriber which receives events of type T in batches.
+ *
+ * Producers push events onto a lock-free stack; the delivery thread takes
+ * the whole stack at once, restores the publishing order and passes the
+ * events to the handler in batches of at most maxBatch events.
+ *
+ * @ingroup base
+ */
+template<typename T>
+class EventSubscriber final : public EventSubscriberBase
+{
+public:
+	DECLARE_PTR_TYPEDEFS(EventSubscriber<T>);
+
+	typedef std::function<void (const std::vector<T>&)> Handler;
+
+	EventSubscriber(String name, Handler handler, size_t capacity, size_t maxBatch)
+		: EventSubscriberBase(std::move(name), capacity, maxBatch), m_Handler(std::move(handler))
+	{ }
+
+	~EventSubscriber() override
+	{
+		Stop();
+
+		Node *node = m_Head.exchange(nullptr);
+
+		while (node) {
+			Node *next = node->Next;
+			delete node;
+			node = next;
+		}
+	}
+
+	void Push(const T& event)
+	{
+		ReserveSlot();
+
+		Node *node = new Node{event, Utility::GetTime(), m_Head.load(std::memory_order_relaxed)};
+
+		while (!m_Head.compare_exchange_weak(node->Next, node))
+			; /* empty loop body */
+
+		NotifyDelivery();
+	}
+
+	using EventSubscriberBase::Start;
+
+protected:
+	bool HasEvents() const override
+	{
+		return m_Head.load() != nullptr;
+	}
+
+	size_t DeliverEvents() override
+	{
+		Node *node = m_Head.exchange(nullptr, std::memory_order_acquire);
+
+		/* The stack is LIFO, reverse it to restore the publishing order. */
+		Node *head = nullptr;
+
+		while (node) {
+			Node *next = node->Next;
+			node->Next = head;
+			head = node;
+			node = next;
+		}
+
+		size_t maxBatch = GetMaxBatch();
+		size_t count = 0;
+		std::vector<T> batch;
+
+		while (head) {
+			batch.clear();
+
+			double now = Utility::GetTime();
+
+			while (head && batch.size() < maxBatch) {
+				Node *next = head->Next;
+				RecordLatency(now - head->Published);
+				batch.emplace_back(std::move(head->Event));
+				delete head;
+				head = next;
+			}
+
+			count += batch.size();
+
+			std::exception_ptr error;
+
+			try {
+				m_Handler(batch);
+			} catch (...) {
+				error = std::current_exception();
+			}
+
+			RecordBatch(error);
+		}
+
+		return count;
+	}
+
+private:
+	struct Node
+	{
+		T Event;
+		double Published;
+		Node *Next;
+	};
+
+	Handler m_Handler;
+	std::atomic<Node *> m_Head{nullptr};
+};
+
+/**
+ * A typed multi-producer event bus. Every subscriber owns a bounded queue
+ * and a delivery thread, so publishing an event never runs handlers on the
+ * publishing thread. Producers only block if a subscriber's queue is full.
+ *
+ * @ingroup base
+ */
+template<typename T>
+class EventBus final
+{
+public:
+	typedef EventSubscriber<T> Subscriber;
+	typedef typename Subscriber::Handler Handler;
+
+	EventBus()
+		: m_Subscribers(std::make_shared<const std::vector<typename Subscriber::Ptr> >())
+	{ }
+
+	/**
+	 * Registers a new subscriber.
+	 *
+	 * @param name The name which is used for logging and statistics.
+	 * @param handler Called on the subscriber's thread with batches of events.
+	 * @param capacity The maximum number of queued events before producers block.
+	 * @param maxBatch The maximum number of events passed to a single handler call.
+	 * @returns The subscriber which can be passed to Unsubscribe().
+	 */
+	typename Subscriber::Ptr Subscribe(const String& name, const Handler& handler,
+		size_t capacity = 100000, size_t maxBatch = 1000)
+	{
+		typename Subscriber::Ptr subscriber = new Subscriber(name, handler, capacity, maxBatch);
+		subscriber->Start();
+
+		boost::mutex::scoped_lock lock(m_Mutex);
+
+		auto subscribers (std::make_shared<std::vector<typename Subscriber::Ptr> >(*std::atomic_load(&m_Subscribers)));
+		subscribers->push_back(subscriber);
+		std::atomic_store(&m_Subscribers, std::shared_ptr<const std::vector<typename Subscriber::Ptr> >(subscribers));
+
+		return subscriber;
+	}
+
+	/**
+	 * Removes a subscriber. Events which were already queued for the
+	 * subscriber are delivered before this function returns.
+	 */
+	void Unsubscribe(const typename Subscriber::Ptr& subscriber)
+	{
+		if (!subscriber)
+			return;
+
+		{
+			boost::mutex::scoped_lock lock(m_Mutex);
+
+			auto subscribers (std::make_shared<std::vector<typename Subscriber::Ptr> >(*std::atomic_load(&m_Subscribers)));
+			subscribers->erase(std::remove(subscribers->begin(), subscribers->end(), subscriber), subscribers->end());
+			std::atomic_store(&m_Subscribers, std::shared_ptr<const std::vector<typename Subscriber::Ptr> >(subscribers));
+		}
+
+		subscriber->Stop();
+	}
+
+	void Publish(const T& event)
+	{
+		auto subscribers (std::atomic_load(&m_Subscribers));
+
+		for (const typename Subscriber::Ptr& subscriber : *subscribers)
+			subscriber->Push(event);
+	}
+
+	size_t GetSubscriberCount() const
+	{
+		return std::atomic_load(&m_Subscribers)->size();
+	}
+
+private:
+	boost::mutex m_Mutex;
+	std::shared_ptr<const std::vector<typename Subscriber::Ptr> > m_Subscribers;
+};
+
+}
+
+#endif /* EVENTBUS_H */
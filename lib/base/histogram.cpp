@@ -0,0 +1,59 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "base/histogram.hpp"
+#include <algorithm>
+#include <sstream>
+
+using namespace icinga;
+
+/**
+ * Constructor for the Histogram class.
+ *
+ * @param bounds The buckets' upper bounds (ascending), values beyond the last one are counted in an extra bucket.
+ */
+Histogram::Histogram(std::vector<double> bounds)
+	: m_Bounds(std::move(bounds)), m_Buckets(m_Bounds.size() + 1u, 0), m_Count(0), m_Sum(0), m_Max(0)
+{ }
+
+void Histogram::InsertValue(double value)
+{
+	auto bucket (std::lower_bound(m_Bounds.begin(), m_Bounds.end(), value) - m_Bounds.begin());
+
+	boost::mutex::scoped_lock lock(m_Mutex);
+
+	m_Buckets[bucket]++;
+	m_Count++;
+	m_Sum += value;
+
+	if (value > m_Max)
+		m_Max = value;
+}
+
+/**
+ * Returns the number of values per bucket (keyed by the upper bound) as well as
+ * the count, average and maximum of all values.
+ *
+ * @returns The statistics.
+ */
+Dictionary::Ptr Histogram::GetStats() const
+{
+	DictionaryData buckets;
+
+	boost::mutex::scoped_lock lock(m_Mutex);
+
+	for (decltype(m_Bounds.size()) i = 0; i < m_Bounds.size(); i++) {
+		std::ostringstream msgbuf;
+		msgbuf << m_Bounds[i];
+
+		buckets.emplace_back(msgbuf.str(), m_Buckets[i]);
+	}
+
+	buckets.emplace_back("inf", m_Buckets.back());
+
+	return new Dictionary({
+		{ "buckets", new Dictionary(std::move(buckets)) },
+		{ "count", m_Count },
+		{ "avg", m_Count ? m_Sum / m_Count : 0 },
+		{ "max", m_Max }
+	});
+}
@@ -0,0 +1,39 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include "base/i2-base.hpp"
+#include "base/dictionary.hpp"
+#include <boost/thread/mutex.hpp>
+#include <cstdint>
+#include <vector>
+
+namespace icinga
+{
+
+/**
+ * A histogram which counts values in buckets with fixed upper bounds.
+ *
+ * @ingroup base
+ */
+class Histogram final
+{
+public:
+	Histogram(std::vector<double> bounds);
+
+	void InsertValue(double value);
+	Dictionary::Ptr GetStats() const;
+
+private:
+	mutable boost::mutex m_Mutex;
+	std::vector<double> m_Bounds;
+	std::vector<uint_fast64_t> m_Buckets;
+	uint_fast64_t m_Count;
+	double m_Sum;
+	double m_Max;
+};
+
+}
+
+#endif /* HISTOGRAM_H */
@@ -10,9 +10,13 @@
 #include "base/utility.hpp"
 #include <bitset>
 #include <boost/exception_ptr.hpp>
+#include <boost/thread/tss.hpp>
+#include <cmath>
 #include <cstdint>
+#include <cstring>
 #include <json.hpp>
 #include <stack>
+#include <utf8.h>
 #include <utility>
 #include <vector>
 
@@ -49,158 +53,71 @@ const char l_False[] = "false";
 const char l_True[] = "true";
 const char l_Indent[] = "    ";
 
-// https://github.com/nlohmann/json/issues/1512
-template<bool prettyPrint>
-class JsonEncoder
-{
-public:
-	void Null();
-	void Boolean(bool value);
-	void NumberFloat(double value);
-	void Strng(String value);
-	void StartObject();
-	void Key(String value);
-	void EndObject();
-	void StartArray();
-	void EndArray();
-
-	String GetResult();
-
-private:
-	std::vector<char> m_Result;
-	String m_CurrentKey;
-	std::stack<std::bitset<2>> m_CurrentSubtree;
-
-	void AppendChar(char c);
-
-	template<class Iterator>
-	void AppendChars(Iterator begin, Iterator end);
-
-	void AppendJson(nlohmann::json json);
-
-	void BeforeItem();
-
-	void FinishContainer(char terminator);
-};
-
-template<bool prettyPrint>
-void Encode(JsonEncoder<prettyPrint>& stateMachine, const Value& value);
-
-template<bool prettyPrint>
-inline
-void EncodeNamespace(JsonEncoder<prettyPrint>& stateMachine, const Namespace::Ptr& ns)
+static void EncodeNamespace(JsonEncoder& stateMachine, const Namespace::Ptr& ns)
 {
 	stateMachine.StartObject();
 
 	ObjectLock olock(ns);
 	for (const Namespace::Pair& kv : ns) {
-		stateMachine.Key(Utility::ValidateUTF8(kv.first));
-		Encode(stateMachine, kv.second->Get());
+		stateMachine.Key(kv.first);
+		stateMachine.Encode(kv.second->Get());
 	}
 
 	stateMachine.EndObject();
 }
 
-template<bool prettyPrint>
-inline
-void EncodeDictionary(JsonEncoder<prettyPrint>& stateMachine, const Dictionary::Ptr& dict)
+static void EncodeDictionary(JsonEncoder& stateMachine, const Dictionary::Ptr& dict)
 {
 	stateMachine.StartObject();
 
 	ObjectLock olock(dict);
 	for (const Dictionary::Pair& kv : dict) {
-		stateMachine.Key(Utility::ValidateUTF8(kv.first));
-		Encode(stateMachine, kv.second);
+		stateMachine.Key(kv.first);
+		stateMachine.Encode(kv.second);
 	}
 
 	stateMachine.EndObject();
 }
 
-template<bool prettyPrint>
-inline
-void EncodeArray(JsonEncoder<prettyPrint>& stateMachine, const Array::Ptr& arr)
+static void EncodeArray(JsonEncoder& stateMachine, const Array::Ptr& arr)
 {
 	stateMachine.StartArray();
 
 	ObjectLock olock(arr);
 	for (const Value& value : arr) {
-		Encode(stateMachine, value);
+		stateMachine.Encode(value);
 	}
 
 	stateMachine.EndArray();
 }
 
-template<bool prettyPrint>
-void Encode(JsonEncoder<prettyPrint>& stateMachine, const Value& value)
-{
-	switch (value.GetType()) {
-		case ValueNumber:
-			stateMachine.NumberFloat(value.Get<double>());
-			break;
-
-		case ValueBoolean:
-			stateMachine.Boolean(value.ToBool());
-			break;
-
-		case ValueString:
-			stateMachine.Strng(Utility::ValidateUTF8(value.Get<String>()));
-			break;
-
-		case ValueObject:
-			{
-				const Object::Ptr& obj = value.Get<Object::Ptr>();
-
-				{
-					Namespace::Ptr ns = dynamic_pointer_cast<Namespace>(obj);
-					if (ns) {
-						EncodeNamespace(stateMachine, ns);
-						break;
-					}
-				}
-
-				{
-					Dictionary::Ptr dict = dynamic_pointer_cast<Dictionary>(obj);
-					if (dict) {
-						EncodeDictionary(stateMachine, dict);
-						break;
-					}
-				}
-
-				Array::Ptr arr = dynamic_pointer_cast<Array>(obj);
-				if (arr) {
-					EncodeArray(stateMachine, arr);
-					break;
-				}
-			}
-
-			stateMachine.Null();
-
-			break;
-
-		case ValueEmpty:
-			stateMachine.Null();
-			break;
-
-		default:
-			VERIFY(!"Invalid variant type.");
-	}
-}
+/* Reused by JsonEncode() so that the output buffer doesn't have to grow for every document. */
+static boost::thread_specific_ptr<std::vector<char>> l_JsonEncodeBuffer;
 
 String icinga::JsonEncode(const Value& value, bool pretty_print)
 {
-	if (pretty_print) {
-		JsonEncoder<true> stateMachine;
+	std::vector<char> *buffer = l_JsonEncodeBuffer.get();
 
-		Encode(stateMachine, value);
+	if (!buffer) {
+		buffer = new std::vector<char>();
+		l_JsonEncodeBuffer.reset(buffer);
+	}
 
-		return stateMachine.GetResult();
-	} else {
-		JsonEncoder<false> stateMachine;
+	JsonEncoder stateMachine (pretty_print);
 
-		Encode(stateMachine, value);
+	stateMachine.GetBuffer().swap(*buffer);
+	stateMachine.Encode(value);
 
-		return stateMachine.GetResult();
+	String result (stateMachine.GetResult());
+	auto& used (stateMachine.GetBuffer());
+
+	/* Don't keep exceptionally big buffers around. */
+	if (used.capacity() <= 1024u * 1024u) {
+		used.clear();
+		buffer->swap(used);
 	}
+
+	return result;
 }
 
 Value icinga::JsonDecode(const String& data)
@@ -339,17 +256,25 @@ void JsonSax::FillCurrentTarget(Value value)
 	}
 }
 
-template<bool prettyPrint>
+template<class Iterator>
 inline
-void JsonEncoder<prettyPrint>::Null()
+void JsonEncoder::AppendChars(Iterator begin, Iterator end)
+{
+	m_Result.insert(m_Result.end(), begin, end);
+}
+
+JsonEncoder::JsonEncoder(bool prettyPrint)
+	: m_PrettyPrint(prettyPrint)
+{
+}
+
+void JsonEncoder::Null()
 {
 	BeforeItem();
 	AppendChars((const char*)l_Null, (const char*)l_Null + 4);
 }
 
-template<bool prettyPrint>
-inline
-void JsonEncoder<prettyPrint>::Boolean(bool value)
+void JsonEncoder::Boolean(bool value)
 {
 	BeforeItem();
 
@@ -360,25 +285,19 @@ void JsonEncoder<prettyPrint>::Boolean(bool value)
 	}
 }
 
-template<bool prettyPrint>
-inline
-void JsonEncoder<prettyPrint>::NumberFloat(double value)
+void JsonEncoder::NumberFloat(double value)
 {
 	BeforeItem();
-	AppendJson(value);
+	AppendNumber(value);
 }
 
-template<bool prettyPrint>
-inline
-void JsonEncoder<prettyPrint>::Strng(String value)
+void JsonEncoder::Strng(const String& value)
 {
 	BeforeItem();
-	AppendJson(std::move(value));
+	AppendString(value.CStr(), value.CStr() + value.GetLength());
 }
 
-template<bool prettyPrint>
-inline
-void JsonEncoder<prettyPrint>::StartObject()
+void JsonEncoder::StartObject()
 {
 	BeforeItem();
 	AppendChar('{');
@@ -386,23 +305,26 @@ void JsonEncoder<prettyPrint>::StartObject()
 	m_CurrentSubtree.push(2);
 }
 
-template<bool prettyPrint>
-inline
-void JsonEncoder<prettyPrint>::Key(String value)
+void JsonEncoder::Key(const String& value)
 {
-	m_CurrentKey = std::move(value);
+	BeforeItem();
+	AppendString(value.CStr(), value.CStr() + value.GetLength());
+	AppendChar(':');
+
+	if (m_PrettyPrint) {
+		AppendChar(' ');
+	}
+
+	/* The value belongs to the key, i.e. it's not preceded by a separator. */
+	m_CurrentSubtree.top()[2] = true;
 }
 
-template<bool prettyPrint>
-inline
-void JsonEncoder<prettyPrint>::EndObject()
+void JsonEncoder::EndObject()
 {
 	FinishContainer('}');
 }
 
-template<bool prettyPrint>
-inline
-void JsonEncoder<prettyPrint>::StartArray()
+void JsonEncoder::StartArray()
 {
 	BeforeItem();
 	AppendChar('[');
@@ -410,79 +332,296 @@ void JsonEncoder<prettyPrint>::StartArray()
 	m_CurrentSubtree.push(0);
 }
 
-template<bool prettyPrint>
-inline
-void JsonEncoder<prettyPrint>::EndArray()
+void JsonEncoder::EndArray()
 {
 	FinishContainer(']');
 }
 
-template<bool prettyPrint>
-inline
-String JsonEncoder<prettyPrint>::GetResult()
+/**
+ * Encodes a whole value, i.e. a scalar or a container including all of its items.
+ *
+ * @param value The value
+ */
+void JsonEncoder::Encode(const Value& value)
+{
+	switch (value.GetType()) {
+		case ValueNumber:
+			NumberFloat(value.Get<double>());
+			break;
+
+		case ValueBoolean:
+			Boolean(value.ToBool());
+			break;
+
+		case ValueString:
+			Strng(value.Get<String>());
+			break;
+
+		case ValueObject:
+			{
+				const Object::Ptr& obj = value.Get<Object::Ptr>();
+
+				{
+					Namespace::Ptr ns = dynamic_pointer_cast<Namespace>(obj);
+					if (ns) {
+						EncodeNamespace(*this, ns);
+						break;
+					}
+				}
+
+				{
+					Dictionary::Ptr dict = dynamic_pointer_cast<Dictionary>(obj);
+					if (dict) {
+						EncodeDictionary(*this, dict);
+						break;
+					}
+				}
+
+				Array::Ptr arr = dynamic_pointer_cast<Array>(obj);
+				if (arr) {
+					EncodeArray(*this, arr);
+					break;
+				}
+			}
+
+			Null();
+
+			break;
+
+		case ValueEmpty:
+			Null();
+			break;
+
+		default:
+			VERIFY(!"Invalid variant type.");
+	}
+}
+
+/**
+ * Returns the output which has been encoded so far.
+ *
+ * Callers which write the document to a stream may consume and clear
+ * the buffer between items.
+ *
+ * @returns The output buffer
+ */
+std::vector<char>& JsonEncoder::GetBuffer()
+{
+	return m_Result;
+}
+
+String JsonEncoder::GetResult()
 {
 	return String(m_Result.begin(), m_Result.end());
 }
 
-template<bool prettyPrint>
-inline
-void JsonEncoder<prettyPrint>::AppendChar(char c)
+void JsonEncoder::AppendChar(char c)
 {
 	m_Result.emplace_back(c);
 }
 
-template<bool prettyPrint>
-template<class Iterator>
-inline
-void JsonEncoder<prettyPrint>::AppendChars(Iterator begin, Iterator end)
+/**
+ * Checks whether any of the eight bytes of a word is a control character,
+ * a quotation mark, a backslash or not printable ASCII.
+ */
+static inline bool JsonNeedsEscaping(uint64_t word)
 {
-	m_Result.insert(m_Result.end(), begin, end);
+	const uint64_t ones = 0x0101010101010101u;
+	const uint64_t highBits = 0x8080808080808080u;
+
+	uint64_t quotes = word ^ (ones * '"');
+	uint64_t backslashes = word ^ (ones * '\\');
+
+	return (
+		((word - ones * 0x20u) & ~word) /* < 0x20 */
+		| ((quotes - ones) & ~quotes) /* == '"' */
+		| ((backslashes - ones) & ~backslashes) /* == '\\' */
+		| word | (word + ones) /* >= 0x7F */
+	) & highBits;
 }
 
-template<bool prettyPrint>
-inline
-void JsonEncoder<prettyPrint>::AppendJson(nlohmann::json json)
+static inline void JsonAppendUnicodeEscape(std::vector<char>& output, uint16_t codeUnit)
 {
-	nlohmann::detail::serializer<nlohmann::json>(nlohmann::detail::output_adapter<char>(m_Result), ' ').dump(std::move(json), prettyPrint, true, 0);
+	const char hex[] = "0123456789abcdef";
+	const char escape[] = {
+		'\\', 'u', hex[codeUnit >> 12u], hex[(codeUnit >> 8u) & 0xFu], hex[(codeUnit >> 4u) & 0xFu], hex[codeUnit & 0xFu]
+	};
+
+	output.insert(output.end(), escape, escape + sizeof(escape));
 }
 
-template<bool prettyPrint>
-inline
-void JsonEncoder<prettyPrint>::BeforeItem()
+/**
+ * Appends a string literal, escaping everything except printable ASCII.
+ *
+ * Invalid UTF-8 is replaced the same way Utility::ValidateUTF8() does.
+ */
+void JsonEncoder::AppendString(const char *begin, const char *end)
+{
+	auto start (m_Result.size());
+	auto clean (begin);
+	bool validated = false;
+
+	AppendChar('"');
+
+	for (auto current (begin); current < end;) {
+		/* Fast path: skip eight bytes which don't need to be escaped at once. */
+		while (end - current >= 8) {
+			uint64_t word;
+			memcpy(&word, current, 8);
+
+			if (JsonNeedsEscaping(word)) {
+				break;
+			}
+
+			current += 8;
+		}
+
+		if (current == end) {
+			break;
+		}
+
+		auto c ((unsigned char)*current);
+
+		if (c >= 0x20u && c < 0x7Fu && c != '"' && c != '\\') {
+			++current;
+			continue;
+		}
+
+		AppendChars(clean, current);
+
+		switch (c) {
+			case '\b':
+				AppendChars("\\b", "\\b" + 2);
+				break;
+			case '\t':
+				AppendChars("\\t", "\\t" + 2);
+				break;
+			case '\n':
+				AppendChars("\\n", "\\n" + 2);
+				break;
+			case '\f':
+				AppendChars("\\f", "\\f" + 2);
+				break;
+			case '\r':
+				AppendChars("\\r", "\\r" + 2);
+				break;
+			case '"':
+				AppendChars("\\\"", "\\\"" + 2);
+				break;
+			case '\\':
+				AppendChars("\\\\", "\\\\" + 2);
+				break;
+			default:
+				if (c < 0x80u) {
+					JsonAppendUnicodeEscape(m_Result, c);
+					break;
+				}
+
+				/* Everything before the first non-ASCII character is valid anyway. */
+				if (!validated) {
+					if (!utf8::is_valid(current, end)) {
+						String sanitized (Utility::ValidateUTF8(String(begin, end)));
+
+						m_Result.resize(start);
+						AppendString(sanitized.CStr(), sanitized.CStr() + sanitized.GetLength());
+						return;
+					}
+
+					validated = true;
+				}
+
+				{
+					uint32_t codePoint = utf8::unchecked::next(current);
+
+					if (codePoint <= 0xFFFFu) {
+						JsonAppendUnicodeEscape(m_Result, codePoint);
+					} else {
+						JsonAppendUnicodeEscape(m_Result, 0xD7C0u + (codePoint >> 10u));
+						JsonAppendUnicodeEscape(m_Result, 0xDC00u + (codePoint & 0x3FFu));
+					}
+				}
+
+				clean = current;
+				continue;
+		}
+
+		clean = ++current;
+	}
+
+	AppendChars(clean, end);
+	AppendChar('"');
+}
+
+/**
+ * Appends a number the same way nlohmann::json does, i.e. integers with a trailing ".0",
+ * the shortest representation which can be read back for everything else.
+ */
+void JsonEncoder::AppendNumber(double value)
+{
+	if (!std::isfinite(value)) {
+		AppendChars((const char*)l_Null, (const char*)l_Null + 4);
+		return;
+	}
+
+	char buf[64];
+	char *end;
+
+	/* Fast path for integers which nlohmann::json wouldn't print in exponential notation. */
+	if (value != 0 && value > -1e15 && value < 1e15 && value == (int64_t)value) {
+		auto integer ((int64_t)value);
+		auto magnitude (integer < 0 ? (uint64_t)-integer : (uint64_t)integer);
+
+		char *begin = buf + sizeof(buf);
+		end = begin;
+
+		do {
+			*--begin = '0' + magnitude % 10u;
+			magnitude /= 10u;
+		} while (magnitude);
+
+		if (integer < 0) {
+			*--begin = '-';
+		}
+
+		AppendChars((const char*)begin, (const char*)end);
+		AppendChars(".0", ".0" + 2);
+		return;
+	}
+
+	end = nlohmann::detail::to_chars(buf, buf + sizeof(buf), value);
+
+	AppendChars((const char*)buf, (const char*)end);
+}
+
+void JsonEncoder::BeforeItem()
 {
 	if (!m_CurrentSubtree.empty()) {
 		auto& node (m_CurrentSubtree.top());
 
+		if (node[2]) {
+			node[2] = false;
+			return;
+		}
+
 		if (node[0]) {
 			AppendChar(',');
 		} else {
 			node[0] = true;
 		}
 
-		if (prettyPrint) {
+		if (m_PrettyPrint) {
 			AppendChar('\n');
 
 			for (auto i (m_CurrentSubtree.size()); i; --i) {
 				AppendChars((const char*)l_Indent, (const char*)l_Indent + 4);
 			}
 		}
-
-		if (node[1]) {
-			AppendJson(std::move(m_CurrentKey));
-			AppendChar(':');
-
-			if (prettyPrint) {
-				AppendChar(' ');
-			}
-		}
 	}
 }
 
-template<bool prettyPrint>
-inline
-void JsonEncoder<prettyPrint>::FinishContainer(char terminator)
+void JsonEncoder::FinishContainer(char terminator)
 {
-	if (prettyPrint && m_CurrentSubtree.top()[0]) {
+	if (m_PrettyPrint && m_CurrentSubtree.top()[0]) {
 		AppendChar('\n');
 
 		for (auto i (m_CurrentSubtree.size() - 1u); i; --i) {
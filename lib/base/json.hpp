@@ -4,13 +4,63 @@
 #define JSON_H
 
 #include "base/i2-base.hpp"
+#include "base/string.hpp"
+#include <bitset>
+#include <stack>
+#include <vector>
 
 namespace icinga
 {
 
-class String;
 class Value;
 
+/**
+ * JSON encoder which builds a document piece by piece.
+ *
+ * Big documents don't have to be built in memory as a whole, the encoded
+ * output can be taken out of the buffer (e.g. to be written to a stream)
+ * between the individual items.
+ *
+ * @ingroup base
+ */
+class JsonEncoder
+{
+public:
+	JsonEncoder(bool prettyPrint = false);
+
+	void Null();
+	void Boolean(bool value);
+	void NumberFloat(double value);
+	void Strng(const String& value);
+	void StartObject();
+	void Key(const String& value);
+	void EndObject();
+	void StartArray();
+	void EndArray();
+
+	void Encode(const Value& value);
+
+	std::vector<char>& GetBuffer();
+	String GetResult();
+
+private:
+	bool m_PrettyPrint;
+	std::vector<char> m_Result;
+	std::stack<std::bitset<3>> m_CurrentSubtree;
+
+	void AppendChar(char c);
+
+	template<class Iterator>
+	void AppendChars(Iterator begin, Iterator end);
+
+	void AppendString(const char *begin, const char *end);
+	void AppendNumber(double value);
+
+	void BeforeItem();
+
+	void FinishContainer(char terminator);
+};
+
 String JsonEncode(const Value& value, bool pretty_print = false);
 Value JsonDecode(const String& data);
 
@@ -4,6 +4,7 @@
 #include "base/debug.hpp"
 #include "base/tlsstream.hpp"
 #include <cstdint>
+#include <cstdio>
 #include <memory>
 #include <sstream>
 #include <utility>
@@ -322,6 +323,50 @@ size_t NetString::WriteStringToStream(const Shared<AsioTlsStream>::Ptr& stream,
 	return msg.GetLength();
 }
 
+/**
+ * Writes multiple strings into a stream using the netstring format.
+ *
+ * The strings aren't copied. A single gather write is issued for the whole
+ * batch, referencing a length prefix, the payload and the trailing comma
+ * of every netstring.
+ *
+ * @param stream The stream.
+ * @param messages The Strings that are to be written.
+ *
+ * @return The amount of bytes written.
+ */
+size_t NetString::WriteStringsToStream(const Shared<AsioTlsStream>::Ptr& stream,
+	const std::vector<std::shared_ptr<const String>>& messages, boost::asio::yield_context yc)
+{
+	namespace asio = boost::asio;
+
+	/* Up to 20 digits plus the colon and the terminating NUL of snprintf(). */
+	static const size_t prefixSize = 22;
+	static const char comma = ',';
+
+	std::vector<char> prefixes (messages.size() * prefixSize);
+	std::vector<asio::const_buffer> buffers;
+	size_t total = 0;
+
+	buffers.reserve(messages.size() * 3u);
+
+	for (size_t i = 0; i < messages.size(); i++) {
+		const String& message (*messages[i]);
+		char *prefix = &prefixes[i * prefixSize];
+		int prefixLength = snprintf(prefix, prefixSize, "%zu:", message.GetLength());
+
+		buffers.emplace_back(prefix, prefixLength);
+		buffers.emplace_back(message.CStr(), message.GetLength());
+		buffers.emplace_back(&comma, 1);
+
+		total += prefixLength + message.GetLength() + 1u;
+	}
+
+	asio::async_write(*stream, buffers, yc);
+
+	return total;
+}
+
 /**
  * Writes data into a stream using the netstring format.
  *
@@ -7,6 +7,7 @@
 #include "base/stream.hpp"
 #include "base/tlsstream.hpp"
 #include <memory>
+#include <vector>
 #include <boost/asio/spawn.hpp>
 
 namespace icinga
@@ -32,6 +33,8 @@ public:
 	static size_t WriteStringToStream(const Stream::Ptr& stream, const String& message);
 	static size_t WriteStringToStream(const Shared<AsioTlsStream>::Ptr& stream, const String& message);
 	static size_t WriteStringToStream(const Shared<AsioTlsStream>::Ptr& stream, const String& message, boost::asio::yield_context yc);
+	static size_t WriteStringsToStream(const Shared<AsioTlsStream>::Ptr& stream,
+		const std::vector<std::shared_ptr<const String>>& messages, boost::asio::yield_context yc);
 	static void WriteStringToStream(std::ostream& stream, const String& message);
 
 private:
@@ -6,9 +6,12 @@
 #include "base/array.hpp"
 #include "base/objectlock.hpp"
 #include "base/stringbuilder.hpp"
+#include "base/tlsutility.hpp"
+#include <boost/throw_exception.hpp>
 #include <algorithm>
 #include <climits>
 #include <cstdint>
+#include <stdexcept>
 #include <utility>
 #include <vector>
 
@@ -30,7 +33,8 @@ static const EndiannessDetector l_EndiannessDetector;
 // Assumption: The compiler will optimize (away) if/else statements using this.
 #define MACHINE_LITTLE_ENDIAN (l_EndiannessDetector.buf[0])
 
-static void PackAny(const Value& value, StringBuilder& builder);
+template<class Builder>
+static void PackAny(const Value& value, Builder& builder);
 
 /**
  * std::swap() seems not to work
@@ -73,7 +77,8 @@ static inline char UIntToByte(unsigned i)
 /**
  * Append the given int as big-endian 64-bit unsigned int
  */
-static inline void PackUInt64BE(uint_least64_t i, StringBuilder& builder)
+template<class Builder>
+static inline void PackUInt64BE(uint_least64_t i, Builder& builder)
 {
 	char buf[8] = {
 		UIntToByte(i >> 56u),
@@ -110,7 +115,8 @@ union Double2BytesConverter
 /**
  * Append the given double as big-endian IEEE 754 binary64
  */
-static inline void PackFloat64BE(double f, StringBuilder& builder)
+template<class Builder>
+static inline void PackFloat64BE(double f, Builder& builder)
 {
 	Double2BytesConverter converter;
 
@@ -129,7 +135,8 @@ static inline void PackFloat64BE(double f, StringBuilder& builder)
 /**
  * Append the given string's length (BE uint64) and the string itself
  */
-static inline void PackString(const String& string, StringBuilder& builder)
+template<class Builder>
+static inline void PackString(const String& string, Builder& builder)
 {
 	PackUInt64BE(string.GetLength(), builder);
 	builder.Append(string);
@@ -138,7 +145,8 @@ static inline void PackString(const String& string, StringBuilder& builder)
 /**
  * Append the given array
  */
-static inline void PackArray(const Array::Ptr& arr, StringBuilder& builder)
+template<class Builder>
+static inline void PackArray(const Array::Ptr& arr, Builder& builder)
 {
 	ObjectLock olock(arr);
 
@@ -153,7 +161,8 @@ static inline void PackArray(const Array::Ptr& arr, StringBuilder& builder)
 /**
  * Append the given dictionary
  */
-static inline void PackDictionary(const Dictionary::Ptr& dict, StringBuilder& builder)
+template<class Builder>
+static inline void PackDictionary(const Dictionary::Ptr& dict, Builder& builder)
 {
 	ObjectLock olock(dict);
 
@@ -169,7 +178,8 @@ static inline void PackDictionary(const Dictionary::Ptr& dict, StringBuilder& bu
 /**
  * Append any JSON-encodable value
  */
-static void PackAny(const Value& value, StringBuilder& builder)
+template<class Builder>
+static void PackAny(const Value& value, Builder& builder)
 {
 	switch (value.GetType()) {
 		case ValueString:
@@ -245,3 +255,169 @@ String icinga::PackObject(const Value& value)
 
 	return builder.ToString();
 }
+
+/**
+ * Feed the PackObject() representation of the given value into the given hasher
+ *
+ * SHA1(PackObject(value)) == (PackObject(value, hasher), hasher.Finish())
+ * without building the packed string.
+ */
+void icinga::PackObject(const Value& value, SHA1Hasher& hasher)
+{
+	PackAny(value, hasher);
+}
+
+/**
+ * Feed the PackObject() representation of an array of the given values into the given hasher
+ *
+ * Same as PackObject(new Array(values), hasher), but without creating the array.
+ */
+void icinga::PackObject(const std::vector<Value>& values, SHA1Hasher& hasher)
+{
+	hasher.Append('\5');
+	PackUInt64BE(values.size(), hasher);
+
+	for (const Value& value : values) {
+		PackAny(value, hasher);
+	}
+}
+
+/**
+ * Read a big-endian 64-bit unsigned int
+ */
+static inline uint_least64_t UnpackUInt64BE(const char *& begin, const char *end)
+{
+	if (end - begin < 8)
+		BOOST_THROW_EXCEPTION(std::invalid_argument("Packed object is truncated."));
+
+	uint_least64_t i = 0;
+
+	for (int n = 0; n < 8; n++) {
+		i = (i << 8u) | (unsigned char)*begin++;
+	}
+
+	return i;
+}
+
+/**
+ * Read a big-endian IEEE 754 binary64
+ */
+static inline double UnpackFloat64BE(const char *& begin, const char *end)
+{
+	if (end - begin < 8)
+		BOOST_THROW_EXCEPTION(std::invalid_argument("Packed object is truncated."));
+
+	Double2BytesConverter converter;
+
+	std::copy(begin, begin + 8, converter.buf);
+	begin += 8;
+
+	if (MACHINE_LITTLE_ENDIAN) {
+		SwapBytes(converter.buf[0], converter.buf[7]);
+		SwapBytes(converter.buf[1], converter.buf[6]);
+		SwapBytes(converter.buf[2], converter.buf[5]);
+		SwapBytes(converter.buf[3], converter.buf[4]);
+	}
+
+	return converter.f;
+}
+
+/**
+ * Read a string's length (BE uint64) and the string itself
+ */
+static inline String UnpackString(const char *& begin, const char *end)
+{
+	uint_least64_t length = UnpackUInt64BE(begin, end);
+
+	if ((uint_least64_t)(end - begin) < length)
+		BOOST_THROW_EXCEPTION(std::invalid_argument("Packed object is truncated."));
+
+	String string (begin, begin + length);
+	begin += length;
+
+	return string;
+}
+
+/**
+ * Unpack a value packed by PackObject() which starts at begin and advance begin behind it
+ *
+ * Throws std::invalid_argument if the input is malformed.
+ */
+Value icinga::UnpackObject(const char *& begin, const char *end)
+{
+	if (begin == end)
+		BOOST_THROW_EXCEPTION(std::invalid_argument("Packed object is truncated."));
+
+	switch (*begin++) {
+		case '\0':
+			return Empty;
+
+		case '\1':
+			return false;
+
+		case '\2':
+			return true;
+
+		case '\3':
+			return UnpackFloat64BE(begin, end);
+
+		case '\4':
+			return UnpackString(begin, end);
+
+		case '\5':
+			{
+				uint_least64_t length = UnpackUInt64BE(begin, end);
+
+				/* Every item takes at least one byte. */
+				if ((uint_least64_t)(end - begin) < length)
+					BOOST_THROW_EXCEPTION(std::invalid_argument("Packed object is truncated."));
+
+				ArrayData items;
+				items.reserve(length);
+
+				for (uint_least64_t i = 0; i < length; i++) {
+					items.emplace_back(UnpackObject(begin, end));
+				}
+
+				return new Array(std::move(items));
+			}
+
+		case '\6':
+			{
+				uint_least64_t length = UnpackUInt64BE(begin, end);
+
+				/* Every pair takes at least nine bytes. */
+				if ((uint_least64_t)(end - begin) / 9u < length)
+					BOOST_THROW_EXCEPTION(std::invalid_argument("Packed object is truncated."));
+
+				DictionaryData pairs;
+				pairs.reserve(length);
+
+				for (uint_least64_t i = 0; i < length; i++) {
+					String key = UnpackString(begin, end);
+					pairs.emplace_back(std::move(key), UnpackObject(begin, end));
+				}
+
+				return new Dictionary(std::move(pairs));
+			}
+
+		default:
+			BOOST_THROW_EXCEPTION(std::invalid_argument("Packed object contains an invalid type tag."));
+	}
+}
+
+/**
+ * Unpack a value packed by PackObject()
+ */
+Value icinga::UnpackObject(const String& packed)
+{
+	const char *begin = packed.CStr();
+	const char *end = begin + packed.GetLength();
+
+	Value value = UnpackObject(begin, end);
+
+	if (begin != end)
+		BOOST_THROW_EXCEPTION(std::invalid_argument("Packed object is followed by garbage."));
+
+	return value;
+}
@@ -4,14 +4,20 @@
 #define OBJECT_PACKER
 
 #include "base/i2-base.hpp"
+#include <vector>
 
 namespace icinga
 {
 
 class String;
 class Value;
+class SHA1Hasher;
 
 String PackObject(const Value& value);
+void PackObject(const Value& value, SHA1Hasher& hasher);
+void PackObject(const std::vector<Value>& values, SHA1Hasher& hasher);
+Value UnpackObject(const char *& begin, const char *end);
+Value UnpackObject(const String& packed);
 
 }
 
@@ -1,6 +1,16 @@
 /* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
 
 #include "base/objectlock.hpp"
+#ifdef ICINGA2_LOCK_PROFILING
+#	include "base/convert.hpp"
+#	include "base/dictionary.hpp"
+#	include "base/perfdatavalue.hpp"
+#	include "base/statsfunction.hpp"
+#	include "base/type.hpp"
+#	include <boost/thread/mutex.hpp>
+#	include <chrono>
+#	include <map>
+#endif /* ICINGA2_LOCK_PROFILING */
 #include <thread>
 
 using namespace icinga;
@@ -8,11 +18,107 @@ using namespace icinga;
 #define I2MUTEX_UNLOCKED 0
 #define I2MUTEX_LOCKED 1
 
+#ifdef ICINGA2_LOCK_PROFILING
+struct LockContention
+{
+	uint_fast64_t Count{0};
+	double WaitTime{0};
+	double MaxWaitTime{0};
+
+	void Add(double waitTime)
+	{
+		Count++;
+		WaitTime += waitTime;
+
+		if (waitTime > MaxWaitTime)
+			MaxWaitTime = waitTime;
+	}
+
+	Dictionary::Ptr ToDictionary() const
+	{
+		return new Dictionary({
+			{ "count", Count },
+			{ "wait_time", WaitTime },
+			{ "max_wait_time", MaxWaitTime }
+		});
+	}
+};
+
+static boost::mutex l_ContentionMutex;
+static std::map<std::pair<const char *, int>, LockContention> l_ContentionBySite;
+static std::map<String, LockContention> l_ContentionByType;
+static std::atomic<uint_fast64_t> l_LockCount (0);
+
+static void RecordContention(const Object *object, const char *file, int line, double waitTime)
+{
+	Type::Ptr type = object->GetReflectionType();
+	String typeName = type ? type->GetName() : "Object";
+
+	boost::mutex::scoped_lock lock(l_ContentionMutex);
+
+	l_ContentionBySite[std::make_pair(file, line)].Add(waitTime);
+	l_ContentionByType[typeName].Add(waitTime);
+}
+
+static void ObjectLockStatsFunc(const Dictionary::Ptr& status, const Array::Ptr& perfdata)
+{
+	std::map<std::pair<const char *, int>, LockContention> bySite;
+	std::map<String, LockContention> byType;
+
+	{
+		boost::mutex::scoped_lock lock(l_ContentionMutex);
+		bySite = l_ContentionBySite;
+		byType = l_ContentionByType;
+	}
+
+	Dictionary::Ptr sites = new Dictionary();
+	Dictionary::Ptr types = new Dictionary();
+	uint_fast64_t contended = 0;
+	double waitTime = 0;
+
+	for (auto& kv : bySite) {
+		sites->Set(String(kv.first.first) + ":" + Convert::ToString(kv.first.second), kv.second.ToDictionary());
+
+		contended += kv.second.Count;
+		waitTime += kv.second.WaitTime;
+	}
+
+	for (auto& kv : byType)
+		types->Set(kv.first, kv.second.ToDictionary());
+
+	status->Set("object_lock", new Dictionary({
+		{ "locks", l_LockCount.load() },
+		{ "contended", contended },
+		{ "wait_time", waitTime },
+		{ "sites", sites },
+		{ "types", types }
+	}));
+
+	perfdata->Add(new PerfdataValue("object_lock_contended", contended));
+	perfdata->Add(new PerfdataValue("object_lock_wait_time", waitTime));
+}
+
+REGISTER_STATSFUNCTION(ObjectLock, &ObjectLockStatsFunc);
+#endif /* ICINGA2_LOCK_PROFILING */
+
 ObjectLock::~ObjectLock()
 {
 	Unlock();
 }
 
+#ifdef ICINGA2_LOCK_PROFILING
+ObjectLock::ObjectLock(const Object::Ptr& object, const char *file, int line)
+	: ObjectLock(object.get(), file, line)
+{
+}
+
+ObjectLock::ObjectLock(const Object *object, const char *file, int line)
+	: m_Object(object), m_Locked(false), m_File(file), m_Line(line)
+{
+	if (m_Object)
+		Lock();
+}
+#else /* ICINGA2_LOCK_PROFILING */
 ObjectLock::ObjectLock(const Object::Ptr& object)
 	: ObjectLock(object.get())
 {
@@ -24,12 +130,26 @@ ObjectLock::ObjectLock(const Object *object)
 	if (m_Object)
 		Lock();
 }
+#endif /* ICINGA2_LOCK_PROFILING */
 
 void ObjectLock::Lock()
 {
 	ASSERT(!m_Locked && m_Object);
 
+#ifdef ICINGA2_LOCK_PROFILING
+	l_LockCount.fetch_add(1, std::memory_order_relaxed);
+
+	if (!m_Object->m_Mutex.try_lock()) {
+		auto start (std::chrono::steady_clock::now());
+
+		m_Object->m_Mutex.lock();
+
+		RecordContention(m_Object, m_File, m_Line,
+			std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+	}
+#else /* ICINGA2_LOCK_PROFILING */
 	m_Object->m_Mutex.lock();
+#endif /* ICINGA2_LOCK_PROFILING */
 
 	m_Locked = true;
 
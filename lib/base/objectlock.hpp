@@ -10,12 +10,21 @@ namespace icinga
 
 /**
  * A scoped lock for Objects.
+ *
+ * When built with ICINGA2_LOCK_PROFILING, the call site of each lock is
+ * recorded and the time spent waiting for contended locks is accounted
+ * per call site and per object type (see the ObjectLock status function).
  */
 struct ObjectLock
 {
 public:
+#ifdef ICINGA2_LOCK_PROFILING
+	ObjectLock(const Object::Ptr& object, const char *file = __builtin_FILE(), int line = __builtin_LINE());
+	ObjectLock(const Object *object, const char *file = __builtin_FILE(), int line = __builtin_LINE());
+#else /* ICINGA2_LOCK_PROFILING */
 	ObjectLock(const Object::Ptr& object);
 	ObjectLock(const Object *object);
+#endif /* ICINGA2_LOCK_PROFILING */
 
 	~ObjectLock();
 
@@ -25,6 +34,11 @@ public:
 private:
 	const Object *m_Object{nullptr};
 	bool m_Locked{false};
+
+#ifdef ICINGA2_LOCK_PROFILING
+	const char *m_File;
+	int m_Line;
+#endif /* ICINGA2_LOCK_PROFILING */
 };
 
 }
@@ -10,9 +10,13 @@
 #include "base/logger.hpp"
 #include "base/utility.hpp"
 #include "base/scriptglobal.hpp"
-#include "base/json.hpp"
+#include "base/configuration.hpp"
+#include "base/histogram.hpp"
 #include <boost/algorithm/string/join.hpp>
 #include <boost/thread/once.hpp>
+#include <algorithm>
+#include <atomic>
+#include <functional>
 #include <thread>
 #include <iostream>
 
@@ -21,6 +25,12 @@
 #	include <poll.h>
 #	include <string.h>
 
+#	ifdef HAVE_EPOLL
+#		include <sys/epoll.h>
+#		include <sys/eventfd.h>
+#		include <sys/syscall.h>
+#	endif /* HAVE_EPOLL */
+
 #	ifndef __APPLE__
 extern char **environ;
 #	else /* __APPLE__ */
@@ -31,20 +41,102 @@ extern char **environ;
 
 using namespace icinga;
 
+#ifdef HAVE_EPOLL
+/* I/O threads are started on demand, see GetIOThread(). */
+#define IOTHREADS 16
+#define IOTHREAD_PROCESSES 256
+
+/**
+ * An I/O thread which watches the output and exit of the processes assigned to it.
+ *
+ * @ingroup base
+ */
+struct ProcessIOThread
+{
+	boost::mutex Mutex;
+	int PollFD{-1};
+	int EventFD{-1};
+	std::map<int, Process::Ptr> FDs; /**< Output FDs and pidfds */
+	std::multimap<double, Process::Ptr> Timeouts;
+	std::atomic<size_t> Load{0}; /**< Number of processes which haven't been reaped yet */
+};
+
+static ProcessIOThread l_IOThreads[IOTHREADS];
+static std::atomic<int> l_IOThreadCount (0);
+static boost::mutex l_IOThreadStartMutex;
+#else /* HAVE_EPOLL */
 #define IOTHREADS 4
 
 static boost::mutex l_ProcessMutex[IOTHREADS];
 static std::map<Process::ProcessHandle, Process::Ptr> l_Processes[IOTHREADS];
-#ifdef _WIN32
+#	ifdef _WIN32
 static HANDLE l_Events[IOTHREADS];
-#else /* _WIN32 */
+#	else /* _WIN32 */
 static int l_EventFDs[IOTHREADS][2];
 static std::map<Process::ConsoleHandle, Process::ProcessHandle> l_FDs[IOTHREADS];
+#	endif /* _WIN32 */
+#endif /* HAVE_EPOLL */
+
+#ifndef _WIN32
+/**
+ * A helper process which spawns processes on our behalf, forked early so that
+ * it doesn't inherit any file descriptors it isn't supposed to.
+ *
+ * @ingroup base
+ */
+struct SpawnHelper
+{
+	boost::mutex Mutex;
+	int FD{-1};
+	pid_t PID{-1};
+};
+
+#define SPAWN_HELPERS 8
+
+static SpawnHelper l_SpawnHelpers[SPAWN_HELPERS];
+static int l_SpawnHelperCount = 1;
 
-static boost::mutex l_ProcessControlMutex;
+/* The control socket of the spawn helper we're running in (if any). */
 static int l_ProcessControlFD = -1;
-static pid_t l_ProcessControlPID;
+
+enum class SpawnHelperCommand : uint32_t
+{
+	Spawn,
+	WaitPID,
+	Kill
+};
+
+/**
+ * A request to a spawn helper. Spawn requests are followed by the arguments and
+ * the extra environment variables as NUL-terminated strings.
+ *
+ * @ingroup base
+ */
+struct SpawnHelperRequest
+{
+	SpawnHelperCommand Command;
+	pid_t PID;
+	int Signum;
+	bool AdjustPriority;
+	uint32_t ArgumentCount;
+	uint32_t EnvironmentCount;
+	uint32_t Length; /**< The size of the strings following the request */
+};
+
+/**
+ * A spawn helper's response, RC and Errno are the respective syscall's results.
+ *
+ * @ingroup base
+ */
+struct SpawnHelperResponse
+{
+	pid_t RC;
+	int Errno;
+	int Status;
+};
 #endif /* _WIN32 */
+
+static Histogram l_SpawnLatency ({ 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1 });
 static boost::once_flag l_ProcessOnceFlag = BOOST_ONCE_INIT;
 static boost::once_flag l_SpawnHelperOnceFlag = BOOST_ONCE_INIT;
 
@@ -53,6 +145,12 @@ Process::Process(Process::Arguments arguments, Dictionary::Ptr extraEnvironment)
 #ifdef _WIN32
 	, m_ReadPending(false), m_ReadFailed(false), m_Overlapped()
 #endif /* _WIN32 */
+#ifndef _WIN32
+	, m_Stdin(STDIN_FILENO), m_Stdout(-1), m_SpawnHelper(0)
+#endif /* _WIN32 */
+#ifdef HAVE_EPOLL
+	, m_TID(-1), m_PidFD(-1)
+#endif /* HAVE_EPOLL */
 {
 #ifdef _WIN32
 	m_Overlapped.hEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
@@ -67,163 +165,159 @@ Process::~Process()
 }
 
 #ifndef _WIN32
-static Value ProcessSpawnImpl(struct msghdr *msgh, const Dictionary::Ptr& request)
+static SpawnHelperResponse ProcessSpawnImpl(struct msghdr *msgh, const SpawnHelperRequest& request, char *strings)
 {
+	SpawnHelperResponse response = {};
+	response.RC = -1;
+
 	struct cmsghdr *cmsg = CMSG_FIRSTHDR(msgh);
 
 	if (cmsg == nullptr || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_len != CMSG_LEN(sizeof(int) * 3)) {
 		std::cerr << "Invalid 'spawn' request: FDs missing" << std::endl;
-		return Empty;
+		response.Errno = EINVAL;
+		return response;
 	}
 
 	auto *fds = (int *)CMSG_DATA(cmsg);
 
-	Array::Ptr arguments = request->Get("arguments");
-	Dictionary::Ptr extraEnvironment = request->Get("extraEnvironment");
-	bool adjustPriority = request->Get("adjustPriority");
+	/* The arguments and environment variables point into the request's strings. */
+	char *end = strings + request.Length;
 
-	// build argv
-	auto **argv = new char *[arguments->GetLength() + 1];
+	std::vector<char *> argv;
+	argv.reserve(request.ArgumentCount + 1u);
 
-	for (unsigned int i = 0; i < arguments->GetLength(); i++) {
-		String arg = arguments->Get(i);
-		argv[i] = strdup(arg.CStr());
+	for (uint32_t i = 0; i < request.ArgumentCount && strings < end; i++) {
+		argv.push_back(strings);
+		strings += strlen(strings) + 1u;
 	}
 
-	argv[arguments->GetLength()] = nullptr;
-
-	// build envp
-	int envc = 0;
+	argv.push_back(nullptr);
 
-	/* count existing environment variables */
-	while (environ[envc])
-		envc++;
+	std::vector<char *> envp;
 
-	auto **envp = new char *[envc + (extraEnvironment ? extraEnvironment->GetLength() : 0) + 2];
+	for (char **env = environ; *env; env++)
+		envp.push_back(*env);
 
-	for (int i = 0; i < envc; i++)
-		envp[i] = strdup(environ[i]);
-
-	if (extraEnvironment) {
-		ObjectLock olock(extraEnvironment);
-
-		int index = envc;
-		for (const Dictionary::Pair& kv : extraEnvironment) {
-			String skv = kv.first + "=" + Convert::ToString(kv.second);
-			envp[index] = strdup(skv.CStr());
-			index++;
-		}
+	for (uint32_t i = 0; i < request.EnvironmentCount && strings < end; i++) {
+		envp.push_back(strings);
+		strings += strlen(strings) + 1u;
 	}
 
-	envp[envc + (extraEnvironment ? extraEnvironment->GetLength() : 0)] = strdup("LC_NUMERIC=C");
-	envp[envc + (extraEnvironment ? extraEnvironment->GetLength() : 0) + 1] = nullptr;
-
-	extraEnvironment.reset();
-
-	pid_t pid = fork();
+	envp.push_back(const_cast<char *>("LC_NUMERIC=C"));
+	envp.push_back(nullptr);
 
-	int errorCode = 0;
+	if (argv.size() < 2u) {
+		std::cerr << "Invalid 'spawn' request: arguments missing" << std::endl;
+		response.Errno = EINVAL;
+	} else {
+#ifdef HAVE_VFORK
+		/* The child doesn't touch our memory before it calls exec, so there's no need to copy our page tables. */
+		pid_t pid = vfork();
+#else /* HAVE_VFORK */
+		pid_t pid = fork();
+#endif /* HAVE_VFORK */
 
-	if (pid < 0)
-		errorCode = errno;
+		if (pid < 0)
+			response.Errno = errno;
 
-	if (pid == 0) {
-		// child process
+		if (pid == 0) {
+			// child process
 
-		(void)close(l_ProcessControlFD);
+			(void)close(l_ProcessControlFD);
 
-		if (setsid() < 0) {
-			perror("setsid() failed");
-			_exit(128);
-		}
+			if (setsid() < 0) {
+				perror("setsid() failed");
+				_exit(128);
+			}
 
-		if (dup2(fds[0], STDIN_FILENO) < 0 || dup2(fds[1], STDOUT_FILENO) < 0 || dup2(fds[2], STDERR_FILENO) < 0) {
-			perror("dup2() failed");
-			_exit(128);
-		}
+			if (dup2(fds[0], STDIN_FILENO) < 0 || dup2(fds[1], STDOUT_FILENO) < 0 || dup2(fds[2], STDERR_FILENO) < 0) {
+				perror("dup2() failed");
+				_exit(128);
+			}
 
-		(void)close(fds[0]);
-		(void)close(fds[1]);
-		(void)close(fds[2]);
+			(void)close(fds[0]);
+			(void)close(fds[1]);
+			(void)close(fds[2]);
 
 #ifdef HAVE_NICE
-		if (adjustPriority) {
-			// Cheating the compiler on "warning: ignoring return value of 'int nice(int)', declared with attribute warn_unused_result [-Wunused-result]".
-			auto x (nice(5));
-			(void)x;
-		}
+			if (request.AdjustPriority) {
+				// Cheating the compiler on "warning: ignoring return value of 'int nice(int)', declared with attribute warn_unused_result [-Wunused-result]".
+				auto x (nice(5));
+				(void)x;
+			}
 #endif /* HAVE_NICE */
 
-		sigset_t mask;
-		sigemptyset(&mask);
-		sigprocmask(SIG_SETMASK, &mask, nullptr);
-
-		if (icinga2_execvpe(argv[0], argv, envp) < 0) {
-			char errmsg[512];
-			strcpy(errmsg, "execvpe(");
-			strncat(errmsg, argv[0], sizeof(errmsg) - strlen(errmsg) - 1);
-			strncat(errmsg, ") failed", sizeof(errmsg) - strlen(errmsg) - 1);
-			errmsg[sizeof(errmsg) - 1] = '\0';
-			perror(errmsg);
+			sigset_t mask;
+			sigemptyset(&mask);
+			sigprocmask(SIG_SETMASK, &mask, nullptr);
+
+			if (icinga2_execvpe(argv[0], argv.data(), envp.data()) < 0) {
+				char errmsg[512];
+				strcpy(errmsg, "execvpe(");
+				strncat(errmsg, argv[0], sizeof(errmsg) - strlen(errmsg) - 1);
+				strncat(errmsg, ") failed", sizeof(errmsg) - strlen(errmsg) - 1);
+				errmsg[sizeof(errmsg) - 1] = '\0';
+				perror(errmsg);
+				_exit(128);
+			}
+
 			_exit(128);
 		}
 
-		_exit(128);
+		response.RC = pid;
 	}
 
 	(void)close(fds[0]);
 	(void)close(fds[1]);
 	(void)close(fds[2]);
 
-	// free arguments
-	for (int i = 0; argv[i]; i++)
-		free(argv[i]);
-
-	delete[] argv;
-
-	// free environment
-	for (int i = 0; envp[i]; i++)
-		free(envp[i]);
+	return response;
+}
 
-	delete[] envp;
+static SpawnHelperResponse ProcessKillImpl(const SpawnHelperRequest& request)
+{
+	SpawnHelperResponse response = {};
 
-	Dictionary::Ptr response = new Dictionary({
-		{ "rc", pid },
-		{ "errno", errorCode }
-	});
+	errno = 0;
+	response.RC = kill(request.PID, request.Signum);
+	response.Errno = errno;
 
 	return response;
 }
 
-static Value ProcessKillImpl(struct msghdr *msgh, const Dictionary::Ptr& request)
+static SpawnHelperResponse ProcessWaitPIDImpl(const SpawnHelperRequest& request)
 {
-	pid_t pid = request->Get("pid");
-	int signum = request->Get("signum");
+	SpawnHelperResponse response = {};
 
-	errno = 0;
-	kill(pid, signum);
-	int error = errno;
-
-	Dictionary::Ptr response = new Dictionary({
-		{ "errno", error }
-	});
+	response.RC = waitpid(request.PID, &response.Status, 0);
+	response.Errno = errno;
 
 	return response;
 }
 
-static Value ProcessWaitPIDImpl(struct msghdr *msgh, const Dictionary::Ptr& request)
+/**
+ * Receives exactly the specified number of bytes from the control socket.
+ *
+ * @returns false if the socket has been closed.
+ */
+static bool RecvAll(int fd, void *buffer, size_t length)
 {
-	pid_t pid = request->Get("pid");
+	size_t count = 0;
 
-	int status;
-	int rc = waitpid(pid, &status, 0);
+	while (count < length) {
+		ssize_t rc = recv(fd, static_cast<char *>(buffer) + count, length - count, 0);
 
-	Dictionary::Ptr response = new Dictionary({
-		{ "status", status },
-		{ "rc", rc }
-	});
+		if (rc <= 0) {
+			if (rc < 0 && (errno == EINTR || errno == EAGAIN))
+				continue;
 
-	return response;
+			return false;
+		}
+
+		count += rc;
+	}
+
+	return true;
 }
 
 static void ProcessHandler()
@@ -244,15 +338,17 @@ static void ProcessHandler()
 				(void)close(i);
 	}
 
+	std::vector<char> strings;
+
 	for (;;) {
-		size_t length;
+		SpawnHelperRequest request;
 
 		struct msghdr msg;
 		memset(&msg, 0, sizeof(msg));
 
 		struct iovec io;
-		io.iov_base = &length;
-		io.iov_len = sizeof(length);
+		io.iov_base = &request;
+		io.iov_len = sizeof(request);
 
 		msg.msg_iov = &io;
 		msg.msg_iovlen = 1;
@@ -270,49 +366,36 @@ static void ProcessHandler()
 			break;
 		}
 
-		auto *mbuf = new char[length];
-
-		size_t count = 0;
-		while (count < length) {
-			rc = recv(l_ProcessControlFD, mbuf + count, length - count, 0);
+		/* The FDs are attached to the first byte, the remainder of the request may arrive separately. */
+		if (!RecvAll(l_ProcessControlFD, reinterpret_cast<char *>(&request) + rc, sizeof(request) - rc))
+			_exit(0);
 
-			if (rc <= 0) {
-				if (rc < 0 && (errno == EINTR || errno == EAGAIN))
-					continue;
+		strings.resize(request.Length + 1u);
 
-				delete [] mbuf;
+		if (!RecvAll(l_ProcessControlFD, strings.data(), request.Length))
+			_exit(0);
 
-				_exit(0);
-			}
+		strings[request.Length] = '\0';
 
-			count += rc;
+		SpawnHelperResponse response;
 
-			if (rc == 0)
+		switch (request.Command) {
+			case SpawnHelperCommand::Spawn:
+				response = ProcessSpawnImpl(&msg, request, strings.data());
+				break;
+			case SpawnHelperCommand::WaitPID:
+				response = ProcessWaitPIDImpl(request);
 				break;
+			case SpawnHelperCommand::Kill:
+				response = ProcessKillImpl(request);
+				break;
+			default:
+				response = SpawnHelperResponse();
+				response.RC = -1;
+				response.Errno = EINVAL;
 		}
 
-		String jrequest = String(mbuf, mbuf + count);
-
-		delete [] mbuf;
-
-		Dictionary::Ptr request = JsonDecode(jrequest);
-
-		String command = request->Get("command");
-
-		Value response;
-
-		if (command == "spawn")
-			response = ProcessSpawnImpl(&msg, request);
-		else if (command == "waitpid")
-			response = ProcessWaitPIDImpl(&msg, request);
-		else if (command == "kill")
-			response = ProcessKillImpl(&msg, request);
-		else
-			response = Empty;
-
-		String jresponse = JsonEncode(response);
-
-		if (send(l_ProcessControlFD, jresponse.CStr(), jresponse.GetLength(), 0) < 0) {
+		if (send(l_ProcessControlFD, &response, sizeof(response), 0) < 0) {
 			BOOST_THROW_EXCEPTION(posix_error()
 				<< boost::errinfo_api_function("send")
 				<< boost::errinfo_errno(errno));
@@ -322,13 +405,13 @@ static void ProcessHandler()
 	_exit(0);
 }
 
-static void StartSpawnProcessHelper()
+static void StartSpawnProcessHelper(SpawnHelper& helper)
 {
-	if (l_ProcessControlFD != -1) {
-		(void)close(l_ProcessControlFD);
+	if (helper.FD != -1) {
+		(void)close(helper.FD);
 
 		int status;
-		(void)waitpid(l_ProcessControlPID, &status, 0);
+		(void)waitpid(helper.PID, &status, 0);
 	}
 
 	int controlFDs[2];
@@ -358,141 +441,180 @@ static void StartSpawnProcessHelper()
 
 	(void)close(controlFDs[0]);
 
-	l_ProcessControlFD = controlFDs[1];
-	l_ProcessControlPID = pid;
+	helper.FD = controlFDs[1];
+	helper.PID = pid;
 }
 
-static pid_t ProcessSpawn(const std::vector<String>& arguments, const Dictionary::Ptr& extraEnvironment, bool adjustPriority, int fds[3])
+/**
+ * Sends a request to a spawn helper (restarting it if necessary) and waits for its response.
+ *
+ * @param helper The spawn helper.
+ * @param request The request, its Length must match the strings' size.
+ * @param strings The strings which follow the request.
+ * @param fds The FDs for the new process (spawn requests only).
+ * @param response Receives the response.
+ * @returns false if the helper didn't respond.
+ */
+static bool SendSpawnHelperRequest(SpawnHelper& helper, SpawnHelperRequest& request, const std::string& strings,
+	int *fds, SpawnHelperResponse& response)
 {
-	Dictionary::Ptr request = new Dictionary({
-		{ "command", "spawn" },
-		{ "arguments", Array::FromVector(arguments) },
-		{ "extraEnvironment", extraEnvironment },
-		{ "adjustPriority", adjustPriority }
-	});
-
-	String jrequest = JsonEncode(request);
-	size_t length = jrequest.GetLength();
-
-	boost::mutex::scoped_lock lock(l_ProcessControlMutex);
-
 	struct msghdr msg;
 	memset(&msg, 0, sizeof(msg));
 
-	struct iovec io;
-	io.iov_base = &length;
-	io.iov_len = sizeof(length);
+	struct iovec io[2];
+	io[0].iov_base = &request;
+	io[0].iov_len = sizeof(request);
+	io[1].iov_base = const_cast<char *>(strings.data());
+	io[1].iov_len = strings.size();
 
-	msg.msg_iov = &io;
-	msg.msg_iovlen = 1;
+	msg.msg_iov = io;
+	msg.msg_iovlen = strings.empty() ? 1 : 2;
 
 	char cbuf[CMSG_SPACE(sizeof(int) * 3)];
-	msg.msg_control = cbuf;
-	msg.msg_controllen = sizeof(cbuf);
 
-	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
-	cmsg->cmsg_level = SOL_SOCKET;
-	cmsg->cmsg_type = SCM_RIGHTS;
-	cmsg->cmsg_len = CMSG_LEN(sizeof(int) * 3);
+	if (fds) {
+		msg.msg_control = cbuf;
+		msg.msg_controllen = sizeof(cbuf);
+
+		struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(int) * 3);
+
+		memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * 3);
+
+		msg.msg_controllen = cmsg->cmsg_len;
+	}
 
-	memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * 3);
+	boost::mutex::scoped_lock lock(helper.Mutex);
 
-	msg.msg_controllen = cmsg->cmsg_len;
+	for (;;) {
+		ssize_t rc = sendmsg(helper.FD, &msg, 0);
 
-	do {
-		while (sendmsg(l_ProcessControlFD, &msg, 0) < 0) {
-			StartSpawnProcessHelper();
+		if (rc < 0) {
+			StartSpawnProcessHelper(helper);
+			continue;
 		}
-	} while (send(l_ProcessControlFD, jrequest.CStr(), jrequest.GetLength(), 0) < 0);
 
-	char buf[4096];
+		/* Blocking sends are only cut short by signals. */
+		if (static_cast<size_t>(rc) < sizeof(request) + strings.size()) {
+			size_t offset = rc;
 
-	ssize_t rc = recv(l_ProcessControlFD, buf, sizeof(buf), 0);
+			if (offset < sizeof(request)) {
+				if (send(helper.FD, reinterpret_cast<char *>(&request) + offset, sizeof(request) - offset, 0) < 0)
+					return false;
 
-	if (rc <= 0)
-		return -1;
+				offset = sizeof(request);
+			}
 
-	String jresponse = String(buf, buf + rc);
+			offset -= sizeof(request);
 
-	Dictionary::Ptr response = JsonDecode(jresponse);
+			if (send(helper.FD, strings.data() + offset, strings.size() - offset, 0) < 0)
+				return false;
+		}
 
-	if (response->Get("rc") == -1)
-		errno = response->Get("errno");
+		break;
+	}
 
-	return response->Get("rc");
+	return RecvAll(helper.FD, &response, sizeof(response));
 }
 
-static int ProcessKill(pid_t pid, int signum)
+static pid_t ProcessSpawn(SpawnHelper& helper, const std::vector<String>& arguments, const Dictionary::Ptr& extraEnvironment, bool adjustPriority, int fds[3])
 {
-	Dictionary::Ptr request = new Dictionary({
-		{ "command", "kill" },
-		{ "pid", pid },
-		{ "signum", signum }
-	});
+	SpawnHelperRequest request = {};
+	request.Command = SpawnHelperCommand::Spawn;
+	request.AdjustPriority = adjustPriority;
+	request.ArgumentCount = arguments.size();
+
+	std::string strings;
 
-	String jrequest = JsonEncode(request);
-	size_t length = jrequest.GetLength();
+	for (const String& argument : arguments) {
+		strings.append(argument.CStr(), argument.GetLength());
+		strings.push_back('\0');
+	}
 
-	boost::mutex::scoped_lock lock(l_ProcessControlMutex);
+	if (extraEnvironment) {
+		ObjectLock olock(extraEnvironment);
 
-	do {
-		while (send(l_ProcessControlFD, &length, sizeof(length), 0) < 0) {
-			StartSpawnProcessHelper();
+		for (const Dictionary::Pair& kv : extraEnvironment) {
+			String skv = kv.first + "=" + Convert::ToString(kv.second);
+
+			strings.append(skv.CStr(), skv.GetLength());
+			strings.push_back('\0');
 		}
-	} while (send(l_ProcessControlFD, jrequest.CStr(), jrequest.GetLength(), 0) < 0);
 
-	char buf[4096];
+		request.EnvironmentCount = extraEnvironment->GetLength();
+	}
+
+	request.Length = strings.size();
 
-	ssize_t rc = recv(l_ProcessControlFD, buf, sizeof(buf), 0);
+	SpawnHelperResponse response;
 
-	if (rc <= 0)
+	if (!SendSpawnHelperRequest(helper, request, strings, fds, response))
 		return -1;
 
-	String jresponse = String(buf, buf + rc);
+	if (response.RC == -1)
+		errno = response.Errno;
 
-	Dictionary::Ptr response = JsonDecode(jresponse);
-	return response->Get("errno");
+	return response.RC;
 }
 
-static int ProcessWaitPID(pid_t pid, int *status)
+static int ProcessKill(SpawnHelper& helper, pid_t pid, int signum)
 {
-	Dictionary::Ptr request = new Dictionary({
-		{ "command", "waitpid" },
-		{ "pid", pid }
-	});
+	SpawnHelperRequest request = {};
+	request.Command = SpawnHelperCommand::Kill;
+	request.PID = pid;
+	request.Signum = signum;
 
-	String jrequest = JsonEncode(request);
-	size_t length = jrequest.GetLength();
+	SpawnHelperResponse response;
 
-	boost::mutex::scoped_lock lock(l_ProcessControlMutex);
+	if (!SendSpawnHelperRequest(helper, request, std::string(), nullptr, response))
+		return -1;
 
-	do {
-		while (send(l_ProcessControlFD, &length, sizeof(length), 0) < 0) {
-			StartSpawnProcessHelper();
-		}
-	} while (send(l_ProcessControlFD, jrequest.CStr(), jrequest.GetLength(), 0) < 0);
+	return response.Errno;
+}
 
-	char buf[4096];
+static int ProcessWaitPID(SpawnHelper& helper, pid_t pid, int *status)
+{
+	SpawnHelperRequest request = {};
+	request.Command = SpawnHelperCommand::WaitPID;
+	request.PID = pid;
 
-	ssize_t rc = recv(l_ProcessControlFD, buf, sizeof(buf), 0);
+	SpawnHelperResponse response;
 
-	if (rc <= 0)
+	if (!SendSpawnHelperRequest(helper, request, std::string(), nullptr, response))
 		return -1;
 
-	String jresponse = String(buf, buf + rc);
-
-	Dictionary::Ptr response = JsonDecode(jresponse);
-	*status = response->Get("status");
-	return response->Get("rc");
+	*status = response.Status;
+	return response.RC;
 }
 
+/**
+ * Starts the spawn helpers, one per concurrent thread (up to SPAWN_HELPERS).
+ */
 void Process::InitializeSpawnHelper()
 {
-	if (l_ProcessControlFD == -1)
-		StartSpawnProcessHelper();
+	if (l_SpawnHelpers[0].FD != -1)
+		return;
+
+	l_SpawnHelperCount = std::max(1, std::min(static_cast<int>(Configuration::Concurrency), SPAWN_HELPERS));
+
+	for (int i = 0; i < l_SpawnHelperCount; i++)
+		StartSpawnProcessHelper(l_SpawnHelpers[i]);
+}
+
+/**
+ * Picks the spawn helper for a new process. Callers are spread over all helpers by their thread.
+ *
+ * @returns The helper's index.
+ */
+static int GetSpawnHelper()
+{
+	return std::hash<std::thread::id>()(std::this_thread::get_id()) % l_SpawnHelperCount;
 }
 #endif /* _WIN32 */
 
+#ifndef HAVE_EPOLL
 static void InitializeProcess()
 {
 #ifdef _WIN32
@@ -526,16 +648,99 @@ static void InitializeProcess()
 }
 
 INITIALIZE_ONCE(InitializeProcess);
+#endif /* HAVE_EPOLL */
 
 void Process::ThreadInitialize()
 {
 	/* Note to self: Make sure this runs _after_ we've daemonized. */
+#ifdef HAVE_EPOLL
+	StartIOThread();
+#else /* HAVE_EPOLL */
 	for (int tid = 0; tid < IOTHREADS; tid++) {
 		std::thread t(std::bind(&Process::IOThreadProc, tid));
 		t.detach();
 	}
+#endif /* HAVE_EPOLL */
 }
 
+#ifdef HAVE_EPOLL
+/**
+ * Starts another I/O thread.
+ *
+ * @returns The new thread's ID or -1 if all threads are already running.
+ */
+int Process::StartIOThread()
+{
+	boost::mutex::scoped_lock lock(l_IOThreadStartMutex);
+
+	int tid = l_IOThreadCount.load();
+
+	if (tid >= IOTHREADS)
+		return -1;
+
+	auto& thread (l_IOThreads[tid]);
+
+	thread.PollFD = epoll_create1(EPOLL_CLOEXEC);
+
+	if (thread.PollFD < 0) {
+		BOOST_THROW_EXCEPTION(posix_error()
+			<< boost::errinfo_api_function("epoll_create1")
+			<< boost::errinfo_errno(errno));
+	}
+
+	thread.EventFD = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+
+	if (thread.EventFD < 0) {
+		BOOST_THROW_EXCEPTION(posix_error()
+			<< boost::errinfo_api_function("eventfd")
+			<< boost::errinfo_errno(errno));
+	}
+
+	epoll_event event = {};
+	event.events = EPOLLIN;
+	event.data.fd = thread.EventFD;
+
+	if (epoll_ctl(thread.PollFD, EPOLL_CTL_ADD, thread.EventFD, &event) < 0) {
+		BOOST_THROW_EXCEPTION(posix_error()
+			<< boost::errinfo_api_function("epoll_ctl")
+			<< boost::errinfo_errno(errno));
+	}
+
+	std::thread t(std::bind(&Process::IOThreadProc, tid));
+	t.detach();
+
+	l_IOThreadCount.store(tid + 1);
+
+	return tid;
+}
+
+/**
+ * Picks the I/O thread for a new process, i.e. the least busy one.
+ * Another thread is started if all running ones are busy.
+ *
+ * @returns The thread's ID.
+ */
+int Process::GetIOThread()
+{
+	int count = l_IOThreadCount.load();
+	int tid = 0;
+
+	for (int i = 1; i < count; i++) {
+		if (l_IOThreads[i].Load.load() < l_IOThreads[tid].Load.load())
+			tid = i;
+	}
+
+	if (l_IOThreads[tid].Load.load() >= IOTHREAD_PROCESSES) {
+		int newTid = StartIOThread();
+
+		if (newTid != -1)
+			tid = newTid;
+	}
+
+	return tid;
+}
+#endif /* HAVE_EPOLL */
+
 Process::Arguments Process::PrepareCommand(const Value& command)
 {
 #ifdef _WIN32
@@ -579,6 +784,22 @@ double Process::GetTimeout() const
 	return m_Timeout;
 }
 
+#ifndef _WIN32
+/**
+ * Lets the process use the specified FDs as its stdin and stdout (instead of
+ * ours and the output pipe). Its stderr is still read as its output.
+ * The FDs are duplicated, the caller may close them once Run() has returned.
+ *
+ * @param stdinFD The FD for stdin.
+ * @param stdoutFD The FD for stdout.
+ */
+void Process::SetStdio(int stdinFD, int stdoutFD)
+{
+	m_Stdin = stdinFD;
+	m_Stdout = stdoutFD;
+}
+#endif /* _WIN32 */
+
 void Process::SetAdjustPriority(bool adjust)
 {
 	m_AdjustPriority = adjust;
@@ -589,6 +810,153 @@ bool Process::GetAdjustPriority() const
 	return m_AdjustPriority;
 }
 
+#ifdef HAVE_EPOLL
+void Process::IOThreadProc(int tid)
+{
+	auto& thread (l_IOThreads[tid]);
+
+	Utility::SetThreadName("ProcessIO");
+
+	/* Hands the result to the callback once we're done with the process. */
+	auto reap ([&thread](const Process::Ptr& process, bool wait) {
+		if (process->m_Timeout != 0) {
+			auto range (thread.Timeouts.equal_range(process->m_Result.ExecutionStart + process->m_Timeout));
+
+			for (auto it (range.first); it != range.second; ++it) {
+				if (it->second == process) {
+					thread.Timeouts.erase(it);
+					break;
+				}
+			}
+		}
+
+		if (process->m_PidFD != -1) {
+			thread.FDs.erase(process->m_PidFD);
+			(void)close(process->m_PidFD);
+			process->m_PidFD = -1;
+		}
+
+		thread.Load.fetch_sub(1);
+
+		process->Reap(wait);
+	});
+
+	auto closeOutput ([&thread](const Process::Ptr& process) {
+		thread.FDs.erase(process->m_FD);
+		(void)close(process->m_FD);
+		process->m_FD = -1;
+	});
+
+	/* Stops reading the output and waits for the process to exit. */
+	auto waitForExit ([&thread, &reap, &closeOutput](const Process::Ptr& process) {
+		closeOutput(process);
+
+		if (process->m_PID == -1) {
+			reap(process, false);
+			return;
+		}
+
+		int pidFD = -1;
+
+#ifdef SYS_pidfd_open
+		/* The process isn't our child but the spawn helper's, so we can't waitpid(2) for it. Instead we watch
+		 * a pidfd which becomes readable once the process has exited, waiting for its status won't block then.
+		 */
+		pidFD = syscall(SYS_pidfd_open, process->m_PID, 0);
+#endif /* SYS_pidfd_open */
+
+		if (pidFD != -1) {
+			epoll_event event = {};
+			event.events = EPOLLIN;
+			event.data.fd = pidFD;
+
+			if (epoll_ctl(thread.PollFD, EPOLL_CTL_ADD, pidFD, &event) < 0) {
+				(void)close(pidFD);
+				pidFD = -1;
+			}
+		}
+
+		if (pidFD == -1) {
+			/* No pidfd support (Linux < 5.3), fall back to waiting synchronously. */
+			reap(process, true);
+			return;
+		}
+
+		process->m_PidFD = pidFD;
+		thread.FDs[pidFD] = process;
+	});
+
+	epoll_event events[128];
+
+	for (;;) {
+		int timeout = -1;
+
+		{
+			boost::mutex::scoped_lock lock(thread.Mutex);
+
+			if (!thread.Timeouts.empty()) {
+				double delta = thread.Timeouts.begin()->first - Utility::GetTime();
+
+				timeout = delta > 0 ? static_cast<int>(delta * 1000) + 1 : 0;
+			}
+		}
+
+		int rc = epoll_wait(thread.PollFD, events, sizeof(events) / sizeof(events[0]), timeout);
+
+		if (rc < 0) {
+			if (errno != EINTR)
+				Log(LogCritical, "Process", "epoll_wait() failed.");
+
+			continue;
+		}
+
+		boost::mutex::scoped_lock lock(thread.Mutex);
+
+		for (int i = 0; i < rc; i++) {
+			int fd = events[i].data.fd;
+
+			if (fd == thread.EventFD) {
+				uint64_t value;
+
+				if (read(thread.EventFD, &value, sizeof(value)) < 0 && errno != EAGAIN)
+					Log(LogCritical, "Process", "Read from event FD failed.");
+
+				continue;
+			}
+
+			auto it (thread.FDs.find(fd));
+
+			if (it == thread.FDs.end())
+				continue; /* This should never happen. */
+
+			Process::Ptr process = it->second;
+
+			if (fd == process->m_PidFD)
+				reap(process, true);
+			else if (!process->ReadOutput())
+				waitForExit(process);
+		}
+
+		double now = Utility::GetTime();
+
+		while (!thread.Timeouts.empty() && thread.Timeouts.begin()->first <= now) {
+			Process::Ptr process = thread.Timeouts.begin()->second;
+			thread.Timeouts.erase(thread.Timeouts.begin());
+
+			if (process->KillOnTimeout()) {
+				/* Unless we're already waiting for the process to exit. */
+				if (process->m_FD != -1)
+					waitForExit(process);
+			} else {
+				if (process->m_FD != -1)
+					closeOutput(process);
+
+				reap(process, false);
+			}
+		}
+	}
+}
+#else /* HAVE_EPOLL */
 void Process::IOThreadProc(int tid)
 {
 #ifdef _WIN32
@@ -734,6 +1102,7 @@ void Process::IOThreadProc(int tid)
 		}
 	}
 }
+#endif /* HAVE_EPOLL */
 
 String Process::PrettyPrintArguments(const Process::Arguments& arguments)
 {
@@ -965,11 +1334,12 @@ void Process::Run(const std::function<void(const ProcessResult&)>& callback)
 #endif /* HAVE_PIPE2 */
 
 	int fds[3];
-	fds[0] = STDIN_FILENO;
-	fds[1] = outfds[1];
+	fds[0] = m_Stdin;
+	fds[1] = m_Stdout != -1 ? m_Stdout : outfds[1];
 	fds[2] = outfds[1];
 
-	m_Process = ProcessSpawn(m_Arguments, m_ExtraEnvironment, m_AdjustPriority, fds);
+	m_SpawnHelper = GetSpawnHelper();
+	m_Process = ProcessSpawn(l_SpawnHelpers[m_SpawnHelper], m_Arguments, m_ExtraEnvironment, m_AdjustPriority, fds);
 	m_PID = m_Process;
 
 	if (m_PID == -1) {
@@ -987,8 +1357,49 @@ void Process::Run(const std::function<void(const ProcessResult&)>& callback)
 	m_FD = outfds[0];
 #endif /* _WIN32 */
 
+	l_SpawnLatency.InsertValue(Utility::GetTime() - m_Result.ExecutionStart);
+
 	m_Callback = callback;
 
+#ifdef HAVE_EPOLL
+	m_TID = GetIOThread();
+
+	auto& thread (l_IOThreads[m_TID]);
+	bool wakeUp = false;
+
+	{
+		boost::mutex::scoped_lock lock(thread.Mutex);
+
+		epoll_event event = {};
+		event.events = EPOLLIN;
+		event.data.fd = m_FD;
+
+		if (epoll_ctl(thread.PollFD, EPOLL_CTL_ADD, m_FD, &event) < 0) {
+			BOOST_THROW_EXCEPTION(posix_error()
+				<< boost::errinfo_api_function("epoll_ctl")
+				<< boost::errinfo_errno(errno));
+		}
+
+		thread.FDs[m_FD] = this;
+		thread.Load.fetch_add(1);
+
+		if (m_Timeout != 0) {
+			double deadline = m_Result.ExecutionStart + m_Timeout;
+
+			/* The thread only has to wake up if the new deadline is its next one. */
+			wakeUp = thread.Timeouts.empty() || deadline < thread.Timeouts.begin()->first;
+
+			thread.Timeouts.emplace(deadline, this);
+		}
+	}
+
+	if (wakeUp) {
+		uint64_t value = 1;
+
+		if (write(thread.EventFD, &value, sizeof(value)) < 0 && errno != EAGAIN)
+			Log(LogCritical, "Process", "Write to event FD failed.");
+	}
+#else /* HAVE_EPOLL */
 	int tid = GetTID();
 
 	{
@@ -1005,36 +1416,20 @@ void Process::Run(const std::function<void(const ProcessResult&)>& callback)
 	if (write(l_EventFDs[tid][1], "T", 1) < 0 && errno != EINTR && errno != EAGAIN)
 		Log(LogCritical, "base", "Write to event FD failed.");
 #endif /* _WIN32 */
+#endif /* HAVE_EPOLL */
 }
 
+#ifndef HAVE_EPOLL
 bool Process::DoEvents()
 {
 	bool is_timeout = false;
-#ifndef _WIN32
 	bool could_not_kill = false;
-#endif /* _WIN32 */
 
 	if (m_Timeout != 0) {
 		double timeout = m_Result.ExecutionStart + m_Timeout;
 
 		if (timeout < Utility::GetTime()) {
-			Log(LogWarning, "Process")
-				<< "Killing process group " << m_PID << " (" << PrettyPrintArguments(m_Arguments)
-				<< ") after timeout of " << m_Timeout << " seconds";
-
-			m_OutputStream << "<Timeout exceeded.>";
-#ifdef _WIN32
-			TerminateProcess(m_Process, 3);
-#else /* _WIN32 */
-			int error = ProcessKill(-m_Process, SIGKILL);
-			if (error) {
-				Log(LogWarning, "Process")
-					<< "Couldn't kill the process group " << m_PID << " (" << PrettyPrintArguments(m_Arguments)
-					<< "): [errno " << error << "] " << strerror(error);
-				could_not_kill = true;
-			}
-#endif /* _WIN32 */
-
+			could_not_kill = !KillOnTimeout();
 			is_timeout = true;
 		}
 	}
@@ -1049,23 +1444,76 @@ bool Process::DoEvents()
 			return true;
 		}
 #else /* _WIN32 */
-		char buffer[512];
-		for (;;) {
-			int rc = read(m_FD, buffer, sizeof(buffer));
+		if (ReadOutput())
+			return true;
+#endif /* _WIN32 */
+	}
 
-			if (rc < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
-				return true;
+	Reap(!could_not_kill);
 
-			if (rc > 0) {
-				m_OutputStream.write(buffer, rc);
-				continue;
-			}
+	return false;
+}
+#endif /* HAVE_EPOLL */
+
+/**
+ * Kills the process (group) as it has exceeded its timeout.
+ *
+ * @returns false if the process couldn't be killed.
+ */
+bool Process::KillOnTimeout()
+{
+	Log(LogWarning, "Process")
+		<< "Killing process group " << m_PID << " (" << PrettyPrintArguments(m_Arguments)
+		<< ") after timeout of " << m_Timeout << " seconds";
 
-			break;
-		}
+	m_OutputStream << "<Timeout exceeded.>";
+#ifdef _WIN32
+	TerminateProcess(m_Process, 3);
+#else /* _WIN32 */
+	int error = ProcessKill(l_SpawnHelpers[m_SpawnHelper], -m_Process, SIGKILL);
+	if (error) {
+		Log(LogWarning, "Process")
+			<< "Couldn't kill the process group " << m_PID << " (" << PrettyPrintArguments(m_Arguments)
+			<< "): [errno " << error << "] " << strerror(error);
+		return false;
+	}
 #endif /* _WIN32 */
+
+	return true;
+}
+
+#ifndef _WIN32
+/**
+ * Reads the output which is currently available.
+ *
+ * @returns false if the output has been closed.
+ */
+bool Process::ReadOutput()
+{
+	char buffer[512];
+	for (;;) {
+		int rc = read(m_FD, buffer, sizeof(buffer));
+
+		if (rc < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			return true;
+
+		if (rc > 0) {
+			m_OutputStream.write(buffer, rc);
+			continue;
+		}
+
+		return false;
 	}
+}
+#endif /* _WIN32 */
 
+/**
+ * Collects the exit status of the process and passes the result to the callback.
+ *
+ * @param wait Whether to wait for the process, false if it couldn't be killed.
+ */
+void Process::Reap(bool wait)
+{
 	String output = m_OutputStream.str();
 
 #ifdef _WIN32
@@ -1078,9 +1526,9 @@ bool Process::DoEvents()
 		<< "PID " << m_PID << " (" << PrettyPrintArguments(m_Arguments) << ") terminated with exit code " << exitcode;
 #else /* _WIN32 */
 	int status, exitcode;
-	if (could_not_kill || m_PID == -1) {
+	if (!wait || m_PID == -1) {
 		exitcode = 128;
-	} else if (ProcessWaitPID(m_Process, &status) != m_Process) {
+	} else if (ProcessWaitPID(l_SpawnHelpers[m_SpawnHelper], m_Process, &status) != m_Process) {
 		exitcode = 128;
 
 		Log(LogWarning, "Process")
@@ -1121,8 +1569,6 @@ bool Process::DoEvents()
 
 	if (m_Callback)
 		Utility::QueueAsyncCallback(std::bind(m_Callback, m_Result));
-
-	return false;
 }
 
 pid_t Process::GetPID() const
@@ -1130,9 +1576,43 @@ pid_t Process::GetPID() const
 	return m_PID;
 }
 
+/**
+ * Kills the process (group) prematurely. The callback is called as usual once the process has exited.
+ */
+void Process::Terminate()
+{
+	Log(LogNotice, "Process")
+		<< "Terminating process group " << m_PID << " (" << PrettyPrintArguments(m_Arguments) << ")";
+
+#ifdef _WIN32
+	TerminateProcess(m_Process, 3);
+#else /* _WIN32 */
+	if (m_PID == -1)
+		return;
+
+	int error = ProcessKill(l_SpawnHelpers[m_SpawnHelper], -m_Process, SIGKILL);
+	if (error) {
+		Log(LogWarning, "Process")
+			<< "Couldn't kill the process group " << m_PID << " (" << PrettyPrintArguments(m_Arguments)
+			<< "): [errno " << error << "] " << strerror(error);
+	}
+#endif /* _WIN32 */
+}
+
+/**
+ * Returns how long it took to start processes, i.e. until Run() had spawned them.
+ *
+ * @returns The histogram's statistics.
+ */
+Dictionary::Ptr Process::GetSpawnLatencyStats()
+{
+	return l_SpawnLatency.GetStats();
+}
 
+#ifndef HAVE_EPOLL
 int Process::GetTID() const
 {
 	return (reinterpret_cast<uintptr_t>(this) / sizeof(void *)) % IOTHREADS;
 }
+#endif /* HAVE_EPOLL */
 
@@ -59,7 +59,12 @@ public:
 	void SetAdjustPriority(bool adjust);
 	bool GetAdjustPriority() const;
 
+#ifndef _WIN32
+	void SetStdio(int stdinFD, int stdoutFD);
+#endif /* _WIN32 */
+
 	void Run(const std::function<void (const ProcessResult&)>& callback = std::function<void (const ProcessResult&)>());
+	void Terminate();
 
 	pid_t GetPID() const;
 
@@ -69,6 +74,8 @@ public:
 
 	static String PrettyPrintArguments(const Arguments& arguments);
 
+	static Dictionary::Ptr GetSpawnLatencyStats();
+
 #ifndef _WIN32
 	static void InitializeSpawnHelper();
 #endif /* _WIN32 */
@@ -84,6 +91,12 @@ private:
 	pid_t m_PID;
 	ConsoleHandle m_FD;
 
+#ifndef _WIN32
+	int m_Stdin;
+	int m_Stdout;
+	int m_SpawnHelper;
+#endif /* _WIN32 */
+
 #ifdef _WIN32
 	bool m_ReadPending;
 	bool m_ReadFailed;
@@ -95,9 +108,23 @@ private:
 	std::function<void (const ProcessResult&)> m_Callback;
 	ProcessResult m_Result;
 
-	static void IOThreadProc(int tid);
+#ifdef HAVE_EPOLL
+	int m_TID;
+	int m_PidFD;
+
+	static int StartIOThread();
+	static int GetIOThread();
+#else /* HAVE_EPOLL */
 	bool DoEvents();
 	int GetTID() const;
+#endif /* HAVE_EPOLL */
+
+	static void IOThreadProc(int tid);
+	bool KillOnTimeout();
+#ifndef _WIN32
+	bool ReadOutput();
+#endif /* _WIN32 */
+	void Reap(bool wait);
 };
 
 }
@@ -0,0 +1,87 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef RWLOCK_H
+#define RWLOCK_H
+
+#include "base/i2-base.hpp"
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+namespace icinga
+{
+
+/**
+ * A compact reader/writer lock for read-mostly containers.
+ *
+ * Unlike boost::shared_mutex it only occupies four bytes, which matters for
+ * the millions of small dictionaries a large configuration consists of.
+ * Waiters spin and yield, so critical sections must be short. Writers are
+ * expected to be serialized by the caller (e.g. by holding the container's
+ * ObjectLock), readers never block each other.
+ *
+ * Satisfies the Lockable and SharedLockable concepts.
+ *
+ * @ingroup base
+ */
+class RWLock final
+{
+public:
+	RWLock() = default;
+	RWLock(const RWLock&) = delete;
+	RWLock& operator=(const RWLock&) = delete;
+
+	void lock_shared()
+	{
+		for (unsigned int spins = 0;; spins++) {
+			uint32_t state = m_State.load(std::memory_order_relaxed);
+
+			if (!(state & Writer) && m_State.compare_exchange_weak(state, state + 1u, std::memory_order_acquire))
+				return;
+
+			Backoff(spins);
+		}
+	}
+
+	void unlock_shared()
+	{
+		m_State.fetch_sub(1u, std::memory_order_release);
+	}
+
+	void lock()
+	{
+		/* Setting the writer bit keeps new readers out... */
+		for (unsigned int spins = 0;; spins++) {
+			uint32_t state = m_State.load(std::memory_order_relaxed);
+
+			if (!(state & Writer) && m_State.compare_exchange_weak(state, state | Writer, std::memory_order_acquire))
+				break;
+
+			Backoff(spins);
+		}
+
+		/* ...while the current ones finish. */
+		for (unsigned int spins = 0; m_State.load(std::memory_order_acquire) != Writer; spins++)
+			Backoff(spins);
+	}
+
+	void unlock()
+	{
+		m_State.fetch_and(~Writer, std::memory_order_release);
+	}
+
+private:
+	static const uint32_t Writer = 1u << 31;
+
+	std::atomic<uint32_t> m_State{0};
+
+	static void Backoff(unsigned int spins)
+	{
+		if (spins >= 16)
+			std::this_thread::yield();
+	}
+};
+
+}
+
+#endif /* RWLOCK_H */
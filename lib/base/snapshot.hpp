@@ -0,0 +1,59 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "base/i2-base.hpp"
+#include "base/shared.hpp"
+
+namespace icinga
+{
+
+/**
+ * An immutable copy of a container's items. Snapshots are reference counted,
+ * can be shared between threads and read without any locking.
+ *
+ * @ingroup base
+ */
+template<typename T>
+class Snapshot final
+{
+public:
+	typedef typename T::const_iterator Iterator;
+	typedef typename T::size_type SizeType;
+
+	Snapshot() = default;
+
+	Snapshot(typename Shared<T>::Ptr data)
+		: m_Data(std::move(data))
+	{ }
+
+	Iterator begin() const
+	{
+		return GetData().begin();
+	}
+
+	Iterator end() const
+	{
+		return GetData().end();
+	}
+
+	SizeType GetLength() const
+	{
+		return GetData().size();
+	}
+
+	const T& GetData() const
+	{
+		static const T empty;
+
+		return m_Data ? *m_Data : empty;
+	}
+
+private:
+	typename Shared<T>::Ptr m_Data;
+};
+
+}
+
+#endif /* SNAPSHOT_H */
@@ -4,10 +4,17 @@
 #include "base/value.hpp"
 #include "base/primitivetype.hpp"
 #include "base/dictionary.hpp"
+#include "base/array.hpp"
+#include "base/perfdatavalue.hpp"
+#include "base/statsfunction.hpp"
 #include <boost/algorithm/string/case_conv.hpp>
 #include <boost/algorithm/string/trim.hpp>
 #include <boost/algorithm/string/split.hpp>
+#include <boost/thread/mutex.hpp>
+#include <functional>
+#include <map>
 #include <ostream>
+#include <unordered_map>
 
 using namespace icinga;
 
@@ -17,6 +24,127 @@ REGISTER_BUILTIN_TYPE(String, String::GetPrototype());
 
 const String::SizeType String::NPos = std::string::npos;
 
+#ifdef ICINGA2_STRING_INTERNING
+/**
+ * One part of the table of interned strings. The table is split by hash
+ * so that threads interning different strings rarely wait for each other.
+ */
+struct InternShard
+{
+	typedef std::unordered_map<std::reference_wrapper<const std::string>, SharedStringData *,
+		std::hash<std::string>, std::equal_to<std::string> > StringMap;
+
+	boost::mutex Mutex;
+	StringMap Strings;
+	size_t PurgeSize{1024};
+};
+
+static const size_t l_InternShardCount = 16;
+
+/* Strings may be interned during static initialization. */
+static InternShard *GetInternShards()
+{
+	static InternShard shards[l_InternShardCount];
+	return shards;
+}
+
+static void ReleaseSharedData(SharedStringData *data)
+{
+	if (data->References.fetch_sub(1) == 1)
+		delete data;
+}
+
+/**
+ * Drops interned strings which are only referenced by the table itself.
+ * Caller must hold the shard's mutex.
+ */
+static void PurgeShard(InternShard& shard)
+{
+	for (auto it (shard.Strings.begin()); it != shard.Strings.end();) {
+		if (it->second->References.load() == 1) {
+			SharedStringData *data = it->second;
+			it = shard.Strings.erase(it);
+			ReleaseSharedData(data);
+		} else {
+			++it;
+		}
+	}
+
+	shard.PurgeSize = std::max<size_t>(1024, shard.Strings.size() * 2);
+}
+
+static const char *GetStringOriginName(StringOrigin origin)
+{
+	switch (origin) {
+		case StringOriginDictionaryKey:
+			return "dictionary_key";
+		case StringOriginObjectName:
+			return "object_name";
+		case StringOriginCommandLine:
+			return "command_line";
+		default:
+			return "other";
+	}
+}
+
+static void StringStatsFunc(const Dictionary::Ptr& status, const Array::Ptr& perfdata)
+{
+	struct OriginStats
+	{
+		uint_fast64_t Strings{0};
+		uint_fast64_t References{0};
+		uint_fast64_t Bytes{0};
+		uint_fast64_t SavedBytes{0};
+	};
+
+	std::map<String, OriginStats> origins;
+
+	InternShard *shards = GetInternShards();
+
+	for (size_t i = 0; i < l_InternShardCount; i++) {
+		InternShard& shard (shards[i]);
+		boost::mutex::scoped_lock lock (shard.Mutex);
+
+		for (auto& kv : shard.Strings) {
+			const SharedStringData *data = kv.second;
+			auto& stats (origins[GetStringOriginName(data->Origin)]);
+
+			/* The table's own reference doesn't count. */
+			uint_fast64_t references = data->References.load() - 1u;
+
+			stats.Strings++;
+			stats.References += references;
+			stats.Bytes += sizeof(SharedStringData) + data->Data.capacity() + 1u;
+
+			if (references > 1u)
+				stats.SavedBytes += (references - 1u) * (data->Data.capacity() + 1u);
+		}
+	}
+
+	Dictionary::Ptr result = new Dictionary();
+	uint_fast64_t totalBytes = 0, totalSavedBytes = 0;
+
+	for (auto& kv : origins) {
+		result->Set(kv.first, new Dictionary({
+			{ "strings", kv.second.Strings },
+			{ "references", kv.second.References },
+			{ "bytes", kv.second.Bytes },
+			{ "saved_bytes", kv.second.SavedBytes }
+		}));
+
+		totalBytes += kv.second.Bytes;
+		totalSavedBytes += kv.second.SavedBytes;
+	}
+
+	status->Set("string_memory", result);
+
+	perfdata->Add(new PerfdataValue("interned_string_bytes", totalBytes));
+	perfdata->Add(new PerfdataValue("interned_string_saved_bytes", totalSavedBytes));
+}
+
+REGISTER_STATSFUNCTION(String, &StringStatsFunc);
+#endif /* ICINGA2_STRING_INTERNING */
+
 String::String(const char *data)
 	: m_Data(data)
 { }
@@ -29,6 +157,20 @@ String::String(String::SizeType n, char c)
 	: m_Data(n, c)
 { }
 
+#ifdef ICINGA2_STRING_INTERNING
+String::String(const String& other)
+	: m_Data(other.m_Data), m_Shared(other.m_Shared)
+{
+	if (m_Shared)
+		m_Shared->References.fetch_add(1);
+}
+
+String::String(String&& other)
+	: m_Data(std::move(other.m_Data)), m_Shared(other.m_Shared)
+{
+	other.m_Shared = nullptr;
+}
+#else /* ICINGA2_STRING_INTERNING */
 String::String(const String& other)
 	: m_Data(other)
 { }
@@ -36,6 +178,7 @@ String::String(const String& other)
 String::String(String&& other)
 	: m_Data(std::move(other.m_Data))
 { }
+#endif /* ICINGA2_STRING_INTERNING */
 
 #ifndef _MSC_VER
 String::String(Value&& other)
@@ -47,7 +190,7 @@ String::String(Value&& other)
 String& String::operator=(Value&& other)
 {
 	if (other.IsString())
-		m_Data = std::move(other.Get<String>());
+		*this = other.Get<String>();
 	else
 		*this = static_cast<String>(other);
 
@@ -56,10 +199,39 @@ String& String::operator=(Value&& other)
 
 String& String::operator+=(const Value& rhs)
 {
+	Unshare();
 	m_Data += static_cast<String>(rhs);
 	return *this;
 }
 
+#ifdef ICINGA2_STRING_INTERNING
+String& String::operator=(const String& rhs)
+{
+	if (rhs.m_Shared) {
+		rhs.m_Shared->References.fetch_add(1);
+		ReleaseShared();
+		m_Shared = rhs.m_Shared;
+		std::string().swap(m_Data);
+	} else if (this != &rhs) {
+		ReleaseShared();
+		m_Data = rhs.m_Data;
+	}
+
+	return *this;
+}
+
+String& String::operator=(String&& rhs)
+{
+	if (this != &rhs) {
+		ReleaseShared();
+		m_Data = std::move(rhs.m_Data);
+		m_Shared = rhs.m_Shared;
+		rhs.m_Shared = nullptr;
+	}
+
+	return *this;
+}
+#else /* ICINGA2_STRING_INTERNING */
 String& String::operator=(const String& rhs)
 {
 	m_Data = rhs.m_Data;
@@ -71,230 +243,330 @@ String& String::operator=(String&& rhs)
 	m_Data = std::move(rhs.m_Data);
 	return *this;
 }
+#endif /* ICINGA2_STRING_INTERNING */
 
 String& String::operator=(const std::string& rhs)
 {
+	ReleaseShared();
 	m_Data = rhs;
 	return *this;
 }
 
 String& String::operator=(const char *rhs)
 {
+	ReleaseShared();
 	m_Data = rhs;
 	return *this;
 }
 
 const char& String::operator[](String::SizeType pos) const
 {
-	return m_Data[pos];
+	return Data()[pos];
 }
 
 char& String::operator[](String::SizeType pos)
 {
+	Unshare();
 	return m_Data[pos];
 }
 
 String& String::operator+=(const String& rhs)
 {
-	m_Data += rhs.m_Data;
+	Unshare();
+	m_Data += rhs.Data();
 	return *this;
 }
 
 String& String::operator+=(const char *rhs)
 {
+	Unshare();
 	m_Data += rhs;
 	return *this;
 }
 
 String& String::operator+=(char rhs)
 {
+	Unshare();
 	m_Data += rhs;
 	return *this;
 }
 
 bool String::IsEmpty() const
 {
-	return m_Data.empty();
+	return Data().empty();
 }
 
 bool String::operator<(const String& rhs) const
 {
-	return m_Data < rhs.m_Data;
+	return Data() < rhs.Data();
 }
 
 String::operator const std::string&() const
 {
-	return m_Data;
+	return Data();
 }
 
 const char *String::CStr() const
 {
-	return m_Data.c_str();
+	return Data().c_str();
 }
 
 void String::Clear()
 {
+	ReleaseShared();
 	m_Data.clear();
 }
 
 String::SizeType String::GetLength() const
 {
-	return m_Data.size();
+	return Data().size();
 }
 
 std::string& String::GetData()
 {
+	Unshare();
 	return m_Data;
 }
 
 const std::string& String::GetData() const
 {
-	return m_Data;
+	return Data();
 }
 
 String::SizeType String::Find(const String& str, String::SizeType pos) const
 {
-	return m_Data.find(str, pos);
+	return Data().find(str, pos);
 }
 
 String::SizeType String::RFind(const String& str, String::SizeType pos) const
 {
-	return m_Data.rfind(str, pos);
+	return Data().rfind(str, pos);
 }
 
 String::SizeType String::FindFirstOf(const char *s, String::SizeType pos) const
 {
-	return m_Data.find_first_of(s, pos);
+	return Data().find_first_of(s, pos);
 }
 
 String::SizeType String::FindFirstOf(char ch, String::SizeType pos) const
 {
-	return m_Data.find_first_of(ch, pos);
+	return Data().find_first_of(ch, pos);
 }
 
 String::SizeType String::FindFirstNotOf(const char *s, String::SizeType pos) const
 {
-	return m_Data.find_first_not_of(s, pos);
+	return Data().find_first_not_of(s, pos);
 }
 
 String::SizeType String::FindFirstNotOf(char ch, String::SizeType pos) const
 {
-	return m_Data.find_first_not_of(ch, pos);
+	return Data().find_first_not_of(ch, pos);
 }
 
 String::SizeType String::FindLastOf(const char *s, String::SizeType pos) const
 {
-	return m_Data.find_last_of(s, pos);
+	return Data().find_last_of(s, pos);
 }
 
 String::SizeType String::FindLastOf(char ch, String::SizeType pos) const
 {
-	return m_Data.find_last_of(ch, pos);
+	return Data().find_last_of(ch, pos);
 }
 
 String String::SubStr(String::SizeType first, String::SizeType len) const
 {
-	return m_Data.substr(first, len);
+	return Data().substr(first, len);
 }
 
 std::vector<String> String::Split(const char *separators) const
 {
 	std::vector<String> result;
-	boost::algorithm::split(result, m_Data, boost::is_any_of(separators));
+	boost::algorithm::split(result, Data(), boost::is_any_of(separators));
 	return result;
 }
 
 void String::Replace(String::SizeType first, String::SizeType second, const String& str)
 {
+	Unshare();
 	m_Data.replace(first, second, str);
 }
 
 String String::Trim() const
 {
-	String t = m_Data;
+	String t = Data();
 	boost::algorithm::trim(t);
 	return t;
 }
 
 String String::ToLower() const
 {
-	String t = m_Data;
+	String t = Data();
 	boost::algorithm::to_lower(t);
 	return t;
 }
 
 String String::ToUpper() const
 {
-	String t = m_Data;
+	String t = Data();
 	boost::algorithm::to_upper(t);
 	return t;
 }
 
 String String::Reverse() const
 {
-	String t = m_Data;
+	String t = Data();
 	std::reverse(t.m_Data.begin(), t.m_Data.end());
 	return t;
 }
 
 void String::Append(int count, char ch)
 {
+	Unshare();
 	m_Data.append(count, ch);
 }
 
 bool String::Contains(const String& str) const
 {
-	return (m_Data.find(str) != std::string::npos);
+	return (Data().find(str) != std::string::npos);
 }
 
 void String::swap(String& str)
 {
 	m_Data.swap(str.m_Data);
+#ifdef ICINGA2_STRING_INTERNING
+	std::swap(m_Shared, str.m_Shared);
+#endif /* ICINGA2_STRING_INTERNING */
 }
 
 String::Iterator String::erase(String::Iterator first, String::Iterator last)
 {
+	/* first and last were obtained from Begin() or End(), which unshared the string. */
 	return m_Data.erase(first, last);
 }
 
 String::Iterator String::Begin()
 {
+	Unshare();
 	return m_Data.begin();
 }
 
 String::ConstIterator String::Begin() const
 {
-	return m_Data.begin();
+	return Data().begin();
 }
 
 String::Iterator String::End()
 {
+	Unshare();
 	return m_Data.end();
 }
 
 String::ConstIterator String::End() const
 {
-	return m_Data.end();
+	return Data().end();
 }
 
 String::ReverseIterator String::RBegin()
 {
+	Unshare();
 	return m_Data.rbegin();
 }
 
 String::ConstReverseIterator String::RBegin() const
 {
-	return m_Data.rbegin();
+	return Data().rbegin();
 }
 
 String::ReverseIterator String::REnd()
 {
+	Unshare();
 	return m_Data.rend();
 }
 
 String::ConstReverseIterator String::REnd() const
 {
-	return m_Data.rend();
+	return Data().rend();
+}
+
+/**
+ * Returns an equal string which shares its characters with all other interned
+ * strings of the same value. Short strings are stored inline anyway and thus
+ * returned as they are, as are all strings unless built with ICINGA2_STRING_INTERNING.
+ *
+ * @param origin What the string is used for, for the string memory report.
+ * @returns The interned string.
+ */
+String String::Intern(StringOrigin origin) const
+{
+#ifdef ICINGA2_STRING_INTERNING
+	static const SizeType inlineCapacity = std::string().capacity();
+
+	if (m_Shared || m_Data.size() <= inlineCapacity)
+		return *this;
+
+	InternShard& shard (GetInternShards()[std::hash<std::string>()(m_Data) % l_InternShardCount]);
+	String result;
+
+	boost::mutex::scoped_lock lock (shard.Mutex);
+
+	auto it (shard.Strings.find(std::cref(m_Data)));
+
+	if (it == shard.Strings.end()) {
+		if (shard.Strings.size() >= shard.PurgeSize)
+			PurgeShard(shard);
+
+		/* The table keeps the initial reference. */
+		auto data (new SharedStringData(m_Data, origin));
+		it = shard.Strings.emplace(std::cref(data->Data), data).first;
+	}
+
+	result.m_Shared = it->second;
+	result.m_Shared->References.fetch_add(1);
+
+	return result;
+#else /* ICINGA2_STRING_INTERNING */
+	(void)origin;
+
+	return *this;
+#endif /* ICINGA2_STRING_INTERNING */
+}
+
+/**
+ * Checks whether the string shares its characters with other interned strings.
+ *
+ * @returns true if the string is interned, false otherwise.
+ */
+bool String::IsShared() const
+{
+#ifdef ICINGA2_STRING_INTERNING
+	return m_Shared != nullptr;
+#else /* ICINGA2_STRING_INTERNING */
+	return false;
+#endif /* ICINGA2_STRING_INTERNING */
+}
+
+/**
+ * Copies the characters of an interned string into the string itself
+ * so that it can be modified.
+ */
+void String::Unshare()
+{
+#ifdef ICINGA2_STRING_INTERNING
+	if (m_Shared) {
+		m_Data = m_Shared->Data;
+		ReleaseShared();
+	}
+#endif /* ICINGA2_STRING_INTERNING */
+}
+
+void String::ReleaseShared()
+{
+#ifdef ICINGA2_STRING_INTERNING
+	if (m_Shared) {
+		ReleaseSharedData(m_Shared);
+		m_Shared = nullptr;
+	}
+#endif /* ICINGA2_STRING_INTERNING */
 }
 
 std::ostream& icinga::operator<<(std::ostream& stream, const String& str)
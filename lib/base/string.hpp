@@ -6,6 +6,8 @@
 #include "base/i2-base.hpp"
 #include "base/object.hpp"
 #include <boost/range/iterator.hpp>
+#include <atomic>
+#include <cstdint>
 #include <string>
 #include <iosfwd>
 
@@ -13,11 +15,44 @@ namespace icinga {
 
 class Value;
 
+/**
+ * What an interned string is used for. Only used for the string memory report.
+ */
+enum StringOrigin
+{
+	StringOriginOther,
+	StringOriginDictionaryKey,
+	StringOriginObjectName,
+	StringOriginCommandLine
+};
+
+/**
+ * The immutable, reference-counted buffer of interned strings.
+ *
+ * @ingroup base
+ */
+struct SharedStringData
+{
+	std::atomic<uint_fast32_t> References;
+	StringOrigin Origin;
+	const std::string Data;
+
+	SharedStringData(std::string data, StringOrigin origin)
+		: References(1), Origin(origin), Data(std::move(data))
+	{ }
+};
+
 /**
  * String class.
  *
  * Rationale for having this: The std::string class has an ambiguous assignment
  * operator when used in conjunction with the Value class.
+ *
+ * When built with ICINGA2_STRING_INTERNING, long-lived strings can be
+ * interned, after which all copies share one immutable buffer instead of
+ * allocating their own. Modifying an interned string (including obtaining
+ * non-const iterators or references to its characters) first copies the
+ * characters back into the string itself. Otherwise Intern() is a no-op.
  */
 class String
 {
@@ -43,6 +78,14 @@ public:
 	String(const String& other);
 	String(String&& other);
 
+#ifdef ICINGA2_STRING_INTERNING
+	~String()
+	{
+		if (m_Shared)
+			ReleaseShared();
+	}
+#endif /* ICINGA2_STRING_INTERNING */
+
 #ifndef _MSC_VER
 	String(Value&& other);
 #endif /* _MSC_VER */
@@ -115,6 +158,7 @@ public:
 	template<typename InputIterator>
 	void insert(Iterator p, InputIterator first, InputIterator last)
 	{
+		/* p was obtained from Begin() or End(), which unshared the string. */
 		m_Data.insert(p, first, last);
 	}
 
@@ -127,12 +171,33 @@ public:
 	ReverseIterator REnd();
 	ConstReverseIterator REnd() const;
 
+	String Intern(StringOrigin origin = StringOriginOther) const;
+	bool IsShared() const;
+
 	static const SizeType NPos;
 
 	static Object::Ptr GetPrototype();
 
 private:
-	std::string m_Data;
+	std::string m_Data; /**< The characters unless the string is shared. */
+#ifdef ICINGA2_STRING_INTERNING
+	SharedStringData *m_Shared{nullptr}; /**< The interned buffer, if any. */
+#endif /* ICINGA2_STRING_INTERNING */
+
+	/**
+	 * Returns the characters of the string, wherever they are stored.
+	 */
+	const std::string& Data() const
+	{
+#ifdef ICINGA2_STRING_INTERNING
+		return m_Shared ? m_Shared->Data : m_Data;
+#else /* ICINGA2_STRING_INTERNING */
+		return m_Data;
+#endif /* ICINGA2_STRING_INTERNING */
+	}
+
+	void Unshare();
+	void ReleaseShared();
 };
 
 std::ostream& operator<<(std::ostream& stream, const String& str);
@@ -5,61 +5,304 @@
 #include "base/debug.hpp"
 #include "base/logger.hpp"
 #include "base/utility.hpp"
+#include <boost/intrusive/list.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/condition_variable.hpp>
-#include <boost/multi_index_container.hpp>
-#include <boost/multi_index/ordered_index.hpp>
-#include <boost/multi_index/key_extractors.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <limits>
 #include <thread>
+#include <vector>
 
 using namespace icinga;
 
-namespace icinga {
+/* Timers are scheduled with a resolution of 10ms. */
+static const double l_TimerTicksPerSecond = 100;
 
-class TimerHolder {
-public:
-	TimerHolder(Timer *timer)
-		: m_Timer(timer)
-	{ }
+static const uint_fast64_t l_TimerNever = std::numeric_limits<uint_fast64_t>::max();
 
-	inline Timer *GetObject() const
-	{
-		return m_Timer;
-	}
+static inline uint_fast64_t TimeToTick(double time)
+{
+	return time > 0 ? static_cast<uint_fast64_t>(time * l_TimerTicksPerSecond) : 0;
+}
 
-	inline double GetNextUnlocked() const
-	{
-		return m_Timer->m_Next;
-	}
+static inline double TickToTime(uint_fast64_t tick)
+{
+	return tick / l_TimerTicksPerSecond;
+}
 
-	operator Timer *() const
-	{
-		return m_Timer;
-	}
+namespace icinga {
+
+/**
+ * A hierarchical timing wheel.
+ *
+ * Each of the wheel's levels consists of 256 slots. A slot on level n covers 256^n ticks.
+ * Timers are linked into the slot of the lowest level which covers their due tick and are
+ * moved to the lower levels ("cascaded") as time passes, so adding and removing a timer
+ * takes constant time. Timers which are due beyond the highest level wait in an overflow list.
+ *
+ * The timers are spread over multiple wheels, each with its own lock.
+ *
+ * @ingroup base
+ */
+class TimerWheel
+{
+public:
+	boost::mutex Mutex;
+	boost::condition_variable CV; /**< Notified whenever a timer callback has completed. */
+
+	void Add(Timer *timer);
+	void Remove(Timer *timer);
+	void Advance(uint_fast64_t now, std::vector<Timer *>& expired);
+	uint_fast64_t GetNextTick() const;
+	void GetTimers(std::vector<Timer *>& timers) const;
 
 private:
-	Timer *m_Timer;
+	static const int Levels = 4;
+	static const int SlotBits = 8;
+	static const uint_fast64_t SlotCount = 1u << SlotBits;
+	static const uint_fast64_t SlotMask = SlotCount - 1u;
+
+	typedef boost::intrusive::list<
+		Timer,
+		boost::intrusive::member_hook<Timer, decltype(Timer::m_WheelHook), &Timer::m_WheelHook>,
+		boost::intrusive::constant_time_size<false>
+	> TimerList;
+
+	uint_fast64_t m_CurrentTick{0}; /**< All ticks before this one have been processed. */
+	size_t m_Count{0};
+	TimerList m_Slots[Levels][SlotCount];
+	uint64_t m_Occupied[Levels][SlotCount / 64u] = {}; /**< Which slots may be non-empty */
+	TimerList m_Overflow;
+
+	void Insert(Timer *timer);
+	void Cascade();
+	int FindOccupied(int level, uint_fast64_t from) const;
 };
 
 }
 
-typedef boost::multi_index_container<
-	TimerHolder,
-	boost::multi_index::indexed_by<
-		boost::multi_index::ordered_unique<boost::multi_index::const_mem_fun<TimerHolder, Timer *, &TimerHolder::GetObject> >,
-		boost::multi_index::ordered_non_unique<boost::multi_index::const_mem_fun<TimerHolder, double, &TimerHolder::GetNextUnlocked> >
-	>
-> TimerSet;
-
 static boost::mutex l_TimerMutex;
 static boost::condition_variable l_TimerCV;
 static std::thread l_TimerThread;
 static bool l_StopTimerThread;
-static TimerSet l_Timers;
+static bool l_WakeUpTimerThread;
+static std::atomic<uint_fast64_t> l_TimerThreadWakeUpTick (0);
+static TimerWheel l_TimerWheels[16];
 static int l_AliveTimers = 0;
 
 static Defer l_ShutdownTimersCleanlyOnExit (&Timer::Uninitialize);
 
+/**
+ * Adds a timer which isn't part of any wheel yet.
+ *
+ * @param timer The timer, due at its m_WheelTick.
+ */
+void TimerWheel::Add(Timer *timer)
+{
+	/* Don't make the timer thread catch up with ticks nobody is interested in. */
+	if (m_Count == 0)
+		m_CurrentTick = TimeToTick(Utility::GetTime());
+
+	Insert(timer);
+}
+
+void TimerWheel::Insert(Timer *timer)
+{
+	auto tick (std::max(timer->m_WheelTick, m_CurrentTick));
+	auto delta (tick - m_CurrentTick);
+
+	m_Count++;
+
+	for (int level = 0; level < Levels; level++) {
+		if (delta < (uint_fast64_t(1) << (SlotBits * (level + 1)))) {
+			auto slot ((tick >> (SlotBits * level)) & SlotMask);
+
+			m_Slots[level][slot].push_back(*timer);
+			m_Occupied[level][slot / 64u] |= uint64_t(1) << (slot % 64u);
+			return;
+		}
+	}
+
+	m_Overflow.push_back(*timer);
+}
+
+void TimerWheel::Remove(Timer *timer)
+{
+	/* The slot's bit stays set, it's cleared once the slot is processed. */
+	if (timer->m_WheelHook.is_linked()) {
+		timer->m_WheelHook.unlink();
+		m_Count--;
+	}
+}
+
+/**
+ * Moves the timers of the higher levels' slots which start at the current tick
+ * to the lower levels.
+ */
+void TimerWheel::Cascade()
+{
+	int top = 1;
+
+	while (top < Levels && (m_CurrentTick & ((uint_fast64_t(1) << (SlotBits * (top + 1))) - 1u)) == 0)
+		top++;
+
+	auto reinsert ([this](TimerList& list) {
+		while (!list.empty()) {
+			Timer& timer (list.front());
+
+			list.pop_front();
+			m_Count--;
+
+			Insert(&timer);
+		}
+	});
+
+	if (top == Levels) {
+		TimerList overflow;
+		overflow.swap(m_Overflow);
+		reinsert(overflow);
+
+		top--;
+	}
+
+	for (int level = top; level > 0; level--) {
+		auto slot ((m_CurrentTick >> (SlotBits * level)) & SlotMask);
+
+		TimerList list;
+		list.swap(m_Slots[level][slot]);
+		m_Occupied[level][slot / 64u] &= ~(uint64_t(1) << (slot % 64u));
+
+		reinsert(list);
+	}
+}
+
+/**
+ * Processes all ticks up to (including) the specified one.
+ *
+ * @param now The current tick.
+ * @param expired Receives the timers which are due, they're marked as running.
+ */
+void TimerWheel::Advance(uint_fast64_t now, std::vector<Timer *>& expired)
+{
+	if (m_Count == 0) {
+		m_CurrentTick = std::max(m_CurrentTick, now + 1u);
+		return;
+	}
+
+	while (m_CurrentTick <= now) {
+		auto slot (m_CurrentTick & SlotMask);
+
+		if (slot == 0)
+			Cascade();
+
+		auto& list (m_Slots[0][slot]);
+
+		while (!list.empty()) {
+			Timer& timer (list.front());
+
+			list.pop_front();
+			m_Count--;
+
+			timer.m_Running = true;
+			expired.push_back(&timer);
+		}
+
+		m_Occupied[0][slot / 64u] &= ~(uint64_t(1) << (slot % 64u));
+
+		/* Skip the empty slots up to the next cascade. */
+		auto next ((m_CurrentTick | SlotMask) + 1u);
+		int occupied = FindOccupied(0, slot + 1u);
+
+		if (occupied >= 0)
+			next = (m_CurrentTick & ~SlotMask) + occupied;
+
+		m_CurrentTick = std::min(next, now + 1u);
+	}
+}
+
+/**
+ * Returns the tick the wheel has to be advanced to next.
+ *
+ * @returns The tick or l_TimerNever if there are no timers.
+ */
+uint_fast64_t TimerWheel::GetNextTick() const
+{
+	if (m_Count == 0)
+		return l_TimerNever;
+
+	auto slot (m_CurrentTick & SlotMask);
+
+	/* A cascade is pending. */
+	if (slot == 0)
+		return m_CurrentTick;
+
+	int occupied = FindOccupied(0, slot);
+
+	if (occupied >= 0)
+		return (m_CurrentTick & ~SlotMask) + occupied;
+
+	return (m_CurrentTick | SlotMask) + 1u;
+}
+
+void TimerWheel::GetTimers(std::vector<Timer *>& timers) const
+{
+	for (auto& level : m_Slots) {
+		for (auto& slot : level) {
+			for (auto& timer : slot) {
+				timers.push_back(const_cast<Timer *>(&timer));
+			}
+		}
+	}
+
+	for (auto& timer : m_Overflow) {
+		timers.push_back(const_cast<Timer *>(&timer));
+	}
+}
+
+/**
+ * Finds the first slot of a level from the specified one on which may be non-empty.
+ *
+ * @returns The slot or -1.
+ */
+int TimerWheel::FindOccupied(int level, uint_fast64_t from) const
+{
+	for (auto word (from / 64u); word < SlotCount / 64u; word++) {
+		uint64_t bits = m_Occupied[level][word];
+
+		if (word == from / 64u)
+			bits &= ~uint64_t(0) << (from % 64u);
+
+		if (bits) {
+			int bit = 0;
+
+			while (!(bits & 1u)) {
+				bits >>= 1u;
+				bit++;
+			}
+
+			return word * 64u + bit;
+		}
+	}
+
+	return -1;
+}
+
+/**
+ * Wakes up the timer thread if it sleeps beyond the specified tick.
+ */
+static void NotifyTimerThread(uint_fast64_t tick)
+{
+	if (tick < l_TimerThreadWakeUpTick.load()) {
+		boost::mutex::scoped_lock lock(l_TimerMutex);
+
+		l_WakeUpTimerThread = true;
+		l_TimerCV.notify_all();
+	}
+}
+
 /**
  * Destructor for the Timer class.
  */
@@ -107,6 +350,14 @@ void Timer::UninitializeThread()
 	l_TimerMutex.lock();
 }
 
+/**
+ * Returns the timer wheel this timer belongs to.
+ */
+TimerWheel& Timer::GetWheel() const
+{
+	return l_TimerWheels[(reinterpret_cast<uintptr_t>(this) >> 4u) % (sizeof(l_TimerWheels) / sizeof(l_TimerWheels[0]))];
+}
+
 /**
  * Calls this timer.
  */
@@ -130,7 +381,7 @@ void Timer::Call()
  */
 void Timer::SetInterval(double interval)
 {
-	boost::mutex::scoped_lock lock(l_TimerMutex);
+	boost::mutex::scoped_lock lock(GetWheel().Mutex);
 	m_Interval = interval;
 }
 
@@ -141,7 +392,7 @@ void Timer::SetInterval(double interval)
  */
 double Timer::GetInterval() const
 {
-	boost::mutex::scoped_lock lock(l_TimerMutex);
+	boost::mutex::scoped_lock lock(GetWheel().Mutex);
 	return m_Interval;
 }
 
@@ -152,11 +403,13 @@ void Timer::Start()
 {
 	{
 		boost::mutex::scoped_lock lock(l_TimerMutex);
-		m_Started = true;
 
 		if (++l_AliveTimers == 1) {
 			InitializeThread();
 		}
+
+		boost::mutex::scoped_lock wheelLock(GetWheel().Mutex);
+		m_Started = true;
 	}
 
 	InternalReschedule(false);
@@ -170,20 +423,31 @@ void Timer::Stop(bool wait)
 	if (l_StopTimerThread)
 		return;
 
-	boost::mutex::scoped_lock lock(l_TimerMutex);
+	TimerWheel& wheel = GetWheel();
 
-	if (m_Started && --l_AliveTimers == 0) {
-		UninitializeThread();
-	}
+	{
+		boost::mutex::scoped_lock lock(l_TimerMutex);
+		bool started;
 
-	m_Started = false;
-	l_Timers.erase(this);
+		{
+			boost::mutex::scoped_lock wheelLock(wheel.Mutex);
 
-	/* Notify the worker thread that we've disabled a timer. */
-	l_TimerCV.notify_all();
+			started = m_Started;
+			m_Started = false;
+			wheel.Remove(this);
+		}
 
-	while (wait && m_Running)
-		l_TimerCV.wait(lock);
+		if (started && --l_AliveTimers == 0) {
+			UninitializeThread();
+		}
+	}
+
+	if (wait) {
+		boost::mutex::scoped_lock wheelLock(wheel.Mutex);
+
+		while (m_Running)
+			wheel.CV.wait(wheelLock);
+	}
 }
 
 void Timer::Reschedule(double next)
@@ -200,29 +464,42 @@ void Timer::Reschedule(double next)
  */
 void Timer::InternalReschedule(bool completed, double next)
 {
-	boost::mutex::scoped_lock lock(l_TimerMutex);
+	TimerWheel& wheel = GetWheel();
+	uint_fast64_t tick;
+
+	{
+		boost::mutex::scoped_lock lock(wheel.Mutex);
 
-	if (completed)
-		m_Running = false;
+		if (completed) {
+			m_Running = false;
 
-	if (next < 0) {
-		/* Don't schedule the next call if this is not a periodic timer. */
-		if (m_Interval <= 0)
-			return;
+			/* Notify Stop() that the callback has completed. */
+			wheel.CV.notify_all();
+		}
 
-		next = Utility::GetTime() + m_Interval;
-	}
+		if (next < 0) {
+			/* Don't schedule the next call if this is not a periodic timer. */
+			if (m_Interval <= 0)
+				return;
 
-	m_Next = next;
+			next = Utility::GetTime() + m_Interval;
+		}
 
-	if (m_Started && !m_Running) {
-		/* Remove and re-add the timer to update the index. */
-		l_Timers.erase(this);
-		l_Timers.insert(this);
+		m_Next = next;
 
-		/* Notify the worker that we've rescheduled a timer. */
-		l_TimerCV.notify_all();
+		if (!m_Started || m_Running)
+			return;
+
+		/* Remove and re-add the timer to move it to the slot for its new due time. */
+		tick = TimeToTick(next);
+		m_WheelTick = tick;
+
+		wheel.Remove(this);
+		wheel.Add(this);
 	}
+
+	/* Notify the worker that we've rescheduled a timer. */
+	NotifyTimerThread(tick);
 }
 
 /**
@@ -232,7 +509,7 @@ void Timer::InternalReschedule(bool completed, double next)
  */
 double Timer::GetNext() const
 {
-	boost::mutex::scoped_lock lock(l_TimerMutex);
+	boost::mutex::scoped_lock lock(GetWheel().Mutex);
 	return m_Next;
 }
 
@@ -244,30 +521,34 @@ double Timer::GetNext() const
  */
 void Timer::AdjustTimers(double adjustment)
 {
-	boost::mutex::scoped_lock lock(l_TimerMutex);
-
 	double now = Utility::GetTime();
 
-	typedef boost::multi_index::nth_index<TimerSet, 1>::type TimerView;
-	TimerView& idx = boost::get<1>(l_Timers);
-
 	std::vector<Timer *> timers;
 
-	for (Timer *timer : idx) {
-		if (std::fabs(now - (timer->m_Next + adjustment)) <
-			std::fabs(now - timer->m_Next)) {
-			timer->m_Next += adjustment;
-			timers.push_back(timer);
+	for (auto& wheel : l_TimerWheels) {
+		boost::mutex::scoped_lock lock(wheel.Mutex);
+
+		timers.clear();
+		wheel.GetTimers(timers);
+
+		/* Start over with an empty wheel, the clock may have jumped backwards. */
+		for (Timer *timer : timers) {
+			wheel.Remove(timer);
 		}
-	}
 
-	for (Timer *timer : timers) {
-		l_Timers.erase(timer);
-		l_Timers.insert(timer);
+		for (Timer *timer : timers) {
+			if (std::fabs(now - (timer->m_Next + adjustment)) <
+				std::fabs(now - timer->m_Next)) {
+				timer->m_Next += adjustment;
+				timer->m_WheelTick = TimeToTick(timer->m_Next);
+			}
+
+			wheel.Add(timer);
+		}
 	}
 
 	/* Notify the worker that we've rescheduled some timers. */
-	l_TimerCV.notify_all();
+	NotifyTimerThread(0);
 }
 
 /**
@@ -279,40 +560,53 @@ void Timer::TimerThreadProc()
 
 	Utility::SetThreadName("Timer Thread");
 
+	std::vector<Timer *> expired;
+
 	for (;;) {
-		boost::mutex::scoped_lock lock(l_TimerMutex);
+		/* Timers (re)scheduled while we're looking at the wheels wake us up again. */
+		l_TimerThreadWakeUpTick.store(l_TimerNever);
 
-		typedef boost::multi_index::nth_index<TimerSet, 1>::type NextTimerView;
-		NextTimerView& idx = boost::get<1>(l_Timers);
+		uint_fast64_t now = TimeToTick(Utility::GetTime());
+		uint_fast64_t next = l_TimerNever;
 
-		/* Wait until there is at least one timer. */
-		while (idx.empty() && !l_StopTimerThread)
-			l_TimerCV.wait(lock);
+		for (auto& wheel : l_TimerWheels) {
+			boost::mutex::scoped_lock lock(wheel.Mutex);
 
-		if (l_StopTimerThread)
-			break;
+			wheel.Advance(now, expired);
+			next = std::min(next, wheel.GetNextTick());
+		}
 
-		auto it = idx.begin();
-		Timer *timer = *it;
+		for (Timer *timer : expired) {
+			/* Asynchronously call the timer. */
+			Utility::QueueAsyncCallback([timer]() { timer->Call(); });
+		}
 
-		double wait = timer->m_Next - Utility::GetTime();
+		expired.clear();
 
-		if (wait > 0.01) {
-			/* Wait for the next timer. */
-			l_TimerCV.timed_wait(lock, boost::posix_time::milliseconds(long(wait * 1000)));
+		boost::mutex::scoped_lock lock(l_TimerMutex);
 
-			continue;
-		}
+		if (l_StopTimerThread)
+			break;
+
+		if (!l_WakeUpTimerThread) {
+			l_TimerThreadWakeUpTick.store(next);
 
-		/* Remove the timer from the list so it doesn't get called again
-		 * until the current call is completed. */
-		l_Timers.erase(timer);
+			if (next == l_TimerNever) {
+				/* Wait until there is at least one timer. */
+				while (!l_WakeUpTimerThread && !l_StopTimerThread)
+					l_TimerCV.wait(lock);
+			} else {
+				double wait = TickToTime(next) - Utility::GetTime();
 
-		timer->m_Running = true;
+				/* Wait for the next timer. */
+				if (wait > 0)
+					l_TimerCV.timed_wait(lock, boost::posix_time::milliseconds(long(wait * 1000) + 1));
+			}
+		}
 
-		lock.unlock();
+		l_WakeUpTimerThread = false;
 
-		/* Asynchronously call the timer. */
-		Utility::QueueAsyncCallback([timer]() { timer->Call(); });
+		if (l_StopTimerThread)
+			break;
 	}
 }
@@ -5,11 +5,13 @@
 
 #include "base/i2-base.hpp"
 #include "base/object.hpp"
+#include <cstdint>
+#include <boost/intrusive/list_hook.hpp>
 #include <boost/signals2.hpp>
 
 namespace icinga {
 
-class TimerHolder;
+class TimerWheel;
 
 /**
  * A timer that periodically triggers an event.
@@ -47,12 +49,18 @@ private:
 	bool m_Started{false}; /**< Whether the timer is enabled. */
 	bool m_Running{false}; /**< Whether the timer proc is currently running. */
 
+	/* The slot of the timer wheel the timer is currently linked into, if any. */
+	boost::intrusive::list_member_hook<boost::intrusive::link_mode<boost::intrusive::auto_unlink>> m_WheelHook;
+	uint_fast64_t m_WheelTick{0}; /**< The tick the timer is due at. */
+
+	TimerWheel& GetWheel() const;
+
 	void Call();
 	void InternalReschedule(bool completed, double next = -1);
 
 	static void TimerThreadProc();
 
-	friend class TimerHolder;
+	friend class TimerWheel;
 };
 
 }
@@ -11,6 +11,7 @@
 #include <boost/asio/ssl/context.hpp>
 #include <openssl/opensslv.h>
 #include <openssl/crypto.h>
+#include <algorithm>
 #include <fstream>
 
 namespace icinga
@@ -691,28 +692,67 @@ String PBKDF2_SHA256(const String& password, const String& salt, int iterations)
 }
 
 String SHA1(const String& s, bool binary)
+{
+	SHA1Hasher hasher;
+	hasher.Append(s);
+
+	return hasher.Finish(binary);
+}
+
+SHA1Hasher::SHA1Hasher()
+	: m_BufferLength(0)
 {
 	char errbuf[120];
-	SHA_CTX context;
-	unsigned char digest[SHA_DIGEST_LENGTH];
 
-	if (!SHA1_Init(&context)) {
+	if (!SHA1_Init(&m_Context)) {
 		Log(LogCritical, "SSL")
 			<< "Error on SHA Init: " << ERR_peek_error() << ", \"" << ERR_error_string(ERR_peek_error(), errbuf) << "\"";
 		BOOST_THROW_EXCEPTION(openssl_error()
 			<< boost::errinfo_api_function("SHA1_Init")
 			<< errinfo_openssl_error(ERR_peek_error()));
 	}
+}
 
-	if (!SHA1_Update(&context, (unsigned char*)s.CStr(), s.GetLength())) {
-		Log(LogCritical, "SSL")
-			<< "Error on SHA Update: " << ERR_peek_error() << ", \"" << ERR_error_string(ERR_peek_error(), errbuf) << "\"";
-		BOOST_THROW_EXCEPTION(openssl_error()
-			<< boost::errinfo_api_function("SHA1_Update")
-			<< errinfo_openssl_error(ERR_peek_error()));
+void SHA1Hasher::Append(const String& s)
+{
+	Append(s.CStr(), s.CStr() + s.GetLength());
+}
+
+void SHA1Hasher::Append(const char *begin, const char *end)
+{
+	size_t length = end - begin;
+
+	if (m_BufferLength + length <= sizeof(m_Buffer)) {
+		std::copy(begin, end, m_Buffer + m_BufferLength);
+		m_BufferLength += length;
+		return;
 	}
 
-	if (!SHA1_Final(digest, &context)) {
+	FlushBuffer();
+	Update(reinterpret_cast<const unsigned char*>(begin), length);
+}
+
+void SHA1Hasher::Append(char c)
+{
+	if (m_BufferLength == sizeof(m_Buffer))
+		FlushBuffer();
+
+	m_Buffer[m_BufferLength++] = c;
+}
+
+/**
+ * Returns the digest of everything appended so far. The hasher must not be used afterwards.
+ *
+ * @param binary Whether to return the raw 20 bytes instead of their hex representation
+ */
+String SHA1Hasher::Finish(bool binary)
+{
+	char errbuf[120];
+	unsigned char digest[SHA_DIGEST_LENGTH];
+
+	FlushBuffer();
+
+	if (!SHA1_Final(digest, &m_Context)) {
 		Log(LogCritical, "SSL")
 			<< "Error on SHA Final: " << ERR_peek_error() << ", \"" << ERR_error_string(ERR_peek_error(), errbuf) << "\"";
 		BOOST_THROW_EXCEPTION(openssl_error()
@@ -730,6 +770,27 @@ String SHA1(const String& s, bool binary)
 	return output;
 }
 
+void SHA1Hasher::Update(const unsigned char *data, size_t length)
+{
+	char errbuf[120];
+
+	if (!SHA1_Update(&m_Context, data, length)) {
+		Log(LogCritical, "SSL")
+			<< "Error on SHA Update: " << ERR_peek_error() << ", \"" << ERR_error_string(ERR_peek_error(), errbuf) << "\"";
+		BOOST_THROW_EXCEPTION(openssl_error()
+			<< boost::errinfo_api_function("SHA1_Update")
+			<< errinfo_openssl_error(ERR_peek_error()));
+	}
+}
+
+void SHA1Hasher::FlushBuffer()
+{
+	if (m_BufferLength) {
+		Update(m_Buffer, m_BufferLength);
+		m_BufferLength = 0;
+	}
+}
+
 String SHA256(const String& s)
 {
 	char errbuf[120];
@@ -51,6 +51,32 @@ String SHA1(const String& s, bool binary = false);
 String SHA256(const String& s);
 String RandomString(int length);
 
+/**
+ * Computes a SHA1 digest of data appended piece by piece (e.g. by PackObject()),
+ * without having to concatenate it first. Small pieces are buffered.
+ *
+ * @ingroup base
+ */
+class SHA1Hasher final
+{
+public:
+	SHA1Hasher();
+
+	void Append(const String& s);
+	void Append(const char *begin, const char *end);
+	void Append(char c);
+
+	String Finish(bool binary = false);
+
+private:
+	SHA_CTX m_Context;
+	unsigned char m_Buffer[512];
+	size_t m_BufferLength;
+
+	void Update(const unsigned char *data, size_t length);
+	void FlushBuffer();
+};
+
 bool VerifyCertificate(const std::shared_ptr<X509>& caCertificate, const std::shared_ptr<X509>& certificate);
 bool IsCa(const std::shared_ptr<X509>& cacert);
 int GetCertificateVersion(const std::shared_ptr<X509>& cert);
@@ -21,6 +21,13 @@ REGISTER_TYPE(CheckerComponent);
 
 REGISTER_STATSFUNCTION(CheckerComponent, &CheckerComponent::StatsFunc);
 
+/* Upper bound for the number of checks a scheduler thread takes out of its
+ * shard at once. */
+static const size_t l_MaxDispatchBatch = 128;
+
+/* Upper bound for the number of shards. */
+static const size_t l_MaxShards = 16;
+
 void CheckerComponent::StatsFunc(const Dictionary::Ptr& status, const Array::Ptr& perfdata)
 {
 	DictionaryData nodes;
@@ -28,15 +35,21 @@ void CheckerComponent::StatsFunc(const Dictionary::Ptr& status, const Array::Ptr
 	for (const CheckerComponent::Ptr& checker : ConfigType::GetObjectsByType<CheckerComponent>()) {
 		unsigned long idle = checker->GetIdleCheckables();
 		unsigned long pending = checker->GetPendingCheckables();
+		double dispatchLatency = checker->GetDispatchLatency();
+		double maxDispatchLatency = checker->GetMaxDispatchLatency();
 
 		nodes.emplace_back(checker->GetName(), new Dictionary({
 			{ "idle", idle },
-			{ "pending", pending }
+			{ "pending", pending },
+			{ "dispatch_latency", dispatchLatency },
+			{ "max_dispatch_latency", maxDispatchLatency }
 		}));
 
 		String perfdata_prefix = "checkercomponent_" + checker->GetName() + "_";
 		perfdata->Add(new PerfdataValue(perfdata_prefix + "idle", Convert::ToDouble(idle)));
 		perfdata->Add(new PerfdataValue(perfdata_prefix + "pending", Convert::ToDouble(pending)));
+		perfdata->Add(new PerfdataValue(perfdata_prefix + "dispatch_latency", dispatchLatency));
+		perfdata->Add(new PerfdataValue(perfdata_prefix + "max_dispatch_latency", maxDispatchLatency));
 	}
 
 	status->Set("checkercomponent", new Dictionary(std::move(nodes)));
@@ -44,6 +57,16 @@ void CheckerComponent::StatsFunc(const Dictionary::Ptr& status, const Array::Ptr
 
 void CheckerComponent::OnConfigLoaded()
 {
+	size_t shards = Configuration::Concurrency;
+
+	if (shards < 1)
+		shards = 1;
+	else if (shards > l_MaxShards)
+		shards = l_MaxShards;
+
+	for (size_t i = 0; i < shards; i++)
+		m_Shards.emplace_back(new Shard());
+
 	ConfigObject::OnActiveChanged.connect(std::bind(&CheckerComponent::ObjectHandler, this, _1));
 	ConfigObject::OnPausedChanged.connect(std::bind(&CheckerComponent::ObjectHandler, this, _1));
 
@@ -55,10 +78,10 @@ void CheckerComponent::Start(bool runtimeCreated)
 	ObjectImpl<CheckerComponent>::Start(runtimeCreated);
 
 	Log(LogInformation, "CheckerComponent")
-		<< "'" << GetName() << "' started.";
-
+		<< "'" << GetName() << "' started with " << m_Shards.size() << " scheduler threads.";
 
-	m_Thread = std::thread(std::bind(&CheckerComponent::CheckThreadProc, this));
+	for (size_t i = 0; i < m_Shards.size(); i++)
+		m_Shards[i]->Thread = std::thread(std::bind(&CheckerComponent::CheckThreadProc, this, i));
 
 	m_ResultTimer = new Timer();
 	m_ResultTimer->SetInterval(5);
@@ -68,10 +91,11 @@ void CheckerComponent::Start(bool runtimeCreated)
 
 void CheckerComponent::Stop(bool runtimeRemoved)
 {
-	{
-		boost::mutex::scoped_lock lock(m_Mutex);
-		m_Stopped = true;
-		m_CV.notify_all();
+	m_Stopped = true;
+
+	for (auto& shard : m_Shards) {
+		boost::mutex::scoped_lock lock(shard->Mutex);
+		shard->CV.notify_all();
 	}
 
 	double wait = 0.0;
@@ -99,7 +123,9 @@ void CheckerComponent::Stop(bool runtimeRemoved)
 	}
 
 	m_ResultTimer->Stop();
-	m_Thread.join();
+
+	for (auto& shard : m_Shards)
+		shard->Thread.join();
 
 	Log(LogInformation, "CheckerComponent")
 		<< "'" << GetName() << "' stopped.";
@@ -107,48 +133,114 @@ void CheckerComponent::Stop(bool runtimeRemoved)
 	ObjectImpl<CheckerComponent>::Stop(runtimeRemoved);
 }
 
-void CheckerComponent::CheckThreadProc()
+CheckerComponent::Shard& CheckerComponent::GetShard(const Checkable::Ptr& checkable)
+{
+	return *m_Shards[(reinterpret_cast<uintptr_t>(checkable.get()) >> 4) % m_Shards.size()];
+}
+
+void CheckerComponent::CheckThreadProc(size_t shardIndex)
 {
 	Utility::SetThreadName("Check Scheduler");
 	IcingaApplication::Ptr icingaApp = IcingaApplication::GetInstance();
 
-	boost::mutex::scoped_lock lock(m_Mutex);
+	Shard& shard = *m_Shards[shardIndex];
+
+	boost::mutex::scoped_lock lock(shard.Mutex);
 
 	for (;;) {
 		typedef boost::multi_index::nth_index<CheckableSet, 1>::type CheckTimeView;
-		CheckTimeView& idx = boost::get<1>(m_IdleCheckables);
+		CheckTimeView& idx = boost::get<1>(shard.IdleCheckables);
+
+		if (m_Stopped)
+			break;
+
+		double now = Utility::GetTime();
+		bool limitReached = Checkable::GetPendingChecks() >= icingaApp->GetMaxConcurrentChecks();
+
+		/* A negative wait time means there's nothing scheduled in this shard. */
+		double wait = idx.empty() ? -1 : idx.begin()->NextCheck - now;
+
+		if (limitReached)
+			wait = 0.5;
+
+		if (!limitReached && !idx.empty() && wait <= 0) {
+			DispatchChecks(shard, lock, now);
+			continue;
+		}
+
+		/* Help out other shards whose scheduler threads are busy dispatching. */
+		if (!limitReached && m_Shards.size() > 1) {
+			lock.unlock();
+			bool stolen = StealChecks(shardIndex);
+			lock.lock();
+
+			if (stolen)
+				continue;
 
-		while (idx.begin() == idx.end() && !m_Stopped)
-			m_CV.wait(lock);
+			/* Look at the other shards again from time to time. */
+			if (wait < 0 || wait > 0.5)
+				wait = 0.5;
+		}
 
 		if (m_Stopped)
 			break;
 
+		/* Wait for the next check. */
+		if (wait < 0)
+			shard.CV.wait(lock);
+		else
+			shard.CV.timed_wait(lock, boost::posix_time::milliseconds(long(wait * 1000)));
+	}
+}
+
+/**
+ * Takes a batch of checks which are due from the specified shard and
+ * dispatches them. The lock must be held when calling this method; it is
+ * released while the checks are being dispatched and re-acquired afterwards.
+ *
+ * @returns The number of checkables which were taken from the shard.
+ */
+size_t CheckerComponent::DispatchChecks(Shard& shard, boost::mutex::scoped_lock& lock, double now)
+{
+	IcingaApplication::Ptr icingaApp = IcingaApplication::GetInstance();
+
+	/* Take the slots for the whole batch right away, other shards dispatch concurrently. */
+	int slots = Checkable::ReservePendingChecks(l_MaxDispatchBatch, icingaApp->GetMaxConcurrentChecks());
+
+	if (slots <= 0)
+		return 0;
+
+	typedef boost::multi_index::nth_index<CheckableSet, 1>::type CheckTimeView;
+	CheckTimeView& idx = boost::get<1>(shard.IdleCheckables);
+
+	std::vector<Checkable::Ptr> batch;
+
+	while (!idx.empty() && batch.size() < static_cast<size_t>(slots)) {
 		auto it = idx.begin();
-		CheckableScheduleInfo csi = *it;
 
-		double wait = csi.NextCheck - Utility::GetTime();
+		if (it->NextCheck > now)
+			break;
 
-//#ifdef I2_DEBUG
-//		Log(LogDebug, "CheckerComponent")
-//			<< "Pending checks " << Checkable::GetPendingChecks()
-//			<< " vs. max concurrent checks " << icingaApp->GetMaxConcurrentChecks() << ".";
-//#endif /* I2_DEBUG */
+		shard.DispatchLatency = shard.DispatchLatency * 0.95 + (now - it->NextCheck) * 0.05;
 
-		if (Checkable::GetPendingChecks() >= icingaApp->GetMaxConcurrentChecks())
-			wait = 0.5;
+		/* Mark the checkable as pending right away so that ObjectHandler()
+		 * doesn't re-add it while the lock isn't held. */
+		CheckableScheduleInfo csi = *it;
+		idx.erase(it);
+		shard.PendingCheckables.insert(csi);
 
-		if (wait > 0) {
-			/* Wait for the next check. */
-			m_CV.timed_wait(lock, boost::posix_time::milliseconds(long(wait * 1000)));
+		batch.emplace_back(std::move(csi.Object));
+	}
 
-			continue;
-		}
+	if (batch.size() < static_cast<size_t>(slots))
+		Checkable::DecreasePendingChecks(slots - batch.size());
 
-		Checkable::Ptr checkable = csi.Object;
+	if (batch.empty())
+		return 0;
 
-		m_IdleCheckables.erase(checkable);
+	lock.unlock();
 
+	for (const Checkable::Ptr& checkable : batch) {
 		bool forced = checkable->GetForceNextCheck();
 		bool check = true;
 
@@ -186,21 +278,25 @@ void CheckerComponent::CheckThreadProc()
 
 		/* reschedule the checkable if checks are disabled */
 		if (!check) {
-			m_IdleCheckables.insert(GetCheckableScheduleInfo(checkable));
+			lock.lock();
+
+			/* the checkable might have been deactivated in the meantime */
+			if (shard.PendingCheckables.erase(checkable) > 0)
+				shard.IdleCheckables.insert(GetCheckableScheduleInfo(checkable));
+
 			lock.unlock();
 
+			Checkable::DecreasePendingChecks();
+
 			Log(LogDebug, "CheckerComponent")
 				<< "Checks for checkable '" << checkable->GetName() << "' are disabled. Rescheduling check.";
 
 			checkable->UpdateNextCheck();
 
-			lock.lock();
-
 			continue;
 		}
 
-
-		csi = GetCheckableScheduleInfo(checkable);
+		CheckableScheduleInfo csi = GetCheckableScheduleInfo(checkable);
 
 		Log(LogDebug, "CheckerComponent")
 			<< "Scheduling info for checkable '" << checkable->GetName() << "' ("
@@ -208,10 +304,6 @@ void CheckerComponent::CheckThreadProc()
 			<< csi.Object->GetName() << "', Next Check: "
 			<< Utility::FormatDateTime("%Y-%m-%d %H:%M:%S %z", csi.NextCheck) << "(" << csi.NextCheck << ").";
 
-		m_PendingCheckables.insert(csi);
-
-		lock.unlock();
-
 		if (forced) {
 			ObjectLock olock(checkable);
 			checkable->SetForceNextCheck(false);
@@ -220,12 +312,37 @@ void CheckerComponent::CheckThreadProc()
 		Log(LogDebug, "CheckerComponent")
 			<< "Executing check for '" << checkable->GetName() << "'";
 
-		Checkable::IncreasePendingChecks();
-
 		Utility::QueueAsyncCallback(std::bind(&CheckerComponent::ExecuteCheckHelper, CheckerComponent::Ptr(this), checkable));
+	}
+
+	lock.lock();
 
-		lock.lock();
+	return batch.size();
+}
+
+/**
+ * Dispatches due checks from the first shard other than the specified one
+ * which has any and whose lock isn't currently held.
+ *
+ * @returns Whether any checks were taken from another shard.
+ */
+bool CheckerComponent::StealChecks(size_t shardIndex)
+{
+	double now = Utility::GetTime();
+
+	for (size_t i = 1; i < m_Shards.size(); i++) {
+		Shard& victim = *m_Shards[(shardIndex + i) % m_Shards.size()];
+
+		boost::mutex::scoped_lock lock(victim.Mutex, boost::try_to_lock);
+
+		if (!lock.owns_lock())
+			continue;
+
+		if (DispatchChecks(victim, lock, now) > 0)
+			return true;
 	}
+
+	return false;
 }
 
 void CheckerComponent::ExecuteCheckHelper(const Checkable::Ptr& checkable)
@@ -253,20 +370,22 @@ void CheckerComponent::ExecuteCheckHelper(const Checkable::Ptr& checkable)
 	Checkable::DecreasePendingChecks();
 
 	{
-		boost::mutex::scoped_lock lock(m_Mutex);
+		Shard& shard = GetShard(checkable);
+
+		boost::mutex::scoped_lock lock(shard.Mutex);
 
 		/* remove the object from the list of pending objects; if it's not in the
 		 * list this was a manual (i.e. forced) check and we must not re-add the
 		 * object to the list because it's already there. */
-		auto it = m_PendingCheckables.find(checkable);
+		auto it = shard.PendingCheckables.find(checkable);
 
-		if (it != m_PendingCheckables.end()) {
-			m_PendingCheckables.erase(it);
+		if (it != shard.PendingCheckables.end()) {
+			shard.PendingCheckables.erase(it);
 
 			if (checkable->IsActive())
-				m_IdleCheckables.insert(GetCheckableScheduleInfo(checkable));
+				shard.IdleCheckables.insert(GetCheckableScheduleInfo(checkable));
 
-			m_CV.notify_all();
+			shard.CV.notify_all();
 		}
 	}
 
@@ -278,12 +397,9 @@ void CheckerComponent::ResultTimerHandler()
 {
 	std::ostringstream msgbuf;
 
-	{
-		boost::mutex::scoped_lock lock(m_Mutex);
-
-		msgbuf << "Pending checkables: " << m_PendingCheckables.size() << "; Idle checkables: " << m_IdleCheckables.size() << "; Checks/s: "
-			<< (CIB::GetActiveHostChecksStatistics(60) + CIB::GetActiveServiceChecksStatistics(60)) / 60.0;
-	}
+	msgbuf << "Pending checkables: " << GetPendingCheckables() << "; Idle checkables: " << GetIdleCheckables() << "; Checks/s: "
+		<< (CIB::GetActiveHostChecksStatistics(60) + CIB::GetActiveServiceChecksStatistics(60)) / 60.0
+		<< "; Dispatch latency: " << GetDispatchLatency() << "s";
 
 	Log(LogNotice, "CheckerComponent", msgbuf.str());
 }
@@ -299,19 +415,21 @@ void CheckerComponent::ObjectHandler(const ConfigObject::Ptr& object)
 	bool same_zone = (!zone || Zone::GetLocalZone() == zone);
 
 	{
-		boost::mutex::scoped_lock lock(m_Mutex);
+		Shard& shard = GetShard(checkable);
+
+		boost::mutex::scoped_lock lock(shard.Mutex);
 
 		if (object->IsActive() && !object->IsPaused() && same_zone) {
-			if (m_PendingCheckables.find(checkable) != m_PendingCheckables.end())
+			if (shard.PendingCheckables.find(checkable) != shard.PendingCheckables.end())
 				return;
 
-			m_IdleCheckables.insert(GetCheckableScheduleInfo(checkable));
+			shard.IdleCheckables.insert(GetCheckableScheduleInfo(checkable));
 		} else {
-			m_IdleCheckables.erase(checkable);
-			m_PendingCheckables.erase(checkable);
+			shard.IdleCheckables.erase(checkable);
+			shard.PendingCheckables.erase(checkable);
 		}
 
-		m_CV.notify_all();
+		shard.CV.notify_all();
 	}
 }
 
@@ -325,11 +443,13 @@ CheckableScheduleInfo CheckerComponent::GetCheckableScheduleInfo(const Checkable
 
 void CheckerComponent::NextCheckChangedHandler(const Checkable::Ptr& checkable)
 {
-	boost::mutex::scoped_lock lock(m_Mutex);
+	Shard& shard = GetShard(checkable);
+
+	boost::mutex::scoped_lock lock(shard.Mutex);
 
 	/* remove and re-insert the object from the set in order to force an index update */
 	typedef boost::multi_index::nth_index<CheckableSet, 0>::type CheckableView;
-	CheckableView& idx = boost::get<0>(m_IdleCheckables);
+	CheckableView& idx = boost::get<0>(shard.IdleCheckables);
 
 	auto it = idx.find(checkable);
 
@@ -341,19 +461,64 @@ void CheckerComponent::NextCheckChangedHandler(const Checkable::Ptr& checkable)
 	CheckableScheduleInfo csi = GetCheckableScheduleInfo(checkable);
 	idx.insert(csi);
 
-	m_CV.notify_all();
+	shard.CV.notify_all();
 }
 
 unsigned long CheckerComponent::GetIdleCheckables()
 {
-	boost::mutex::scoped_lock lock(m_Mutex);
+	unsigned long count = 0;
+
+	for (auto& shard : m_Shards) {
+		boost::mutex::scoped_lock lock(shard->Mutex);
+		count += shard->IdleCheckables.size();
+	}
 
-	return m_IdleCheckables.size();
+	return count;
 }
 
 unsigned long CheckerComponent::GetPendingCheckables()
 {
-	boost::mutex::scoped_lock lock(m_Mutex);
+	unsigned long count = 0;
+
+	for (auto& shard : m_Shards) {
+		boost::mutex::scoped_lock lock(shard->Mutex);
+		count += shard->PendingCheckables.size();
+	}
+
+	return count;
+}
+
+/**
+ * Returns the average time between the scheduled and the actual start of checks.
+ */
+double CheckerComponent::GetDispatchLatency()
+{
+	if (m_Shards.empty())
+		return 0;
+
+	double latency = 0;
+
+	for (auto& shard : m_Shards) {
+		boost::mutex::scoped_lock lock(shard->Mutex);
+		latency += shard->DispatchLatency;
+	}
+
+	return latency / m_Shards.size();
+}
+
+/**
+ * Returns the highest average dispatch latency of all shards.
+ */
+double CheckerComponent::GetMaxDispatchLatency()
+{
+	double latency = 0;
+
+	for (auto& shard : m_Shards) {
+		boost::mutex::scoped_lock lock(shard->Mutex);
+
+		if (shard->DispatchLatency > latency)
+			latency = shard->DispatchLatency;
+	}
 
-	return m_PendingCheckables.size();
+	return latency;
 }
@@ -13,7 +13,10 @@
 #include <boost/multi_index_container.hpp>
 #include <boost/multi_index/ordered_index.hpp>
 #include <boost/multi_index/key_extractors.hpp>
+#include <atomic>
+#include <memory>
 #include <thread>
+#include <vector>
 
 namespace icinga
 {
@@ -67,19 +70,36 @@ public:
 	static void StatsFunc(const Dictionary::Ptr& status, const Array::Ptr& perfdata);
 	unsigned long GetIdleCheckables();
 	unsigned long GetPendingCheckables();
+	double GetDispatchLatency();
+	double GetMaxDispatchLatency();
 
 private:
-	boost::mutex m_Mutex;
-	boost::condition_variable m_CV;
-	bool m_Stopped{false};
-	std::thread m_Thread;
+	/**
+	 * A part of the schedule with its own lock and scheduler thread.
+	 * Each checkable is assigned to exactly one shard.
+	 */
+	struct Shard
+	{
+		boost::mutex Mutex;
+		boost::condition_variable CV;
+		std::thread Thread;
 
-	CheckableSet m_IdleCheckables;
-	CheckableSet m_PendingCheckables;
+		CheckableSet IdleCheckables;
+		CheckableSet PendingCheckables;
+
+		double DispatchLatency{0};
+	};
+
+	std::vector<std::unique_ptr<Shard> > m_Shards;
+	std::atomic<bool> m_Stopped{false};
 
 	Timer::Ptr m_ResultTimer;
 
-	void CheckThreadProc();
+	Shard& GetShard(const Checkable::Ptr& checkable);
+
+	void CheckThreadProc(size_t shardIndex);
+	size_t DispatchChecks(Shard& shard, boost::mutex::scoped_lock& lock, double now);
+	bool StealChecks(size_t shardIndex);
 	void ResultTimerHandler();
 
 	void ExecuteCheckHelper(const Checkable::Ptr& checkable);
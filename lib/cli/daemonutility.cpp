@@ -8,6 +8,7 @@
 #include "config/configcompiler.hpp"
 #include "config/configcompilercontext.hpp"
 #include "config/configitembuilder.hpp"
+#include <iomanip>
 #include <set>
 
 using namespace icinga;
@@ -28,6 +29,20 @@ static bool ExecuteExpression(Expression *expression)
 	return true;
 }
 
+/**
+ * Compiles all config files of a zone directory and logs how long that took.
+ */
+static void CompileZoneDir(std::vector<std::unique_ptr<Expression> >& expressions, const String& path,
+	const String& zoneName, const String& package)
+{
+	double start = Utility::GetTime();
+	size_t files = ConfigCompiler::CollectIncludesRecursive(expressions, path, "*.conf", zoneName, package);
+
+	Log(LogInformation, "config")
+		<< "Compiled " << files << " config file(s) of zone '" << zoneName << "' from '" << path << "' in "
+		<< std::fixed << std::setprecision(3) << Utility::GetTime() - start << " seconds.";
+}
+
 static bool IncludeZoneDirRecursive(const String& path, const String& package, bool& success)
 {
 	String zoneName = Utility::BaseName(path);
@@ -43,7 +58,7 @@ static bool IncludeZoneDirRecursive(const String& path, const String& package, b
 	ConfigCompiler::RegisterZoneDir("_etc", path, zoneName);
 
 	std::vector<std::unique_ptr<Expression> > expressions;
-	Utility::GlobRecursive(path, "*.conf", std::bind(&ConfigCompiler::CollectIncludes, std::ref(expressions), _1, zoneName, package), GlobFile);
+	CompileZoneDir(expressions, path, zoneName, package);
 	DictExpression expr(std::move(expressions));
 	if (!ExecuteExpression(&expr))
 		success = false;
@@ -75,7 +90,7 @@ static bool IncludeNonLocalZone(const String& zonePath, const String& package, b
 	}
 
 	std::vector<std::unique_ptr<Expression> > expressions;
-	Utility::GlobRecursive(zonePath, "*.conf", std::bind(&ConfigCompiler::CollectIncludes, std::ref(expressions), _1, zoneName, package), GlobFile);
+	CompileZoneDir(expressions, zonePath, zoneName, package);
 	DictExpression expr(std::move(expressions));
 	if (!ExecuteExpression(&expr))
 		success = false;
@@ -49,7 +49,10 @@ void CompatLogger::Start(bool runtimeCreated)
 	Log(LogWarning, "CompatLogger")
 		<< "This feature is DEPRECATED and will be removed in future releases. Check the roadmap at https://github.com/Icinga/icinga2/milestones";
 
-	Checkable::OnNewCheckResult.connect(std::bind(&CompatLogger::CheckResultHandler, this, _1, _2));
+	m_HandleCheckResults = Checkable::OnNewCheckResult.Subscribe("CompatLogger:" + GetName(), [this](const std::vector<CheckResultEvent>& events) {
+		for (const CheckResultEvent& event : events)
+			CheckResultHandler(event);
+	});
 	Checkable::OnNotificationSentToUser.connect(std::bind(&CompatLogger::NotificationSentHandler, this, _1, _2, _3, _4, _5, _6, _7, _8));
 	Downtime::OnDowntimeTriggered.connect(std::bind(&CompatLogger::TriggerDowntimeHandler, this, _1));
 	Downtime::OnDowntimeRemoved.connect(std::bind(&CompatLogger::RemoveDowntimeHandler, this, _1));
@@ -73,6 +76,9 @@ void CompatLogger::Start(bool runtimeCreated)
  */
 void CompatLogger::Stop(bool runtimeRemoved)
 {
+	Checkable::OnNewCheckResult.Unsubscribe(m_HandleCheckResults);
+	m_HandleCheckResults.reset();
+
 	Log(LogInformation, "CompatLogger")
 		<< "'" << GetName() << "' stopped.";
 
@@ -82,8 +88,11 @@ void CompatLogger::Stop(bool runtimeRemoved)
 /**
  * @threadsafety Always.
  */
-void CompatLogger::CheckResultHandler(const Checkable::Ptr& checkable, const CheckResult::Ptr &cr)
+void CompatLogger::CheckResultHandler(const CheckResultEvent& event)
 {
+	const Checkable::Ptr& checkable = event.Source;
+	const CheckResult::Ptr& cr = event.Result;
+
 	Host::Ptr host;
 	Service::Ptr service;
 	tie(host, service) = GetHostService(checkable);
@@ -118,18 +127,19 @@ void CompatLogger::CheckResultHandler(const Checkable::Ptr& checkable, const Che
 		msgbuf << "SERVICE ALERT: "
 			<< host->GetName() << ";"
 			<< service->GetShortName() << ";"
-			<< Service::StateToString(service->GetState()) << ";"
-			<< Service::StateTypeToString(service->GetStateType()) << ";"
+			<< Service::StateToString(event.State) << ";"
+			<< Service::StateTypeToString(event.Type) << ";"
 			<< attempt_after << ";"
 			<< output << ""
 			<< "";
 	} else {
-		String state = Host::StateToString(Host::CalculateState(static_cast<ServiceState>(state_after)));
+		HostState hostState = Host::CalculateState(event.State);
+		String state = (hostState != HostUp && !event.Reachable) ? "UNREACHABLE" : Host::StateToString(hostState);
 
 		msgbuf << "HOST ALERT: "
 			<< host->GetName() << ";"
-			<< GetHostStateString(host) << ";"
-			<< Host::StateTypeToString(host->GetStateType()) << ";"
+			<< state << ";"
+			<< Host::StateTypeToString(event.Type) << ";"
 			<< attempt_after << ";"
 			<< output << ""
 			<< "";
@@ -31,10 +31,12 @@ protected:
 	void Stop(bool runtimeRemoved) override;
 
 private:
+	EventSubscriber<CheckResultEvent>::Ptr m_HandleCheckResults;
+
 	void WriteLine(const String& line);
 	void Flush();
 
-	void CheckResultHandler(const Checkable::Ptr& service, const CheckResult::Ptr& cr);
+	void CheckResultHandler(const CheckResultEvent& event);
 	void NotificationSentHandler(const Notification::Ptr& notification, const Checkable::Ptr& service,
 		const User::Ptr& user, NotificationType notification_type, CheckResult::Ptr const& cr,
 		const String& author, const String& comment_text, const String& command_name);
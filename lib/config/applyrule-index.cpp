@@ -0,0 +1,381 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "config/applyrule.hpp"
+#include "base/array.hpp"
+#include "base/function.hpp"
+#include "base/logger.hpp"
+#include "base/namespace.hpp"
+#include "base/objectlock.hpp"
+#include "base/scriptglobal.hpp"
+#include "base/utility.hpp"
+#include <set>
+
+using namespace icinga;
+
+/**
+ * Pre-analysed 'assign where' filters for the apply rules of one source/target type.
+ *
+ * Each indexed rule is known to match only if at least one of its atoms
+ * (`path == "literal"`, `"literal" in path` or `match("pattern", path)`) is true,
+ * where path is an attribute of one of the objects the rule is applied to
+ * (e.g. `host.vars.os`). Rules whose filters can't be reduced to such atoms
+ * are always evaluated.
+ */
+struct ApplyRule::FilterIndex
+{
+	struct Match
+	{
+		String Pattern;
+		const Expression *Function;
+		size_t Rule;
+	};
+
+	struct Path
+	{
+		const Expression *Expr;
+		std::map<String, std::vector<size_t> > Equal;
+		std::map<String, std::vector<size_t> > Contains;
+		std::vector<Match> Matches;
+		std::vector<size_t> EqualRules;
+		std::vector<size_t> ContainsRules;
+	};
+
+	std::vector<Path> Paths;
+	std::vector<size_t> Unindexed;
+};
+
+enum FilterAtomType
+{
+	FilterAtomEqual,
+	FilterAtomContains,
+	FilterAtomMatch
+};
+
+struct FilterAtom
+{
+	FilterAtomType Type;
+	const Expression *Path;
+	std::vector<String> PathKey;
+	String Value;
+	const Expression *Function;
+};
+
+static bool GetStringLiteral(const Expression *expr, String *value)
+{
+	auto lit = dynamic_cast<const LiteralExpression *>(expr);
+
+	if (!lit || !lit->GetValue().IsString())
+		return false;
+
+	*value = lit->GetValue();
+	return true;
+}
+
+/**
+ * Checks whether the expression is a plain attribute lookup on one of the
+ * root variables (e.g. `host.vars.os`) and returns its components.
+ */
+static bool GetFilterPath(const Expression *expr, const std::set<String>& roots, std::vector<String>& path)
+{
+	auto var = dynamic_cast<const VariableExpression *>(expr);
+
+	if (var) {
+		if (roots.find(var->GetVariable()) == roots.end())
+			return false;
+
+		path.push_back(var->GetVariable());
+		return true;
+	}
+
+	auto indexer = dynamic_cast<const IndexerExpression *>(expr);
+	String field;
+
+	if (!indexer || !GetStringLiteral(indexer->GetOperand2().get(), &field))
+		return false;
+
+	if (!GetFilterPath(indexer->GetOperand1().get(), roots, path))
+		return false;
+
+	path.push_back(field);
+	return true;
+}
+
+/**
+ * Reduces a filter to a list of atoms at least one of which has to be true
+ * for the filter to be true.
+ *
+ * Only the first operand of '&&' is considered, so that every atom is
+ * evaluated by the regular filter evaluation before anything else which
+ * could throw an error.
+ */
+static bool AnalyzeFilter(const Expression *expr, const std::set<String>& roots, bool allowMatch, std::vector<FilterAtom>& atoms)
+{
+	if (auto land = dynamic_cast<const LogicalAndExpression *>(expr))
+		return AnalyzeFilter(land->GetOperand1().get(), roots, allowMatch, atoms);
+
+	if (auto lor = dynamic_cast<const LogicalOrExpression *>(expr)) {
+		return AnalyzeFilter(lor->GetOperand1().get(), roots, allowMatch, atoms)
+			&& AnalyzeFilter(lor->GetOperand2().get(), roots, allowMatch, atoms);
+	}
+
+	FilterAtom atom;
+	atom.Function = nullptr;
+
+	if (auto eq = dynamic_cast<const EqualExpression *>(expr)) {
+		const Expression *op1 = eq->GetOperand1().get();
+		const Expression *op2 = eq->GetOperand2().get();
+
+		if (!GetStringLiteral(op2, &atom.Value)) {
+			if (!GetStringLiteral(op1, &atom.Value))
+				return false;
+
+			std::swap(op1, op2);
+		}
+
+		if (!GetFilterPath(op1, roots, atom.PathKey))
+			return false;
+
+		atom.Type = FilterAtomEqual;
+		atom.Path = op1;
+		atoms.push_back(std::move(atom));
+		return true;
+	}
+
+	if (auto in = dynamic_cast<const InExpression *>(expr)) {
+		/* "literal" in host.groups */
+		if (GetStringLiteral(in->GetOperand1().get(), &atom.Value)) {
+			if (!GetFilterPath(in->GetOperand2().get(), roots, atom.PathKey))
+				return false;
+
+			atom.Type = FilterAtomContains;
+			atom.Path = in->GetOperand2().get();
+			atoms.push_back(std::move(atom));
+			return true;
+		}
+
+		/* host.vars.os in [ "Linux", "FreeBSD" ] */
+		auto arr = dynamic_cast<const ArrayExpression *>(in->GetOperand2().get());
+
+		if (!arr || !GetFilterPath(in->GetOperand1().get(), roots, atom.PathKey))
+			return false;
+
+		atom.Type = FilterAtomEqual;
+		atom.Path = in->GetOperand1().get();
+
+		std::vector<FilterAtom> values;
+
+		for (const std::unique_ptr<Expression>& item : arr->GetExpressions()) {
+			if (!GetStringLiteral(item.get(), &atom.Value))
+				return false;
+
+			values.push_back(atom);
+		}
+
+		std::move(values.begin(), values.end(), std::back_inserter(atoms));
+		return true;
+	}
+
+	if (auto call = dynamic_cast<const FunctionCallExpression *>(expr)) {
+		auto fname = dynamic_cast<const VariableExpression *>(call->m_FName.get());
+
+		if (!allowMatch || !fname || fname->GetVariable() != "match" || call->m_Args.size() != 2)
+			return false;
+
+		if (!GetStringLiteral(call->m_Args[0].get(), &atom.Value) || !GetFilterPath(call->m_Args[1].get(), roots, atom.PathKey))
+			return false;
+
+		atom.Type = FilterAtomMatch;
+		atom.Path = call->m_Args[1].get();
+		atom.Function = fname;
+		atoms.push_back(std::move(atom));
+		return true;
+	}
+
+	return false;
+}
+
+std::shared_ptr<ApplyRule::FilterIndex> ApplyRule::GetFilterIndex(const String& sourceType, const String& targetType, const Dictionary::Ptr& locals)
+{
+	std::unique_lock<std::mutex> lock(m_FilterIndexMutex);
+
+	auto key = std::make_pair(sourceType, targetType);
+	auto it = m_FilterIndexes.find(key);
+
+	if (it != m_FilterIndexes.end())
+		return it->second;
+
+	std::set<String> roots;
+
+	{
+		ObjectLock olock(locals);
+		for (const Dictionary::Pair& kv : locals)
+			roots.insert(kv.first);
+	}
+
+	auto index = std::make_shared<FilterIndex>();
+	std::map<std::vector<String>, size_t> paths;
+	size_t indexed = 0;
+
+	const std::vector<ApplyRule>& rules = GetRules(sourceType);
+
+	for (size_t i = 0; i < rules.size(); i++) {
+		const ApplyRule& rule = rules[i];
+
+		if (!targetType.IsEmpty() && rule.GetTargetType() != targetType)
+			continue;
+
+		/* Loop variables shadow the objects the filter is evaluated for. */
+		bool shadowed = roots.find(rule.GetFKVar()) != roots.end() || roots.find(rule.GetFVVar()) != roots.end();
+
+		/* The rule's scope or loop variables might override the match() function. */
+		bool allowMatch = rule.GetFKVar() != "match" && rule.GetFVVar() != "match" && (!rule.GetScope() || !rule.GetScope()->Contains("match"));
+
+		std::vector<FilterAtom> atoms;
+
+		if (shadowed || !AnalyzeFilter(rule.GetFilter().get(), roots, allowMatch, atoms)) {
+			index->Unindexed.push_back(i);
+			continue;
+		}
+
+		indexed++;
+
+		for (const FilterAtom& atom : atoms) {
+			auto pit = paths.find(atom.PathKey);
+
+			if (pit == paths.end()) {
+				FilterIndex::Path path;
+				path.Expr = atom.Path;
+				index->Paths.push_back(std::move(path));
+
+				pit = paths.insert(std::make_pair(atom.PathKey, index->Paths.size() - 1)).first;
+			}
+
+			FilterIndex::Path& path = index->Paths[pit->second];
+
+			switch (atom.Type) {
+				case FilterAtomEqual:
+					path.Equal[atom.Value].push_back(i);
+					path.EqualRules.push_back(i);
+					break;
+				case FilterAtomContains:
+					path.Contains[atom.Value].push_back(i);
+					path.ContainsRules.push_back(i);
+					break;
+				case FilterAtomMatch:
+					path.Matches.push_back({ atom.Value, atom.Function, i });
+					break;
+			}
+		}
+	}
+
+	Log(LogNotice, "ApplyRule")
+		<< "Indexed " << indexed << " of " << (indexed + index->Unindexed.size()) << " '" << sourceType << "' apply rules"
+		<< (targetType.IsEmpty() ? "" : " for type '" + targetType + "'") << " using " << index->Paths.size() << " attributes.";
+
+	m_FilterIndexes[key] = index;
+
+	return index;
+}
+
+static inline void SelectRules(std::vector<bool>& selected, const std::vector<size_t>& rules)
+{
+	for (size_t rule : rules)
+		selected[rule] = true;
+}
+
+/**
+ * Returns the apply rules whose filters might match the specified objects,
+ * in the order they were defined. All other rules are known not to match.
+ *
+ * @param sourceType The type of objects created by the rules.
+ * @param targetType The type of objects the rules are applied to, or empty to use all rules.
+ * @param locals The objects the filter is evaluated for, e.g. { host = ..., service = ... }.
+ * @returns The candidate rules.
+ */
+std::vector<ApplyRule *> ApplyRule::GetCandidateRules(const String& sourceType, const String& targetType, const Dictionary::Ptr& locals)
+{
+	std::vector<ApplyRule>& rules = GetRules(sourceType);
+	std::shared_ptr<FilterIndex> index = GetFilterIndex(sourceType, targetType, locals);
+
+	std::vector<bool> selected(rules.size(), false);
+	SelectRules(selected, index->Unindexed);
+
+	ScriptFrame frame(true);
+	locals->CopyTo(frame.Locals);
+
+	Namespace::Ptr systemNS = ScriptGlobal::Get("System");
+	Value builtinMatch = systemNS->Get("match");
+
+	for (const FilterIndex::Path& path : index->Paths) {
+		Value value;
+
+		try {
+			value = path.Expr->Evaluate(frame).GetValue();
+		} catch (const std::exception&) {
+			/* Let the regular filter evaluation report the error. */
+			SelectRules(selected, path.EqualRules);
+			SelectRules(selected, path.ContainsRules);
+
+			for (const FilterIndex::Match& match : path.Matches)
+				selected[match.Rule] = true;
+
+			continue;
+		}
+
+		/* Other comparisons than with strings (or empty values) aren't indexed. */
+		if (value.IsString() || value.IsEmpty()) {
+			auto it = path.Equal.find(static_cast<String>(value));
+
+			if (it != path.Equal.end())
+				SelectRules(selected, it->second);
+		} else
+			SelectRules(selected, path.EqualRules);
+
+		if (value.IsObjectType<Array>()) {
+			Array::Ptr arr = value;
+			ObjectLock olock(arr);
+
+			for (const Value& item : arr) {
+				if (!item.IsString() && !item.IsEmpty()) {
+					SelectRules(selected, path.ContainsRules);
+					break;
+				}
+
+				auto it = path.Contains.find(static_cast<String>(item));
+
+				if (it != path.Contains.end())
+					SelectRules(selected, it->second);
+			}
+		} else if (!value.IsEmpty())
+			SelectRules(selected, path.ContainsRules);
+
+		for (const FilterIndex::Match& match : path.Matches) {
+			if (!value.IsString() && !value.IsEmpty()) {
+				selected[match.Rule] = true;
+				continue;
+			}
+
+			/* The function name is resolved like the filter would, the rule's imports might shadow match(). */
+			Value func;
+
+			try {
+				func = match.Function->Evaluate(frame).GetValue();
+			} catch (const std::exception&) {
+				selected[match.Rule] = true;
+				continue;
+			}
+
+			if (func != builtinMatch || Utility::Match(match.Pattern, static_cast<String>(value)))
+				selected[match.Rule] = true;
+		}
+	}
+
+	std::vector<ApplyRule *> result;
+
+	for (size_t i = 0; i < rules.size(); i++) {
+		if (selected[i])
+			result.push_back(&rules[i]);
+	}
+
+	return result;
+}
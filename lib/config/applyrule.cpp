@@ -8,6 +8,8 @@ using namespace icinga;
 
 ApplyRule::RuleMap ApplyRule::m_Rules;
 ApplyRule::TypeMap ApplyRule::m_Types;
+std::mutex ApplyRule::m_FilterIndexMutex;
+std::map<std::pair<String, String>, std::shared_ptr<ApplyRule::FilterIndex> > ApplyRule::m_FilterIndexes;
 
 ApplyRule::ApplyRule(String targetType, String name, Expression::Ptr expression,
 	Expression::Ptr filter, String package, String fkvar, String fvvar, Expression::Ptr fterm,
@@ -76,6 +78,16 @@ void ApplyRule::AddRule(const String& sourceType, const String& targetType, cons
 	const String& fvvar, const Expression::Ptr& fterm, bool ignoreOnError, const DebugInfo& di, const Dictionary::Ptr& scope)
 {
 	m_Rules[sourceType].push_back(ApplyRule(targetType, name, expression, filter, package, fkvar, fvvar, fterm, ignoreOnError, di, scope));
+
+	/* Invalidate the filter indexes for this source type, they're rebuilt on demand. */
+	std::unique_lock<std::mutex> lock(m_FilterIndexMutex);
+
+	for (auto it = m_FilterIndexes.begin(); it != m_FilterIndexes.end();) {
+		if (it->first.first == sourceType)
+			it = m_FilterIndexes.erase(it);
+		else
+			++it;
+	}
 }
 
 bool ApplyRule::EvaluateFilter(ScriptFrame& frame) const
@@ -6,6 +6,8 @@
 #include "config/i2-config.hpp"
 #include "config/expression.hpp"
 #include "base/debuginfo.hpp"
+#include <memory>
+#include <mutex>
 
 namespace icinga
 {
@@ -39,6 +41,7 @@ public:
 		const Expression::Ptr& filter, const String& package, const String& fkvar, const String& fvvar, const Expression::Ptr& fterm,
 		bool ignoreOnError, const DebugInfo& di, const Dictionary::Ptr& scope);
 	static std::vector<ApplyRule>& GetRules(const String& type);
+	static std::vector<ApplyRule *> GetCandidateRules(const String& sourceType, const String& targetType, const Dictionary::Ptr& locals);
 
 	static void RegisterType(const String& sourceType, const std::vector<String>& targetTypes);
 	static bool IsValidSourceType(const String& sourceType);
@@ -48,6 +51,8 @@ public:
 	static void CheckMatches(bool silent);
 
 private:
+	struct FilterIndex;
+
 	String m_TargetType;
 	String m_Name;
 	Expression::Ptr m_Expression;
@@ -64,6 +69,11 @@ private:
 	static TypeMap m_Types;
 	static RuleMap m_Rules;
 
+	static std::mutex m_FilterIndexMutex;
+	static std::map<std::pair<String, String>, std::shared_ptr<FilterIndex> > m_FilterIndexes;
+
+	static std::shared_ptr<FilterIndex> GetFilterIndex(const String& sourceType, const String& targetType, const Dictionary::Ptr& locals);
+
 	ApplyRule(String targetType, String name, Expression::Ptr expression,
 		Expression::Ptr filter, String package, String fkvar, String fvvar, Expression::Ptr fterm,
 		bool ignoreOnError, DebugInfo di, Dictionary::Ptr scope);
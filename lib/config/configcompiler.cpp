@@ -7,6 +7,8 @@
 #include "base/loader.hpp"
 #include "base/context.hpp"
 #include "base/exception.hpp"
+#include "base/configuration.hpp"
+#include "base/workqueue.hpp"
 #include <fstream>
 
 using namespace icinga;
@@ -104,6 +106,57 @@ void ConfigCompiler::CollectIncludes(std::vector<std::unique_ptr<Expression> >&
 	}
 }
 
+/**
+ * Compiles the given files in parallel (the scanner and the parser don't share state)
+ * and appends their expressions in the order of the files.
+ *
+ * Files which can't be compiled are skipped just like by the single file variant.
+ */
+void ConfigCompiler::CollectIncludes(std::vector<std::unique_ptr<Expression> >& expressions,
+	const std::vector<String>& files, const String& zone, const String& package)
+{
+	if (files.size() < 2u || Configuration::Concurrency < 2) {
+		for (const String& file : files)
+			CollectIncludes(expressions, file, zone, package);
+
+		return;
+	}
+
+	std::vector<std::vector<std::unique_ptr<Expression> > > compiled (files.size());
+
+	WorkQueue upq(25000, Configuration::Concurrency);
+	upq.SetName("ConfigCompiler::CollectIncludes");
+
+	for (size_t i = 0; i < files.size(); i++) {
+		upq.Enqueue([&compiled, &files, &zone, &package, i]() {
+			CollectIncludes(compiled[i], files[i], zone, package);
+		});
+	}
+
+	upq.Join();
+
+	for (auto& fileExpressions : compiled) {
+		for (auto& expression : fileExpressions)
+			expressions.emplace_back(std::move(expression));
+	}
+}
+
+/**
+ * Compiles all files below path matching pattern, see CollectIncludes().
+ *
+ * @returns The number of files found
+ */
+size_t ConfigCompiler::CollectIncludesRecursive(std::vector<std::unique_ptr<Expression> >& expressions,
+	const String& path, const String& pattern, const String& zone, const String& package)
+{
+	std::vector<String> files;
+	Utility::GlobRecursive(path, pattern, [&files](const String& file) { files.emplace_back(file); }, GlobFile);
+
+	CollectIncludes(expressions, files, zone, package);
+
+	return files.size();
+}
+
 /**
  * Handles an include directive.
  *
@@ -137,7 +190,7 @@ std::unique_ptr<Expression> ConfigCompiler::HandleInclude(const String& relative
 
 	std::vector<std::unique_ptr<Expression> > expressions;
 
-	if (!Utility::Glob(includePath, std::bind(&ConfigCompiler::CollectIncludes, std::ref(expressions), _1, zone, package), GlobFile) && includePath.FindFirstOf("*?") == String::NPos) {
+	if (!Utility::Glob(includePath, [&expressions, &zone, &package](const String& file) { CollectIncludes(expressions, file, zone, package); }, GlobFile) && includePath.FindFirstOf("*?") == String::NPos) {
 		std::ostringstream msgbuf;
 		msgbuf << "Include file '" + path + "' does not exist";
 		BOOST_THROW_EXCEPTION(ScriptError(msgbuf.str(), debuginfo));
@@ -167,7 +220,7 @@ std::unique_ptr<Expression> ConfigCompiler::HandleIncludeRecursive(const String&
 		ppath = relativeBase + "/" + path;
 
 	std::vector<std::unique_ptr<Expression> > expressions;
-	Utility::GlobRecursive(ppath, pattern, std::bind(&ConfigCompiler::CollectIncludes, std::ref(expressions), _1, zone, package), GlobFile);
+	CollectIncludesRecursive(expressions, ppath, pattern, zone, package);
 
 	std::unique_ptr<DictExpression> dict{new DictExpression(std::move(expressions))};
 	dict->MakeInline();
@@ -187,7 +240,7 @@ void ConfigCompiler::HandleIncludeZone(const String& relativeBase, const String&
 
 	RegisterZoneDir(tag, ppath, zoneName);
 
-	Utility::GlobRecursive(ppath, pattern, std::bind(&ConfigCompiler::CollectIncludes, std::ref(expressions), _1, zoneName, package), GlobFile);
+	CollectIncludesRecursive(expressions, ppath, pattern, zoneName, package);
 }
 
 /**
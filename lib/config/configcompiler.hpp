@@ -98,6 +98,10 @@ public:
 
 	static void CollectIncludes(std::vector<std::unique_ptr<Expression> >& expressions,
 		const String& file, const String& zone, const String& package);
+	static void CollectIncludes(std::vector<std::unique_ptr<Expression> >& expressions,
+		const std::vector<String>& files, const String& zone, const String& package);
+	static size_t CollectIncludesRecursive(std::vector<std::unique_ptr<Expression> >& expressions,
+		const String& path, const String& pattern, const String& zone, const String& package);
 
 	static std::unique_ptr<Expression> HandleInclude(const String& relativeBase, const String& path, bool search,
 		const String& zone, const String& package, const DebugInfo& debuginfo = DebugInfo());
@@ -231,10 +231,11 @@ ConfigObject::Ptr ConfigItem::Commit(bool discard)
 			BOOST_THROW_EXCEPTION(std::runtime_error("Could not determine name for object"));
 	}
 
+	/* Names are copied into many other objects (e.g. check results, API events). */
 	if (name != item_name)
-		dobj->SetShortName(item_name);
+		dobj->SetShortName(item_name.Intern(StringOriginObjectName));
 
-	dobj->SetName(name);
+	dobj->SetName(name.Intern(StringOriginObjectName));
 
 	Dictionary::Ptr dhint = debugHints.ToDictionary();
 
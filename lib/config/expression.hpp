@@ -283,6 +283,16 @@ public:
 		: DebuggableExpression(debugInfo), m_Operand1(std::move(operand1)), m_Operand2(std::move(operand2))
 	{ }
 
+	const std::unique_ptr<Expression>& GetOperand1() const
+	{
+		return m_Operand1;
+	}
+
+	const std::unique_ptr<Expression>& GetOperand2() const
+	{
+		return m_Operand2;
+	}
+
 protected:
 	std::unique_ptr<Expression> m_Operand1;
 	std::unique_ptr<Expression> m_Operand2;
@@ -596,6 +606,11 @@ public:
 		: DebuggableExpression(debugInfo), m_Expressions(std::move(expressions))
 	{ }
 
+	const std::vector<std::unique_ptr<Expression> >& GetExpressions() const
+	{
+		return m_Expressions;
+	}
+
 protected:
 	ExpressionResult DoEvaluate(ScriptFrame& frame, DebugHint *dhint) const override;
 
@@ -45,8 +45,8 @@ void DbConnection::Start(bool runtimeCreated)
 	Log(LogInformation, "DbConnection")
 		<< "'" << GetName() << "' started.";
 
-	DbObject::OnQuery.connect(std::bind(&DbConnection::ExecuteQuery, this, _1));
-	DbObject::OnMultipleQueries.connect(std::bind(&DbConnection::ExecuteMultipleQueries, this, _1));
+	DbObject::OnQuery.connect(std::bind(&DbConnection::QueryHandler, this, _1));
+	DbObject::OnMultipleQueries.connect(std::bind(&DbConnection::MultipleQueriesHandler, this, _1));
 }
 
 void DbConnection::Stop(bool runtimeRemoved)
@@ -80,6 +80,9 @@ void DbConnection::Resume()
 
 void DbConnection::Pause()
 {
+	/* Write pending status updates while queries are still accepted. */
+	FlushStatusUpdates();
+
 	ConfigObject::Pause();
 
 	Log(LogInformation, "DbConnection")
@@ -493,6 +496,134 @@ int DbConnection::GetQueryCount(RingBuffer::SizeType span)
 	return m_QueryStats.UpdateAndGetValues(Utility::GetTime(), span);
 }
 
+void DbConnection::QueryHandler(const DbQuery& query)
+{
+	if (!CoalesceStatusUpdate(query))
+		ExecuteQuery(query);
+}
+
+void DbConnection::MultipleQueriesHandler(const std::vector<DbQuery>& queries)
+{
+	std::vector<DbQuery> remaining;
+
+	for (const DbQuery& query : queries) {
+		if (!CoalesceStatusUpdate(query))
+			remaining.push_back(query);
+	}
+
+	if (!remaining.empty())
+		ExecuteMultipleQueries(remaining);
+}
+
+/**
+ * Holds back a status update until the next transaction is started.
+ * Status updates for the same row which arrive in the meantime are merged
+ * into the pending one, so only the latest value of each column is written.
+ *
+ * @param query The query.
+ * @returns Whether the query was held back.
+ */
+bool DbConnection::CoalesceStatusUpdate(const DbQuery& query)
+{
+	if (!query.StatusUpdate || !query.Object || !(query.Type & DbQueryUpdate) || (query.Type & DbQueryDelete))
+		return false;
+
+	if (query.NotificationInsertID || IsPaused())
+		return false;
+
+	DbQuery previous;
+
+	{
+		boost::mutex::scoped_lock lock(m_PendingStatusUpdatesMutex);
+
+		auto key = std::make_pair(query.Table, query.Object);
+		auto it = m_PendingStatusUpdates.find(key);
+
+		if (it == m_PendingStatusUpdates.end()) {
+			m_PendingStatusUpdates.emplace(std::move(key), query);
+			return true;
+		}
+
+		DbQuery& pending = it->second;
+
+		if (pending.Category == query.Category) {
+			/* The query's fields may be shared with other connections. */
+			Dictionary::Ptr fields = pending.Fields->ShallowClone();
+			query.Fields->CopyTo(fields);
+			pending.Fields = fields;
+
+			if (query.WhereCriteria) {
+				Dictionary::Ptr where = pending.WhereCriteria ? pending.WhereCriteria->ShallowClone() : new Dictionary();
+				query.WhereCriteria->CopyTo(where);
+				pending.WhereCriteria = where;
+			}
+
+			/* An upsert stays an upsert. */
+			pending.Type |= query.Type;
+
+			if (query.Priority > pending.Priority)
+				pending.Priority = query.Priority;
+
+			lock.unlock();
+
+			boost::mutex::scoped_lock statsLock(m_StatsMutex);
+			m_CoalescedStatusUpdateStats.InsertValue(Utility::GetTime(), 1);
+
+			return true;
+		}
+
+		/* Queries of different categories are subject to different filters,
+		 * write the pending one first. */
+		previous = std::move(pending);
+		pending = query;
+	}
+
+	{
+		boost::mutex::scoped_lock statsLock(m_StatsMutex);
+		m_EmittedStatusUpdateStats.InsertValue(Utility::GetTime(), 1);
+	}
+
+	ExecuteQuery(previous);
+
+	return true;
+}
+
+/**
+ * Writes all pending status updates. Called right before a new transaction is started.
+ */
+void DbConnection::FlushStatusUpdates()
+{
+	std::map<std::pair<String, DbObject::Ptr>, DbQuery> pending;
+
+	{
+		boost::mutex::scoped_lock lock(m_PendingStatusUpdatesMutex);
+		pending.swap(m_PendingStatusUpdates);
+	}
+
+	if (pending.empty())
+		return;
+
+	{
+		boost::mutex::scoped_lock statsLock(m_StatsMutex);
+		m_EmittedStatusUpdateStats.InsertValue(Utility::GetTime(), static_cast<int>(pending.size()));
+	}
+
+	for (auto& kv : pending)
+		ExecuteQuery(kv.second);
+}
+
+int DbConnection::GetCoalescedStatusUpdateCount(RingBuffer::SizeType span)
+{
+	boost::mutex::scoped_lock lock(m_StatsMutex);
+	return m_CoalescedStatusUpdateStats.UpdateAndGetValues(Utility::GetTime(), span);
+}
+
+int DbConnection::GetEmittedStatusUpdateCount(RingBuffer::SizeType span)
+{
+	boost::mutex::scoped_lock lock(m_StatsMutex);
+	return m_EmittedStatusUpdateStats.UpdateAndGetValues(Utility::GetTime(), span);
+}
+
 bool DbConnection::IsIDCacheValid() const
 {
 	return m_IDCacheValid;
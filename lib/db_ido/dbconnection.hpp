@@ -57,6 +57,9 @@ public:
 	int GetQueryCount(RingBuffer::SizeType span);
 	virtual int GetPendingQueryCount() const = 0;
 
+	int GetCoalescedStatusUpdateCount(RingBuffer::SizeType span);
+	int GetEmittedStatusUpdateCount(RingBuffer::SizeType span);
+
 	void ValidateFailoverTimeout(const Lazy<double>& lvalue, const ValidationUtils& utils) final;
 	void ValidateCategories(const Lazy<Array::Ptr>& lvalue, const ValidationUtils& utils) final;
 
@@ -83,6 +86,9 @@ protected:
 
 	void IncreaseQueryCount();
 
+	bool CoalesceStatusUpdate(const DbQuery& query);
+	void FlushStatusUpdates();
+
 	bool IsIDCacheValid() const;
 	void SetIDCacheValid(bool valid);
 
@@ -102,8 +108,14 @@ private:
 	std::set<DbObject::Ptr> m_StatusUpdates;
 	Timer::Ptr m_CleanUpTimer;
 
+	boost::mutex m_PendingStatusUpdatesMutex;
+	std::map<std::pair<String, DbObject::Ptr>, DbQuery> m_PendingStatusUpdates;
+
 	void CleanUpHandler();
 
+	void QueryHandler(const DbQuery& query);
+	void MultipleQueriesHandler(const std::vector<DbQuery>& queries);
+
 	static Timer::Ptr m_ProgramStatusTimer;
 	static boost::once_flag m_OnceFlag;
 
@@ -111,6 +123,8 @@ private:
 
 	mutable boost::mutex m_StatsMutex;
 	RingBuffer m_QueryStats{15 * 60};
+	RingBuffer m_CoalescedStatusUpdateStats{15 * 60};
+	RingBuffer m_EmittedStatusUpdateStats{15 * 60};
 	bool m_ActiveChangedHandler{false};
 };
 
@@ -55,7 +55,6 @@ void DbEvents::StaticInitialize()
 
 	Checkable::OnStateChange.connect(std::bind(&DbEvents::AddStateChangeHistory, _1, _2, _3));
 
-	Checkable::OnNewCheckResult.connect(std::bind(&DbEvents::AddCheckResultLogHistory, _1, _2));
 	Checkable::OnNotificationSentToUser.connect(std::bind(&DbEvents::AddNotificationSentLogHistory, _1, _2, _3, _4, _5, _6, _7));
 	Checkable::OnFlappingChanged.connect(std::bind(&DbEvents::AddFlappingChangedLogHistory, _1));
 	Checkable::OnEnableFlappingChanged.connect(std::bind(&DbEvents::AddEnableFlappingChangedLogHistory, _1));
@@ -64,7 +63,12 @@ void DbEvents::StaticInitialize()
 
 	Checkable::OnFlappingChanged.connect(std::bind(&DbEvents::AddFlappingChangedHistory, _1));
 	Checkable::OnEnableFlappingChanged.connect(std::bind(&DbEvents::AddEnableFlappingChangedHistory, _1));
-	Checkable::OnNewCheckResult.connect(std::bind(&DbEvents::AddCheckableCheckHistory, _1, _2));
+	Checkable::OnNewCheckResult.Subscribe("DbEvents", [](const std::vector<CheckResultEvent>& events) {
+		for (const CheckResultEvent& event : events) {
+			DbEvents::AddCheckResultLogHistory(event);
+			DbEvents::AddCheckableCheckHistory(event);
+		}
+	});
 
 	Checkable::OnEventCommandExecuted.connect(std::bind(&DbEvents::AddEventHandlerHistory, _1));
 
@@ -911,8 +915,11 @@ void DbEvents::AddStateChangeHistory(const Checkable::Ptr& checkable, const Chec
 }
 
 /* logentries */
-void DbEvents::AddCheckResultLogHistory(const Checkable::Ptr& checkable, const CheckResult::Ptr &cr)
+void DbEvents::AddCheckResultLogHistory(const CheckResultEvent& event)
 {
+	const Checkable::Ptr& checkable = event.Source;
+	const CheckResult::Ptr& cr = event.Result;
+
 	if (!cr)
 		return;
 
@@ -934,19 +941,24 @@ void DbEvents::AddCheckResultLogHistory(const Checkable::Ptr& checkable, const C
 	Service::Ptr service;
 	tie(host, service) = GetHostService(checkable);
 
+	/* The event carries the state at the time the check result was processed,
+	 * the checkable itself may already have moved on. */
+	HostState hostState = Host::CalculateState(event.State);
+	bool unreachable = hostState != HostUp && !event.Reachable;
+
 	std::ostringstream msgbuf;
 
 	if (service) {
 		msgbuf << "SERVICE ALERT: "
 			<< host->GetName() << ";"
 			<< service->GetShortName() << ";"
-			<< Service::StateToString(service->GetState()) << ";"
-			<< Service::StateTypeToString(service->GetStateType()) << ";"
-			<< service->GetCheckAttempt() << ";"
+			<< Service::StateToString(event.State) << ";"
+			<< Service::StateTypeToString(event.Type) << ";"
+			<< event.CheckAttempt << ";"
 			<< output << ""
 			<< "";
 
-		switch (service->GetState()) {
+		switch (event.State) {
 			case ServiceOK:
 				type = LogEntryTypeServiceOk;
 				break;
@@ -961,19 +973,19 @@ void DbEvents::AddCheckResultLogHistory(const Checkable::Ptr& checkable, const C
 				break;
 			default:
 				Log(LogCritical, "DbEvents")
-					<< "Unknown service state: " << service->GetState();
+					<< "Unknown service state: " << event.State;
 				return;
 		}
 	} else {
 		msgbuf << "HOST ALERT: "
 			<< host->GetName() << ";"
-			<< GetHostStateString(host) << ";"
-			<< Host::StateTypeToString(host->GetStateType()) << ";"
-			<< host->GetCheckAttempt() << ";"
+			<< (unreachable ? "UNREACHABLE" : Host::StateToString(hostState)) << ";"
+			<< Host::StateTypeToString(event.Type) << ";"
+			<< event.CheckAttempt << ";"
 			<< output << ""
 			<< "";
 
-		switch (host->GetState()) {
+		switch (hostState) {
 			case HostUp:
 				type = LogEntryTypeHostUp;
 				break;
@@ -982,11 +994,11 @@ void DbEvents::AddCheckResultLogHistory(const Checkable::Ptr& checkable, const C
 				break;
 			default:
 				Log(LogCritical, "DbEvents")
-					<< "Unknown host state: " << host->GetState();
+					<< "Unknown host state: " << hostState;
 				return;
 		}
 
-		if (!host->IsReachable())
+		if (!event.Reachable)
 			type = LogEntryTypeHostUnreachable;
 	}
 
@@ -1295,8 +1307,11 @@ void DbEvents::AddEnableFlappingChangedHistory(const Checkable::Ptr& checkable)
 }
 
 /* servicechecks */
-void DbEvents::AddCheckableCheckHistory(const Checkable::Ptr& checkable, const CheckResult::Ptr& cr)
+void DbEvents::AddCheckableCheckHistory(const CheckResultEvent& event)
 {
+	const Checkable::Ptr& checkable = event.Source;
+	const CheckResult::Ptr& cr = event.Result;
+
 	if (!cr)
 		return;
 
@@ -1310,10 +1325,10 @@ void DbEvents::AddCheckableCheckHistory(const Checkable::Ptr& checkable, const C
 	query1.Category = DbCatCheck;
 
 	Dictionary::Ptr fields1 = new Dictionary();
-	fields1->Set("check_type", !checkable->GetEnableActiveChecks()); /* 0 .. active, 1 .. passive */
-	fields1->Set("current_check_attempt", checkable->GetCheckAttempt());
-	fields1->Set("max_check_attempts", checkable->GetMaxCheckAttempts());
-	fields1->Set("state_type", checkable->GetStateType());
+	fields1->Set("check_type", !event.ActiveChecksEnabled); /* 0 .. active, 1 .. passive */
+	fields1->Set("current_check_attempt", event.CheckAttempt);
+	fields1->Set("max_check_attempts", event.MaxCheckAttempts);
+	fields1->Set("state_type", event.Type);
 
 	double start = cr->GetExecutionStart();
 	double end = cr->GetExecutionEnd();
@@ -1339,10 +1354,16 @@ void DbEvents::AddCheckableCheckHistory(const Checkable::Ptr& checkable, const C
 
 	if (service) {
 		fields1->Set("service_object_id", service);
-		fields1->Set("state", service->GetState());
+		fields1->Set("state", event.State);
 	} else {
 		fields1->Set("host_object_id", host);
-		fields1->Set("state", GetHostState(host));
+
+		HostState hostState = Host::CalculateState(event.State);
+
+		if (hostState != HostUp && !event.Reachable)
+			fields1->Set("state", 2); /* hardcoded compat state */
+		else
+			fields1->Set("state", hostState);
 	}
 
 	Endpoint::Ptr endpoint = Endpoint::GetByName(IcingaApplication::GetInstance()->GetNodeName());
@@ -90,7 +90,7 @@ public:
 	static void AddStateChangeHistory(const Checkable::Ptr& checkable, const CheckResult::Ptr& cr, StateType type);
 
 	/* logentries */
-	static void AddCheckResultLogHistory(const Checkable::Ptr& checkable, const CheckResult::Ptr &cr);
+	static void AddCheckResultLogHistory(const CheckResultEvent& event);
 	static void AddTriggerDowntimeLogHistory(const Downtime::Ptr& downtime);
 	static void AddRemoveDowntimeLogHistory(const Downtime::Ptr& downtime);
 	static void AddNotificationSentLogHistory(const Notification::Ptr& notification, const Checkable::Ptr& checkable,
@@ -103,7 +103,7 @@ public:
 	/* other history */
 	static void AddFlappingChangedHistory(const Checkable::Ptr& checkable);
 	static void AddEnableFlappingChangedHistory(const Checkable::Ptr& checkable);
-	static void AddCheckableCheckHistory(const Checkable::Ptr& checkable, const CheckResult::Ptr &cr);
+	static void AddCheckableCheckHistory(const CheckResultEvent& event);
 	static void AddEventHandlerHistory(const Checkable::Ptr& checkable);
 	static void AddExternalCommandHistory(double time, const String& command, const std::vector<String>& arguments);
 
@@ -42,13 +42,17 @@ void IdoMysqlConnection::StatsFunc(const Dictionary::Ptr& status, const Array::P
 	for (const IdoMysqlConnection::Ptr& idomysqlconnection : ConfigType::GetObjectsByType<IdoMysqlConnection>()) {
 		size_t queryQueueItems = idomysqlconnection->m_QueryQueue.GetLength();
 		double queryQueueItemRate = idomysqlconnection->m_QueryQueue.GetTaskCount(60) / 60.0;
+		int statusUpdatesCoalesced = idomysqlconnection->GetCoalescedStatusUpdateCount(60);
+		int statusUpdatesEmitted = idomysqlconnection->GetEmittedStatusUpdateCount(60);
 
 		nodes.emplace_back(idomysqlconnection->GetName(), new Dictionary({
 			{ "version", idomysqlconnection->GetSchemaVersion() },
 			{ "instance_name", idomysqlconnection->GetInstanceName() },
 			{ "connected", idomysqlconnection->GetConnected() },
 			{ "query_queue_items", queryQueueItems },
-			{ "query_queue_item_rate", queryQueueItemRate }
+			{ "query_queue_item_rate", queryQueueItemRate },
+			{ "status_updates_coalesced_1min", statusUpdatesCoalesced },
+			{ "status_updates_emitted_1min", statusUpdatesEmitted }
 		}));
 
 		perfdata->Add(new PerfdataValue("idomysqlconnection_" + idomysqlconnection->GetName() + "_queries_rate", idomysqlconnection->GetQueryCount(60) / 60.0));
@@ -57,6 +61,8 @@ void IdoMysqlConnection::StatsFunc(const Dictionary::Ptr& status, const Array::P
 		perfdata->Add(new PerfdataValue("idomysqlconnection_" + idomysqlconnection->GetName() + "_queries_15mins", idomysqlconnection->GetQueryCount(15 * 60)));
 		perfdata->Add(new PerfdataValue("idomysqlconnection_" + idomysqlconnection->GetName() + "_query_queue_items", queryQueueItems));
 		perfdata->Add(new PerfdataValue("idomysqlconnection_" + idomysqlconnection->GetName() + "_query_queue_item_rate", queryQueueItemRate));
+		perfdata->Add(new PerfdataValue("idomysqlconnection_" + idomysqlconnection->GetName() + "_status_updates_coalesced_1min", statusUpdatesCoalesced));
+		perfdata->Add(new PerfdataValue("idomysqlconnection_" + idomysqlconnection->GetName() + "_status_updates_emitted_1min", statusUpdatesEmitted));
 	}
 
 	status->Set("idomysqlconnection", new Dictionary(std::move(nodes)));
@@ -151,6 +157,7 @@ void IdoMysqlConnection::Disconnect()
 
 void IdoMysqlConnection::TxTimerHandler()
 {
+	FlushStatusUpdates();
 	NewTransaction();
 }
 
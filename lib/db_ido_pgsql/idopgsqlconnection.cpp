@@ -14,14 +14,26 @@
 #include "base/exception.hpp"
 #include "base/context.hpp"
 #include "base/statsfunction.hpp"
+#include <boost/exception/errinfo_api_function.hpp>
+#include <boost/exception/errinfo_errno.hpp>
 #include <utility>
 
+#ifndef _WIN32
+#	include <poll.h>
+#endif /* _WIN32 */
+
 using namespace icinga;
 
 REGISTER_TYPE(IdoPgsqlConnection);
 
 REGISTER_STATSFUNCTION(IdoPgsqlConnection, &IdoPgsqlConnection::StatsFunc);
 
+/* Upper bound for the size of the statements which are sent in one round trip. */
+static const size_t l_MaxPipelineBytes = 1024 * 1024;
+
+/* Upper bound for the number of prepared statements per connection. */
+static const size_t l_MaxPreparedStatements = 256;
+
 IdoPgsqlConnection::IdoPgsqlConnection()
 {
 	m_QueryQueue.SetName("IdoPgsqlConnection, " + GetName());
@@ -49,21 +61,32 @@ void IdoPgsqlConnection::StatsFunc(const Dictionary::Ptr& status, const Array::P
 	for (const IdoPgsqlConnection::Ptr& idopgsqlconnection : ConfigType::GetObjectsByType<IdoPgsqlConnection>()) {
 		size_t queryQueueItems = idopgsqlconnection->m_QueryQueue.GetLength();
 		double queryQueueItemRate = idopgsqlconnection->m_QueryQueue.GetTaskCount(60) / 60.0;
+		int statusUpdatesCoalesced = idopgsqlconnection->GetCoalescedStatusUpdateCount(60);
+		int statusUpdatesEmitted = idopgsqlconnection->GetEmittedStatusUpdateCount(60);
+		double queryRate = idopgsqlconnection->GetQueryCount(60) / 60.0;
+		double pipelineDepth = idopgsqlconnection->m_PipelineDepth;
 
 		nodes.emplace_back(idopgsqlconnection->GetName(), new Dictionary({
 			{ "version", idopgsqlconnection->GetSchemaVersion() },
 			{ "instance_name", idopgsqlconnection->GetInstanceName() },
 			{ "connected", idopgsqlconnection->GetConnected() },
 			{ "query_queue_items", queryQueueItems },
-			{ "query_queue_item_rate", queryQueueItemRate }
+			{ "query_queue_item_rate", queryQueueItemRate },
+			{ "status_updates_coalesced_1min", statusUpdatesCoalesced },
+			{ "status_updates_emitted_1min", statusUpdatesEmitted },
+			{ "query_rate", queryRate },
+			{ "pipeline_depth", pipelineDepth }
 		}));
 
-		perfdata->Add(new PerfdataValue("idopgsqlconnection_" + idopgsqlconnection->GetName() + "_queries_rate", idopgsqlconnection->GetQueryCount(60) / 60.0));
+		perfdata->Add(new PerfdataValue("idopgsqlconnection_" + idopgsqlconnection->GetName() + "_queries_rate", queryRate));
 		perfdata->Add(new PerfdataValue("idopgsqlconnection_" + idopgsqlconnection->GetName() + "_queries_1min", idopgsqlconnection->GetQueryCount(60)));
 		perfdata->Add(new PerfdataValue("idopgsqlconnection_" + idopgsqlconnection->GetName() + "_queries_5mins", idopgsqlconnection->GetQueryCount(5 * 60)));
 		perfdata->Add(new PerfdataValue("idopgsqlconnection_" + idopgsqlconnection->GetName() + "_queries_15mins", idopgsqlconnection->GetQueryCount(15 * 60)));
 		perfdata->Add(new PerfdataValue("idopgsqlconnection_" + idopgsqlconnection->GetName() + "_query_queue_items", queryQueueItems));
 		perfdata->Add(new PerfdataValue("idopgsqlconnection_" + idopgsqlconnection->GetName() + "_query_queue_item_rate", queryQueueItemRate));
+		perfdata->Add(new PerfdataValue("idopgsqlconnection_" + idopgsqlconnection->GetName() + "_status_updates_coalesced_1min", statusUpdatesCoalesced));
+		perfdata->Add(new PerfdataValue("idopgsqlconnection_" + idopgsqlconnection->GetName() + "_status_updates_emitted_1min", statusUpdatesEmitted));
+		perfdata->Add(new PerfdataValue("idopgsqlconnection_" + idopgsqlconnection->GetName() + "_pipeline_depth", pipelineDepth));
 	}
 
 	status->Set("idopgsqlconnection", new Dictionary(std::move(nodes)));
@@ -112,6 +135,56 @@ void IdoPgsqlConnection::Pause()
 		<< "'" << GetName() << "' paused.";
 }
 
+/**
+ * Replaces the libpq shim and treats the given connection as established.
+ *
+ * @param pgsql The interface, the connection takes ownership of it.
+ * @param connection The handle passed to the interface.
+ */
+void IdoPgsqlConnection::SetPgsqlInterface(PgsqlInterface *pgsql, PGconn *connection)
+{
+	m_Pgsql.reset(pgsql);
+	m_Connection = connection;
+
+	m_QueryQueue.SetExceptionCallback(std::bind(&IdoPgsqlConnection::ExceptionHandler, this, _1));
+
+	SetConnected(true);
+}
+
+/**
+ * Queues the statements, sends them to the server and waits until all
+ * of them have been processed.
+ *
+ * @param queries The statements.
+ */
+void IdoPgsqlConnection::ExecuteAsyncQueries(const std::vector<IdoPgsqlAsyncQuery>& queries)
+{
+	m_QueryQueue.Enqueue([this, queries]() {
+		for (const IdoPgsqlAsyncQuery& aq : queries)
+			AsyncQuery(aq.Query, aq.Callback);
+
+		FinishAsyncQueries();
+	});
+
+	m_QueryQueue.Join();
+}
+
+/**
+ * Queues the queries, sends each one to the server on its own and waits
+ * until all of them have been processed.
+ *
+ * @param queries The queries.
+ */
+void IdoPgsqlConnection::ExecuteQueries(const std::vector<DbQuery>& queries)
+{
+	for (const DbQuery& query : queries) {
+		ExecuteQuery(query);
+		m_QueryQueue.Enqueue(std::bind(&IdoPgsqlConnection::FinishAsyncQueries, this), query.Priority, true);
+	}
+
+	m_QueryQueue.Join();
+}
+
 void IdoPgsqlConnection::ExceptionHandler(boost::exception_ptr exp)
 {
 	Log(LogWarning, "IdoPgsqlConnection", "Exception during database operation: Verify that your database is operational!");
@@ -148,6 +221,7 @@ void IdoPgsqlConnection::Disconnect()
 
 void IdoPgsqlConnection::TxTimerHandler()
 {
+	FlushStatusUpdates();
 	NewTransaction();
 }
 
@@ -157,6 +231,7 @@ void IdoPgsqlConnection::NewTransaction()
 		return;
 
 	m_QueryQueue.Enqueue(std::bind(&IdoPgsqlConnection::InternalNewTransaction, this), PriorityNormal, true);
+	m_QueryQueue.Enqueue(std::bind(&IdoPgsqlConnection::FinishAsyncQueries, this), PriorityNormal, true);
 }
 
 void IdoPgsqlConnection::InternalNewTransaction()
@@ -166,8 +241,8 @@ void IdoPgsqlConnection::InternalNewTransaction()
 	if (!GetConnected())
 		return;
 
-	Query("COMMIT");
-	Query("BEGIN");
+	AsyncQuery("COMMIT");
+	AsyncQuery("BEGIN");
 }
 
 void IdoPgsqlConnection::ReconnectTimerHandler()
@@ -202,6 +277,10 @@ void IdoPgsqlConnection::Reconnect()
 
 	ClearIDCache();
 
+	/* Neither queued statements nor prepared statements survive the old connection. */
+	m_AsyncQueries.clear();
+	m_PreparedStatements.clear();
+
 	String host = GetHost();
 	String port = GetPort();
 	String user = GetUser();
@@ -255,6 +334,9 @@ void IdoPgsqlConnection::Reconnect()
 
 	SetConnected(true);
 
+	if (GetEnablePipelining())
+		m_Pgsql->setnonblocking(m_Connection, 1);
+
 	IdoPgsqlResult result;
 
 	/* explicitely require legacy mode for string escaping in PostgreSQL >= 9.1
@@ -464,13 +546,26 @@ IdoPgsqlResult IdoPgsqlConnection::Query(const String& query)
 {
 	AssertOnWorkQueue();
 
+	/* finish all async queries to maintain the right order for queries */
+	FinishAsyncQueries();
+
 	Log(LogDebug, "IdoPgsqlConnection")
 		<< "Query: " << query;
 
 	IncreaseQueryCount();
 
-	PGresult *result = m_Pgsql->exec(m_Connection, query.CStr());
+	return HandleResult(m_Pgsql->exec(m_Connection, query.CStr()), query);
+}
 
+/**
+ * Checks the result of a single statement and takes ownership of it.
+ *
+ * @param result The result as returned by libpq.
+ * @param query The statement which produced the result, used for error messages.
+ * @returns The result if the statement returned any rows, an empty pointer otherwise.
+ */
+IdoPgsqlResult IdoPgsqlConnection::HandleResult(PGresult *result, const String& query)
+{
 	if (!result) {
 		String message = m_Pgsql->errorMessage(m_Connection);
 		Log(LogCritical, "IdoPgsqlConnection")
@@ -508,6 +603,218 @@ IdoPgsqlResult IdoPgsqlConnection::Query(const String& query)
 	return IdoPgsqlResult(result, std::bind(&PgsqlInterface::clear, std::cref(m_Pgsql), _1));
 }
 
+/**
+ * Executes a statement whose result isn't needed right away. With pipelining
+ * enabled the statement is queued and sent to the server together with other
+ * queued statements; otherwise it's executed immediately.
+ *
+ * @param query The statement.
+ * @param callback Invoked with the statement's result.
+ */
+void IdoPgsqlConnection::AsyncQuery(const String& query, const IdoPgsqlAsyncCallback& callback)
+{
+	AssertOnWorkQueue();
+
+	if (!GetEnablePipelining()) {
+		IdoPgsqlResult result = Query(query);
+
+		if (callback)
+			callback(result);
+
+		return;
+	}
+
+	IdoPgsqlAsyncQuery aq;
+	aq.Query = query;
+	/* XXX: Important: The callback may queue further statements, but must not wait for their results! */
+	aq.Callback = callback;
+	m_AsyncQueries.emplace_back(std::move(aq));
+
+	/* Results are still being fetched while the callbacks run. */
+	if (m_AsyncQueries.size() > 25000 && !m_FinishingAsyncQueries) {
+		FinishAsyncQueries();
+		InternalNewTransaction();
+	}
+}
+
+void IdoPgsqlConnection::FinishAsyncQueries()
+{
+	AssertOnWorkQueue();
+
+	std::vector<IdoPgsqlAsyncQuery> queries;
+	m_AsyncQueries.swap(queries);
+
+	if (!GetConnected())
+		return;
+
+	m_FinishingAsyncQueries = true;
+
+	std::vector<IdoPgsqlAsyncQuery>::size_type offset = 0;
+
+	while (offset < queries.size()) {
+		std::ostringstream querybuf;
+
+		std::vector<IdoPgsqlAsyncQuery>::size_type count = 0;
+		size_t num_bytes = 0;
+
+		for (std::vector<IdoPgsqlAsyncQuery>::size_type i = offset; i < queries.size(); i++) {
+			const IdoPgsqlAsyncQuery& aq = queries[i];
+
+			size_t size_query = aq.Query.GetLength() + 1;
+
+			if (count > 0) {
+				if (num_bytes + size_query > l_MaxPipelineBytes)
+					break;
+
+				querybuf << ";";
+			}
+
+			IncreaseQueryCount();
+			count++;
+
+			Log(LogDebug, "IdoPgsqlConnection")
+				<< "Query: " << aq.Query;
+
+			querybuf << aq.Query;
+			num_bytes += size_query;
+		}
+
+		String query = querybuf.str();
+
+		if (!m_Pgsql->sendQuery(m_Connection, query.CStr())) {
+			String message = m_Pgsql->errorMessage(m_Connection);
+			Log(LogCritical, "IdoPgsqlConnection")
+				<< "Error \"" << message << "\" when executing query \"" << query << "\"";
+
+			BOOST_THROW_EXCEPTION(
+				database_error()
+				<< errinfo_message(message)
+				<< errinfo_database_query(query)
+			);
+		}
+
+		FlushConnection(query);
+
+		m_PipelineDepth = m_PipelineDepth * 0.95 + count * 0.05;
+
+		/* libpq expects PQgetResult() to be called until it returns a null pointer. */
+		auto discardResults ([this]() {
+			while (PGresult *result = m_Pgsql->getResult(m_Connection))
+				m_Pgsql->clear(result);
+		});
+
+		/* The server returns one result per statement, in order. */
+		std::vector<IdoPgsqlAsyncQuery>::size_type i = offset;
+
+		try {
+			for (; i < offset + count; i++) {
+				const IdoPgsqlAsyncQuery& aq = queries[i];
+
+				IdoPgsqlResult result = HandleResult(m_Pgsql->getResult(m_Connection), aq.Query);
+
+				if (aq.Callback)
+					aq.Callback(result);
+			}
+		} catch (const std::exception&) {
+			/* The server skips the rest of a query string after an error and the transaction
+			 * is aborted, so neither the remaining statements of this batch nor the ones not
+			 * sent yet can succeed. They're dropped; the exception handler closes the
+			 * connection and Reconnect() resynchronizes all objects. */
+			discardResults();
+
+			Log(LogCritical, "IdoPgsqlConnection")
+				<< "Discarding " << (queries.size() - i - 1) << " pipelined queries after the failed one.";
+
+			m_FinishingAsyncQueries = false;
+
+			throw;
+		}
+
+		discardResults();
+
+		offset += count;
+	}
+
+	m_FinishingAsyncQueries = false;
+
+	/* Send the statements queued by the callbacks, e.g. for upserts which didn't find a row to update. */
+	if (!m_AsyncQueries.empty())
+		FinishAsyncQueries();
+}
+
+/**
+ * Sends all data which libpq has buffered for a non-blocking connection.
+ * Waits for the socket to become writable in between and reads the server's
+ * responses meanwhile so that neither side blocks on a full buffer.
+ */
+void IdoPgsqlConnection::FlushConnection(const String& query)
+{
+	for (;;) {
+		int rc = m_Pgsql->flush(m_Connection);
+
+		if (rc == 0)
+			return;
+
+		if (rc < 0) {
+			String message = m_Pgsql->errorMessage(m_Connection);
+			Log(LogCritical, "IdoPgsqlConnection")
+				<< "Error \"" << message << "\" when sending query \"" << query << "\"";
+
+			BOOST_THROW_EXCEPTION(
+				database_error()
+				<< errinfo_message(message)
+				<< errinfo_database_query(query)
+			);
+		}
+
+		int fd = m_Pgsql->socket(m_Connection);
+		bool readable;
+
+#ifdef _WIN32
+		fd_set readfds, writefds;
+
+		FD_ZERO(&readfds);
+		FD_SET(fd, &readfds);
+
+		FD_ZERO(&writefds);
+		FD_SET(fd, &writefds);
+
+		if (select(fd + 1, &readfds, &writefds, nullptr, nullptr) < 0) {
+			BOOST_THROW_EXCEPTION(posix_error()
+				<< boost::errinfo_api_function("select")
+				<< errinfo_win32_error(WSAGetLastError()));
+		}
+
+		readable = FD_ISSET(fd, &readfds);
+#else /* _WIN32 */
+		pollfd pfd;
+		pfd.fd = fd;
+		pfd.events = POLLIN | POLLOUT;
+		pfd.revents = 0;
+
+		if (poll(&pfd, 1, -1) < 0 && errno != EINTR) {
+			BOOST_THROW_EXCEPTION(posix_error()
+				<< boost::errinfo_api_function("poll")
+				<< boost::errinfo_errno(errno));
+		}
+
+		readable = pfd.revents & POLLIN;
+#endif /* _WIN32 */
+
+		if (readable && !m_Pgsql->consumeInput(m_Connection)) {
+			String message = m_Pgsql->errorMessage(m_Connection);
+			Log(LogCritical, "IdoPgsqlConnection")
+				<< "Error \"" << message << "\" when sending query \"" << query << "\"";
+
+			BOOST_THROW_EXCEPTION(
+				database_error()
+				<< errinfo_message(message)
+				<< errinfo_database_query(query)
+			);
+		}
+	}
+}
+
 DbReference IdoPgsqlConnection::GetSequenceValue(const String& table, const String& column)
 {
 	AssertOnWorkQueue();
@@ -594,18 +901,22 @@ void IdoPgsqlConnection::InternalActivateObject(const DbObject::Ptr& dbobj)
 		if (!dbobj->GetName2().IsEmpty()) {
 			qbuf << "INSERT INTO " + GetTablePrefix() + "objects (instance_id, objecttype_id, name1, name2, is_active) VALUES ("
 				<< static_cast<long>(m_InstanceID) << ", " << dbobj->GetType()->GetTypeID() << ", "
-				<< "E'" << Escape(dbobj->GetName1()) << "', E'" << Escape(dbobj->GetName2()) << "', 1)";
+				<< "E'" << Escape(dbobj->GetName1()) << "', E'" << Escape(dbobj->GetName2()) << "', 1) RETURNING object_id";
 		} else {
 			qbuf << "INSERT INTO " + GetTablePrefix() + "objects (instance_id, objecttype_id, name1, is_active) VALUES ("
 				<< static_cast<long>(m_InstanceID) << ", " << dbobj->GetType()->GetTypeID() << ", "
-				<< "E'" << Escape(dbobj->GetName1()) << "', 1)";
+				<< "E'" << Escape(dbobj->GetName1()) << "', 1) RETURNING object_id";
 		}
 
-		Query(qbuf.str());
-		SetObjectID(dbobj, GetSequenceValue(GetTablePrefix() + "objects", "object_id"));
+		IdoPgsqlResult result = Query(qbuf.str());
+		Dictionary::Ptr row = FetchRow(result, 0);
+
+		ASSERT(row);
+
+		SetObjectID(dbobj, DbReference(Convert::ToLong(row->Get("object_id"))));
 	} else {
 		qbuf << "UPDATE " + GetTablePrefix() + "objects SET is_active = 1 WHERE object_id = " << static_cast<long>(dbref);
-		Query(qbuf.str());
+		AsyncQuery(qbuf.str());
 	}
 }
 
@@ -631,7 +942,7 @@ void IdoPgsqlConnection::InternalDeactivateObject(const DbObject::Ptr& dbobj)
 
 	std::ostringstream qbuf;
 	qbuf << "UPDATE " + GetTablePrefix() + "objects SET is_active = 0 WHERE object_id = " << static_cast<long>(dbref);
-	Query(qbuf.str());
+	AsyncQuery(qbuf.str());
 
 	/* Note that we're _NOT_ clearing the db refs via SetReference/SetConfigUpdate/SetStatusUpdate
 	 * because the object is still in the database. */
@@ -813,15 +1124,12 @@ void IdoPgsqlConnection::InternalExecuteQuery(const DbQuery& query, int typeOver
 		return;
 	}
 
-	std::ostringstream qbuf, where;
+	std::vector<std::pair<String, Value> > where, fields;
 	int type;
 
 	if (query.WhereCriteria) {
-		where << " WHERE ";
-
 		ObjectLock olock(query.WhereCriteria);
 		Value value;
-		bool first = true;
 
 		for (const Dictionary::Pair& kv : query.WhereCriteria) {
 			if (!FieldToEscapedString(kv.first, kv.second, &value)) {
@@ -829,13 +1137,7 @@ void IdoPgsqlConnection::InternalExecuteQuery(const DbQuery& query, int typeOver
 				return;
 			}
 
-			if (!first)
-				where << " AND ";
-
-			where << kv.first << " = " << value;
-
-			if (first)
-				first = false;
+			where.emplace_back(kv.first, value);
 		}
 	}
 
@@ -859,38 +1161,21 @@ void IdoPgsqlConnection::InternalExecuteQuery(const DbQuery& query, int typeOver
 		type = DbQueryUpdate;
 	}
 
-	if ((type & DbQueryInsert) && (type & DbQueryDelete)) {
-		std::ostringstream qdel;
-		qdel << "DELETE FROM " << GetTablePrefix() << query.Table << where.str();
-		Query(qdel.str());
+	bool deleteFirst = false;
 
+	if ((type & DbQueryInsert) && (type & DbQueryDelete)) {
+		deleteFirst = true;
 		type = DbQueryInsert;
 	}
 
-	switch (type) {
-		case DbQueryInsert:
-			qbuf << "INSERT INTO " << GetTablePrefix() << query.Table;
-			break;
-		case DbQueryUpdate:
-			qbuf << "UPDATE " << GetTablePrefix() << query.Table << " SET";
-			break;
-		case DbQueryDelete:
-			qbuf << "DELETE FROM " << GetTablePrefix() << query.Table;
-			break;
-		default:
-			VERIFY(!"Invalid query type.");
-	}
-
 	if (type == DbQueryInsert || type == DbQueryUpdate) {
-		std::ostringstream colbuf, valbuf;
-
 		if (type == DbQueryUpdate && query.Fields->GetLength() == 0)
 			return;
 
 		ObjectLock olock(query.Fields);
 
 		Value value;
-		bool first = true;
+
 		for (const Dictionary::Pair& kv : query.Fields) {
 			if (kv.second.IsEmpty() && !kv.second.IsString())
 				continue;
@@ -900,58 +1185,188 @@ void IdoPgsqlConnection::InternalExecuteQuery(const DbQuery& query, int typeOver
 				return;
 			}
 
-			if (type == DbQueryInsert) {
-				if (!first) {
-					colbuf << ", ";
-					valbuf << ", ";
-				}
+			fields.emplace_back(kv.first, value);
+		}
+	}
 
-				colbuf << kv.first;
-				valbuf << value;
-			} else {
-				if (!first)
-					qbuf << ", ";
+	if (deleteFirst)
+		AsyncQuery(BuildQuery(query.Table, DbQueryDelete, {}, where, ""));
 
-				qbuf << " " << kv.first << " = " << value;
-			}
+	/* Let the server return generated IDs right away instead of querying
+	 * the sequence afterwards. */
+	String returning;
 
-			if (first)
-				first = false;
-		}
+	if (type == DbQueryInsert) {
+		if (query.Object && query.ConfigUpdate) {
+			returning = query.IdColumn;
 
-		if (type == DbQueryInsert)
-			qbuf << " (" << colbuf.str() << ") VALUES (" << valbuf.str() << ")";
+			if (returning.IsEmpty())
+				returning = query.Table.SubStr(0, query.Table.GetLength() - 1) + "_id";
+		} else if (query.Table == "notifications" && query.NotificationInsertID)
+			returning = "notification_id";
 	}
 
-	if (type != DbQueryInsert)
-		qbuf << where.str();
-
-	Query(qbuf.str());
+	AsyncQuery(BuildQuery(query.Table, type, fields, where, returning),
+		std::bind(&IdoPgsqlConnection::FinishExecuteQuery, this, query, type, upsert, returning, _1));
+}
 
+void IdoPgsqlConnection::FinishExecuteQuery(const DbQuery& query, int type, bool upsert, const String& returning, const IdoPgsqlResult& result)
+{
 	if (upsert && GetAffectedRows() == 0) {
+		/* With pipelining the statements are queued ahead of any issued by later
+		 * queries and FinishAsyncQueries() sends them right after the current ones. */
 		InternalExecuteQuery(query, DbQueryDelete | DbQueryInsert);
-
 		return;
 	}
 
-	if (type == DbQueryInsert && query.Object) {
-		if (query.ConfigUpdate) {
-			String idField = query.IdColumn;
+	DbReference returnedId;
 
-			if (idField.IsEmpty())
-				idField = query.Table.SubStr(0, query.Table.GetLength() - 1) + "_id";
+	if (!returning.IsEmpty()) {
+		Dictionary::Ptr row = FetchRow(result, 0);
+
+		ASSERT(row);
+
+		returnedId = DbReference(Convert::ToLong(row->Get(returning)));
+	}
 
-			SetInsertID(query.Object, GetSequenceValue(GetTablePrefix() + query.Table, idField));
+	if (type == DbQueryInsert && query.Object) {
+		if (query.ConfigUpdate) {
+			SetInsertID(query.Object, returnedId);
 
 			SetConfigUpdate(query.Object, true);
 		} else if (query.StatusUpdate)
 			SetStatusUpdate(query.Object, true);
 	}
 
-	if (type == DbQueryInsert && query.Table == "notifications" && query.NotificationInsertID) {
-		DbReference seqval = GetSequenceValue(GetTablePrefix() + query.Table, "notification_id");
-		query.NotificationInsertID->SetValue(static_cast<long>(seqval));
+	if (type == DbQueryInsert && query.Table == "notifications" && query.NotificationInsertID)
+		query.NotificationInsertID->SetValue(static_cast<long>(returnedId));
+}
+
+/**
+ * Builds the SQL statement for a query. For the frequently updated status
+ * and state history tables a server-side prepared statement is used if
+ * enabled; it's created on first use and executed with the escaped values as
+ * parameters afterwards.
+ *
+ * @param table The table name without prefix.
+ * @param type Either DbQueryInsert, DbQueryUpdate or DbQueryDelete.
+ * @param fields Column names and escaped values to be inserted or updated.
+ * @param where Column names and escaped values for the WHERE clause.
+ * @param returning Column to be returned by an INSERT, if any.
+ * @returns The statement.
+ */
+String IdoPgsqlConnection::BuildQuery(const String& table, int type, const std::vector<std::pair<String, Value> >& fields,
+	const std::vector<std::pair<String, Value> >& where, const String& returning)
+{
+	/* qbuf contains the statement with literal values, tbuf the same
+	 * statement with placeholders instead for preparing it. */
+	std::ostringstream qbuf, tbuf, args;
+	int params = 0;
+
+	auto addValue ([&qbuf, &tbuf, &args, &params](const Value& value) {
+		qbuf << value;
+
+		if (params > 0)
+			args << ", ";
+
+		args << value;
+		tbuf << "$" << ++params;
+	});
+
+	auto addText ([&qbuf, &tbuf](const String& text) {
+		qbuf << text;
+		tbuf << text;
+	});
+
+	switch (type) {
+		case DbQueryInsert:
+			addText("INSERT INTO " + GetTablePrefix() + table);
+			break;
+		case DbQueryUpdate:
+			addText("UPDATE " + GetTablePrefix() + table + " SET");
+			break;
+		case DbQueryDelete:
+			addText("DELETE FROM " + GetTablePrefix() + table);
+			break;
+		default:
+			VERIFY(!"Invalid query type.");
+	}
+
+	if (type == DbQueryInsert) {
+		String columns;
+
+		for (auto& kv : fields) {
+			if (!columns.IsEmpty())
+				columns += ", ";
+
+			columns += kv.first;
+		}
+
+		addText(" (" + columns + ") VALUES (");
+
+		bool first = true;
+
+		for (auto& kv : fields) {
+			if (!first)
+				addText(", ");
+
+			addValue(kv.second);
+			first = false;
+		}
+
+		addText(")");
+	} else if (type == DbQueryUpdate) {
+		bool first = true;
+
+		for (auto& kv : fields) {
+			if (!first)
+				addText(",");
+
+			addText(" " + kv.first + " = ");
+			addValue(kv.second);
+			first = false;
+		}
+	}
+
+	if (type != DbQueryInsert && !where.empty()) {
+		addText(" WHERE ");
+
+		bool first = true;
+
+		for (auto& kv : where) {
+			if (!first)
+				addText(" AND ");
+
+			addText(kv.first + " = ");
+			addValue(kv.second);
+			first = false;
+		}
+	}
+
+	if (!returning.IsEmpty())
+		addText(" RETURNING " + returning);
+
+	if (!GetEnablePreparedStatements() || params == 0)
+		return qbuf.str();
+
+	if (table != "hoststatus" && table != "servicestatus" && table != "statehistory")
+		return qbuf.str();
+
+	String statement = tbuf.str();
+	auto it = m_PreparedStatements.find(statement);
+
+	if (it == m_PreparedStatements.end()) {
+		if (m_PreparedStatements.size() >= l_MaxPreparedStatements)
+			return qbuf.str();
+
+		String name = "icinga_stmt_" + Convert::ToString(m_PreparedStatements.size() + 1);
+
+		AsyncQuery("PREPARE " + name + " AS " + statement);
+
+		it = m_PreparedStatements.insert({ statement, name }).first;
 	}
+
+	return "EXECUTE " + it->second + "(" + args.str() + ")";
 }
 
 void IdoPgsqlConnection::CleanUpExecuteQuery(const String& table, const String& time_column, double max_age)
@@ -969,7 +1384,7 @@ void IdoPgsqlConnection::InternalCleanUpExecuteQuery(const String& table, const
 	if (!GetConnected())
 		return;
 
-	Query("DELETE FROM " + GetTablePrefix() + table + " WHERE instance_id = " +
+	AsyncQuery("DELETE FROM " + GetTablePrefix() + table + " WHERE instance_id = " +
 		Convert::ToString(static_cast<long>(m_InstanceID)) + " AND " + time_column +
 		" < TO_TIMESTAMP(" + Convert::ToString(static_cast<long>(max_age)) + ") AT TIME ZONE 'UTC'");
 }
@@ -9,11 +9,20 @@
 #include "base/timer.hpp"
 #include "base/workqueue.hpp"
 #include "base/library.hpp"
+#include <atomic>
+#include <map>
 
 namespace icinga
 {
 
 typedef std::shared_ptr<PGresult> IdoPgsqlResult;
+typedef std::function<void (const IdoPgsqlResult&)> IdoPgsqlAsyncCallback;
+
+struct IdoPgsqlAsyncQuery
+{
+	String Query;
+	IdoPgsqlAsyncCallback Callback;
+};
 
 /**
  * An IDO pgSQL database connection.
@@ -32,6 +41,11 @@ public:
 
 	int GetPendingQueryCount() const override;
 
+	/* Note: Only use them for unit test mocks. Prefer OnConfigLoaded() and Resume(). */
+	void SetPgsqlInterface(PgsqlInterface *pgsql, PGconn *connection);
+	void ExecuteAsyncQueries(const std::vector<IdoPgsqlAsyncQuery>& queries);
+	void ExecuteQueries(const std::vector<DbQuery>& queries);
+
 protected:
 	void OnConfigLoaded() override;
 	void Resume() override;
@@ -56,10 +70,19 @@ private:
 	PGconn *m_Connection;
 	int m_AffectedRows;
 
+	std::vector<IdoPgsqlAsyncQuery> m_AsyncQueries;
+	bool m_FinishingAsyncQueries{false};
+	std::map<String, String> m_PreparedStatements;
+	std::atomic<double> m_PipelineDepth{0};
+
 	Timer::Ptr m_ReconnectTimer;
 	Timer::Ptr m_TxTimer;
 
 	IdoPgsqlResult Query(const String& query);
+	void AsyncQuery(const String& query, const IdoPgsqlAsyncCallback& callback = IdoPgsqlAsyncCallback());
+	void FinishAsyncQueries();
+	void FlushConnection(const String& query);
+	IdoPgsqlResult HandleResult(PGresult *result, const String& query);
 	DbReference GetSequenceValue(const String& table, const String& column);
 	int GetAffectedRows();
 	String Escape(const String& s);
@@ -83,6 +106,9 @@ private:
 	bool CanExecuteQuery(const DbQuery& query);
 
 	void InternalExecuteQuery(const DbQuery& query, int typeOverride = -1);
+	void FinishExecuteQuery(const DbQuery& query, int type, bool upsert, const String& returning, const IdoPgsqlResult& result);
+	String BuildQuery(const String& table, int type, const std::vector<std::pair<String, Value> >& fields,
+		const std::vector<std::pair<String, Value> >& where, const String& returning);
 	void InternalExecuteMultipleQueries(const std::vector<DbQuery>& queries);
 	void InternalCleanUpExecuteQuery(const String& table, const String& time_key, double time_value);
 
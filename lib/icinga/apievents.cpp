@@ -14,7 +14,10 @@ INITIALIZE_ONCE(&ApiEvents::StaticInitialize);
 
 void ApiEvents::StaticInitialize()
 {
-	Checkable::OnNewCheckResult.connect(&ApiEvents::CheckResultHandler);
+	Checkable::OnNewCheckResult.Subscribe("ApiEvents", [](const std::vector<CheckResultEvent>& events) {
+		for (const CheckResultEvent& event : events)
+			ApiEvents::CheckResultHandler(event.Source, event.Result, event.Origin);
+	});
 	Checkable::OnStateChange.connect(&ApiEvents::StateChangeHandler);
 	Checkable::OnNotificationSentToAllUsers.connect(&ApiEvents::NotificationSentToAllUsersHandler);
 
@@ -17,7 +17,8 @@
 
 using namespace icinga;
 
-boost::signals2::signal<void (const Checkable::Ptr&, const CheckResult::Ptr&, const MessageOrigin::Ptr&)> Checkable::OnNewCheckResult;
+EventBus<CheckResultEvent> Checkable::OnNewCheckResult;
+boost::signals2::signal<void (const Checkable::Ptr&, const CheckResult::Ptr&, const MessageOrigin::Ptr&)> Checkable::OnCheckResultProcessed;
 boost::signals2::signal<void (const Checkable::Ptr&, const CheckResult::Ptr&, StateType, const MessageOrigin::Ptr&)> Checkable::OnStateChange;
 boost::signals2::signal<void (const Checkable::Ptr&, const CheckResult::Ptr&, std::set<Checkable::Ptr>, const MessageOrigin::Ptr&)> Checkable::OnReachabilityChanged;
 boost::signals2::signal<void (const Checkable::Ptr&, NotificationType, const CheckResult::Ptr&, const String&, const String&, const MessageOrigin::Ptr&)> Checkable::OnNotificationsRequested;
@@ -387,6 +388,17 @@ void Checkable::ProcessCheckResult(const CheckResult::Ptr& cr, const MessageOrig
 		SetNextCheck(Utility::GetTime() + offset, false, origin);
 	}
 
+	CheckResultEvent event;
+	event.Source = this;
+	event.Result = cr;
+	event.Origin = origin;
+	event.State = new_state;
+	event.Type = GetStateType();
+	event.CheckAttempt = GetCheckAttempt();
+	event.MaxCheckAttempts = GetMaxCheckAttempts();
+	event.Reachable = reachable;
+	event.ActiveChecksEnabled = GetEnableActiveChecks();
+
 	olock.Unlock();
 
 #ifdef I2_DEBUG /* I2_DEBUG */
@@ -399,7 +411,10 @@ void Checkable::ProcessCheckResult(const CheckResult::Ptr& cr, const MessageOrig
 		<< "% current: " << GetFlappingCurrent() << "%.";
 #endif /* I2_DEBUG */
 
-	OnNewCheckResult(this, cr, origin);
+	/* Subscribers which need the live object (e.g. for macro resolution) or
+	 * must keep the ordering with the other cluster events are notified synchronously. */
+	OnCheckResultProcessed(this, cr, origin);
+	OnNewCheckResult.Publish(event);
 
 	/* signal status updates to for example db_ido */
 	OnStateChanged(this);
@@ -644,11 +659,15 @@ void Checkable::IncreasePendingChecks()
 	m_PendingChecks++;
 }
 
-void Checkable::DecreasePendingChecks()
+void Checkable::DecreasePendingChecks(int count)
 {
 	boost::mutex::scoped_lock lock(m_StatsMutex);
-	m_PendingChecks--;
-	m_PendingChecksCV.notify_one();
+	m_PendingChecks -= count;
+
+	if (count == 1)
+		m_PendingChecksCV.notify_one();
+	else
+		m_PendingChecksCV.notify_all();
 }
 
 int Checkable::GetPendingChecks()
@@ -657,6 +676,23 @@ int Checkable::GetPendingChecks()
 	return m_PendingChecks;
 }
 
+/**
+ * Takes up to the specified number of pending check slots at once without
+ * exceeding the limit. Unused slots must be given back using
+ * DecreasePendingChecks().
+ *
+ * @returns The number of slots which were taken, possibly 0.
+ */
+int Checkable::ReservePendingChecks(int count, int maxPendingChecks)
+{
+	boost::mutex::scoped_lock lock(m_StatsMutex);
+	int reserved = std::max(0, std::min(count, maxPendingChecks - m_PendingChecks));
+
+	m_PendingChecks += reserved;
+
+	return reserved;
+}
+
 void Checkable::AquirePendingCheckSlot(int maxPendingChecks)
 {
 	boost::mutex::scoped_lock lock(m_StatsMutex);
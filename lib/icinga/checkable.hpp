@@ -4,6 +4,7 @@
 #define CHECKABLE_H
 
 #include "base/atomic.hpp"
+#include "base/eventbus.hpp"
 #include "base/timer.hpp"
 #include "icinga/i2-icinga.hpp"
 #include "icinga/checkable-ti.hpp"
@@ -39,10 +40,34 @@ enum CheckableType
 	CheckableService
 };
 
+class Checkable;
 class CheckCommand;
 class EventCommand;
 class Dependency;
 
+/**
+ * A check result which was processed by a checkable.
+ *
+ * Subscribers run asynchronously, so the checkable's state is captured
+ * while the check result is being processed instead of being read from
+ * the live object later on.
+ *
+ * @ingroup icinga
+ */
+struct CheckResultEvent
+{
+	intrusive_ptr<Checkable> Source;
+	CheckResult::Ptr Result;
+	MessageOrigin::Ptr Origin;
+
+	ServiceState State;
+	StateType Type;
+	long CheckAttempt;
+	long MaxCheckAttempts;
+	bool Reachable;
+	bool ActiveChecksEnabled;
+};
+
 /**
  * An Icinga service.
  *
@@ -100,7 +125,8 @@ public:
 
 	Endpoint::Ptr GetCommandEndpoint() const;
 
-	static boost::signals2::signal<void (const Checkable::Ptr&, const CheckResult::Ptr&, const MessageOrigin::Ptr&)> OnNewCheckResult;
+	static EventBus<CheckResultEvent> OnNewCheckResult;
+	static boost::signals2::signal<void (const Checkable::Ptr&, const CheckResult::Ptr&, const MessageOrigin::Ptr&)> OnCheckResultProcessed;
 	static boost::signals2::signal<void (const Checkable::Ptr&, const CheckResult::Ptr&, StateType, const MessageOrigin::Ptr&)> OnStateChange;
 	static boost::signals2::signal<void (const Checkable::Ptr&, const CheckResult::Ptr&, std::set<Checkable::Ptr>, const MessageOrigin::Ptr&)> OnReachabilityChanged;
 	static boost::signals2::signal<void (const Checkable::Ptr&, NotificationType, const CheckResult::Ptr&,
@@ -172,8 +198,9 @@ public:
 	void ValidateMaxCheckAttempts(const Lazy<int>& lvalue, const ValidationUtils& value) final;
 
 	static void IncreasePendingChecks();
-	static void DecreasePendingChecks();
+	static void DecreasePendingChecks(int count = 1);
 	static int GetPendingChecks();
+	static int ReservePendingChecks(int count, int maxPendingChecks);
 	static void AquirePendingCheckSlot(int maxPendingChecks);
 
 	static Object::Ptr GetPrototype();
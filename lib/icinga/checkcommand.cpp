@@ -3,6 +3,7 @@
 #include "icinga/checkcommand.hpp"
 #include "icinga/checkcommand-ti.cpp"
 #include "base/configtype.hpp"
+#include "base/exception.hpp"
 
 using namespace icinga;
 
@@ -18,3 +19,19 @@ void CheckCommand::Execute(const Checkable::Ptr& checkable, const CheckResult::P
 		useResolvedMacros
 	});
 }
+
+void CheckCommand::ValidateWorkerPoolSize(const Lazy<int>& lvalue, const ValidationUtils& utils)
+{
+	ObjectImpl<CheckCommand>::ValidateWorkerPoolSize(lvalue, utils);
+
+	if (lvalue() <= 0)
+		BOOST_THROW_EXCEPTION(ValidationError(this, { "worker_pool_size" }, "Value must be greater than 0."));
+}
+
+void CheckCommand::ValidateWorkerMaxChecks(const Lazy<int>& lvalue, const ValidationUtils& utils)
+{
+	ObjectImpl<CheckCommand>::ValidateWorkerMaxChecks(lvalue, utils);
+
+	if (lvalue() < 0)
+		BOOST_THROW_EXCEPTION(ValidationError(this, { "worker_max_checks" }, "Value must not be negative."));
+}
@@ -23,6 +23,9 @@ public:
 	virtual void Execute(const Checkable::Ptr& checkable, const CheckResult::Ptr& cr,
 		const Dictionary::Ptr& resolvedMacros = nullptr,
 		bool useResolvedMacros = false);
+
+	void ValidateWorkerPoolSize(const Lazy<int>& lvalue, const ValidationUtils& utils) final;
+	void ValidateWorkerMaxChecks(const Lazy<int>& lvalue, const ValidationUtils& utils) final;
 };
 
 }
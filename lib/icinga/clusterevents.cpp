@@ -37,7 +37,7 @@ REGISTER_APIFUNCTION(NotificationSentToAllUsers, event, &ClusterEvents::Notifica
 
 void ClusterEvents::StaticInitialize()
 {
-	Checkable::OnNewCheckResult.connect(&ClusterEvents::CheckResultHandler);
+	Checkable::OnCheckResultProcessed.connect(&ClusterEvents::CheckResultHandler);
 	Checkable::OnNextCheckChanged.connect(&ClusterEvents::NextCheckChangedHandler);
 	Checkable::OnSuppressedNotificationsChanged.connect(&ClusterEvents::SuppressedNotificationsChangedHandler);
 	Notification::OnNextNotificationChanged.connect(&ClusterEvents::NextNotificationChangedHandler);
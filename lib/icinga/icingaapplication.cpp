@@ -17,12 +17,18 @@
 #include "base/initialize.hpp"
 #include "base/statsfunction.hpp"
 #include "base/loader.hpp"
+#include "base/perfdatavalue.hpp"
+#include "base/eventbus.hpp"
+#include "base/process.hpp"
 #include <fstream>
 
 using namespace icinga;
 
 static Timer::Ptr l_RetentionTimer;
 
+/* The number of times only changed objects have been dumped since the last full dump. */
+static int l_RetentionJournalDumps = 0;
+
 REGISTER_TYPE(IcingaApplication);
 /* Ensure that the priority is lower than the basic System namespace initialization in scriptframe.cpp. */
 INITIALIZE_ONCE_WITH_PRIORITY(&IcingaApplication::StaticInitialize, 50);
@@ -86,6 +92,24 @@ void IcingaApplication::StatsFunc(const Dictionary::Ptr& status, const Array::Pt
 	}
 
 	status->Set("icingaapplication", new Dictionary(std::move(nodes)));
+
+	Dictionary::Ptr spawnLatency = Process::GetSpawnLatencyStats();
+
+	status->Set("process_spawn_latency", spawnLatency);
+
+	perfdata->Add(new PerfdataValue("process_spawn_latency_avg", spawnLatency->Get("avg")));
+	perfdata->Add(new PerfdataValue("process_spawn_latency_max", spawnLatency->Get("max")));
+
+	Dictionary::Ptr eventBus = EventSubscriberBase::GetAllStats();
+
+	status->Set("event_bus", eventBus);
+
+	ObjectLock olock(eventBus);
+
+	for (const Dictionary::Pair& kv : eventBus) {
+		Dictionary::Ptr stats = kv.second;
+		perfdata->Add(new PerfdataValue("event_bus_" + kv.first + "_pending", stats->Get("pending")));
+	}
 }
 
 /**
@@ -100,7 +124,7 @@ int IcingaApplication::Main()
 	/* periodically dump the program state */
 	l_RetentionTimer = new Timer();
 	l_RetentionTimer->SetInterval(300);
-	l_RetentionTimer->OnTimerExpired.connect(std::bind(&IcingaApplication::DumpProgramState, this));
+	l_RetentionTimer->OnTimerExpired.connect([this](const Timer * const&) { DumpProgramState(false); });
 	l_RetentionTimer->Start();
 
 	RunEventLoop();
@@ -153,9 +177,25 @@ static void PersistModAttrHelper(std::fstream& fp, ConfigObject::Ptr& previousOb
 	previousObject = object;
 }
 
-void IcingaApplication::DumpProgramState()
+/**
+ * Dumps the program state.
+ *
+ * Unless a full dump is requested, only the objects which have changed are appended
+ * to the state journal. Every hour the journal is compacted by a full dump.
+ *
+ * @param full Whether to dump the state of all objects
+ */
+void IcingaApplication::DumpProgramState(bool full)
 {
-	ConfigObject::DumpObjects(Configuration::StatePath);
+	/* The journal is only replayed on top of a state file. */
+	if (full || l_RetentionJournalDumps >= 11 || !Utility::PathExists(Configuration::StatePath)) {
+		ConfigObject::DumpObjects(Configuration::StatePath);
+		l_RetentionJournalDumps = 0;
+	} else {
+		ConfigObject::DumpDirtyObjects(Configuration::StatePath);
+		l_RetentionJournalDumps++;
+	}
+
 	DumpModifiedAttributes();
 }
 
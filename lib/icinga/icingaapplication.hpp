@@ -41,7 +41,7 @@ public:
 	void ValidateVars(const Lazy<Dictionary::Ptr>& lvalue, const ValidationUtils& utils) override;
 
 private:
-	void DumpProgramState();
+	void DumpProgramState(bool full = true);
 	void DumpModifiedAttributes();
 
 	void OnShutdown() override;
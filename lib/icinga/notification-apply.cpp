@@ -135,13 +135,11 @@ void Notification::EvaluateApplyRules(const Host::Ptr& host)
 {
 	CONTEXT("Evaluating 'apply' rules for host '" + host->GetName() + "'");
 
-	for (ApplyRule& rule : ApplyRule::GetRules("Notification"))
-	{
-		if (rule.GetTargetType() != "Host")
-			continue;
+	Dictionary::Ptr locals = new Dictionary({ { "host", host } });
 
-		if (EvaluateApplyRule(host, rule))
-			rule.AddMatch();
+	for (ApplyRule *rule : ApplyRule::GetCandidateRules("Notification", "Host", locals)) {
+		if (EvaluateApplyRule(host, *rule))
+			rule->AddMatch();
 	}
 }
 
@@ -149,11 +147,10 @@ void Notification::EvaluateApplyRules(const Service::Ptr& service)
 {
 	CONTEXT("Evaluating 'apply' rules for service '" + service->GetName() + "'");
 
-	for (ApplyRule& rule : ApplyRule::GetRules("Notification")) {
-		if (rule.GetTargetType() != "Service")
-			continue;
+	Dictionary::Ptr locals = new Dictionary({ { "host", service->GetHost() }, { "service", service } });
 
-		if (EvaluateApplyRule(service, rule))
-			rule.AddMatch();
+	for (ApplyRule *rule : ApplyRule::GetCandidateRules("Notification", "Service", locals)) {
+		if (EvaluateApplyRule(service, *rule))
+			rule->AddMatch();
 	}
 }
@@ -2,6 +2,7 @@
 
 #include "icinga/pluginutility.hpp"
 #include "icinga/macroprocessor.hpp"
+#include "icinga/pluginworker.hpp"
 #include "base/logger.hpp"
 #include "base/utility.hpp"
 #include "base/perfdatavalue.hpp"
@@ -74,6 +75,16 @@ void PluginUtility::ExecuteCommand(const Command::Ptr& commandObj, const Checkab
 	if (resolvedMacros && !useResolvedMacros)
 		return;
 
+#ifndef _WIN32
+	CheckCommand::Ptr checkCommand = dynamic_pointer_cast<CheckCommand>(commandObj);
+
+	if (checkCommand && !checkCommand->GetWorkerCommand().IsEmpty()) {
+		PluginWorker::ExecuteCommand(checkCommand, Process::PrepareCommand(command), envMacros, timeout,
+			std::bind(callback, command, _1));
+		return;
+	}
+#endif /* _WIN32 */
+
 	Process::Ptr process = new Process(Process::PrepareCommand(command), envMacros);
 
 	process->SetTimeout(timeout);
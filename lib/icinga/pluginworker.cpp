@@ -0,0 +1,470 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef _WIN32
+
+#include "icinga/pluginworker.hpp"
+#include "base/array.hpp"
+#include "base/convert.hpp"
+#include "base/exception.hpp"
+#include "base/json.hpp"
+#include "base/logger.hpp"
+#include "base/utility.hpp"
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <deque>
+#include <map>
+#include <thread>
+#include <poll.h>
+#include <sys/socket.h>
+
+using namespace icinga;
+
+/* Responses which are larger than this are considered a protocol error. */
+#define PLUGINWORKER_MAX_RESPONSE (16 * 1024 * 1024)
+
+/* Idle pool threads stop their worker after this many seconds. */
+#define PLUGINWORKER_IDLE_TIMEOUT 300
+
+namespace icinga
+{
+
+/**
+ * A check which is waiting for a plugin worker.
+ *
+ * @ingroup icinga
+ */
+struct PluginWorkerRequest
+{
+	Process::Arguments Arguments;
+	Dictionary::Ptr Env;
+	double Timeout;
+	PluginWorker::Callback Callback;
+};
+
+/**
+ * The plugin workers of a CheckCommand. Each of the pool's threads runs (at most) one worker.
+ *
+ * @ingroup icinga
+ */
+struct PluginWorkerPool
+{
+	boost::mutex Mutex;
+	boost::condition_variable CV;
+	Process::Arguments WorkerCommand;
+	int Generation{0}; /**< Incremented whenever the worker command changes */
+	int Size{1};
+	int MaxChecks{0};
+	int Threads{0};
+	int IdleThreads{0};
+	std::deque<PluginWorkerRequest> Requests;
+};
+
+}
+
+static boost::mutex l_PluginWorkerPoolsMutex;
+static std::map<String, std::shared_ptr<PluginWorkerPool>> l_PluginWorkerPools;
+
+/**
+ * Executes a plugin as a process of its own, used if its worker is broken.
+ *
+ * @param request The plugin's command line, environment, timeout and callback.
+ */
+static void ExecutePluginProcess(const PluginWorkerRequest& request)
+{
+	Process::Ptr process = new Process(request.Arguments, request.Env);
+	process->SetTimeout(request.Timeout);
+	process->Run(request.Callback);
+}
+
+PluginWorker::PluginWorker(Process::Arguments command, int generation)
+	: m_Command(std::move(command)), m_Generation(generation)
+{ }
+
+PluginWorker::~PluginWorker()
+{
+	/* The worker exits once its stdin has been closed. */
+	if (m_FD != -1)
+		(void)close(m_FD);
+}
+
+/**
+ * Executes a check command's plugin through one of the command's workers.
+ *
+ * @param commandObj The check command, its worker_command must be set.
+ * @param arguments The plugin's command line.
+ * @param env Additional environment variables for the plugin.
+ * @param timeout The plugin's timeout.
+ * @param callback Called once the plugin has finished.
+ */
+void PluginWorker::ExecuteCommand(const CheckCommand::Ptr& commandObj, const Process::Arguments& arguments,
+	const Dictionary::Ptr& env, double timeout, const Callback& callback)
+{
+	Process::Arguments workerCommand = Process::PrepareCommand(commandObj->GetWorkerCommand());
+	std::shared_ptr<PluginWorkerPool> pool;
+
+	{
+		boost::mutex::scoped_lock lock(l_PluginWorkerPoolsMutex);
+
+		auto& entry (l_PluginWorkerPools[commandObj->GetName()]);
+
+		if (!entry)
+			entry = std::make_shared<PluginWorkerPool>();
+
+		pool = entry;
+	}
+
+	bool startThread = false;
+
+	{
+		boost::mutex::scoped_lock lock(pool->Mutex);
+
+		if (pool->WorkerCommand != workerCommand) {
+			pool->WorkerCommand = std::move(workerCommand);
+			pool->Generation++;
+		}
+
+		pool->Size = commandObj->GetWorkerPoolSize();
+		pool->MaxChecks = commandObj->GetWorkerMaxChecks();
+
+		pool->Requests.push_back({ arguments, env, timeout, callback });
+
+		if (pool->IdleThreads == 0 && pool->Threads < pool->Size) {
+			pool->Threads++;
+			startThread = true;
+		}
+	}
+
+	if (startThread)
+		StartThread(pool);
+	else
+		pool->CV.notify_one();
+}
+
+void PluginWorker::StartThread(const std::shared_ptr<PluginWorkerPool>& pool)
+{
+	std::thread t(std::bind(&PluginWorker::ThreadProc, pool));
+	t.detach();
+}
+
+void PluginWorker::ThreadProc(const std::shared_ptr<PluginWorkerPool>& pool)
+{
+	Utility::SetThreadName("PluginWorker");
+
+	PluginWorker::Ptr worker;
+
+	for (;;) {
+		PluginWorkerRequest request;
+
+		{
+			boost::mutex::scoped_lock lock(pool->Mutex);
+
+			pool->IdleThreads++;
+
+			while (pool->Requests.empty() && pool->Threads <= pool->Size) {
+				if (!pool->CV.timed_wait(lock, boost::posix_time::seconds(PLUGINWORKER_IDLE_TIMEOUT)) && pool->Requests.empty())
+					break;
+			}
+
+			pool->IdleThreads--;
+
+			/* The pool has shrunk or we've been idle for too long. */
+			if (pool->Requests.empty() || pool->Threads > pool->Size) {
+				pool->Threads--;
+
+				/* Somebody else may take over our request. */
+				if (!pool->Requests.empty())
+					pool->CV.notify_one();
+
+				return;
+			}
+
+			request = std::move(pool->Requests.front());
+			pool->Requests.pop_front();
+
+			if (worker && worker->m_Generation != pool->Generation)
+				worker.reset();
+
+			if (!worker)
+				worker = new PluginWorker(pool->WorkerCommand, pool->Generation);
+		}
+
+		/* A worker which can't be started or exits before answering anything is
+		 * most likely misconfigured, e.g. its interpreter is missing. Fall back
+		 * to running the plugin as a process of its own then.
+		 */
+		if (!worker->m_Process && !worker->Start()) {
+			Log(LogWarning, "PluginWorker")
+				<< "Failed to start plugin worker " << Process::PrettyPrintArguments(worker->m_Command)
+				<< ", executing " << Process::PrettyPrintArguments(request.Arguments) << " directly.";
+
+			worker.reset();
+			ExecutePluginProcess(request);
+			continue;
+		}
+
+		ProcessResult pr = worker->Execute(request);
+
+		if (worker->m_Exited && worker->m_Checks == 0) {
+			Log(LogWarning, "PluginWorker")
+				<< "Plugin worker " << Process::PrettyPrintArguments(worker->m_Command)
+				<< " exited without any response, executing " << Process::PrettyPrintArguments(request.Arguments) << " directly.";
+
+			worker.reset();
+			ExecutePluginProcess(request);
+			continue;
+		}
+
+		worker->m_Checks++;
+
+		int maxChecks;
+
+		{
+			boost::mutex::scoped_lock lock(pool->Mutex);
+			maxChecks = pool->MaxChecks;
+		}
+
+		/* Recycle the worker, e.g. to get rid of memory leaks. */
+		if (worker->m_FD == -1 || (maxChecks > 0 && worker->m_Checks >= maxChecks))
+			worker.reset();
+
+		if (request.Callback)
+			Utility::QueueAsyncCallback(std::bind(request.Callback, pr));
+	}
+}
+
+/**
+ * Starts the worker process.
+ *
+ * @returns Whether the worker could be started.
+ */
+bool PluginWorker::Start()
+{
+	int fds[2];
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+		Log(LogCritical, "PluginWorker")
+			<< "socketpair() failed with error code " << errno << ", \"" << Utility::FormatErrorNumber(errno) << "\"";
+		return false;
+	}
+
+	Utility::SetCloExec(fds[0]);
+	Utility::SetCloExec(fds[1]);
+
+	Process::Arguments command = m_Command;
+
+	m_Process = new Process(m_Command);
+	m_Process->SetTimeout(0);
+	m_Process->SetStdio(fds[1], fds[1]);
+
+	m_Process->Run([command](const ProcessResult& pr) {
+		String output = pr.Output.Trim();
+
+		if (pr.ExitStatus != 0 || !output.IsEmpty()) {
+			Log(LogWarning, "PluginWorker")
+				<< "Plugin worker " << Process::PrettyPrintArguments(command) << " (PID " << pr.PID
+				<< ") exited with code " << pr.ExitStatus << ", output: " << output;
+		} else {
+			Log(LogNotice, "PluginWorker")
+				<< "Plugin worker " << Process::PrettyPrintArguments(command) << " (PID " << pr.PID << ") exited.";
+		}
+	});
+
+	(void)close(fds[1]);
+
+	m_FD = fds[0];
+
+	if (m_Process->GetPID() == -1) {
+		(void)close(m_FD);
+		m_FD = -1;
+
+		return false;
+	}
+
+	Log(LogNotice, "PluginWorker")
+		<< "Started plugin worker " << Process::PrettyPrintArguments(m_Command) << " (PID " << m_Process->GetPID() << ")";
+
+	return true;
+}
+
+/**
+ * Lets the worker execute a plugin. If the worker fails to respond in time
+ * it's killed, the caller is supposed to get rid of it then.
+ *
+ * @param request The plugin's command line, environment and timeout.
+ * @returns The plugin's result.
+ */
+ProcessResult PluginWorker::Execute(const PluginWorkerRequest& request)
+{
+	ProcessResult pr;
+	pr.PID = m_Process->GetPID();
+	pr.ExecutionStart = Utility::GetTime();
+	pr.ExitStatus = 128;
+
+	Dictionary::Ptr message = new Dictionary({
+		{ "arguments", Array::FromVector(request.Arguments) },
+		{ "env", request.Env },
+		{ "timeout", request.Timeout }
+	});
+
+	double deadline = request.Timeout > 0 ? pr.ExecutionStart + request.Timeout : -1;
+	String response;
+	String error;
+
+	if (!SendRequest(JsonEncode(message))) {
+		m_Exited = true;
+		error = "<Plugin worker closed its stdin.>";
+	} else if (ReadResponse(deadline, response, error)) {
+		try {
+			Dictionary::Ptr result = JsonDecode(response);
+
+			pr.ExitStatus = result->Get("exit_status");
+			pr.Output = result->Get("output");
+		} catch (const std::exception& ex) {
+			error = "<Invalid response from plugin worker: " + String(ex.what()) + ">";
+		}
+	}
+
+	if (!error.IsEmpty()) {
+		pr.Output = error;
+
+		Log(LogWarning, "PluginWorker")
+			<< "Plugin worker " << Process::PrettyPrintArguments(m_Command) << " (PID " << pr.PID
+			<< ") failed to run " << Process::PrettyPrintArguments(request.Arguments) << ": " << error;
+
+		/* Unless the worker is about to exit anyway, get rid of it. */
+		if (m_FD != -1) {
+			m_Process->Terminate();
+
+			(void)close(m_FD);
+			m_FD = -1;
+		}
+	}
+
+	pr.ExecutionEnd = Utility::GetTime();
+
+	return pr;
+}
+
+/**
+ * Writes a netstring to the worker's stdin.
+ *
+ * @returns false if the worker has closed its stdin.
+ */
+bool PluginWorker::SendRequest(const String& request)
+{
+	String netstring = Convert::ToString(request.GetLength()) + ":" + request + ",";
+	const char *data = netstring.CStr();
+	size_t length = netstring.GetLength();
+
+	while (length > 0) {
+		ssize_t rc = send(m_FD, data, length, MSG_NOSIGNAL);
+
+		if (rc < 0) {
+			if (errno == EINTR)
+				continue;
+
+			return false;
+		}
+
+		data += rc;
+		length -= rc;
+	}
+
+	return true;
+}
+
+/**
+ * Reads a netstring from the worker's stdout.
+ *
+ * @param deadline When to give up waiting, -1 to wait forever.
+ * @param response Receives the netstring's payload.
+ * @param error Receives the error message if there's no response.
+ * @returns Whether a response has been received. If the worker has closed
+ *          its stdout, m_FD is closed and reset and m_Exited is set.
+ */
+bool PluginWorker::ReadResponse(double deadline, String& response, String& error)
+{
+	for (;;) {
+		auto colon (m_Buffer.find(':'));
+
+		if (colon != std::string::npos) {
+			size_t length = 0;
+			bool valid = colon > 0;
+
+			for (size_t i = 0; i < colon && valid; i++) {
+				if (m_Buffer[i] < '0' || m_Buffer[i] > '9' || length > PLUGINWORKER_MAX_RESPONSE)
+					valid = false;
+				else
+					length = length * 10 + (m_Buffer[i] - '0');
+			}
+
+			if (!valid || length > PLUGINWORKER_MAX_RESPONSE) {
+				error = "<Invalid netstring length from plugin worker.>";
+				return false;
+			}
+
+			if (m_Buffer.size() >= colon + length + 2u) {
+				if (m_Buffer[colon + length + 1u] != ',') {
+					error = "<Invalid netstring from plugin worker: missing trailing comma.>";
+					return false;
+				}
+
+				response = m_Buffer.substr(colon + 1u, length);
+				m_Buffer.erase(0, colon + length + 2u);
+
+				return true;
+			}
+		} else if (m_Buffer.size() > 32u) {
+			error = "<Invalid netstring length from plugin worker.>";
+			return false;
+		}
+
+		int timeout = -1;
+
+		if (deadline != -1) {
+			double delta = deadline - Utility::GetTime();
+
+			if (delta <= 0) {
+				error = "<Timeout exceeded.>";
+				return false;
+			}
+
+			timeout = static_cast<int>(delta * 1000) + 1;
+		}
+
+		pollfd pfd;
+		pfd.fd = m_FD;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+
+		int rc = poll(&pfd, 1, timeout);
+
+		if (rc <= 0) {
+			if (rc < 0 && errno != EINTR) {
+				error = "<poll() failed: " + Utility::FormatErrorNumber(errno) + ">";
+				return false;
+			}
+
+			continue;
+		}
+
+		char buffer[4096];
+		ssize_t count = recv(m_FD, buffer, sizeof(buffer), 0);
+
+		if (count < 0 && errno == EINTR)
+			continue;
+
+		if (count <= 0) {
+			(void)close(m_FD);
+			m_FD = -1;
+			m_Exited = true;
+
+			error = "<Plugin worker exited unexpectedly.>";
+			return false;
+		}
+
+		m_Buffer.append(buffer, count);
+	}
+}
+
+#endif /* _WIN32 */
@@ -0,0 +1,67 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef PLUGINWORKER_H
+#define PLUGINWORKER_H
+
+#include "icinga/i2-icinga.hpp"
+#include "icinga/checkcommand.hpp"
+#include "base/process.hpp"
+#include <functional>
+#include <memory>
+
+namespace icinga
+{
+
+struct PluginWorkerPool;
+struct PluginWorkerRequest;
+
+/**
+ * A long-lived process which executes plugins on behalf of a CheckCommand
+ * (e.g. an interpreter which keeps the plugins loaded) so that we don't have
+ * to fork and exec for every single check.
+ *
+ * The worker reads requests from its stdin and writes one response per request
+ * to its stdout. Both are JSON-encoded netstrings, e.g.:
+ *
+ *   request:  {"arguments":["check_foo","-w","1"],"env":{"FOO":"bar"},"timeout":60}
+ *   response: {"exit_status":0,"output":"FOO OK"}
+ *
+ * The worker's stderr is logged once it has exited. It's supposed to exit once its
+ * stdin has been closed.
+ *
+ * @ingroup icinga
+ */
+class PluginWorker final : public Object
+{
+public:
+	DECLARE_PTR_TYPEDEFS(PluginWorker);
+
+	typedef std::function<void (const ProcessResult&)> Callback;
+
+	static void ExecuteCommand(const CheckCommand::Ptr& commandObj, const Process::Arguments& arguments,
+		const Dictionary::Ptr& env, double timeout, const Callback& callback);
+
+private:
+	Process::Arguments m_Command;
+	int m_Generation;
+	Process::Ptr m_Process;
+	int m_FD{-1};
+	std::string m_Buffer;
+	int m_Checks{0};
+	bool m_Exited{false};
+
+	PluginWorker(Process::Arguments command, int generation);
+	~PluginWorker() override;
+
+	bool Start();
+	ProcessResult Execute(const PluginWorkerRequest& request);
+	bool SendRequest(const String& request);
+	bool ReadResponse(double deadline, String& response, String& error);
+
+	static void StartThread(const std::shared_ptr<PluginWorkerPool>& pool);
+	static void ThreadProc(const std::shared_ptr<PluginWorkerPool>& pool);
+};
+
+}
+
+#endif /* PLUGINWORKER_H */
@@ -134,12 +134,11 @@ void ScheduledDowntime::EvaluateApplyRules(const Host::Ptr& host)
 {
 	CONTEXT("Evaluating 'apply' rules for host '" + host->GetName() + "'");
 
-	for (ApplyRule& rule : ApplyRule::GetRules("ScheduledDowntime")) {
-		if (rule.GetTargetType() != "Host")
-			continue;
+	Dictionary::Ptr locals = new Dictionary({ { "host", host } });
 
-		if (EvaluateApplyRule(host, rule))
-			rule.AddMatch();
+	for (ApplyRule *rule : ApplyRule::GetCandidateRules("ScheduledDowntime", "Host", locals)) {
+		if (EvaluateApplyRule(host, *rule))
+			rule->AddMatch();
 	}
 }
 
@@ -147,11 +146,10 @@ void ScheduledDowntime::EvaluateApplyRules(const Service::Ptr& service)
 {
 	CONTEXT("Evaluating 'apply' rules for service '" + service->GetName() + "'");
 
-	for (ApplyRule& rule : ApplyRule::GetRules("ScheduledDowntime")) {
-		if (rule.GetTargetType() != "Service")
-			continue;
+	Dictionary::Ptr locals = new Dictionary({ { "host", service->GetHost() }, { "service", service } });
 
-		if (EvaluateApplyRule(service, rule))
-			rule.AddMatch();
+	for (ApplyRule *rule : ApplyRule::GetCandidateRules("ScheduledDowntime", "Service", locals)) {
+		if (EvaluateApplyRule(service, *rule))
+			rule->AddMatch();
 	}
 }
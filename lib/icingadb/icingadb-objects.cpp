@@ -102,8 +102,9 @@ void IcingaDB::ConfigStaticInitialize()
 
 	Checkable::OnFlappingChange.connect(&IcingaDB::FlappingChangeHandler);
 
-	Checkable::OnNewCheckResult.connect([](const Checkable::Ptr& checkable, const CheckResult::Ptr&, const MessageOrigin::Ptr&) {
-		IcingaDB::NewCheckResultHandler(checkable);
+	Checkable::OnNewCheckResult.Subscribe("IcingaDB", [](const std::vector<CheckResultEvent>& events) {
+		for (const CheckResultEvent& event : events)
+			IcingaDB::NewCheckResultHandler(event.Source);
 	});
 
 	Checkable::OnNextCheckChanged.connect([](const Checkable::Ptr& checkable, const Value&) {
@@ -151,21 +152,60 @@ void IcingaDB::UpdateAllConfigObjects()
 			m_PrefixConfigObject + "notes_url",
 			m_PrefixConfigObject + "icon_image",
 	};
-	DeleteKeys(globalKeys, Prio::Config);
+
+	/* A differential dump only writes what differs from the previous dump still present in Redis
+	 * and removes what isn't there anymore, instead of deleting and re-writing everything.
+	 */
+	bool differential = GetDifferentialDump();
+	DumpedHashes globalDumped;
+
+	if (differential) {
+		try {
+			globalDumped = FetchDumpedHashes(globalKeys, "");
+		} catch (const std::exception& ex) {
+			Log(LogWarning, "IcingaDB")
+				<< "Cannot fetch the previous config dump, falling back to a full dump: " << DiagnosticInformation(ex, false);
+
+			differential = false;
+		}
+	}
+
+	if (!differential)
+		DeleteKeys(globalKeys, Prio::Config);
+
 	DeleteKeys({"icinga:nextupdate:host", "icinga:nextupdate:service"}, Prio::CheckResult);
 
-	upq.ParallelFor(types, [this](const TypePair& type) {
+	upq.ParallelFor(types, [this, differential, &globalDumped](const TypePair& type) {
 		String lcType = type.second;
 
 		std::vector<String> keys = GetTypeObjectKeys(lcType);
-		DeleteKeys(keys, Prio::Config);
+		DumpedHashes dumped;
+
+		if (differential) {
+			try {
+				dumped = FetchDumpedHashes(keys, lcType);
+			} catch (const std::exception& ex) {
+				Log(LogWarning, "IcingaDB")
+					<< "Cannot fetch the previous config dump of type '" << lcType
+					<< "', falling back to a full dump: " << DiagnosticInformation(ex, false);
+			}
+		}
+
+		if (dumped.empty())
+			DeleteKeys(keys, Prio::Config);
+
+		/* Shared keys (custom vars, URLs) are compared, but only cleaned up after all types have been dumped. */
+		DumpedHashes lookup (dumped);
+		lookup.insert(globalDumped.begin(), globalDumped.end());
+
+		ConfigDumpStats stats;
 
 		auto objectChunks (ChunkObjects(type.first->GetObjects(), 500));
 
 		WorkQueue upqObjectType(25000, Configuration::Concurrency);
 		upqObjectType.SetName("IcingaDB:ConfigDump:" + lcType);
 
-		upqObjectType.ParallelFor(objectChunks, [this, &type, &lcType](decltype(objectChunks)::const_reference chunk) {
+		upqObjectType.ParallelFor(objectChunks, [this, &type, &lcType, &dumped, &lookup, &stats](decltype(objectChunks)::const_reference chunk) {
 			std::map<String, std::vector<String>> hMSets, publishes;
 			std::vector<String> states 							= {"HMSET", m_PrefixStateObject + lcType};
 			std::vector<std::vector<String> > transaction 		= {{"MULTI"}};
@@ -173,6 +213,23 @@ void IcingaDB::UpdateAllConfigObjects()
 
 			bool dumpState = (lcType == "host" || lcType == "service");
 
+			// States are written regardless of the previous dump, they're just not stale.
+			auto dumpedStates (dumped.find(m_PrefixStateObject + lcType));
+
+			auto filterUnchanged ([this, &hMSets, &states, &dumped, &lookup, &lcType, &stats, &dumpedStates]() {
+				FilterUnchangedFields(hMSets, lookup, lcType, stats);
+
+				if (dumpedStates != dumped.end() && states.size() > 2u) {
+					std::vector<String> ids;
+
+					for (size_t i = 2; i < states.size(); i += 2) {
+						ids.emplace_back(states[i]);
+					}
+
+					dumpedStates->second->MarkSeen(ids);
+				}
+			});
+
 			size_t bulkCounter = 0;
 			for (const ConfigObject::Ptr& object : chunk) {
 				if (lcType != GetLowerCaseTypeNameDB(object))
@@ -188,6 +245,8 @@ void IcingaDB::UpdateAllConfigObjects()
 
 				bulkCounter++;
 				if (!(bulkCounter % 100)) {
+					filterUnchanged();
+
 					for (auto& kv : hMSets) {
 						if (!kv.second.empty()) {
 							kv.second.insert(kv.second.begin(), {"HMSET", kv.first});
@@ -241,6 +300,8 @@ void IcingaDB::UpdateAllConfigObjects()
 				}
 			}
 
+			filterUnchanged();
+
 			for (auto& kv : hMSets) {
 				if (!kv.second.empty()) {
 					kv.second.insert(kv.second.begin(), {"HMSET", kv.first});
@@ -289,7 +350,24 @@ void IcingaDB::UpdateAllConfigObjects()
 			}
 		}
 
-		m_Rcon->FireAndForgetQuery({"XADD", "icinga:dump", "*", "type", lcType, "state", "done"}, Prio::Config);
+		auto dumpedObjects (dumped.find(m_PrefixConfigObject + lcType));
+
+		if (dumpedObjects != dumped.end()) {
+			// Only fields already present in Redis are marked as seen.
+			stats.Deleted = dumpedObjects->second->Fields.size() - dumpedObjects->second->Seen.size();
+		}
+
+		DeleteStaleFields(dumped);
+
+		Log(LogNotice, "IcingaDB")
+			<< "Dumped objects of type " << lcType << ": " << stats.Added.load() << " added, " << stats.Updated.load() << " updated, "
+			<< stats.Deleted.load() << " deleted, " << stats.Unchanged.load() << " unchanged";
+
+		m_Rcon->FireAndForgetQuery({
+			"XADD", "icinga:dump", "*", "type", lcType, "state", "done",
+			"added", Convert::ToString(stats.Added.load()), "updated", Convert::ToString(stats.Updated.load()),
+			"deleted", Convert::ToString(stats.Deleted.load()), "unchanged", Convert::ToString(stats.Unchanged.load())
+		}, Prio::Config);
 	});
 
 	upq.Join();
@@ -307,8 +385,16 @@ void IcingaDB::UpdateAllConfigObjects()
 		}
 	}
 
+	DeleteStaleFields(globalDumped);
+
 	m_Rcon->FireAndForgetQuery({"XADD", "icinga:dump", "*", "type", "*", "state", "done"}, Prio::Config);
 
+	/* With multiple connections, wait for the dump to be sent. Otherwise state updates
+	 * on another connection could overtake the dump's (older) states once unsuppressed.
+	 */
+	if (GetConnections() > 1)
+		m_Rcon->GetResultOfQuery({"PING"}, Prio::Config);
+
 	Log(LogInformation, "IcingaDB")
 			<< "Initial config/status dump finished in " << Utility::GetTime() - startTime << " seconds.";
 }
@@ -342,6 +428,203 @@ void IcingaDB::DeleteKeys(const std::vector<String>& keys, RedisConnection::Quer
 	m_Rcon->FireAndForgetQuery(std::move(query), priority);
 }
 
+/**
+ * Fetches the given hashes of a previous config dump for a differential one.
+ *
+ * The objects hash of the given type is only fetched by its fields which are
+ * mapped to the checksums from the respective checksums hash.
+ */
+IcingaDB::DumpedHashes IcingaDB::FetchDumpedHashes(const std::vector<String>& keys, const String& type)
+{
+	String objectsKey (m_PrefixConfigObject + type);
+	String checkSumsKey (m_PrefixConfigCheckSum + type);
+	String statesKey (m_PrefixStateObject + type);
+
+	RedisConnection::Queries queries;
+
+	for (auto& key : keys) {
+		queries.push_back({key == objectsKey || key == statesKey ? "HKEYS" : "HGETALL", key});
+	}
+
+	auto replies (m_Rcon->GetResultsOfQueries(std::move(queries), Prio::Config));
+	DumpedHashes dumped;
+
+	for (size_t i = 0; i < keys.size(); ++i) {
+		auto& reply (replies.at(i));
+
+		if (reply.IsObjectType<RedisError>()) {
+			RedisError::Ptr error = reply;
+			BOOST_THROW_EXCEPTION(std::runtime_error("Can't fetch Redis hash '" + keys[i] + "': " + error->GetMessage()));
+		}
+
+		if (!reply.IsObjectType<Array>())
+			BOOST_THROW_EXCEPTION(std::runtime_error("Unexpected reply while fetching Redis hash '" + keys[i] + "'"));
+
+		Array::Ptr fields = reply;
+		ObjectLock fieldsLock (fields);
+		auto hash (std::make_shared<DumpedHash>());
+
+		if (keys[i] == objectsKey || keys[i] == statesKey) {
+			hash->Fields.reserve(fields->GetLength());
+
+			for (auto& field : fields) {
+				hash->Fields.emplace(field, "");
+			}
+		} else {
+			hash->Fields.reserve(fields->GetLength() / 2u);
+
+			for (auto it (fields->Begin()); it != fields->End() && it + 1 != fields->End(); it += 2) {
+				hash->Fields.emplace(*it, *(it + 1));
+			}
+		}
+
+		dumped.emplace(keys[i], std::move(hash));
+	}
+
+	auto objects (dumped.find(objectsKey));
+	auto checkSums (dumped.find(checkSumsKey));
+
+	if (objects != dumped.end() && checkSums != dumped.end()) {
+		for (auto& object : objects->second->Fields) {
+			auto checkSum (checkSums->second->Fields.find(object.first));
+
+			if (checkSum != checkSums->second->Fields.end())
+				object.second = checkSum->second;
+		}
+	}
+
+	return std::move(dumped);
+}
+
+/**
+ * Removes all fields from the given HMSETs which are already present in Redis with the same value.
+ *
+ * Objects are compared by their checksums (see CreateConfigUpdate()) and are kept or dropped along with them.
+ * Without previously dumped hashes nothing is removed and all objects count as added.
+ */
+void IcingaDB::FilterUnchangedFields(std::map<String, std::vector<String>>& hMSets, const DumpedHashes& dumped,
+		const String& type, ConfigDumpStats& stats)
+{
+	String objectsKey (m_PrefixConfigObject + type);
+	String checkSumsKey (m_PrefixConfigCheckSum + type);
+
+	auto objects (hMSets.find(objectsKey));
+	auto checkSums (hMSets.find(checkSumsKey));
+	auto dumpedObjects (dumped.find(objectsKey));
+	auto dumpedCheckSums (dumped.find(checkSumsKey));
+
+	bool compareCheckSums = objects != hMSets.end() && checkSums != hMSets.end()
+		&& dumpedObjects != dumped.end() && dumpedCheckSums != dumped.end();
+
+	if (compareCheckSums) {
+		auto& objs (objects->second);
+		auto& sums (checkSums->second);
+		auto& oldObjs (dumpedObjects->second->Fields);
+
+		VERIFY(objs.size() == sums.size());
+
+		std::vector<String> changedObjs, changedSums, seen;
+
+		for (size_t i = 0; i + 1u < objs.size(); i += 2) {
+			auto oldObj (oldObjs.find(objs[i]));
+
+			if (oldObj == oldObjs.end()) {
+				stats.Added++;
+			} else {
+				seen.emplace_back(objs[i]);
+
+				if (oldObj->second == sums[i + 1u]) {
+					stats.Unchanged++;
+					continue;
+				}
+
+				stats.Updated++;
+			}
+
+			changedObjs.emplace_back(std::move(objs[i]));
+			changedObjs.emplace_back(std::move(objs[i + 1u]));
+			changedSums.emplace_back(std::move(sums[i]));
+			changedSums.emplace_back(std::move(sums[i + 1u]));
+		}
+
+		dumpedObjects->second->MarkSeen(seen);
+		dumpedCheckSums->second->MarkSeen(seen);
+
+		objs = std::move(changedObjs);
+		sums = std::move(changedSums);
+	} else if (objects != hMSets.end()) {
+		stats.Added += objects->second.size() / 2u;
+	}
+
+	for (auto& kv : hMSets) {
+		if (compareCheckSums && (kv.first == objectsKey || kv.first == checkSumsKey))
+			continue;
+
+		auto hash (dumped.find(kv.first));
+
+		if (hash == dumped.end())
+			continue;
+
+		auto& oldFields (hash->second->Fields);
+		std::vector<String> changed, seen;
+
+		for (size_t i = 0; i + 1u < kv.second.size(); i += 2) {
+			auto oldField (oldFields.find(kv.second[i]));
+
+			if (oldField != oldFields.end()) {
+				seen.emplace_back(kv.second[i]);
+
+				if (oldField->second == kv.second[i + 1u])
+					continue;
+			}
+
+			changed.emplace_back(std::move(kv.second[i]));
+			changed.emplace_back(std::move(kv.second[i + 1u]));
+		}
+
+		hash->second->MarkSeen(seen);
+		kv.second = std::move(changed);
+	}
+}
+
+/**
+ * Deletes all fields of the given hashes which haven't been seen during the current dump.
+ */
+void IcingaDB::DeleteStaleFields(const DumpedHashes& dumped)
+{
+	for (auto& kv : dumped) {
+		auto& hash (*kv.second);
+		std::vector<String> hDel ({"HDEL", kv.first});
+
+		for (auto& field : hash.Fields) {
+			if (hash.Seen.find(field.first) != hash.Seen.end())
+				continue;
+
+			hDel.emplace_back(field.first);
+
+			if (hDel.size() >= 1002u) {
+				m_Rcon->FireAndForgetQuery(std::move(hDel), Prio::Config);
+				hDel = {"HDEL", kv.first};
+			}
+		}
+
+		if (hDel.size() > 2u)
+			m_Rcon->FireAndForgetQuery(std::move(hDel), Prio::Config);
+	}
+}
+
+void IcingaDB::DumpedHash::MarkSeen(const std::vector<String>& fields)
+{
+	if (fields.empty())
+		return;
+
+	boost::mutex::scoped_lock lock (Mutex);
+
+	for (auto& field : fields) {
+		Seen.emplace(field);
+	}
+}
+
 std::vector<String> IcingaDB::GetTypeObjectKeys(const String& type)
 {
 	std::vector<String> keys = {
@@ -385,7 +668,7 @@ void IcingaDB::InsertObjectDependencies(const ConfigObject::Ptr& object, const S
 	String objectKey = GetObjectIdentifier(object);
 	CustomVarObject::Ptr customVarObject = dynamic_pointer_cast<CustomVarObject>(object);
 	auto env (GetEnvironment());
-	String envId = SHA1(env);
+	String envId = GetEnvironmentId();
 
 	if (customVarObject) {
 		auto vars(SerializeVars(customVarObject));
@@ -406,7 +689,7 @@ void IcingaDB::InsertObjectDependencies(const ConfigObject::Ptr& object, const S
 					publishes["icinga:config:update:customvar"].emplace_back(kv.first);
 				}
 
-				String id = HashValue(new Array(Prepend(env, Prepend(kv.first, GetObjectIdentifiersWithoutEnv(object)))));
+				String id = HashValue(Prepend(env, Prepend(kv.first, GetObjectIdentifiersWithoutEnv(object))));
 				typeCvs.emplace_back(id);
 				typeCvs.emplace_back(JsonEncode(new Dictionary({{"object_id", objectKey}, {"environment_id", envId}, {"customvar_id", kv.first}})));
 
@@ -426,7 +709,7 @@ void IcingaDB::InsertObjectDependencies(const ConfigObject::Ptr& object, const S
 		String iconImage = checkable->GetIconImage();
 		if (!actionUrl.IsEmpty()) {
 			auto& actionUrls (hMSets[m_PrefixConfigObject + "action_url"]);
-			actionUrls.emplace_back(HashValue(new Array({env, actionUrl})));
+			actionUrls.emplace_back(HashValue({env, actionUrl}));
 			actionUrls.emplace_back(JsonEncode(new Dictionary({{"environment_id", envId}, {"action_url", actionUrl}})));
 
 			if (runtimeUpdate) {
@@ -435,7 +718,7 @@ void IcingaDB::InsertObjectDependencies(const ConfigObject::Ptr& object, const S
 		}
 		if (!notesUrl.IsEmpty()) {
 			auto& notesUrls (hMSets[m_PrefixConfigObject + "notes_url"]);
-			notesUrls.emplace_back(HashValue(new Array({env, notesUrl})));
+			notesUrls.emplace_back(HashValue({env, notesUrl}));
 			notesUrls.emplace_back(JsonEncode(new Dictionary({{"environment_id", envId}, {"notes_url", notesUrl}})));
 
 			if (runtimeUpdate) {
@@ -444,7 +727,7 @@ void IcingaDB::InsertObjectDependencies(const ConfigObject::Ptr& object, const S
 		}
 		if (!iconImage.IsEmpty()) {
 			auto& iconImages (hMSets[m_PrefixConfigObject + "icon_image"]);
-			iconImages.emplace_back(HashValue(new Array({env, iconImage})));
+			iconImages.emplace_back(HashValue({env, iconImage}));
 			iconImages.emplace_back(JsonEncode(new Dictionary({{"environment_id", envId}, {"icon_image", iconImage}})));
 
 			if (runtimeUpdate) {
@@ -477,7 +760,7 @@ void IcingaDB::InsertObjectDependencies(const ConfigObject::Ptr& object, const S
 			for (auto& group : groups) {
 				auto groupObj ((*getGroup)(group));
 				String groupId = GetObjectIdentifier(groupObj);
-				String id = HashValue(new Array(Prepend(env, Prepend(GetObjectIdentifiersWithoutEnv(groupObj), GetObjectIdentifiersWithoutEnv(object)))));
+				String id = HashValue(Prepend(env, Prepend(GetObjectIdentifiersWithoutEnv(groupObj), GetObjectIdentifiersWithoutEnv(object))));
 				members.emplace_back(id);
 				members.emplace_back(JsonEncode(new Dictionary({{"object_id", objectKey}, {"environment_id", envId}, {"group_id", groupId}})));
 
@@ -504,10 +787,10 @@ void IcingaDB::InsertObjectDependencies(const ConfigObject::Ptr& object, const S
 			rangeIds->Reserve(ranges->GetLength());
 
 			for (auto& kv : ranges) {
-				String rangeId = HashValue(new Array({env, kv.first, kv.second}));
+				String rangeId = HashValue({env, kv.first, kv.second});
 				rangeIds->Add(rangeId);
 
-				String id = HashValue(new Array(Prepend(env, Prepend(kv.first, Prepend(kv.second, GetObjectIdentifiersWithoutEnv(object))))));
+				String id = HashValue(Prepend(env, Prepend(kv.first, Prepend(kv.second, GetObjectIdentifiersWithoutEnv(object)))));
 				typeRanges.emplace_back(id);
 				typeRanges.emplace_back(JsonEncode(new Dictionary({{"environment_id", envId}, {"timeperiod_id", objectKey}, {"range_key", kv.first}, {"range_value", kv.second}})));
 
@@ -536,7 +819,7 @@ void IcingaDB::InsertObjectDependencies(const ConfigObject::Ptr& object, const S
 			String includeId = GetObjectIdentifier(includeTp);
 			includeChecksums->Add(includeId);
 
-			String id = HashValue(new Array(Prepend(env, Prepend(GetObjectIdentifiersWithoutEnv(includeTp), GetObjectIdentifiersWithoutEnv(object)))));
+			String id = HashValue(Prepend(env, Prepend(GetObjectIdentifiersWithoutEnv(includeTp), GetObjectIdentifiersWithoutEnv(object))));
 			includs.emplace_back(id);
 			includs.emplace_back(JsonEncode(new Dictionary({{"environment_id", envId}, {"timeperiod_id", objectKey}, {"include_id", includeId}})));
 
@@ -565,7 +848,7 @@ void IcingaDB::InsertObjectDependencies(const ConfigObject::Ptr& object, const S
 			String excludeId = GetObjectIdentifier(excludeTp);
 			excludeChecksums->Add(excludeId);
 
-			String id = HashValue(new Array(Prepend(env, Prepend(GetObjectIdentifiersWithoutEnv(excludeTp), GetObjectIdentifiersWithoutEnv(object)))));
+			String id = HashValue(Prepend(env, Prepend(GetObjectIdentifiersWithoutEnv(excludeTp), GetObjectIdentifiersWithoutEnv(object))));
 			excluds.emplace_back(id);
 			excluds.emplace_back(JsonEncode(new Dictionary({{"environment_id", envId}, {"timeperiod_id", objectKey}, {"exclude_id", excludeId}})));
 
@@ -588,7 +871,7 @@ void IcingaDB::InsertObjectDependencies(const ConfigObject::Ptr& object, const S
 		auto& parnts (hMSets[m_PrefixConfigObject + typeName + ":parent"]);
 
 		for (auto& parent : parentsRaw) {
-			String id = HashValue(new Array(Prepend(env, Prepend(GetObjectIdentifiersWithoutEnv(parent), GetObjectIdentifiersWithoutEnv(object)))));
+			String id = HashValue(Prepend(env, Prepend(GetObjectIdentifiersWithoutEnv(parent), GetObjectIdentifiersWithoutEnv(object))));
 			parnts.emplace_back(id);
 			parnts.emplace_back(JsonEncode(new Dictionary({{"zone_id", objectKey}, {"environment_id", envId}, {"parent_id", GetObjectIdentifier(parent)}})));
 
@@ -622,7 +905,7 @@ void IcingaDB::InsertObjectDependencies(const ConfigObject::Ptr& object, const S
 			for (auto& group : groups) {
 				auto groupObj ((*getGroup)(group));
 				String groupId = GetObjectIdentifier(groupObj);
-				String id = HashValue(new Array(Prepend(env, Prepend(GetObjectIdentifiersWithoutEnv(groupObj), GetObjectIdentifiersWithoutEnv(object)))));
+				String id = HashValue(Prepend(env, Prepend(GetObjectIdentifiersWithoutEnv(groupObj), GetObjectIdentifiersWithoutEnv(object))));
 				members.emplace_back(id);
 				members.emplace_back(JsonEncode(new Dictionary({{"user_id", objectKey}, {"environment_id", envId}, {"group_id", groupId}})));
 
@@ -656,7 +939,7 @@ void IcingaDB::InsertObjectDependencies(const ConfigObject::Ptr& object, const S
 
 		for (auto& user : users) {
 			String userId = GetObjectIdentifier(user);
-			String id = HashValue(new Array(Prepend(env, Prepend(GetObjectIdentifiersWithoutEnv(user), GetObjectIdentifiersWithoutEnv(object)))));
+			String id = HashValue(Prepend(env, Prepend(GetObjectIdentifiersWithoutEnv(user), GetObjectIdentifiersWithoutEnv(object))));
 			usrs.emplace_back(id);
 			usrs.emplace_back(JsonEncode(new Dictionary({{"notification_id", objectKey}, {"environment_id", envId}, {"user_id", userId}})));
 
@@ -678,7 +961,7 @@ void IcingaDB::InsertObjectDependencies(const ConfigObject::Ptr& object, const S
 			auto groupMembers = usergroup->GetMembers();
 			std::copy(groupMembers.begin(), groupMembers.end(), std::inserter(allUsers, allUsers.begin()));
 
-			String id = HashValue(new Array(Prepend(env, Prepend("usergroup", Prepend(GetObjectIdentifiersWithoutEnv(usergroup), GetObjectIdentifiersWithoutEnv(object))))));
+			String id = HashValue(Prepend(env, Prepend("usergroup", Prepend(GetObjectIdentifiersWithoutEnv(usergroup), GetObjectIdentifiersWithoutEnv(object)))));
 			groups.emplace_back(id);
 			groups.emplace_back(JsonEncode(new Dictionary({{"notification_id", objectKey}, {"environment_id", envId}, {"usergroup_id", usergroupId}})));
 
@@ -694,7 +977,7 @@ void IcingaDB::InsertObjectDependencies(const ConfigObject::Ptr& object, const S
 
 		for (auto& user : allUsers) {
 			String userId = GetObjectIdentifier(user);
-			String id = HashValue(new Array(Prepend(env, Prepend("user", Prepend(GetObjectIdentifiersWithoutEnv(user), GetObjectIdentifiersWithoutEnv(object))))));
+			String id = HashValue(Prepend(env, Prepend("user", Prepend(GetObjectIdentifiersWithoutEnv(user), GetObjectIdentifiersWithoutEnv(object)))));
 			notificationRecipients.emplace_back(id);
 			notificationRecipients.emplace_back(JsonEncode(new Dictionary({{"notification_id", objectKey}, {"environment_id", envId}, {"user_id", userId}})));
 
@@ -739,7 +1022,7 @@ void IcingaDB::InsertObjectDependencies(const ConfigObject::Ptr& object, const S
 				values->Set("argument_key", kv.first);
 				values->Set("environment_id", envId);
 
-				String id = HashValue(new Array(Prepend(env, Prepend(kv.first, GetObjectIdentifiersWithoutEnv(object)))));
+				String id = HashValue(Prepend(env, Prepend(kv.first, GetObjectIdentifiersWithoutEnv(object))));
 
 				typeArgs.emplace_back(id);
 				typeArgs.emplace_back(JsonEncode(values));
@@ -786,7 +1069,7 @@ void IcingaDB::InsertObjectDependencies(const ConfigObject::Ptr& object, const S
 				values->Set("envvar_key", kv.first);
 				values->Set("environment_id", envId);
 
-				String id = HashValue(new Array(Prepend(env, Prepend(kv.first, GetObjectIdentifiersWithoutEnv(object)))));
+				String id = HashValue(Prepend(env, Prepend(kv.first, GetObjectIdentifiersWithoutEnv(object))));
 
 				typeVars.emplace_back(id);
 				typeVars.emplace_back(JsonEncode(values));
@@ -809,27 +1092,162 @@ void IcingaDB::UpdateState(const Checkable::Ptr& checkable)
 	if (!m_Rcon || !m_Rcon->IsConnected())
 		return;
 
+	if (m_StateFlushTimer) {
+		QueueStateUpdate(checkable, true, false);
+		return;
+	}
+
 	Dictionary::Ptr stateAttrs = SerializeState(checkable);
 
 	m_Rcon->FireAndForgetQuery({"HSET", m_PrefixStateObject + GetLowerCaseTypeNameDB(checkable), GetObjectIdentifier(checkable), JsonEncode(stateAttrs)}, Prio::State);
 }
 
+/**
+ * Marks the state of a checkable as to be written by the next FlushStates().
+ *
+ * Updates of the same checkable in between are coalesced, only its latest state is sent.
+ *
+ * @param checkable The checkable
+ * @param hash Whether to update its field in icinga:config:state:<type>
+ * @param stream Whether to add its state to icinga:state:stream:<type>
+ */
+void IcingaDB::QueueStateUpdate(const Checkable::Ptr& checkable, bool hash, bool stream)
+{
+	boost::mutex::scoped_lock lock (m_PendingStatesMutex);
+
+	auto& pending (m_PendingStates[checkable.get()]);
+
+	if (!pending.Object) {
+		pending.Object = checkable;
+		pending.Hash = false;
+		pending.Stream = false;
+	}
+
+	pending.Hash = pending.Hash || hash;
+	pending.Stream = pending.Stream || stream;
+}
+
+void IcingaDB::StateFlushTimerHandler()
+{
+	/* Don't pile up flushes while e.g. the config dump blocks the work queue. */
+	if (m_StateFlushQueued.exchange(true))
+		return;
+
+	m_WorkQueue.Enqueue([this]() {
+		m_StateFlushQueued.store(false);
+		FlushStates();
+	});
+}
+
+/**
+ * Writes the latest state of all checkables queued by QueueStateUpdate()
+ * as one pipeline of HMSETs (per type) and state stream XADDs.
+ */
+void IcingaDB::FlushStates()
+{
+	if (!m_Rcon || !m_Rcon->IsConnected()) {
+		boost::mutex::scoped_lock lock (m_PendingStatesMutex);
+		m_PendingStates.clear();
+		return;
+	}
+
+	std::vector<std::vector<String>> queries = GetStateFlushQueries();
+
+	if (!queries.empty())
+		m_Rcon->FireAndForgetQueries(std::move(queries), Prio::State);
+}
+
+/**
+ * Takes all checkables queued by QueueStateUpdate() and serializes their latest state.
+ *
+ * @returns The HMSETs (at most 100 objects each) and state stream XADDs to send
+ */
+std::vector<std::vector<String>> IcingaDB::GetStateFlushQueries()
+{
+	decltype(m_PendingStates) pendingStates;
+
+	{
+		boost::mutex::scoped_lock lock (m_PendingStatesMutex);
+		pendingStates.swap(m_PendingStates);
+	}
+
+	std::map<String, std::vector<String>> hMSets;
+	std::vector<std::vector<String>> queries;
+
+	for (auto& kv : pendingStates) {
+		auto& checkable (kv.second.Object);
+		Dictionary::Ptr stateAttrs = SerializeState(checkable);
+
+		if (kv.second.Hash) {
+			String key = m_PrefixStateObject + GetLowerCaseTypeNameDB(checkable);
+			auto& hMSet (hMSets[key]);
+
+			hMSet.emplace_back(GetObjectIdentifier(checkable));
+			hMSet.emplace_back(JsonEncode(stateAttrs));
+
+			/* Don't let a single HMSET grow unbounded after e.g. a reconnect. */
+			if (hMSet.size() >= 200u) {
+				queries.emplace_back(Prepend(std::vector<String>{"HMSET", std::move(key)}, std::move(hMSet)));
+				hMSet.clear();
+			}
+		}
+
+		if (kv.second.Stream)
+			queries.emplace_back(GetStateStreamAdd(checkable, stateAttrs));
+	}
+
+	for (auto& kv : hMSets) {
+		if (!kv.second.empty())
+			queries.emplace_back(Prepend(std::vector<String>{"HMSET", kv.first}, std::move(kv.second)));
+	}
+
+	return queries;
+}
+
 // Used to update a single object, used for runtime updates
 void IcingaDB::SendConfigUpdate(const ConfigObject::Ptr& object, bool runtimeUpdate)
 {
 	if (!m_Rcon || !m_Rcon->IsConnected())
 		return;
 
+	/* Objects activated before the initial config dump starts are written by it anyway. */
+	if (runtimeUpdate && !m_ConfigDumpInProgress && !m_ConfigDumpDone)
+		return;
+
+	std::vector<std::vector<String>> transaction = GetConfigUpdateQueries(object, runtimeUpdate);
+
+	if (!transaction.empty())
+		m_Rcon->FireAndForgetQueries(std::move(transaction), Prio::Config);
+
+	Checkable::Ptr checkable = dynamic_pointer_cast<Checkable>(object);
+
+	if (checkable) {
+		SendNextUpdate(checkable);
+	}
+}
+
+/**
+ * Builds the transaction which writes the config of a single object (and the state of a checkable)
+ * along with the events which tell subscribers about them.
+ *
+ * @returns The MULTI/EXEC transaction, empty if there's nothing to write
+ */
+std::vector<std::vector<String>> IcingaDB::GetConfigUpdateQueries(const ConfigObject::Ptr& object, bool runtimeUpdate)
+{
 	String typeName = GetLowerCaseTypeNameDB(object);
 
 	std::map<String, std::vector<String>> hMSets, publishes;
-	std::vector<String> states 							= {"HMSET", m_PrefixStateObject + typeName};
 
 	CreateConfigUpdate(object, typeName, hMSets, publishes, runtimeUpdate);
 	Checkable::Ptr checkable = dynamic_pointer_cast<Checkable>(object);
 	if (checkable) {
 		String objectKey = GetObjectIdentifier(object);
-		m_Rcon->FireAndForgetQuery({"HSET", m_PrefixStateObject + typeName, objectKey, JsonEncode(SerializeState(checkable))}, Prio::State);
+
+		/* Not queued for the next FlushStates(), the state has to be there once subscribers are told about it. */
+		auto& states (hMSets[m_PrefixStateObject + typeName]);
+		states.emplace_back(objectKey);
+		states.emplace_back(JsonEncode(SerializeState(checkable)));
+
 		publishes["icinga:config:update:state:" + typeName].emplace_back(objectKey);
 	}
 
@@ -855,14 +1273,12 @@ void IcingaDB::SendConfigUpdate(const ConfigObject::Ptr& object, bool runtimeUpd
 		}
 	}
 
-	if (transaction.size() > 1) {
-		transaction.push_back({"EXEC"});
-		m_Rcon->FireAndForgetQueries(std::move(transaction), Prio::Config);
-	}
+	if (transaction.size() == 1)
+		return {};
 
-	if (checkable) {
-		SendNextUpdate(checkable);
-	}
+	transaction.push_back({"EXEC"});
+
+	return transaction;
 }
 
 // Takes object and collects IcingaDB relevant attributes and computes checksums. Returns whether the object is relevant
@@ -870,7 +1286,7 @@ void IcingaDB::SendConfigUpdate(const ConfigObject::Ptr& object, bool runtimeUpd
 bool IcingaDB::PrepareObject(const ConfigObject::Ptr& object, Dictionary::Ptr& attributes, Dictionary::Ptr& checksums)
 {
 	attributes->Set("name_checksum", SHA1(object->GetName()));
-	attributes->Set("environment_id", SHA1(GetEnvironment()));
+	attributes->Set("environment_id", GetEnvironmentId());
 	attributes->Set("name", object->GetName());
 
 	Zone::Ptr ObjectsZone = static_pointer_cast<Zone>(object->GetZone());
@@ -945,11 +1361,11 @@ bool IcingaDB::PrepareObject(const ConfigObject::Ptr& object, Dictionary::Ptr& a
 		String notesUrl = checkable->GetNotesUrl();
 		String iconImage = checkable->GetIconImage();
 		if (!actionUrl.IsEmpty())
-			attributes->Set("action_url_id", HashValue(new Array({GetEnvironment(), actionUrl})));
+			attributes->Set("action_url_id", HashValue({GetEnvironment(), actionUrl}));
 		if (!notesUrl.IsEmpty())
-			attributes->Set("notes_url_id", HashValue(new Array({GetEnvironment(), notesUrl})));
+			attributes->Set("notes_url_id", HashValue({GetEnvironment(), notesUrl}));
 		if (!iconImage.IsEmpty())
-			attributes->Set("icon_image_id", HashValue(new Array({GetEnvironment(), iconImage})));
+			attributes->Set("icon_image_id", HashValue({GetEnvironment(), iconImage}));
 
 
 		Host::Ptr host;
@@ -1140,9 +1556,6 @@ IcingaDB::CreateConfigUpdate(const ConfigObject::Ptr& object, const String typeN
 		return;
 	*/
 
-	if (m_Rcon == nullptr)
-		return;
-
 	Dictionary::Ptr attr = new Dictionary;
 	Dictionary::Ptr chksm = new Dictionary;
 
@@ -1190,6 +1603,8 @@ void IcingaDB::SendConfigDelete(const ConfigObject::Ptr& object)
 			Prio::CheckResult
 		);
 	}
+
+	ForgetObjectIdentifier(object);
 }
 
 static inline
@@ -1218,22 +1633,11 @@ void IcingaDB::SendStatusUpdate(const ConfigObject::Ptr& object, const CheckResu
 
 	tie(host, service) = GetHostService(checkable);
 
-	String streamname;
-	if (service)
-		streamname = "icinga:state:stream:service";
+	/* Only the latest state matters, but every state change stays in the history. */
+	if (m_StateFlushTimer)
+		QueueStateUpdate(checkable, false, true);
 	else
-		streamname = "icinga:state:stream:host";
-
-	Dictionary::Ptr objectAttrs = SerializeState(checkable);
-
-	std::vector<String> streamadd({"XADD", streamname, "*"});
-	ObjectLock olock(objectAttrs);
-	for (const Dictionary::Pair& kv : objectAttrs) {
-		streamadd.emplace_back(kv.first);
-		streamadd.emplace_back(Utility::ValidateUTF8(kv.second));
-	}
-
-	m_Rcon->FireAndForgetQuery(std::move(streamadd), Prio::State);
+		m_Rcon->FireAndForgetQuery(GetStateStreamAdd(checkable, SerializeState(checkable)), Prio::State);
 
 	int hard_state;
 	if (!cr) {
@@ -1245,7 +1649,7 @@ void IcingaDB::SendStatusUpdate(const ConfigObject::Ptr& object, const CheckResu
 	std::vector<String> xAdd ({
 		"XADD", "icinga:history:stream:state", "*",
 		"id", Utility::NewUniqueID(),
-		"environment_id", SHA1(GetEnvironment()),
+		"environment_id", GetEnvironmentId(),
 		"host_id", GetObjectIdentifier(host),
 		"state_type", Convert::ToString(type),
 		"soft_state", Convert::ToString(cr ? service ? Convert::ToLong(cr->GetState()) : Convert::ToLong(Host::CalculateState(cr->GetState())) : 99),
@@ -1297,6 +1701,19 @@ void IcingaDB::SendStatusUpdate(const ConfigObject::Ptr& object, const CheckResu
 	m_Rcon->FireAndForgetQuery(std::move(xAdd), Prio::History);
 }
 
+std::vector<String> IcingaDB::GetStateStreamAdd(const Checkable::Ptr& checkable, const Dictionary::Ptr& state)
+{
+	std::vector<String> streamadd({"XADD", dynamic_pointer_cast<Service>(checkable) ? "icinga:state:stream:service" : "icinga:state:stream:host", "*"});
+
+	ObjectLock olock(state);
+	for (const Dictionary::Pair& kv : state) {
+		streamadd.emplace_back(kv.first);
+		streamadd.emplace_back(Utility::ValidateUTF8(kv.second));
+	}
+
+	return std::move(streamadd);
+}
+
 void IcingaDB::SendSentNotification(
 	const Notification::Ptr& notification, const Checkable::Ptr& checkable, const std::set<User::Ptr>& users,
 	NotificationType type, const CheckResult::Ptr& cr, const String& author, const String& text
@@ -1320,7 +1737,7 @@ void IcingaDB::SendSentNotification(
 	std::vector<String> xAdd ({
 		"XADD", "icinga:history:stream:notification", "*",
 		"id", notificationHistoryId,
-		"environment_id", SHA1(GetEnvironment()),
+		"environment_id", GetEnvironmentId(),
 		"notification_id", GetObjectIdentifier(notification),
 		"host_id", GetObjectIdentifier(host),
 		"type", Convert::ToString(type),
@@ -1358,7 +1775,7 @@ void IcingaDB::SendSentNotification(
 		std::vector<String> xAddUser ({
 			"XADD", "icinga:history:stream:usernotification", "*",
 			"id", Utility::NewUniqueID(),
-			"environment_id", SHA1(GetEnvironment()),
+			"environment_id", GetEnvironmentId(),
 			"notification_history_id", notificationHistoryId,
 			"user_id", GetObjectIdentifier(user),
 		});
@@ -1384,7 +1801,7 @@ void IcingaDB::SendStartedDowntime(const Downtime::Ptr& downtime)
 	std::vector<String> xAdd ({
 		"XADD", "icinga:history:stream:downtime", "*",
 		"downtime_id", GetObjectIdentifier(downtime),
-		"environment_id", SHA1(GetEnvironment()),
+		"environment_id", GetEnvironmentId(),
 		"host_id", GetObjectIdentifier(host),
 		"entry_time", Convert::ToString(TimestampToMilliseconds(downtime->GetEntryTime())),
 		"author", Utility::ValidateUTF8(downtime->GetAuthor()),
@@ -1455,7 +1872,7 @@ void IcingaDB::SendRemovedDowntime(const Downtime::Ptr& downtime)
 	std::vector<String> xAdd ({
 		"XADD", "icinga:history:stream:downtime", "*",
 		"downtime_id", GetObjectIdentifier(downtime),
-		"environment_id", SHA1(GetEnvironment()),
+		"environment_id", GetEnvironmentId(),
 		"host_id", GetObjectIdentifier(host),
 		"entry_time", Convert::ToString(TimestampToMilliseconds(downtime->GetEntryTime())),
 		"author", Utility::ValidateUTF8(downtime->GetAuthor()),
@@ -1523,7 +1940,7 @@ void IcingaDB::SendAddedComment(const Comment::Ptr& comment)
 	std::vector<String> xAdd ({
 		"XADD", "icinga:history:stream:comment", "*",
 		"comment_id", GetObjectIdentifier(comment),
-		"environment_id", SHA1(GetEnvironment()),
+		"environment_id", GetEnvironmentId(),
 		"host_id", GetObjectIdentifier(host),
 		"entry_time", Convert::ToString(TimestampToMilliseconds(comment->GetEntryTime())),
 		"author", Utility::ValidateUTF8(comment->GetAuthor()),
@@ -1578,7 +1995,7 @@ void IcingaDB::SendRemovedComment(const Comment::Ptr& comment)
 	std::vector<String> xAdd ({
 		"XADD", "icinga:history:stream:comment", "*",
 		"comment_id", GetObjectIdentifier(comment),
-		"environment_id", SHA1(GetEnvironment()),
+		"environment_id", GetEnvironmentId(),
 		"host_id", GetObjectIdentifier(host),
 		"entry_time", Convert::ToString(TimestampToMilliseconds(comment->GetEntryTime())),
 		"author", Utility::ValidateUTF8(comment->GetAuthor()),
@@ -1642,7 +2059,7 @@ void IcingaDB::SendFlappingChange(const Checkable::Ptr& checkable, double change
 
 	std::vector<String> xAdd ({
 		"XADD", "icinga:history:stream:flapping", "*",
-		"environment_id", SHA1(GetEnvironment()),
+		"environment_id", GetEnvironmentId(),
 		"host_id", GetObjectIdentifier(host),
 		"flapping_threshold_low", Convert::ToString(checkable->GetFlappingThresholdLow()),
 		"flapping_threshold_high", Convert::ToString(checkable->GetFlappingThresholdHigh()),
@@ -1689,7 +2106,7 @@ void IcingaDB::SendFlappingChange(const Checkable::Ptr& checkable, double change
 	xAdd.emplace_back("start_time");
 	xAdd.emplace_back(Convert::ToString(startTime));
 	xAdd.emplace_back("id");
-	xAdd.emplace_back(HashValue(new Array({GetEnvironment(), checkable->GetReflectionType()->GetName(), checkable->GetName(), startTime})));
+	xAdd.emplace_back(HashValue({GetEnvironment(), checkable->GetReflectionType()->GetName(), checkable->GetName(), startTime}));
 
 	m_Rcon->FireAndForgetQuery(std::move(xAdd), Prio::History);
 }
@@ -1722,7 +2139,7 @@ void IcingaDB::SendAcknowledgementSet(const Checkable::Ptr& checkable, const Str
 	std::vector<String> xAdd ({
 		"XADD", "icinga:history:stream:acknowledgement", "*",
 		"event_id", Utility::NewUniqueID(),
-		"environment_id", SHA1(GetEnvironment()),
+		"environment_id", GetEnvironmentId(),
 		"host_id", GetObjectIdentifier(host),
 		"event_type", "ack_set",
 		"author", author,
@@ -1758,7 +2175,7 @@ void IcingaDB::SendAcknowledgementSet(const Checkable::Ptr& checkable, const Str
 	xAdd.emplace_back("set_time");
 	xAdd.emplace_back(Convert::ToString(setTime));
 	xAdd.emplace_back("id");
-	xAdd.emplace_back(HashValue(new Array({GetEnvironment(), checkable->GetReflectionType()->GetName(), checkable->GetName(), setTime})));
+	xAdd.emplace_back(HashValue({GetEnvironment(), checkable->GetReflectionType()->GetName(), checkable->GetName(), setTime}));
 
 	m_Rcon->FireAndForgetQuery(std::move(xAdd), Prio::History);
 }
@@ -1775,7 +2192,7 @@ void IcingaDB::SendAcknowledgementCleared(const Checkable::Ptr& checkable, const
 	std::vector<String> xAdd ({
 		"XADD", "icinga:history:stream:acknowledgement", "*",
 		"event_id", Utility::NewUniqueID(),
-		"environment_id", SHA1(GetEnvironment()),
+		"environment_id", GetEnvironmentId(),
 		"host_id", GetObjectIdentifier(host),
 		"clear_time", Convert::ToString(TimestampToMilliseconds(changeTime)),
 		"event_type", "ack_clear"
@@ -1803,7 +2220,7 @@ void IcingaDB::SendAcknowledgementCleared(const Checkable::Ptr& checkable, const
 	xAdd.emplace_back("set_time");
 	xAdd.emplace_back(Convert::ToString(setTime));
 	xAdd.emplace_back("id");
-	xAdd.emplace_back(HashValue(new Array({GetEnvironment(), checkable->GetReflectionType()->GetName(), checkable->GetName(), setTime})));
+	xAdd.emplace_back(HashValue({GetEnvironment(), checkable->GetReflectionType()->GetName(), checkable->GetName(), setTime}));
 
 	if (!removedBy.IsEmpty()) {
 		xAdd.emplace_back("cleared_by");
@@ -1823,7 +2240,7 @@ Dictionary::Ptr IcingaDB::SerializeState(const Checkable::Ptr& checkable)
 	tie(host, service) = GetHostService(checkable);
 
 	attrs->Set("id", GetObjectIdentifier(checkable));;
-	attrs->Set("environment_id", SHA1(GetEnvironment()));
+	attrs->Set("environment_id", GetEnvironmentId());
 	attrs->Set("state_type", checkable->HasBeenChecked() ? checkable->GetStateType() : StateTypeHard);
 
 	// TODO: last_hard/soft_state should be "previous".
@@ -5,10 +5,57 @@
 #include "base/logger.hpp"
 #include "base/serializer.hpp"
 #include "base/statsfunction.hpp"
+#include "base/configtype.hpp"
 #include "base/convert.hpp"
+#include "base/perfdatavalue.hpp"
 
 using namespace icinga;
 
+REGISTER_STATSFUNCTION(IcingaDB, &IcingaDB::StatsFunc);
+
+void IcingaDB::StatsFunc(const Dictionary::Ptr& status, const Array::Ptr& perfdata)
+{
+	DictionaryData nodes;
+
+	for (const IcingaDB::Ptr& icingadb : ConfigType::GetObjectsByType<IcingaDB>()) {
+		auto rcon (icingadb->m_Rcon);
+
+		if (!rcon)
+			continue;
+
+		Array::Ptr lanes = rcon->GetLaneStats();
+
+		{
+			ObjectLock lanesLock (lanes);
+			size_t i = 0;
+
+			for (Dictionary::Ptr lane : lanes) {
+				String prefix = "icingadb_" + icingadb->GetName() + "_connection_" + Convert::ToString(i++);
+
+				perfdata->Add(new PerfdataValue(prefix + "_pending_queries", lane->Get("pending_queries")));
+				perfdata->Add(new PerfdataValue(prefix + "_pending_responses", lane->Get("pending_responses")));
+				perfdata->Add(new PerfdataValue(prefix + "_round_trip_time", lane->Get("round_trip_time")));
+			}
+		}
+
+		size_t pendingStates;
+
+		{
+			boost::mutex::scoped_lock lock (icingadb->m_PendingStatesMutex);
+			pendingStates = icingadb->m_PendingStates.size();
+		}
+
+		perfdata->Add(new PerfdataValue("icingadb_" + icingadb->GetName() + "_pending_states", pendingStates));
+
+		nodes.emplace_back(icingadb->GetName(), new Dictionary({
+			{ "connections", lanes },
+			{ "pending_states", pendingStates }
+		}));
+	}
+
+	status->Set("icingadb", new Dictionary(std::move(nodes)));
+}
+
 Dictionary::Ptr IcingaDB::GetStats()
 {
 	Dictionary::Ptr stats = new Dictionary();
@@ -18,7 +18,10 @@
 #include "icinga/eventcommand.hpp"
 #include "icinga/host.hpp"
 #include <boost/algorithm/string.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/shared_mutex.hpp>
 #include <map>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -62,7 +65,26 @@ String IcingaDB::FormatCommandLine(const Value& commandLine)
 
 String IcingaDB::GetEnvironment()
 {
-	return ConfigType::GetObjectsByType<IcingaApplication>()[0]->GetEnvironment();
+	return IcingaApplication::GetInstance()->GetEnvironment();
+}
+
+/**
+ * SHA1(GetEnvironment()), only re-hashed if the environment changed.
+ */
+String IcingaDB::GetEnvironmentId()
+{
+	static boost::mutex mutex;
+	static String environment, environmentId;
+
+	String env = GetEnvironment();
+	boost::mutex::scoped_lock lock (mutex);
+
+	if (environmentId.IsEmpty() || env != environment) {
+		environmentId = SHA1(env);
+		environment = std::move(env);
+	}
+
+	return environmentId;
 }
 
 ArrayData IcingaDB::GetObjectIdentifiersWithoutEnv(const ConfigObject::Ptr& object)
@@ -75,9 +97,62 @@ ArrayData IcingaDB::GetObjectIdentifiersWithoutEnv(const ConfigObject::Ptr& obje
 		return {object->GetName()};
 }
 
+/* The identifiers computed by GetObjectIdentifier() for l_ObjectIdentifiersEnvironment, by type and name.
+ * Not kept in the objects' extensions, those can't be created concurrently.
+ */
+static boost::shared_mutex l_ObjectIdentifiersMutex;
+static String l_ObjectIdentifiersEnvironment;
+static std::unordered_map<String, String, std::hash<std::string>> l_ObjectIdentifiers;
+
+static String GetObjectIdentifierKey(const ConfigObject::Ptr& object)
+{
+	/* Type names don't contain "!", so the first one separates the type from the name. */
+	return object->GetReflectionType()->GetName() + "!" + object->GetName();
+}
+
+/**
+ * Returns SHA1(PackObject([Environment, ...GetObjectIdentifiersWithoutEnv(object)])).
+ *
+ * It's computed once per object and environment. (Object names are immutable.)
+ */
 String IcingaDB::GetObjectIdentifier(const ConfigObject::Ptr& object)
 {
-	return HashValue(new Array(Prepend(GetEnvironment(), GetObjectIdentifiersWithoutEnv(object))));
+	String env = GetEnvironment();
+	String key = GetObjectIdentifierKey(object);
+
+	{
+		boost::shared_lock<boost::shared_mutex> lock (l_ObjectIdentifiersMutex);
+
+		if (env == l_ObjectIdentifiersEnvironment) {
+			auto it (l_ObjectIdentifiers.find(key));
+
+			if (it != l_ObjectIdentifiers.end())
+				return it->second;
+		}
+	}
+
+	String identifier = HashValue(Prepend(env, GetObjectIdentifiersWithoutEnv(object)));
+
+	boost::unique_lock<boost::shared_mutex> lock (l_ObjectIdentifiersMutex);
+
+	if (env != l_ObjectIdentifiersEnvironment) {
+		l_ObjectIdentifiers.clear();
+		l_ObjectIdentifiersEnvironment = std::move(env);
+	}
+
+	l_ObjectIdentifiers.emplace(std::move(key), identifier);
+
+	return identifier;
+}
+
+/**
+ * Drops the cached identifier of a deleted object.
+ */
+void IcingaDB::ForgetObjectIdentifier(const ConfigObject::Ptr& object)
+{
+	boost::unique_lock<boost::shared_mutex> lock (l_ObjectIdentifiersMutex);
+
+	l_ObjectIdentifiers.erase(GetObjectIdentifierKey(object));
 }
 
 static const std::set<String> metadataWhitelist ({"package", "source_location", "templates"});
@@ -130,13 +205,13 @@ Dictionary::Ptr IcingaDB::SerializeVars(const CustomVarObject::Ptr& object)
 
 	Dictionary::Ptr res = new Dictionary();
 	auto env (GetEnvironment());
-	auto envChecksum (SHA1(env));
+	auto envChecksum (GetEnvironmentId());
 
 	ObjectLock olock(vars);
 
 	for (auto& kv : vars) {
 		res->Set(
-			SHA1(PackObject((Array::Ptr)new Array({env, kv.first, kv.second}))),
+			HashValue({env, kv.first, kv.second}),
 			(Dictionary::Ptr)new Dictionary({
 				{"environment_id", envChecksum},
 				{"name_checksum", SHA1(kv.first)},
@@ -186,7 +261,7 @@ String IcingaDB::HashValue(const Value& value, const std::set<String>& propertie
 
 				while (current != dict->End()) {
 					if (propertiesBlacklist.find(current->first) == propertiesBlacklistEnd) {
-						dict->Remove(current++);
+						current = dict->Remove(current);
 					} else {
 						++current;
 					}
@@ -201,7 +276,22 @@ String IcingaDB::HashValue(const Value& value, const std::set<String>& propertie
 		}
 	}
 
-	return SHA1(PackObject(temp));
+	SHA1Hasher hasher;
+	PackObject(temp, hasher);
+
+	return hasher.Finish();
+}
+
+/**
+ * Same as HashValue(new Array(values)), but without creating the array
+ * and the packed string.
+ */
+String IcingaDB::HashValue(const ArrayData& values)
+{
+	SHA1Hasher hasher;
+	PackObject(values, hasher);
+
+	return hasher.Finish();
 }
 
 String IcingaDB::GetLowerCaseTypeNameDB(const ConfigObject::Ptr& obj)
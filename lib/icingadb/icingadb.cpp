@@ -63,7 +63,7 @@ void IcingaDB::Start(bool runtimeCreated)
 	m_ConfigDumpInProgress = false;
 	m_ConfigDumpDone = false;
 
-	m_Rcon = new RedisConnection(GetHost(), GetPort(), GetPath(), GetPassword(), GetDbIndex());
+	m_Rcon = new RedisConnection(GetHost(), GetPort(), GetPath(), GetPassword(), GetDbIndex(), GetConnections());
 	m_Rcon->Start();
 
 	m_WorkQueue.SetExceptionCallback([this](boost::exception_ptr exp) { ExceptionHandler(std::move(exp)); });
@@ -79,6 +79,13 @@ void IcingaDB::Start(bool runtimeCreated)
 	m_StatsTimer->OnTimerExpired.connect([this](const Timer * const&) { PublishStatsTimerHandler(); });
 	m_StatsTimer->Start();
 
+	if (GetStateFlushInterval() > 0) {
+		m_StateFlushTimer = new Timer();
+		m_StateFlushTimer->SetInterval(GetStateFlushInterval());
+		m_StateFlushTimer->OnTimerExpired.connect([this](const Timer * const&) { StateFlushTimerHandler(); });
+		m_StateFlushTimer->Start();
+	}
+
 	m_WorkQueue.SetName("IcingaDB");
 
 	m_Rcon->SuppressQueryKind(Prio::CheckResult);
@@ -153,12 +160,28 @@ void IcingaDB::PublishStats()
 
 void IcingaDB::Stop(bool runtimeRemoved)
 {
+	if (m_StateFlushTimer) {
+		m_StateFlushTimer->Stop(true);
+
+		/* Queue the final flush behind any one already queued by the timer, so they don't run concurrently. */
+		m_WorkQueue.Enqueue([this]() { FlushStates(); });
+		m_WorkQueue.Join();
+	}
+
 	Log(LogInformation, "IcingaDB")
 		<< "'" << GetName() << "' stopped.";
 
 	ObjectImpl<IcingaDB>::Stop(runtimeRemoved);
 }
 
+void IcingaDB::ValidateConnections(const Lazy<int>& lvalue, const ValidationUtils& utils)
+{
+	ObjectImpl<IcingaDB>::ValidateConnections(lvalue, utils);
+
+	if (lvalue() <= 0)
+		BOOST_THROW_EXCEPTION(ValidationError(this, { "connections" }, "Value must be greater than 0."));
+}
+
 void IcingaDB::AssertOnWorkQueue()
 {
 	ASSERT(m_WorkQueue.IsWorkerThread());
@@ -12,7 +12,12 @@
 #include "icinga/service.hpp"
 #include "icinga/downtime.hpp"
 #include "remote/messageorigin.hpp"
+#include <boost/thread/mutex.hpp>
+#include <atomic>
+#include <map>
 #include <memory>
+#include <unordered_map>
+#include <unordered_set>
 #include <utility>
 
 namespace icinga
@@ -30,10 +35,18 @@ public:
 	IcingaDB();
 
 	static void ConfigStaticInitialize();
+	static void StatsFunc(const Dictionary::Ptr& status, const Array::Ptr& perfdata);
 
 	virtual void Start(bool runtimeCreated) override;
 	virtual void Stop(bool runtimeRemoved) override;
 
+	void ValidateConnections(const Lazy<int>& lvalue, const ValidationUtils& utils) override;
+
+	/* Note: Only use them for unit test mocks. Prefer the state flush timer and the config update handlers. */
+	void QueueStateUpdate(const Checkable::Ptr& checkable, bool hash, bool stream);
+	std::vector<std::vector<String>> GetStateFlushQueries();
+	std::vector<std::vector<String>> GetConfigUpdateQueries(const ConfigObject::Ptr& object, bool runtimeUpdate);
+
 private:
 	void ReconnectTimerHandler();
 	void TryToReconnect();
@@ -42,13 +55,48 @@ private:
 	void PublishStats();
 
 	/* config & status dump */
+
+	/**
+	 * A Redis hash as found before a differential config dump. Fields are mapped
+	 * to their values (or, for the object hashes, to the objects' checksums).
+	 * Seen collects the fields (re-)written by this dump, all others are stale.
+	 */
+	struct DumpedHash
+	{
+		boost::mutex Mutex;
+		std::unordered_map<String, String, std::hash<std::string>> Fields;
+		std::unordered_set<String, std::hash<std::string>> Seen;
+
+		void MarkSeen(const std::vector<String>& fields);
+	};
+
+	typedef std::map<String, std::shared_ptr<DumpedHash>> DumpedHashes;
+
+	/**
+	 * Objects of one type as handled by a config dump.
+	 */
+	struct ConfigDumpStats
+	{
+		std::atomic<size_t> Added{0};
+		std::atomic<size_t> Updated{0};
+		std::atomic<size_t> Unchanged{0};
+		std::atomic<size_t> Deleted{0};
+	};
+
 	void UpdateAllConfigObjects();
+	DumpedHashes FetchDumpedHashes(const std::vector<String>& keys, const String& type);
+	void FilterUnchangedFields(std::map<String, std::vector<String>>& hMSets, const DumpedHashes& dumped,
+			const String& type, ConfigDumpStats& stats);
+	void DeleteStaleFields(const DumpedHashes& dumped);
 	std::vector<std::vector<intrusive_ptr<ConfigObject>>> ChunkObjects(std::vector<intrusive_ptr<ConfigObject>> objects, size_t chunkSize);
 	void DeleteKeys(const std::vector<String>& keys, RedisConnection::QueryPriority priority);
 	std::vector<String> GetTypeObjectKeys(const String& type);
 	void InsertObjectDependencies(const ConfigObject::Ptr& object, const String typeName, std::map<String, std::vector<String>>& hMSets,
 			std::map<String, std::vector<String>>& publishes, bool runtimeUpdate);
 	void UpdateState(const Checkable::Ptr& checkable);
+	void StateFlushTimerHandler();
+	void FlushStates();
+	std::vector<String> GetStateStreamAdd(const Checkable::Ptr& checkable, const Dictionary::Ptr& state);
 	void SendConfigUpdate(const ConfigObject::Ptr& object, bool runtimeUpdate);
 	void CreateConfigUpdate(const ConfigObject::Ptr& object, const String type, std::map<String, std::vector<String>>& hMSets,
 			std::map<String, std::vector<String>>& publishes, bool runtimeUpdate);
@@ -82,10 +130,13 @@ private:
 
 	static ArrayData GetObjectIdentifiersWithoutEnv(const ConfigObject::Ptr& object);
 	static String GetObjectIdentifier(const ConfigObject::Ptr& object);
+	static void ForgetObjectIdentifier(const ConfigObject::Ptr& object);
 	static String GetEnvironment();
+	static String GetEnvironmentId();
 	static Dictionary::Ptr SerializeVars(const CustomVarObject::Ptr& object);
 
 	static String HashValue(const Value& value);
+	static String HashValue(const ArrayData& values);
 	static String HashValue(const Value& value, const std::set<String>& propertiesBlacklist, bool propertiesWhitelist = false);
 
 	static String GetLowerCaseTypeNameDB(const ConfigObject::Ptr& obj);
@@ -133,10 +184,25 @@ private:
 		return std::move(haystack);
 	}
 
+	/**
+	 * A checkable whose latest state still has to be written.
+	 */
+	struct PendingState
+	{
+		Checkable::Ptr Object;
+		bool Hash; /* icinga:config:state:<type> */
+		bool Stream; /* icinga:state:stream:<type> */
+	};
+
 	Timer::Ptr m_StatsTimer;
 	Timer::Ptr m_ReconnectTimer;
+	Timer::Ptr m_StateFlushTimer;
 	WorkQueue m_WorkQueue;
 
+	boost::mutex m_PendingStatesMutex;
+	std::unordered_map<Checkable*, PendingState> m_PendingStates;
+	std::atomic<bool> m_StateFlushQueued{false};
+
 	String m_PrefixConfigObject;
 	String m_PrefixConfigCheckSum;
 	String m_PrefixStateObject;
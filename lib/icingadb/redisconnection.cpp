@@ -9,6 +9,7 @@
 #include "base/objectlock.hpp"
 #include "base/string.hpp"
 #include "base/tcpsocket.hpp"
+#include "base/utility.hpp"
 #include <boost/asio.hpp>
 #include <boost/coroutine/exceptions.hpp>
 #include <boost/date_time/posix_time/posix_time_duration.hpp>
@@ -23,19 +24,40 @@
 using namespace icinga;
 namespace asio = boost::asio;
 
-RedisConnection::RedisConnection(const String& host, const int port, const String& path, const String& password, const int db) :
-	RedisConnection(IoEngine::Get().GetIoContext(), host, port, path, password, db)
+using Prio = RedisConnection::QueryPriority;
+
+/* Lets many small queries share a few large writes. */
+static const size_t l_BufferSize = 64 * 1024;
+
+RedisConnection::RedisConnection(const String& host, const int port, const String& path, const String& password, const int db,
+	const int lanes) : RedisConnection(IoEngine::Get().GetIoContext(), host, port, path, password, db)
 {
+	if (lanes > 1) {
+		m_Lanes.reserve(lanes);
+
+		for (int i = 0; i < lanes; ++i) {
+			m_Lanes.emplace_back(new RedisConnection(IoEngine::Get().GetIoContext(), m_Host, m_Port, m_Path, m_Password, m_DbIndex));
+		}
+	}
 }
 
 RedisConnection::RedisConnection(boost::asio::io_context& io, String host, int port, String path, String password, int db)
 	: m_Host(std::move(host)), m_Port(port), m_Path(std::move(path)), m_Password(std::move(password)), m_DbIndex(db),
-	  m_Connecting(false), m_Connected(false), m_Started(false), m_Strand(io), m_QueuedWrites(io), m_QueuedReads(io)
+	  m_Connecting(false), m_Connected(false), m_Started(false), m_Strand(io), m_QueuedWrites(io), m_QueuedReads(io),
+	  m_PendingQueries(0), m_PendingResponses(0), m_RoundTripTime(0)
 {
 }
 
 void RedisConnection::Start()
 {
+	if (!m_Lanes.empty()) {
+		for (auto& lane : m_Lanes) {
+			lane->Start();
+		}
+
+		return;
+	}
+
 	if (!m_Started.exchange(true)) {
 		Ptr keepAlive (this);
 
@@ -51,9 +73,73 @@ void RedisConnection::Start()
 }
 
 bool RedisConnection::IsConnected() {
+	if (!m_Lanes.empty()) {
+		for (auto& lane : m_Lanes) {
+			if (!lane->IsConnected()) {
+				return false;
+			}
+		}
+
+		return true;
+	}
+
 	return m_Connected.load();
 }
 
+/**
+ * Get the lane queries of the given priority are sent over
+ *
+ * Config dumps get the first lane for themselves not to delay any other queries,
+ * the other priorities share the remaining lanes.
+ *
+ * @param priority The queries' priority
+ *
+ * @return The lane
+ */
+const RedisConnection::Ptr& RedisConnection::GetLane(RedisConnection::QueryPriority priority)
+{
+	size_t other = 0;
+
+	switch (priority) {
+		case Prio::Config:
+			return m_Lanes.front();
+		case Prio::State:
+			other = 0;
+			break;
+		case Prio::History:
+			other = 1;
+			break;
+		case Prio::CheckResult:
+			other = 2;
+			break;
+		default:
+			other = 3;
+	}
+
+	if (m_Lanes.size() < 2u) {
+		return m_Lanes.front();
+	}
+
+	return m_Lanes[1u + other % (m_Lanes.size() - 1u)];
+}
+
+/**
+ * Queue something to be sent to Redis
+ *
+ * @param priority The queries' priority
+ * @param queries The amount of queries
+ * @param item The queries
+ */
+void RedisConnection::Enqueue(RedisConnection::QueryPriority priority, size_t queries, RedisConnection::WriteQueueItem item)
+{
+	m_PendingQueries.fetch_add(queries);
+
+	asio::post(m_Strand, [this, priority, item]() {
+		m_Queues.Writes[priority].emplace(item);
+		m_QueuedWrites.Set();
+	});
+}
+
 /**
  * Append a Redis query to a log message
  *
@@ -87,6 +173,11 @@ void LogQuery(RedisConnection::Query& query, Log& msg)
  */
 void RedisConnection::FireAndForgetQuery(RedisConnection::Query query, RedisConnection::QueryPriority priority)
 {
+	if (!m_Lanes.empty()) {
+		GetLane(priority)->FireAndForgetQuery(std::move(query), priority);
+		return;
+	}
+
 	{
 		Log msg (LogNotice, "IcingaDB", "Firing and forgetting query:");
 		LogQuery(query, msg);
@@ -94,10 +185,7 @@ void RedisConnection::FireAndForgetQuery(RedisConnection::Query query, RedisConn
 
 	auto item (Shared<Query>::Make(std::move(query)));
 
-	asio::post(m_Strand, [this, item, priority]() {
-		m_Queues.Writes[priority].emplace(WriteQueueItem{item, nullptr, nullptr, nullptr});
-		m_QueuedWrites.Set();
-	});
+	Enqueue(priority, 1, WriteQueueItem{item, nullptr, nullptr, nullptr});
 }
 
 /**
@@ -108,17 +196,20 @@ void RedisConnection::FireAndForgetQuery(RedisConnection::Query query, RedisConn
  */
 void RedisConnection::FireAndForgetQueries(RedisConnection::Queries queries, RedisConnection::QueryPriority priority)
 {
+	if (!m_Lanes.empty()) {
+		GetLane(priority)->FireAndForgetQueries(std::move(queries), priority);
+		return;
+	}
+
 	for (auto& query : queries) {
 		Log msg (LogNotice, "IcingaDB", "Firing and forgetting query:");
 		LogQuery(query, msg);
 	}
 
+	auto amount (queries.size());
 	auto item (Shared<Queries>::Make(std::move(queries)));
 
-	asio::post(m_Strand, [this, item, priority]() {
-		m_Queues.Writes[priority].emplace(WriteQueueItem{nullptr, item, nullptr, nullptr});
-		m_QueuedWrites.Set();
-	});
+	Enqueue(priority, amount, WriteQueueItem{nullptr, item, nullptr, nullptr});
 }
 
 /**
@@ -131,6 +222,10 @@ void RedisConnection::FireAndForgetQueries(RedisConnection::Queries queries, Red
  */
 RedisConnection::Reply RedisConnection::GetResultOfQuery(RedisConnection::Query query, RedisConnection::QueryPriority priority)
 {
+	if (!m_Lanes.empty()) {
+		return GetLane(priority)->GetResultOfQuery(std::move(query), priority);
+	}
+
 	{
 		Log msg (LogNotice, "IcingaDB", "Executing query:");
 		LogQuery(query, msg);
@@ -140,10 +235,7 @@ RedisConnection::Reply RedisConnection::GetResultOfQuery(RedisConnection::Query
 	auto future (promise.get_future());
 	auto item (Shared<std::pair<Query, std::promise<Reply>>>::Make(std::move(query), std::move(promise)));
 
-	asio::post(m_Strand, [this, item, priority]() {
-		m_Queues.Writes[priority].emplace(WriteQueueItem{nullptr, nullptr, item, nullptr});
-		m_QueuedWrites.Set();
-	});
+	Enqueue(priority, 1, WriteQueueItem{nullptr, nullptr, item, nullptr});
 
 	item = nullptr;
 	future.wait();
@@ -160,6 +252,10 @@ RedisConnection::Reply RedisConnection::GetResultOfQuery(RedisConnection::Query
  */
 RedisConnection::Replies RedisConnection::GetResultsOfQueries(RedisConnection::Queries queries, RedisConnection::QueryPriority priority)
 {
+	if (!m_Lanes.empty()) {
+		return GetLane(priority)->GetResultsOfQueries(std::move(queries), priority);
+	}
+
 	for (auto& query : queries) {
 		Log msg (LogNotice, "IcingaDB", "Executing query:");
 		LogQuery(query, msg);
@@ -167,12 +263,10 @@ RedisConnection::Replies RedisConnection::GetResultsOfQueries(RedisConnection::Q
 
 	std::promise<Replies> promise;
 	auto future (promise.get_future());
+	auto amount (queries.size());
 	auto item (Shared<std::pair<Queries, std::promise<Replies>>>::Make(std::move(queries), std::move(promise)));
 
-	asio::post(m_Strand, [this, item, priority]() {
-		m_Queues.Writes[priority].emplace(WriteQueueItem{nullptr, nullptr, nullptr, item});
-		m_QueuedWrites.Set();
-	});
+	Enqueue(priority, amount, WriteQueueItem{nullptr, nullptr, nullptr, item});
 
 	item = nullptr;
 	future.wait();
@@ -186,6 +280,11 @@ RedisConnection::Replies RedisConnection::GetResultsOfQueries(RedisConnection::Q
  */
 void RedisConnection::SuppressQueryKind(RedisConnection::QueryPriority kind)
 {
+	if (!m_Lanes.empty()) {
+		GetLane(kind)->SuppressQueryKind(kind);
+		return;
+	}
+
 	asio::post(m_Strand, [this, kind]() { m_SuppressedQueryKinds.emplace(kind); });
 }
 
@@ -196,6 +295,11 @@ void RedisConnection::SuppressQueryKind(RedisConnection::QueryPriority kind)
  */
 void RedisConnection::UnsuppressQueryKind(RedisConnection::QueryPriority kind)
 {
+	if (!m_Lanes.empty()) {
+		GetLane(kind)->UnsuppressQueryKind(kind);
+		return;
+	}
+
 	asio::post(m_Strand, [this, kind]() {
 		m_SuppressedQueryKinds.erase(kind);
 		m_QueuedWrites.Set();
@@ -217,14 +321,14 @@ void RedisConnection::Connect(asio::yield_context& yc)
 				Log(LogInformation, "IcingaDB")
 					<< "Trying to connect to Redis server (async) on host '" << m_Host << ":" << m_Port << "'";
 
-				auto conn (Shared<TcpConn>::Make(m_Strand.context()));
+				auto conn (Shared<TcpConn>::Make(m_Strand.context(), l_BufferSize, l_BufferSize));
 				icinga::Connect(conn->next_layer(), m_Host, Convert::ToString(m_Port), yc);
 				m_TcpConn = std::move(conn);
 			} else {
 				Log(LogInformation, "IcingaDB")
 					<< "Trying to connect to Redis server (async) on unix socket path '" << m_Path << "'";
 
-				auto conn (Shared<UnixConn>::Make(m_Strand.context()));
+				auto conn (Shared<UnixConn>::Make(m_Strand.context(), l_BufferSize, l_BufferSize));
 				conn->next_layer().async_connect(Unix::endpoint(m_Path.CStr()), yc);
 				m_UnixConn = std::move(conn);
 			}
@@ -259,6 +363,8 @@ void RedisConnection::ReadLoop(asio::yield_context& yc)
 			auto item (std::move(m_Queues.FutureResponseActions.front()));
 			m_Queues.FutureResponseActions.pop();
 
+			m_PendingResponses.fetch_sub(item.Amount);
+
 			switch (item.Action) {
 				case ResponseAction::Ignore:
 					try {
@@ -324,6 +430,8 @@ void RedisConnection::ReadLoop(asio::yield_context& yc)
 						promise.set_value(std::move(replies));
 					}
 			}
+
+			AddRoundTripTime(item);
 		}
 
 		m_QueuedReads.Clear();
@@ -338,6 +446,8 @@ void RedisConnection::WriteLoop(asio::yield_context& yc)
 	for (;;) {
 		m_QueuedWrites.Wait(yc);
 
+		bool unflushed = false;
+
 	WriteFirstOfHighestPrio:
 		for (auto& queue : m_Queues.Writes) {
 			if (m_SuppressedQueryKinds.find(queue.first) != m_SuppressedQueryKinds.end() || queue.second.empty()) {
@@ -348,6 +458,23 @@ void RedisConnection::WriteLoop(asio::yield_context& yc)
 			queue.second.pop();
 
 			WriteItem(yc, std::move(next));
+			unflushed = true;
+
+			goto WriteFirstOfHighestPrio;
+		}
+
+		// Send all queries written so far at once and then look for ones queued meanwhile
+		if (unflushed) {
+			unflushed = false;
+
+			try {
+				Flush(yc);
+			} catch (const boost::coroutines::detail::forced_unwind&) {
+				throw;
+			} catch (const std::exception& ex) {
+				Log(LogCritical, "IcingaDB")
+					<< "Error during sending queries: " << ex.what();
+			}
 
 			goto WriteFirstOfHighestPrio;
 		}
@@ -357,7 +484,7 @@ void RedisConnection::WriteLoop(asio::yield_context& yc)
 }
 
 /**
- * Send next and schedule receiving the response
+ * Send next and schedule receiving the response once it has been flushed
  *
  * @param next Redis queries
  */
@@ -366,6 +493,8 @@ void RedisConnection::WriteItem(boost::asio::yield_context& yc, RedisConnection:
 	if (next.FireAndForgetQuery) {
 		auto& item (*next.FireAndForgetQuery);
 
+		m_PendingQueries.fetch_sub(1);
+
 		try {
 			WriteOne(item, yc);
 		} catch (const boost::coroutines::detail::forced_unwind&) {
@@ -384,19 +513,15 @@ void RedisConnection::WriteItem(boost::asio::yield_context& yc, RedisConnection:
 			return;
 		}
 
-		if (m_Queues.FutureResponseActions.empty() || m_Queues.FutureResponseActions.back().Action != ResponseAction::Ignore) {
-			m_Queues.FutureResponseActions.emplace(FutureResponseAction{1, ResponseAction::Ignore});
-		} else {
-			++m_Queues.FutureResponseActions.back().Amount;
-		}
-
-		m_QueuedReads.Set();
+		AddFutureResponseAction(1, ResponseAction::Ignore);
 	}
 
 	if (next.FireAndForgetQueries) {
 		auto& item (*next.FireAndForgetQueries);
 		size_t i = 0;
 
+		m_PendingQueries.fetch_sub(item.size());
+
 		try {
 			for (auto& query : item) {
 				WriteOne(query, yc);
@@ -418,20 +543,18 @@ void RedisConnection::WriteItem(boost::asio::yield_context& yc, RedisConnection:
 			return;
 		}
 
-		if (m_Queues.FutureResponseActions.empty() || m_Queues.FutureResponseActions.back().Action != ResponseAction::Ignore) {
-			m_Queues.FutureResponseActions.emplace(FutureResponseAction{item.size(), ResponseAction::Ignore});
-		} else {
-			m_Queues.FutureResponseActions.back().Amount += item.size();
-		}
-
-		m_QueuedReads.Set();
+		AddFutureResponseAction(item.size(), ResponseAction::Ignore);
 	}
 
 	if (next.GetResultOfQuery) {
 		auto& item (*next.GetResultOfQuery);
 
+		m_PendingQueries.fetch_sub(1);
+
 		try {
 			WriteOne(item.first, yc);
+			AddFutureResponseAction(1, ResponseAction::Deliver);
+			Flush(yc);
 		} catch (const boost::coroutines::detail::forced_unwind&) {
 			throw;
 		} catch (...) {
@@ -441,23 +564,20 @@ void RedisConnection::WriteItem(boost::asio::yield_context& yc, RedisConnection:
 		}
 
 		m_Queues.ReplyPromises.emplace(std::move(item.second));
-
-		if (m_Queues.FutureResponseActions.empty() || m_Queues.FutureResponseActions.back().Action != ResponseAction::Deliver) {
-			m_Queues.FutureResponseActions.emplace(FutureResponseAction{1, ResponseAction::Deliver});
-		} else {
-			++m_Queues.FutureResponseActions.back().Amount;
-		}
-
-		m_QueuedReads.Set();
 	}
 
 	if (next.GetResultsOfQueries) {
 		auto& item (*next.GetResultsOfQueries);
 
+		m_PendingQueries.fetch_sub(item.first.size());
+
 		try {
 			for (auto& query : item.first) {
 				WriteOne(query, yc);
 			}
+
+			AddFutureResponseAction(item.first.size(), ResponseAction::DeliverBulk);
+			Flush(yc);
 		} catch (const boost::coroutines::detail::forced_unwind&) {
 			throw;
 		} catch (...) {
@@ -467,12 +587,95 @@ void RedisConnection::WriteItem(boost::asio::yield_context& yc, RedisConnection:
 		}
 
 		m_Queues.RepliesPromises.emplace(std::move(item.second));
-		m_Queues.FutureResponseActions.emplace(FutureResponseAction{item.first.size(), ResponseAction::DeliverBulk});
+	}
+}
+
+/**
+ * Schedule receiving the responses to queries just written, once they have been flushed
+ *
+ * Every batch of queries keeps its own entry (instead of being merged with
+ * the previous one) to measure its round-trip time.
+ *
+ * @param amount The amount of responses
+ * @param action What to do with them
+ */
+void RedisConnection::AddFutureResponseAction(size_t amount, RedisConnection::ResponseAction action)
+{
+	m_Queues.UnflushedResponseActions.emplace_back(FutureResponseAction{amount, action, Utility::GetTime()});
+}
+
+/**
+ * Update the smoothed round-trip time with the one of a batch of queries whose responses have just been received
+ *
+ * @param action The batch of queries
+ */
+void RedisConnection::AddRoundTripTime(const RedisConnection::FutureResponseAction& action)
+{
+	double rtt = Utility::GetTime() - action.SentAt;
+	double srtt = m_RoundTripTime.load();
+
+	// Like TCP's smoothed round-trip time (RFC 6298)
+	m_RoundTripTime.store(srtt > 0 ? srtt * 0.875 + rtt * 0.125 : rtt);
+}
 
-		m_QueuedReads.Set();
+static const char *GetQueryPriorityName(RedisConnection::QueryPriority priority)
+{
+	switch (priority) {
+		case Prio::Heartbeat:
+			return "heartbeat";
+		case Prio::Config:
+			return "config";
+		case Prio::State:
+			return "state";
+		case Prio::History:
+			return "history";
+		default:
+			return "check_result";
 	}
 }
 
+/**
+ * Get the priorities, queue lengths and round-trip time of all lanes
+ *
+ * @return One dictionary per lane
+ */
+Array::Ptr RedisConnection::GetLaneStats()
+{
+	static const Prio priorities[] = { Prio::Heartbeat, Prio::Config, Prio::State, Prio::History, Prio::CheckResult };
+
+	std::vector<RedisConnection*> lanes;
+
+	if (m_Lanes.empty()) {
+		lanes.emplace_back(this);
+	} else {
+		for (auto& lane : m_Lanes) {
+			lanes.emplace_back(lane.get());
+		}
+	}
+
+	ArrayData stats;
+
+	for (auto lane : lanes) {
+		ArrayData lanePriorities;
+
+		for (auto priority : priorities) {
+			if (m_Lanes.empty() || GetLane(priority).get() == lane) {
+				lanePriorities.emplace_back(GetQueryPriorityName(priority));
+			}
+		}
+
+		stats.emplace_back(new Dictionary({
+			{ "priorities", new Array(std::move(lanePriorities)) },
+			{ "connected", lane->m_Connected.load() },
+			{ "pending_queries", lane->m_PendingQueries.load() },
+			{ "pending_responses", lane->m_PendingResponses.load() },
+			{ "round_trip_time", lane->m_RoundTripTime.load() }
+		}));
+	}
+
+	return new Array(std::move(stats));
+}
+
 /**
  * Receive the response to a Redis query
  *
@@ -500,3 +703,32 @@ void RedisConnection::WriteOne(RedisConnection::Query& query, asio::yield_contex
 		WriteOne(m_UnixConn, query, yc);
 	}
 }
+
+/**
+ * Send everything written so far and schedule receiving the responses
+ */
+void RedisConnection::Flush(asio::yield_context& yc)
+{
+	try {
+		if (m_Path.IsEmpty()) {
+			Flush(m_TcpConn, yc);
+		} else {
+			Flush(m_UnixConn, yc);
+		}
+	} catch (...) {
+		m_Queues.UnflushedResponseActions.clear();
+		throw;
+	}
+
+	if (m_Queues.UnflushedResponseActions.empty()) {
+		return;
+	}
+
+	for (auto& action : m_Queues.UnflushedResponseActions) {
+		m_Queues.FutureResponseActions.emplace(action);
+		m_PendingResponses.fetch_add(action.Amount);
+	}
+
+	m_Queues.UnflushedResponseActions.clear();
+	m_QueuedReads.Set();
+}
@@ -5,6 +5,7 @@
 
 #include "base/array.hpp"
 #include "base/atomic.hpp"
+#include "base/dictionary.hpp"
 #include "base/io-engine.hpp"
 #include "base/object.hpp"
 #include "base/shared.hpp"
@@ -40,6 +41,10 @@ namespace icinga
 /**
  * An Async Redis connection.
  *
+ * With more than one lane, each lane is a connection of its own with its own
+ * strand and queues, and queries are distributed over the lanes by priority.
+ * Queries of the same priority are always sent over the same lane, in order.
+ *
  * @ingroup icingadb
  */
 	class RedisConnection final : public Object
@@ -67,7 +72,7 @@ namespace icinga
 		};
 
 		RedisConnection(const String& host, const int port, const String& path,
-			const String& password = "", const int db = 0);
+			const String& password = "", const int db = 0, const int lanes = 1);
 
 		void Start();
 
@@ -82,6 +87,8 @@ namespace icinga
 		void SuppressQueryKind(QueryPriority kind);
 		void UnsuppressQueryKind(QueryPriority kind);
 
+		Array::Ptr GetLaneStats();
+
 	private:
 		/**
 		 * What to do with the responses to Redis queries.
@@ -104,6 +111,7 @@ namespace icinga
 		{
 			size_t Amount;
 			ResponseAction Action;
+			double SentAt;
 		};
 
 		/**
@@ -139,12 +147,18 @@ namespace icinga
 
 		RedisConnection(boost::asio::io_context& io, String host, int port, String path, String password, int db);
 
+		const Ptr& GetLane(QueryPriority priority);
+		void Enqueue(QueryPriority priority, size_t queries, WriteQueueItem item);
+		void AddFutureResponseAction(size_t amount, ResponseAction action);
+		void AddRoundTripTime(const FutureResponseAction& action);
+
 		void Connect(boost::asio::yield_context& yc);
 		void ReadLoop(boost::asio::yield_context& yc);
 		void WriteLoop(boost::asio::yield_context& yc);
 		void WriteItem(boost::asio::yield_context& yc, WriteQueueItem item);
 		Reply ReadOne(boost::asio::yield_context& yc);
 		void WriteOne(Query& query, boost::asio::yield_context& yc);
+		void Flush(boost::asio::yield_context& yc);
 
 		template<class StreamPtr>
 		Reply ReadOne(StreamPtr& stream, boost::asio::yield_context& yc);
@@ -152,6 +166,12 @@ namespace icinga
 		template<class StreamPtr>
 		void WriteOne(StreamPtr& stream, Query& query, boost::asio::yield_context& yc);
 
+		template<class StreamPtr>
+		void Flush(StreamPtr& stream, boost::asio::yield_context& yc);
+
+		template<class StreamPtr>
+		void HandleStreamError(StreamPtr& stream);
+
 		String m_Path;
 		String m_Host;
 		int m_Port;
@@ -172,6 +192,8 @@ namespace icinga
 			std::queue<std::promise<Replies>> RepliesPromises;
 			// Metadata about all of the above
 			std::queue<FutureResponseAction> FutureResponseActions;
+			// Metadata about queries written, but not flushed yet
+			std::vector<FutureResponseAction> UnflushedResponseActions;
 		} m_Queues;
 
 		// Kinds of queries not to actually send yet
@@ -179,6 +201,15 @@ namespace icinga
 
 		// Indicate that there's something to send/receive
 		AsioConditionVariable m_QueuedWrites, m_QueuedReads;
+
+		// Connections of their own, if more than one
+		std::vector<Ptr> m_Lanes;
+
+		// Queries not sent yet and sent, but not answered yet
+		Atomic<size_t> m_PendingQueries, m_PendingResponses;
+
+		// Smoothed time between sending queries and receiving all of their responses
+		Atomic<double> m_RoundTripTime;
 	};
 
 /**
@@ -296,17 +327,7 @@ RedisConnection::Reply RedisConnection::ReadOne(StreamPtr& stream, boost::asio::
 	} catch (const boost::coroutines::detail::forced_unwind&) {
 		throw;
 	} catch (...) {
-		if (m_Connecting.exchange(false)) {
-			m_Connected.store(false);
-			stream = nullptr;
-
-			if (!m_Connecting.exchange(true)) {
-				Ptr keepAlive (this);
-
-				IoEngine::SpawnCoroutine(m_Strand, [this, keepAlive](asio::yield_context yc) { Connect(yc); });
-			}
-		}
-
+		HandleStreamError(stream);
 		throw;
 	}
 }
@@ -330,25 +351,63 @@ void RedisConnection::WriteOne(StreamPtr& stream, RedisConnection::Query& query,
 
 	try {
 		WriteRESP(*strm, query, yc);
-		strm->async_flush(yc);
 	} catch (const boost::coroutines::detail::forced_unwind&) {
 		throw;
 	} catch (...) {
-		if (m_Connecting.exchange(false)) {
-			m_Connected.store(false);
-			stream = nullptr;
+		HandleStreamError(stream);
+		throw;
+	}
+}
 
-			if (!m_Connecting.exchange(true)) {
-				Ptr keepAlive (this);
+/**
+ * Send everything written to stream so far
+ *
+ * @param stream Redis server connection
+ */
+template<class StreamPtr>
+void RedisConnection::Flush(StreamPtr& stream, boost::asio::yield_context& yc)
+{
+	if (!stream) {
+		throw RedisDisconnected();
+	}
 
-				IoEngine::SpawnCoroutine(m_Strand, [this, keepAlive](asio::yield_context yc) { Connect(yc); });
-			}
-		}
+	auto strm (stream);
 
+	try {
+		strm->async_flush(yc);
+	} catch (const boost::coroutines::detail::forced_unwind&) {
+		throw;
+	} catch (...) {
+		HandleStreamError(stream);
 		throw;
 	}
 }
 
+/**
+ * Drop a broken Redis server connection and reconnect
+ *
+ * @param stream Redis server connection
+ */
+template<class StreamPtr>
+void RedisConnection::HandleStreamError(StreamPtr& stream)
+{
+	namespace asio = boost::asio;
+
+	// Queries written to the broken connection, but not flushed yet, won't be answered
+	m_Queues.UnflushedResponseActions.clear();
+
+	if (m_Connecting.exchange(false)) {
+		m_Connected.store(false);
+		stream = nullptr;
+
+		if (!m_Connecting.exchange(true)) {
+			Ptr keepAlive (this);
+
+			IoEngine::SpawnCoroutine(m_Strand, [this, keepAlive](asio::yield_context yc) { Connect(yc); });
+		}
+	}
+}
+
 /**
  * Read a Redis protocol value from stream
  *
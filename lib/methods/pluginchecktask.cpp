@@ -16,6 +16,42 @@ using namespace icinga;
 
 REGISTER_FUNCTION_NONCONST(Internal, PluginCheck,  &PluginCheckTask::ScriptFunc, "checkable:cr:resolvedMacros:useResolvedMacros");
 
+/**
+ * Interns the arguments of a command line. All checks using the same
+ * command share most of them, e.g. the plugin's path.
+ *
+ * Without ICINGA2_STRING_INTERNING there is nothing to share, so the
+ * command line is returned as is.
+ */
+static Value InternCommandLine(const Value& commandLine)
+{
+#ifdef ICINGA2_STRING_INTERNING
+	if (commandLine.IsString())
+		return commandLine.Get<String>().Intern(StringOriginCommandLine);
+
+	if (!commandLine.IsObjectType<Array>())
+		return commandLine;
+
+	Array::Ptr arguments = commandLine;
+	ArrayData result;
+
+	ObjectLock olock(arguments);
+
+	result.reserve(arguments->GetLength());
+
+	for (const Value& argument : arguments) {
+		if (argument.IsString())
+			result.emplace_back(argument.Get<String>().Intern(StringOriginCommandLine));
+		else
+			result.emplace_back(argument);
+	}
+
+	return new Array(std::move(result));
+#else /* ICINGA2_STRING_INTERNING */
+	return commandLine;
+#endif /* ICINGA2_STRING_INTERNING */
+}
+
 void PluginCheckTask::ScriptFunc(const Checkable::Ptr& checkable, const CheckResult::Ptr& cr,
 	const Dictionary::Ptr& resolvedMacros, bool useResolvedMacros)
 {
@@ -66,7 +102,7 @@ void PluginCheckTask::ProcessFinishedHandler(const Checkable::Ptr& checkable, co
 	String output = pr.Output.Trim();
 
 	std::pair<String, String> co = PluginUtility::ParseCheckOutput(output);
-	cr->SetCommand(commandLine);
+	cr->SetCommand(InternCommandLine(commandLine));
 	cr->SetOutput(co.first);
 	cr->SetPerformanceData(PluginUtility::SplitPerfdata(co.second));
 	cr->SetState(PluginUtility::ExitStatusToState(pr.ExitStatus));
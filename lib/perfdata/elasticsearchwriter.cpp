@@ -95,7 +95,10 @@ void ElasticsearchWriter::Resume()
 	m_FlushTimer->Reschedule(0);
 
 	/* Register for new metrics. */
-	Checkable::OnNewCheckResult.connect(std::bind(&ElasticsearchWriter::CheckResultHandler, this, _1, _2));
+	m_HandleCheckResults = Checkable::OnNewCheckResult.Subscribe("ElasticsearchWriter:" + GetName(), [this](const std::vector<CheckResultEvent>& events) {
+		for (const CheckResultEvent& event : events)
+			CheckResultHandler(event.Source, event.Result);
+	});
 	Checkable::OnStateChange.connect(std::bind(&ElasticsearchWriter::StateChangeHandler, this, _1, _2, _3));
 	Checkable::OnNotificationSentToAllUsers.connect(std::bind(&ElasticsearchWriter::NotificationSentToAllUsersHandler, this, _1, _2, _3, _4, _5, _6, _7));
 }
@@ -103,6 +106,9 @@ void ElasticsearchWriter::Resume()
 /* Pause is equivalent to Stop, but with HA capabilities to resume at runtime. */
 void ElasticsearchWriter::Pause()
 {
+	Checkable::OnNewCheckResult.Unsubscribe(m_HandleCheckResults);
+	m_HandleCheckResults.reset();
+
 	Flush();
 	m_WorkQueue.Join();
 	Flush();
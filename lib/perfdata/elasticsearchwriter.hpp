@@ -29,6 +29,7 @@ protected:
 	void Pause() override;
 
 private:
+	EventSubscriber<CheckResultEvent>::Ptr m_HandleCheckResults;
 	String m_EventPrefix;
 	WorkQueue m_WorkQueue{10000000, 1};
 	Timer::Ptr m_FlushTimer;
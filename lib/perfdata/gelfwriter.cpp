@@ -90,7 +90,10 @@ void GelfWriter::Resume()
 	m_ReconnectTimer->Reschedule(0);
 
 	/* Register event handlers. */
-	Checkable::OnNewCheckResult.connect(std::bind(&GelfWriter::CheckResultHandler, this, _1, _2));
+	m_HandleCheckResults = Checkable::OnNewCheckResult.Subscribe("GelfWriter:" + GetName(), [this](const std::vector<CheckResultEvent>& events) {
+		for (const CheckResultEvent& event : events)
+			CheckResultHandler(event.Source, event.Result);
+	});
 	Checkable::OnNotificationSentToUser.connect(std::bind(&GelfWriter::NotificationToUserHandler, this, _1, _2, _3, _4, _5, _6, _7, _8));
 	Checkable::OnStateChange.connect(std::bind(&GelfWriter::StateChangeHandler, this, _1, _2, _3));
 }
@@ -98,6 +101,9 @@ void GelfWriter::Resume()
 /* Pause is equivalent to Stop, but with HA capabilities to resume at runtime. */
 void GelfWriter::Pause()
 {
+	Checkable::OnNewCheckResult.Unsubscribe(m_HandleCheckResults);
+	m_HandleCheckResults.reset();
+
 	m_ReconnectTimer.reset();
 
 	try {
@@ -33,6 +33,7 @@ protected:
 	void Pause() override;
 
 private:
+	EventSubscriber<CheckResultEvent>::Ptr m_HandleCheckResults;
 	OptionalTlsStream m_Stream;
 	WorkQueue m_WorkQueue{10000000, 1};
 
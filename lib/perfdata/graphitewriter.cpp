@@ -95,7 +95,10 @@ void GraphiteWriter::Resume()
 	m_ReconnectTimer->Reschedule(0);
 
 	/* Register event handlers. */
-	Checkable::OnNewCheckResult.connect(std::bind(&GraphiteWriter::CheckResultHandler, this, _1, _2));
+	m_HandleCheckResults = Checkable::OnNewCheckResult.Subscribe("GraphiteWriter:" + GetName(), [this](const std::vector<CheckResultEvent>& events) {
+		for (const CheckResultEvent& event : events)
+			CheckResultHandler(event.Source, event.Result);
+	});
 }
 
 /**
@@ -103,6 +106,9 @@ void GraphiteWriter::Resume()
  */
 void GraphiteWriter::Pause()
 {
+	Checkable::OnNewCheckResult.Unsubscribe(m_HandleCheckResults);
+	m_HandleCheckResults.reset();
+
 	m_ReconnectTimer.reset();
 
 	try {
@@ -37,6 +37,7 @@ protected:
 	void Pause() override;
 
 private:
+	EventSubscriber<CheckResultEvent>::Ptr m_HandleCheckResults;
 	Shared<AsioTcpStream>::Ptr m_Stream;
 	boost::mutex m_StreamMutex;
 	WorkQueue m_WorkQueue{10000000, 1};
@@ -123,12 +123,18 @@ void InfluxdbWriter::Resume()
 	m_FlushTimer->Reschedule(0);
 
 	/* Register for new metrics. */
-	Checkable::OnNewCheckResult.connect(std::bind(&InfluxdbWriter::CheckResultHandler, this, _1, _2));
+	m_HandleCheckResults = Checkable::OnNewCheckResult.Subscribe("InfluxdbWriter:" + GetName(), [this](const std::vector<CheckResultEvent>& events) {
+		for (const CheckResultEvent& event : events)
+			CheckResultHandler(event.Source, event.Result);
+	});
 }
 
 /* Pause is equivalent to Stop, but with HA capabilities to resume at runtime. */
 void InfluxdbWriter::Pause()
 {
+	Checkable::OnNewCheckResult.Unsubscribe(m_HandleCheckResults);
+	m_HandleCheckResults.reset();
+
 	/* Force a flush. */
 	Log(LogDebug, "InfluxdbWriter")
 		<< "Flushing pending data buffers.";
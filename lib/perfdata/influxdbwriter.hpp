@@ -37,6 +37,7 @@ protected:
 	void Pause() override;
 
 private:
+	EventSubscriber<CheckResultEvent>::Ptr m_HandleCheckResults;
 	WorkQueue m_WorkQueue{10000000, 1};
 	Timer::Ptr m_FlushTimer;
 	std::vector<String> m_DataBuffer;
@@ -35,6 +35,7 @@ protected:
 	void Pause() override;
 
 private:
+	boost::signals2::connection m_HandleCheckResults;
 	Shared<AsioTcpStream>::Ptr m_Stream;
 
 	Timer::Ptr m_ReconnectTimer;
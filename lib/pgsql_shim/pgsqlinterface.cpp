@@ -100,6 +100,36 @@ struct PgsqlInterfaceImpl final : public PgsqlInterface
 	{
 		return PQstatus(conn);
 	}
+
+	int sendQuery(PGconn *conn, const char *query) const override
+	{
+		return PQsendQuery(conn, query);
+	}
+
+	PGresult *getResult(PGconn *conn) const override
+	{
+		return PQgetResult(conn);
+	}
+
+	int setnonblocking(PGconn *conn, int arg) const override
+	{
+		return PQsetnonblocking(conn, arg);
+	}
+
+	int flush(PGconn *conn) const override
+	{
+		return PQflush(conn);
+	}
+
+	int consumeInput(PGconn *conn) const override
+	{
+		return PQconsumeInput(conn);
+	}
+
+	int socket(const PGconn *conn) const override
+	{
+		return PQsocket(conn);
+	}
 };
 
 PgsqlInterface *create_pgsql_shim()
@@ -35,6 +35,12 @@ struct PgsqlInterface
 	virtual PGconn *setdbLogin(const char *pghost, const char *pgport, const char *pgoptions, const char *pgtty, const char *dbName, const char *login, const char *pwd) const = 0;
 	virtual PGconn *connectdb(const char *conninfo) const = 0;
 	virtual ConnStatusType status(const PGconn *conn) const = 0;
+	virtual int sendQuery(PGconn *conn, const char *query) const = 0;
+	virtual PGresult *getResult(PGconn *conn) const = 0;
+	virtual int setnonblocking(PGconn *conn, int arg) const = 0;
+	virtual int flush(PGconn *conn) const = 0;
+	virtual int consumeInput(PGconn *conn) const = 0;
+	virtual int socket(const PGconn *conn) const = 0;
 
 protected:
 	PgsqlInterface() = default;
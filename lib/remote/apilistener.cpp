@@ -29,15 +29,19 @@
 #include <boost/asio/spawn.hpp>
 #include <boost/asio/ssl/context.hpp>
 #include <boost/date_time/posix_time/posix_time_duration.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
 #include <boost/system/error_code.hpp>
 #include <climits>
 #include <cstdint>
+#include <cstring>
 #include <fstream>
 #include <memory>
 #include <openssl/ssl.h>
 #include <openssl/tls1.h>
 #include <openssl/x509.h>
 #include <sstream>
+#include <unordered_map>
 #include <utility>
 
 using namespace icinga;
@@ -47,6 +51,12 @@ REGISTER_TYPE(ApiListener);
 boost::signals2::signal<void(bool)> ApiListener::OnMasterChanged;
 ApiListener::Ptr ApiListener::m_Instance;
 
+/* Version of the replay log record format, stored in the first record of each log file */
+static const int l_LogVersion = 2;
+
+/* Magic number and format version at the beginning of replay log index files */
+static const char l_LogIndexMagic[8] = { 'I', '2', 'R', 'L', 'I', 'D', 'X', 2 };
+
 REGISTER_STATSFUNCTION(ApiListener, &ApiListener::StatsFunc);
 
 REGISTER_APIFUNCTION(Hello, icinga, &ApiListener::HelloAPIHandler);
@@ -249,10 +259,7 @@ void ApiListener::Start(bool runtimeCreated)
 
 	ObjectImpl<ApiListener>::Start(runtimeCreated);
 
-	{
-		boost::mutex::scoped_lock lock(m_LogLock);
-		OpenLogFile();
-	}
+	StartLogging();
 
 	/* create the primary JSON-RPC listener */
 	if (!AddListener(GetBindHost(), GetBindPort())) {
@@ -303,11 +310,7 @@ void ApiListener::Stop(bool runtimeDeleted)
 	Log(LogInformation, "ApiListener")
 		<< "'" << GetName() << "' stopped.";
 
-	{
-		boost::mutex::scoped_lock lock(m_LogLock);
-		CloseLogFile();
-		RotateLogFile();
-	}
+	StopLogging();
 
 	RemoveStatusFile();
 }
@@ -841,6 +844,7 @@ void ApiListener::ApiTimerHandler()
 			Log(LogNotice, "ApiListener")
 				<< "Removing old log file: " << path;
 			(void)unlink(path.CStr());
+			(void)unlink((path + ".idx").CStr());
 		}
 	}
 
@@ -989,27 +993,111 @@ void ApiListener::RelayMessage(const MessageOrigin::Ptr& origin,
 	m_RelayQueue.Enqueue(std::bind(&ApiListener::SyncRelayMessage, this, origin, secobj, message, log), PriorityNormal, true);
 }
 
-void ApiListener::PersistMessage(const Dictionary::Ptr& message, const ConfigObject::Ptr& secobj)
+/**
+ * Stores the given int as big-endian unsigned int of the given size
+ */
+static inline void WriteLogIndexUInt(char *buf, uint_least64_t i, int size)
+{
+	for (int n = size - 1; n >= 0; n--) {
+		buf[n] = i & 0xFFu;
+		i >>= 8u;
+	}
+}
+
+/**
+ * Reads a big-endian unsigned int of the given size
+ */
+static inline uint_least64_t ReadLogIndexUInt(const char *buf, int size)
+{
+	uint_least64_t i = 0;
+
+	for (int n = 0; n < size; n++) {
+		i = (i << 8u) | (unsigned char)buf[n];
+	}
+
+	return i;
+}
+
+/**
+ * Appends an entry to a replay log index file.
+ *
+ * Each entry consists of the offset of the log record, the offset and length of the raw
+ * message inside the log file (64-bit each), the message timestamp (IEEE 754 binary64)
+ * and the type and name of the object the message is about (if any) preceded by their
+ * lengths (32-bit each). All numbers are stored in big-endian byte order.
+ */
+static void WriteLogIndexEntry(const Stream::Ptr& index, uint_fast64_t recordOffset, uint_fast64_t messageOffset,
+	uint_fast64_t messageLength, double ts, const String& type, const String& name)
+{
+	char header[40];
+	uint_least64_t tsBits;
+
+	static_assert(sizeof(tsBits) == sizeof(ts), "double must be 64 bits wide");
+	memcpy(&tsBits, &ts, sizeof(ts));
+
+	WriteLogIndexUInt(header, recordOffset, 8);
+	WriteLogIndexUInt(header + 8, messageOffset, 8);
+	WriteLogIndexUInt(header + 16, messageLength, 8);
+	WriteLogIndexUInt(header + 24, tsBits, 8);
+	WriteLogIndexUInt(header + 32, type.GetLength(), 4);
+	WriteLogIndexUInt(header + 36, name.GetLength(), 4);
+
+	index->Write(header, sizeof(header));
+	index->Write(type.CStr(), type.GetLength());
+	index->Write(name.CStr(), name.GetLength());
+}
+
+/**
+ * Writes a message to the replay log.
+ *
+ * A log record consists of two netstrings: the metadata (timestamp and the object the
+ * message is about) and the raw message, so that the latter can be replayed as is.
+ * The sidecar index written along with the log refers to the raw messages.
+ * Each log file starts with a record holding just the format version.
+ *
+ * @param message The message
+ * @param json The JSON-encoded message
+ * @param secobj The object the message is about
+ */
+void ApiListener::PersistMessage(const Dictionary::Ptr& message, const String& json, const ConfigObject::Ptr& secobj)
 {
 	double ts = message->Get("ts");
 
 	ASSERT(ts != 0);
 
 	Dictionary::Ptr pmessage = new Dictionary();
-	pmessage->Set("timestamp", ts);
+	pmessage->Set("ts", ts);
 
-	pmessage->Set("message", JsonEncode(message));
+	String secType, secName;
 
 	if (secobj) {
+		secType = secobj->GetReflectionType()->GetName();
+		secName = secobj->GetName();
+
 		Dictionary::Ptr secname = new Dictionary();
-		secname->Set("type", secobj->GetReflectionType()->GetName());
-		secname->Set("name", secobj->GetName());
+		secname->Set("type", secType);
+		secname->Set("name", secName);
 		pmessage->Set("secobj", secname);
 	}
 
+	String metadata = JsonEncode(pmessage);
+
 	boost::mutex::scoped_lock lock(m_LogLock);
 	if (m_LogFile) {
-		NetString::WriteStringToStream(m_LogFile, JsonEncode(pmessage));
+		uint_fast64_t recordOffset = m_LogOffset;
+
+		m_LogOffset += NetString::WriteStringToStream(m_LogFile, metadata);
+
+		size_t messageRecordLength = NetString::WriteStringToStream(m_LogFile, json);
+
+		/* The message follows its length prefix ("<length>:") and is followed by a comma. */
+		uint_fast64_t messageOffset = m_LogOffset + messageRecordLength - json.GetLength() - 1u;
+
+		m_LogOffset += messageRecordLength;
+
+		if (m_LogIndexFile)
+			WriteLogIndexEntry(m_LogIndexFile, recordOffset, messageOffset, json.GetLength(), ts, secType, secName);
+
 		m_LogMessageCount++;
 		SetLogMessageTimestamp(ts);
 
@@ -1022,6 +1110,21 @@ void ApiListener::PersistMessage(const Dictionary::Ptr& message, const ConfigObj
 }
 
 void ApiListener::SyncSendMessage(const Endpoint::Ptr& endpoint, const Dictionary::Ptr& message)
+{
+	std::shared_ptr<const String> json;
+
+	SyncSendMessage(endpoint, message, json);
+}
+
+/**
+ * Sends a message to an endpoint, JSON-encoding it only if this hasn't been
+ * done yet. The encoded message is shared with all connections it's queued on.
+ *
+ * @param endpoint The target endpoint
+ * @param message The message
+ * @param json The encoded message, encoded on first use
+ */
+void ApiListener::SyncSendMessage(const Endpoint::Ptr& endpoint, const Dictionary::Ptr& message, std::shared_ptr<const String>& json)
 {
 	ObjectLock olock(endpoint);
 
@@ -1040,12 +1143,16 @@ void ApiListener::SyncSendMessage(const Endpoint::Ptr& endpoint, const Dictionar
 			if (client->GetTimestamp() != maxTs)
 				continue;
 
-			client->SendMessage(message);
+			if (!json)
+				json = std::make_shared<const String>(JsonEncode(message));
+
+			client->SendRawMessage(json);
 		}
 	}
 }
 
-bool ApiListener::RelayMessageOne(const Zone::Ptr& targetZone, const MessageOrigin::Ptr& origin, const Dictionary::Ptr& message, const Endpoint::Ptr& currentZoneMaster)
+bool ApiListener::RelayMessageOne(const Zone::Ptr& targetZone, const MessageOrigin::Ptr& origin, const Dictionary::Ptr& message,
+	std::shared_ptr<const String>& json, const Endpoint::Ptr& currentZoneMaster)
 {
 	ASSERT(targetZone);
 
@@ -1138,7 +1245,7 @@ bool ApiListener::RelayMessageOne(const Zone::Ptr& targetZone, const MessageOrig
 
 		relayed = true;
 
-		SyncSendMessage(targetEndpoint, message);
+		SyncSendMessage(targetEndpoint, message, json);
 	}
 
 	if (!skippedEndpoints.empty()) {
@@ -1177,15 +1284,22 @@ void ApiListener::SyncRelayMessage(const MessageOrigin::Ptr& origin,
 
 	Endpoint::Ptr master = GetMaster();
 
-	bool need_log = !RelayMessageOne(target_zone, origin, message, master);
+	/* Encoded once on demand and shared by all target connections and the replay log. */
+	std::shared_ptr<const String> json;
+
+	bool need_log = !RelayMessageOne(target_zone, origin, message, json, master);
 
 	for (const Zone::Ptr& zone : target_zone->GetAllParentsRaw()) {
-		if (!RelayMessageOne(zone, origin, message, master))
+		if (!RelayMessageOne(zone, origin, message, json, master))
 			need_log = true;
 	}
 
-	if (log && need_log)
-		PersistMessage(message, secobj);
+	if (log && need_log) {
+		if (!json)
+			json = std::make_shared<const String>(JsonEncode(message));
+
+		PersistMessage(message, *json, secobj);
+	}
 }
 
 /* must hold m_LogLock */
@@ -1203,9 +1317,37 @@ void ApiListener::OpenLogFile()
 		return;
 	}
 
+	fp->seekp(0, std::ios::end);
+	m_LogOffset = fp->tellp();
+
 	m_LogFile = new StdioStream(fp, true);
 	m_LogMessageCount = 0;
 	SetLogMessageTimestamp(Utility::GetTime());
+
+	bool newLog = m_LogOffset == 0;
+
+	if (newLog)
+		m_LogOffset += NetString::WriteStringToStream(m_LogFile, JsonEncode(new Dictionary({ { "version", l_LogVersion } })));
+
+	/* An index left behind for a log file which doesn't exist anymore must not be reused. */
+	String indexPath = path + ".idx";
+	auto mode (newLog ? std::fstream::out | std::fstream::trunc : std::fstream::out | std::fstream::app);
+	auto *ifp = new std::fstream(indexPath.CStr(), mode | std::fstream::binary);
+
+	if (!ifp->good()) {
+		delete ifp;
+
+		Log(LogWarning, "ApiListener")
+			<< "Could not open spool index file: " << indexPath;
+		return;
+	}
+
+	ifp->seekp(0, std::ios::end);
+
+	m_LogIndexFile = new StdioStream(ifp, true);
+
+	if (ifp->tellp() == 0)
+		m_LogIndexFile->Write(l_LogIndexMagic, sizeof(l_LogIndexMagic));
 }
 
 /* must hold m_LogLock */
@@ -1216,6 +1358,11 @@ void ApiListener::CloseLogFile()
 
 	m_LogFile->Close();
 	m_LogFile.reset();
+
+	if (m_LogIndexFile) {
+		m_LogIndexFile->Close();
+		m_LogIndexFile.reset();
+	}
 }
 
 /* must hold m_LogLock */
@@ -1238,10 +1385,42 @@ void ApiListener::RotateLogFile()
 			Log(LogCritical, "ApiListener")
 				<< "Cannot rotate replay log file from '" << oldpath << "' to '"
 				<< newpath << "': " << ex.what();
+			return;
+		}
+
+		/* Without its index a log file is replayed by decoding it. */
+		try {
+			if (Utility::PathExists(oldpath + ".idx"))
+				Utility::RenameFile(oldpath + ".idx", newpath + ".idx");
+			else
+				(void)unlink((newpath + ".idx").CStr());
+		} catch (const std::exception& ex) {
+			Log(LogWarning, "ApiListener")
+				<< "Cannot rotate replay log index file from '" << oldpath << ".idx' to '"
+				<< newpath << ".idx': " << ex.what();
 		}
 	}
 }
 
+/**
+ * Opens the replay log, messages are persisted from now on.
+ */
+void ApiListener::StartLogging()
+{
+	boost::mutex::scoped_lock lock(m_LogLock);
+	OpenLogFile();
+}
+
+/**
+ * Closes and rotates the replay log.
+ */
+void ApiListener::StopLogging()
+{
+	boost::mutex::scoped_lock lock(m_LogLock);
+	CloseLogFile();
+	RotateLogFile();
+}
+
 void ApiListener::LogGlobHandler(std::vector<int>& files, const String& file)
 {
 	String name = Utility::BaseName(file);
@@ -1260,6 +1439,198 @@ void ApiListener::LogGlobHandler(std::vector<int>& files, const String& file)
 	files.push_back(ts);
 }
 
+/**
+ * Reads a netstring from memory.
+ *
+ * @returns false if there isn't a complete netstring at pos
+ */
+static bool ReadLogNetString(const char *& pos, const char *end, const char *& payload, size_t& length)
+{
+	const char *p = pos;
+	size_t len = 0;
+	int digits = 0;
+
+	for (; p < end && *p >= '0' && *p <= '9'; p++) {
+		if (++digits > 18)
+			return false;
+
+		len = len * 10u + (*p - '0');
+	}
+
+	if (!digits || p == end || *p != ':')
+		return false;
+
+	p++;
+
+	if (static_cast<size_t>(end - p) <= len || p[len] != ',')
+		return false;
+
+	payload = p;
+	length = len;
+	pos = p + len + 1;
+
+	return true;
+}
+
+/**
+ * Replays log records by decoding them. Used for log files (or parts of them)
+ * which aren't covered by an index, e.g. if they were written by older versions.
+ *
+ * @returns false if the callback asked to stop
+ */
+static bool ReplayLogRecords(const String& path, const char *pos, const char *end, const double& peerTs, const ApiListener::ReplayLogCallback& callback)
+{
+	while (pos < end) {
+		const char *payload, *message;
+		size_t length, messageLength;
+		Dictionary::Ptr pmessage;
+		String oldMessage;
+		double ts;
+
+		try {
+			if (!ReadLogNetString(pos, end, payload, length))
+				BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid netstring"));
+
+			pmessage = JsonDecode(String(payload, payload + length));
+
+			if (pmessage->Contains("version")) {
+				if (pmessage->Get("version") > l_LogVersion) {
+					Log(LogWarning, "ApiListener")
+						<< "Cluster log '" << path << "' was written by a newer version (format version "
+						<< pmessage->Get("version") << "), skipping it.";
+					return true;
+				}
+
+				continue;
+			}
+
+			if (pmessage->Contains("message")) {
+				/* The message is embedded into the metadata in logs written by older versions. */
+				oldMessage = pmessage->Get("message");
+				message = oldMessage.CStr();
+				messageLength = oldMessage.GetLength();
+				ts = pmessage->Get("timestamp");
+			} else {
+				if (!ReadLogNetString(pos, end, message, messageLength))
+					BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid netstring"));
+
+				ts = pmessage->Get("ts");
+			}
+		} catch (const std::exception&) {
+			Log(LogWarning, "ApiListener")
+				<< "Unexpected end-of-file for cluster log: " << path;
+
+			/* Log files may be incomplete or corrupted. This is perfectly OK. */
+			return true;
+		}
+
+		if (ts <= peerTs)
+			continue;
+
+		String type, name;
+		Dictionary::Ptr secname = pmessage->Get("secobj");
+
+		if (secname) {
+			type = secname->Get("type");
+			name = secname->Get("name");
+		}
+
+		if (!callback(ts, type, name, message, messageLength))
+			return false;
+	}
+
+	return true;
+}
+
+/**
+ * Replays a log file.
+ *
+ * The raw messages are taken from the log file as they are, as far as the sidecar index
+ * (see WriteLogIndexEntry()) covers the file. Records which aren't covered by the index
+ * (the index is missing, incomplete or was written after a crash) are decoded instead.
+ *
+ * The index is scanned from its start: relayed messages keep the timestamps of their
+ * origin, so a log file isn't ordered by timestamp and can't be bisected by peerTs.
+ * Skipping entries only reads the mapped index, nothing is decoded.
+ *
+ * @param path The log file
+ * @param peerTs Messages up to this timestamp are skipped
+ * @param callback Called for every message with its timestamp, the type and name of the
+ *                 object it's about (if any) and the raw message
+ * @returns false if the callback asked to stop
+ */
+bool ApiListener::ReplayLogFile(const String& path, const double& peerTs, const ReplayLogCallback& callback)
+{
+	namespace ip = boost::interprocess;
+
+	ip::mapped_region region, indexRegion;
+
+	try {
+		ip::file_mapping file (path.CStr(), ip::read_only);
+		ip::mapped_region(file, ip::read_only).swap(region);
+	} catch (const std::exception&) {
+		/* The file doesn't exist or is empty. */
+		return true;
+	}
+
+	try {
+		ip::file_mapping indexFile ((path + ".idx").CStr(), ip::read_only);
+		ip::mapped_region(indexFile, ip::read_only).swap(indexRegion);
+	} catch (const std::exception&) {
+		Log(LogNotice, "ApiListener")
+			<< "No usable index for cluster log '" << path << "', decoding it.";
+	}
+
+	auto begin (static_cast<const char *>(region.get_address()));
+	auto size (region.get_size());
+	const char *covered = begin;
+
+	auto indexPos (static_cast<const char *>(indexRegion.get_address()));
+	auto indexEnd (indexPos + indexRegion.get_size());
+
+	if (indexRegion.get_size() >= sizeof(l_LogIndexMagic) && std::equal(indexPos, indexPos + sizeof(l_LogIndexMagic), l_LogIndexMagic)) {
+		indexPos += sizeof(l_LogIndexMagic);
+
+		while (indexEnd - indexPos >= 40) {
+			uint64_t recordOffset = ReadLogIndexUInt(indexPos, 8);
+			uint64_t messageOffset = ReadLogIndexUInt(indexPos + 8, 8);
+			uint64_t messageLength = ReadLogIndexUInt(indexPos + 16, 8);
+			uint_least64_t tsBits = ReadLogIndexUInt(indexPos + 24, 8);
+			uint_least64_t lengths[2] = { ReadLogIndexUInt(indexPos + 32, 4), ReadLogIndexUInt(indexPos + 36, 4) };
+			double ts;
+
+			memcpy(&ts, &tsBits, sizeof(ts));
+
+			if (static_cast<uint64_t>(indexEnd - indexPos - 40) < static_cast<uint64_t>(lengths[0]) + lengths[1])
+				break;
+
+			/* Stop using the index as soon as it doesn't match the log file. The log file may also be
+			 * written concurrently, so the index can refer to data which isn't in the file yet.
+			 */
+			if (recordOffset < static_cast<uint64_t>(covered - begin) || messageOffset <= recordOffset || messageOffset > size
+				|| messageLength >= size - messageOffset || begin[messageOffset - 1u] != ':' || begin[messageOffset + messageLength] != ',')
+				break;
+
+			if (recordOffset > static_cast<uint64_t>(covered - begin) && !ReplayLogRecords(path, covered, begin + recordOffset, peerTs, callback))
+				return false;
+
+			const char *type = indexPos + 40;
+			const char *name = type + lengths[0];
+
+			indexPos = name + lengths[1];
+			covered = begin + messageOffset + messageLength + 1u;
+
+			if (ts <= peerTs)
+				continue;
+
+			if (!callback(ts, String(type, type + lengths[0]), String(name, name + lengths[1]), begin + messageOffset, messageLength))
+				return false;
+		}
+	}
+
+	return ReplayLogRecords(path, covered, begin + size, peerTs, callback);
+}
+
 void ApiListener::ReplayLog(const JsonRpcConnection::Ptr& client)
 {
 	Endpoint::Ptr endpoint = client->GetEndpoint();
@@ -1288,6 +1659,11 @@ void ApiListener::ReplayLog(const JsonRpcConnection::Ptr& client)
 		return;
 	}
 
+	/* Whether the target zone may receive messages about an object (type!name). Decided once per replay,
+	 * not when writing the log, so that it follows the config which is active now.
+	 */
+	std::unordered_map<String, bool, std::hash<std::string>> accessible;
+
 	for (;;) {
 		boost::mutex::scoped_lock lock(m_LogLock);
 
@@ -1320,49 +1696,22 @@ void ApiListener::ReplayLog(const JsonRpcConnection::Ptr& client)
 			Log(LogNotice, "ApiListener")
 				<< "Replaying log: " << file.second;
 
-			auto *fp = new std::fstream(file.second.CStr(), std::fstream::in | std::fstream::binary);
-			StdioStream::Ptr logStream = new StdioStream(fp, true);
+			ReplayLogFile(file.second, peer_ts, [&](double ts, const String& type, const String& name, const char *message, size_t length) -> bool {
+				if (!type.IsEmpty()) {
+					/* Most messages are about a few objects, e.g. the check results of a checkable. */
+					auto cached (accessible.emplace(type + "!" + name, false));
 
-			String message;
-			StreamReadContext src;
-			while (true) {
-				Dictionary::Ptr pmessage;
+					if (cached.second) {
+						ConfigObject::Ptr secobj = ConfigObject::GetObject(type, name);
+						cached.first->second = secobj && target_zone->CanAccessObject(secobj);
+					}
 
-				try {
-					StreamReadStatus srs = NetString::ReadStringFromStream(logStream, &message, src);
-
-					if (srs == StatusEof)
-						break;
-
-					if (srs != StatusNewItem)
-						continue;
-
-					pmessage = JsonDecode(message);
-				} catch (const std::exception&) {
-					Log(LogWarning, "ApiListener")
-						<< "Unexpected end-of-file for cluster log: " << file.second;
-
-					/* Log files may be incomplete or corrupted. This is perfectly OK. */
-					break;
-				}
-
-				if (pmessage->Get("timestamp") <= peer_ts)
-					continue;
-
-				Dictionary::Ptr secname = pmessage->Get("secobj");
-
-				if (secname) {
-					ConfigObject::Ptr secobj = ConfigObject::GetObject(secname->Get("type"), secname->Get("name"));
-
-					if (!secobj)
-						continue;
-
-					if (!target_zone->CanAccessObject(secobj))
-						continue;
+					if (!cached.first->second)
+						return true;
 				}
 
 				try  {
-					client->SendRawMessage(pmessage->Get("message"));
+					client->SendRawMessage(std::make_shared<const String>(message, message + length));
 					count++;
 				} catch (const std::exception& ex) {
 					Log(LogWarning, "ApiListener")
@@ -1371,10 +1720,10 @@ void ApiListener::ReplayLog(const JsonRpcConnection::Ptr& client)
 					Log(LogDebug, "ApiListener")
 						<< "Error while replaying log for endpoint '" << endpoint->GetName() << "': " << DiagnosticInformation(ex);
 
-					break;
+					return false;
 				}
 
-				peer_ts = pmessage->Get("timestamp");
+				peer_ts = ts;
 
 				if (file.first > logpos_ts + 10) {
 					logpos_ts = file.first;
@@ -1389,9 +1738,9 @@ void ApiListener::ReplayLog(const JsonRpcConnection::Ptr& client)
 
 					client->SendMessage(lmessage);
 				}
-			}
 
-			logStream->Close();
+				return true;
+			});
 		}
 
 		if (count > 0) {
@@ -1512,6 +1861,34 @@ std::pair<Dictionary::Ptr, Dictionary::Ptr> ApiListener::GetStatus()
 	double syncQueueItemRate = m_SyncQueue.GetTaskCount(60) / 60.0;
 	double relayQueueItemRate = m_RelayQueue.GetTaskCount(60) / 60.0;
 
+	/* per-connection incoming message pipeline stats */
+	Dictionary::Ptr clientStats = new Dictionary();
+	double pendingMessages = 0;
+	double maxDecodeLatency = 0;
+
+	auto addClientStats ([&clientStats, &pendingMessages, &maxDecodeLatency](const JsonRpcConnection::Ptr& client) {
+		double clientPendingMessages = client->GetPendingMessages();
+		double decodeLatency = client->GetDecodeLatency();
+
+		pendingMessages += clientPendingMessages;
+
+		if (decodeLatency > maxDecodeLatency)
+			maxDecodeLatency = decodeLatency;
+
+		clientStats->Set(client->GetIdentity(), new Dictionary({
+			{ "pending_messages", clientPendingMessages },
+			{ "decode_latency", decodeLatency }
+		}));
+	});
+
+	for (const Endpoint::Ptr& endpoint : ConfigType::GetObjectsByType<Endpoint>()) {
+		for (const JsonRpcConnection::Ptr& client : endpoint->GetClients())
+			addClientStats(client);
+	}
+
+	for (const JsonRpcConnection::Ptr& client : GetAnonymousClients())
+		addClientStats(client);
+
 	Dictionary::Ptr status = new Dictionary({
 		{ "identity", GetIdentity() },
 		{ "num_endpoints", allEndpoints },
@@ -1528,7 +1905,10 @@ std::pair<Dictionary::Ptr, Dictionary::Ptr> ApiListener::GetStatus()
 			{ "relay_queue_items", relayQueueItems },
 			{ "work_queue_item_rate", workQueueItemRate },
 			{ "sync_queue_item_rate", syncQueueItemRate },
-			{ "relay_queue_item_rate", relayQueueItemRate }
+			{ "relay_queue_item_rate", relayQueueItemRate },
+			{ "pending_messages", pendingMessages },
+			{ "max_decode_latency", maxDecodeLatency },
+			{ "clients", clientStats }
 		}) },
 
 		{ "http", new Dictionary({
@@ -1550,6 +1930,9 @@ std::pair<Dictionary::Ptr, Dictionary::Ptr> ApiListener::GetStatus()
 	perfdata->Set("num_json_rpc_sync_queue_item_rate", syncQueueItemRate);
 	perfdata->Set("num_json_rpc_relay_queue_item_rate", relayQueueItemRate);
 
+	perfdata->Set("num_json_rpc_pending_messages", pendingMessages);
+	perfdata->Set("json_rpc_max_decode_latency", maxDecodeLatency);
+
 	return std::make_pair(status, perfdata);
 }
 
@@ -17,6 +17,7 @@
 #include "base/tlsstream.hpp"
 #include "base/threadpool.hpp"
 #include <atomic>
+#include <cstdint>
 #include <boost/asio/io_context.hpp>
 #include <boost/asio/ip/tcp.hpp>
 #include <boost/asio/spawn.hpp>
@@ -83,6 +84,17 @@ public:
 
 	static double CalculateZoneLag(const Endpoint::Ptr& endpoint);
 
+	/* replay log */
+	typedef std::function<bool (double, const String&, const String&, const char *, size_t)> ReplayLogCallback;
+
+	static bool ReplayLogFile(const String& path, const double& peerTs, const ReplayLogCallback& callback);
+
+	void StartLogging();
+	void StopLogging();
+
+	/* Note: Only use it for unit test mocks. Prefer RelayMessage(). */
+	void PersistMessage(const Dictionary::Ptr& message, const String& json, const ConfigObject::Ptr& secobj);
+
 	/* filesync */
 	static Value ConfigUpdateHandler(const MessageOrigin::Ptr& origin, const Dictionary::Ptr& params);
 	static void HandleConfigUpdate(const MessageOrigin::Ptr& origin, const Dictionary::Ptr& params);
@@ -168,11 +180,14 @@ private:
 
 	boost::mutex m_LogLock;
 	Stream::Ptr m_LogFile;
+	Stream::Ptr m_LogIndexFile;
+	uint_fast64_t m_LogOffset{0};
 	size_t m_LogMessageCount{0};
 
-	bool RelayMessageOne(const Zone::Ptr& zone, const MessageOrigin::Ptr& origin, const Dictionary::Ptr& message, const Endpoint::Ptr& currentZoneMaster);
+	void SyncSendMessage(const Endpoint::Ptr& endpoint, const Dictionary::Ptr& message, std::shared_ptr<const String>& json);
+	bool RelayMessageOne(const Zone::Ptr& zone, const MessageOrigin::Ptr& origin, const Dictionary::Ptr& message,
+		std::shared_ptr<const String>& json, const Endpoint::Ptr& currentZoneMaster);
 	void SyncRelayMessage(const MessageOrigin::Ptr& origin, const ConfigObject::Ptr& secobj, const Dictionary::Ptr& message, bool log);
-	void PersistMessage(const Dictionary::Ptr& message, const ConfigObject::Ptr& secobj);
 
 	void OpenLogFile();
 	void RotateLogFile();
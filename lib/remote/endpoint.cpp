@@ -109,6 +109,14 @@ void Endpoint::AddMessageSent(int bytes)
 	SetLastMessageSent(time);
 }
 
+void Endpoint::AddMessagesSent(int count, int bytes)
+{
+	double time = Utility::GetTime();
+	m_MessagesSent.InsertValue(time, count);
+	m_BytesSent.InsertValue(time, bytes);
+	SetLastMessageSent(time);
+}
+
 void Endpoint::AddMessageReceived(int bytes)
 {
 	double time = Utility::GetTime();
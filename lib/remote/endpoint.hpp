@@ -41,6 +41,7 @@ public:
 	void SetCachedZone(const intrusive_ptr<Zone>& zone);
 
 	void AddMessageSent(int bytes);
+	void AddMessagesSent(int count, int bytes);
 	void AddMessageReceived(int bytes);
 
 	double GetMessagesSentPerSecond() const override;
@@ -40,7 +40,7 @@ HttpServerConnection::HttpServerConnection(const String& identity, bool authenti
 }
 
 HttpServerConnection::HttpServerConnection(const String& identity, bool authenticated, const Shared<AsioTlsStream>::Ptr& stream, boost::asio::io_context& io)
-	: m_Stream(stream), m_Seen(Utility::GetTime()), m_IoStrand(io), m_ShuttingDown(false), m_HasStartedStreaming(false),
+	: m_Stream(stream), m_Seen(Utility::GetTime()), m_IoStrand(io), m_ShuttingDown(false), m_HasStartedStreaming(false), m_HasStartedChunkedResponse(false),
 	m_CheckLivenessTimer(io)
 {
 	if (authenticated) {
@@ -132,6 +132,16 @@ void HttpServerConnection::StartStreaming()
 	});
 }
 
+/**
+ * Tells the connection that the handler has started to write the response
+ * of the current request by itself (using chunked transfer encoding).
+ * Unlike StartStreaming() the connection remains usable for further requests.
+ */
+void HttpServerConnection::StartChunkedResponse()
+{
+	m_HasStartedChunkedResponse = true;
+}
+
 bool HttpServerConnection::Disconnected()
 {
 	return m_ShuttingDown;
@@ -445,6 +455,7 @@ bool ProcessRequest(
 	boost::beast::http::response<boost::beast::http::string_body>& response,
 	HttpServerConnection& server,
 	bool& hasStartedStreaming,
+	bool& hasStartedChunkedResponse,
 	boost::asio::yield_context& yc
 )
 {
@@ -455,7 +466,7 @@ bool ProcessRequest(
 
 		HttpHandler::ProcessRequest(stream, authenticatedUser, request, response, yc, server);
 	} catch (const std::exception& ex) {
-		if (hasStartedStreaming) {
+		if (hasStartedStreaming || hasStartedChunkedResponse) {
 			return false;
 		}
 
@@ -481,6 +492,10 @@ bool ProcessRequest(
 		return false;
 	}
 
+	if (hasStartedChunkedResponse) {
+		return true;
+	}
+
 	boost::system::error_code ec;
 
 	http::async_write(stream, response, yc[ec]);
@@ -563,8 +578,9 @@ void HttpServerConnection::ProcessMessages(boost::asio::yield_context yc)
 			}
 
 			m_Seen = std::numeric_limits<decltype(m_Seen)>::max();
+			m_HasStartedChunkedResponse = false;
 
-			if (!ProcessRequest(*m_Stream, request, authenticatedUser, response, *this, m_HasStartedStreaming, yc)) {
+			if (!ProcessRequest(*m_Stream, request, authenticatedUser, response, *this, m_HasStartedStreaming, m_HasStartedChunkedResponse, yc)) {
 				break;
 			}
 
@@ -30,6 +30,7 @@ public:
 	void Start();
 	void Disconnect();
 	void StartStreaming();
+	void StartChunkedResponse();
 
 	bool Disconnected();
 
@@ -41,6 +42,7 @@ private:
 	boost::asio::io_context::strand m_IoStrand;
 	bool m_ShuttingDown;
 	bool m_HasStartedStreaming;
+	bool m_HasStartedChunkedResponse;
 	boost::asio::deadline_timer m_CheckLivenessTimer;
 
 	HttpServerConnection(const String& identity, bool authenticated, const Shared<AsioTlsStream>::Ptr& stream, boost::asio::io_context& io);
@@ -2,11 +2,14 @@
 
 #include "remote/httputility.hpp"
 #include "remote/url.hpp"
+#include "base/io-engine.hpp"
 #include "base/json.hpp"
 #include "base/logger.hpp"
 #include <map>
 #include <string>
 #include <vector>
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/write.hpp>
 #include <boost/beast/http.hpp>
 
 using namespace icinga;
@@ -78,3 +81,80 @@ void HttpUtility::SendJsonError(boost::beast::http::response<boost::beast::http:
 
 	HttpUtility::SendJsonBody(response, params, result);
 }
+
+/* Encoded output is sent in chunks of at least this size. */
+static const size_t l_ChunkSize = 64 * 1024;
+
+HttpChunkedJsonWriter::HttpChunkedJsonWriter(AsioTlsStream& stream, HttpServerConnection& server,
+	const Dictionary::Ptr& params, boost::asio::yield_context& yc)
+	: m_Stream(stream), m_Server(server), m_Yc(yc), m_Encoder(params && HttpUtility::GetLastParameter(params, "pretty"))
+{
+}
+
+/**
+ * Sends the response header. The response's body is ignored.
+ *
+ * @param response The response to take the header fields from.
+ */
+void HttpChunkedJsonWriter::Start(boost::beast::http::response<boost::beast::http::string_body>& response)
+{
+	namespace http = boost::beast::http;
+
+	m_Server.StartChunkedResponse();
+
+	response.result(http::status::ok);
+	response.set(http::field::content_type, "application/json");
+	response.chunked(true);
+
+	http::response_serializer<http::string_body> serializer (response);
+
+	IoBoundWorkSlot dontLockTheIoThread (m_Yc);
+
+	http::async_write_header(m_Stream, serializer, m_Yc);
+	m_Stream.async_flush(m_Yc);
+}
+
+JsonEncoder& HttpChunkedJsonWriter::GetEncoder()
+{
+	return m_Encoder;
+}
+
+/**
+ * Sends the output encoded so far as a chunk.
+ *
+ * @param force Whether to send the output even if it's smaller than the chunk size.
+ */
+void HttpChunkedJsonWriter::Flush(bool force)
+{
+	namespace http = boost::beast::http;
+
+	auto& buf (m_Encoder.GetBuffer());
+
+	if (buf.empty() || (!force && buf.size() < l_ChunkSize)) {
+		return;
+	}
+
+	{
+		IoBoundWorkSlot dontLockTheIoThread (m_Yc);
+
+		boost::asio::async_write(m_Stream, http::make_chunk(boost::asio::buffer(buf)), m_Yc);
+		m_Stream.async_flush(m_Yc);
+	}
+
+	buf.clear();
+}
+
+/**
+ * Sends the remaining output and terminates the response body.
+ */
+void HttpChunkedJsonWriter::Finish()
+{
+	namespace http = boost::beast::http;
+
+	Flush(true);
+
+	IoBoundWorkSlot dontLockTheIoThread (m_Yc);
+
+	boost::asio::async_write(m_Stream, http::make_chunk_last(), m_Yc);
+	m_Stream.async_flush(m_Yc);
+}
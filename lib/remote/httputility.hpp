@@ -4,7 +4,11 @@
 #define HTTPUTILITY_H
 
 #include "remote/url.hpp"
+#include "remote/httpserverconnection.hpp"
 #include "base/dictionary.hpp"
+#include "base/json.hpp"
+#include "base/tlsstream.hpp"
+#include <boost/asio/spawn.hpp>
 #include <boost/beast/http.hpp>
 #include <string>
 
@@ -28,6 +32,29 @@ public:
 		const String& verbose = String(), const String& diagnosticInformation = String());
 };
 
+/**
+ * Sends a JSON response body using chunked transfer encoding while it's being encoded,
+ * so that big responses don't have to be built in memory as a whole.
+ *
+ * @ingroup remote
+ */
+class HttpChunkedJsonWriter
+{
+public:
+	HttpChunkedJsonWriter(AsioTlsStream& stream, HttpServerConnection& server, const Dictionary::Ptr& params, boost::asio::yield_context& yc);
+
+	void Start(boost::beast::http::response<boost::beast::http::string_body>& response);
+	JsonEncoder& GetEncoder();
+	void Flush(bool force = false);
+	void Finish();
+
+private:
+	AsioTlsStream& m_Stream;
+	HttpServerConnection& m_Server;
+	boost::asio::yield_context& m_Yc;
+	JsonEncoder m_Encoder;
+};
+
 }
 
 #endif /* HTTPUTILITY_H */
@@ -95,6 +95,28 @@ size_t JsonRpc::SendRawMessage(const Shared<AsioTlsStream>::Ptr& stream, const S
 	return NetString::WriteStringToStream(stream, json, yc);
 }
 
+/**
+  * Sends multiple raw messages to the connected peer using a single write.
+  *
+  * @param stream ASIO TLS Stream
+  * @param jsons messages
+  * @param yc Yield context required for ASIO
+  *
+  * @return bytes sent
+  */
+size_t JsonRpc::SendRawMessages(const Shared<AsioTlsStream>::Ptr& stream,
+	const std::vector<std::shared_ptr<const String>>& jsons, boost::asio::yield_context yc)
+{
+#ifdef I2_DEBUG
+	if (GetDebugJsonRpcCached()) {
+		for (auto& json : jsons)
+			std::cerr << ConsoleColorTag(Console_ForegroundBlue) << ">> " << *json << ConsoleColorTag(Console_Normal) << "\n";
+	}
+#endif /* I2_DEBUG */
+
+	return NetString::WriteStringsToStream(stream, jsons, yc);
+}
+
 /**
  * Reads a message from the connected peer.
  *
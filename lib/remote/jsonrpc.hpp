@@ -8,6 +8,7 @@
 #include "base/tlsstream.hpp"
 #include "remote/i2-remote.hpp"
 #include <memory>
+#include <vector>
 #include <boost/asio/spawn.hpp>
 
 namespace icinga
@@ -24,6 +25,8 @@ public:
 	static size_t SendMessage(const Shared<AsioTlsStream>::Ptr& stream, const Dictionary::Ptr& message);
 	static size_t SendMessage(const Shared<AsioTlsStream>::Ptr& stream, const Dictionary::Ptr& message, boost::asio::yield_context yc);
 	static size_t SendRawMessage(const Shared<AsioTlsStream>::Ptr& stream, const String& json, boost::asio::yield_context yc);
+	static size_t SendRawMessages(const Shared<AsioTlsStream>::Ptr& stream,
+		const std::vector<std::shared_ptr<const String>>& jsons, boost::asio::yield_context yc);
 
 	static String ReadMessage(const Shared<AsioTlsStream>::Ptr& stream, ssize_t maxMessageLength = -1);
 	static String ReadMessage(const Shared<AsioTlsStream>::Ptr& stream, boost::asio::yield_context yc, ssize_t maxMessageLength = -1);
@@ -29,6 +29,9 @@ REGISTER_APIFUNCTION(SetLogPosition, log, &SetLogPositionHandler);
 
 static RingBuffer l_TaskStats (15 * 60);
 
+/* Maximum amount of read, but not yet processed messages per connection */
+static const size_t l_MaxPendingMessages = 1024;
+
 JsonRpcConnection::JsonRpcConnection(const String& identity, bool authenticated,
 	const Shared<AsioTlsStream>::Ptr& stream, ConnectionRole role)
 	: JsonRpcConnection(identity, authenticated, stream, role, IoEngine::Get().GetIoContext())
@@ -39,8 +42,9 @@ JsonRpcConnection::JsonRpcConnection(const String& identity, bool authenticated,
 	const Shared<AsioTlsStream>::Ptr& stream, ConnectionRole role, boost::asio::io_context& io)
 	: m_Identity(identity), m_Authenticated(authenticated), m_Stream(stream), m_Role(role),
 	m_Timestamp(Utility::GetTime()), m_Seen(Utility::GetTime()), m_NextHeartbeat(0), m_IoStrand(io),
-	m_OutgoingMessagesQueued(io), m_WriterDone(io), m_ShuttingDown(false),
-	m_CheckLivenessTimer(io), m_HeartbeatTimer(io)
+	m_OutgoingMessagesQueued(io), m_WriterDone(io), m_PendingMessagesDrained(io), m_ShuttingDown(false),
+	m_CheckLivenessTimer(io), m_HeartbeatTimer(io), m_PendingMessages(0), m_NextReadSequence(0),
+	m_NextDispatchSequence(0), m_Dispatching(false), m_PipelineFailed(false), m_DecodeLatency(0)
 {
 	if (authenticated)
 		m_Endpoint = Endpoint::GetByName(identity);
@@ -58,6 +62,10 @@ void JsonRpcConnection::Start()
 	IoEngine::SpawnCoroutine(m_IoStrand, [this, keepAlive](asio::yield_context yc) { CheckLiveness(yc); });
 }
 
+/**
+ * Reads incoming messages. The coroutine only frames netstrings; JSON decoding and
+ * message processing take place in the thread pool, see DecodeMessage().
+ */
 void JsonRpcConnection::HandleIncomingMessages(boost::asio::yield_context yc)
 {
 	for (;;) {
@@ -77,23 +85,32 @@ void JsonRpcConnection::HandleIncomingMessages(boost::asio::yield_context yc)
 
 		m_Seen = Utility::GetTime();
 
-		try {
-			CpuBoundWork handleMessage (yc);
+		if (m_Endpoint) {
+			m_Endpoint->AddMessageReceived(message.GetLength());
+		}
 
-			MessageHandler(message);
-		} catch (const std::exception& ex) {
-			if (!m_ShuttingDown) {
-				Log(LogWarning, "JsonRpcConnection")
-					<< "Error while processing JSON-RPC message for identity '" << m_Identity
-					<< "': " << DiagnosticInformation(ex);
+		Ptr keepAlive (this);
+		auto sequence (m_NextReadSequence++);
+		double received = m_Seen;
+
+		m_PendingMessages.fetch_add(1);
+
+		Utility::QueueAsyncCallback([this, keepAlive, sequence, message, received]() {
+			DecodeMessage(sequence, message, received);
+		});
+
+		/* Don't read further messages while the thread pool can't keep up. */
+		while (m_PendingMessages.load() >= l_MaxPendingMessages) {
+			m_PendingMessagesDrained.Clear();
+
+			if (m_PendingMessages.load() >= l_MaxPendingMessages) {
+				m_PendingMessagesDrained.Wait(yc);
 			}
+		}
 
+		if (m_ShuttingDown) {
 			break;
 		}
-
-		CpuBoundWork taskStats (yc);
-
-		l_TaskStats.InsertValue(Utility::GetTime(), 1);
 	}
 
 	Disconnect();
@@ -113,12 +130,10 @@ void JsonRpcConnection::WriteOutgoingMessages(boost::asio::yield_context yc)
 
 		if (!queue.empty()) {
 			try {
-				for (auto& message : queue) {
-					size_t bytesSent = JsonRpc::SendRawMessage(m_Stream, message, yc);
+				size_t bytesSent = JsonRpc::SendRawMessages(m_Stream, queue, yc);
 
-					if (m_Endpoint) {
-						m_Endpoint->AddMessageSent(bytesSent);
-					}
+				if (m_Endpoint) {
+					m_Endpoint->AddMessagesSent(queue.size(), bytesSent);
 				}
 
 				m_Stream->async_flush(yc);
@@ -176,6 +191,17 @@ void JsonRpcConnection::SendMessage(const Dictionary::Ptr& message)
 }
 
 void JsonRpcConnection::SendRawMessage(const String& message)
+{
+	SendRawMessage(std::make_shared<const String>(message));
+}
+
+/**
+ * Queues an already encoded message. The buffer is shared, not copied,
+ * so one encoding can be fanned out to any number of connections.
+ *
+ * @param message The JSON-encoded message
+ */
+void JsonRpcConnection::SendRawMessage(const std::shared_ptr<const String>& message)
 {
 	Ptr keepAlive (this);
 
@@ -187,7 +213,7 @@ void JsonRpcConnection::SendRawMessage(const String& message)
 
 void JsonRpcConnection::SendMessageInternal(const Dictionary::Ptr& message)
 {
-	m_OutgoingMessagesQueue.emplace_back(JsonEncode(message));
+	m_OutgoingMessagesQueue.emplace_back(std::make_shared<const String>(JsonEncode(message)));
 	m_OutgoingMessagesQueued.Set();
 }
 
@@ -240,20 +266,253 @@ void JsonRpcConnection::Disconnect()
 	});
 }
 
-void JsonRpcConnection::MessageHandler(const String& jsonString)
+/**
+ * Returns the name of the checkable a message is about. Messages about the
+ * same checkable are processed in order, messages about different ones in
+ * parallel. An empty key means that the message has to be processed after
+ * all previous ones and before all following ones.
+ *
+ * @param message The decoded message
+ * @returns The ordering key
+ */
+static String GetOrderingKey(const Dictionary::Ptr& message)
 {
-	Dictionary::Ptr message = JsonRpc::DecodeMessage(jsonString);
+	Value method = message->Get("method");
 
-	if (m_Endpoint && message->Contains("ts")) {
-		double ts = message->Get("ts");
+	if (!method.IsString() || method.Get<String>().SubStr(0, 7) != "event::")
+		return String();
 
-		/* ignore old messages */
-		if (ts < m_Endpoint->GetRemoteLogPosition())
-			return;
+	Value params = message->Get("params");
+
+	if (!params.IsObjectType<Dictionary>())
+		return String();
+
+	Dictionary::Ptr paramsDict = params;
+	Value host = paramsDict->Get("host");
+
+	if (!host.IsString())
+		return String();
+
+	Value service = paramsDict->Get("service");
+
+	if (service.IsString())
+		return host.Get<String>() + "!" + service.Get<String>();
+
+	return host;
+}
+
+void JsonRpcConnection::DecodeMessage(uint_fast64_t sequence, const String& jsonString, double received)
+{
+	DecodedMessage decoded;
+
+	try {
+		decoded.Message = JsonRpc::DecodeMessage(jsonString);
+		decoded.OrderingKey = GetOrderingKey(decoded.Message);
+	} catch (const std::exception& ex) {
+		Log(LogWarning, "JsonRpcConnection")
+			<< "Error while decoding JSON-RPC message for identity '" << m_Identity
+			<< "': " << DiagnosticInformation(ex);
+	}
+
+	{
+		boost::mutex::scoped_lock lock (m_PipelineMutex);
+
+		/* Exponentially weighted moving average */
+		m_DecodeLatency = m_DecodeLatency * 0.95 + (Utility::GetTime() - received) * 0.05;
 
-		m_Endpoint->SetRemoteLogPosition(ts);
+		m_DecodedMessages.emplace(sequence, std::move(decoded));
 	}
 
+	DispatchMessages();
+}
+
+/**
+ * Passes decoded messages on in the order they have been read. Only one thread
+ * dispatches at a time, the others just leave their messages for it.
+ */
+void JsonRpcConnection::DispatchMessages()
+{
+	boost::mutex::scoped_lock lock (m_PipelineMutex);
+
+	if (m_Dispatching)
+		return;
+
+	m_Dispatching = true;
+
+	/* Whatever happens, the next DispatchMessages() call must be able to take over. */
+	Defer stopDispatching ([this, &lock]() {
+		if (!lock.owns_lock())
+			lock.lock();
+
+		m_Dispatching = false;
+	});
+
+	for (;;) {
+		auto next (m_DecodedMessages.find(m_NextDispatchSequence));
+
+		if (next == m_DecodedMessages.end())
+			break;
+
+		DecodedMessage& decoded (next->second);
+
+		/* Messages without an ordering key wait until all lanes are done. */
+		if (decoded.Message && decoded.OrderingKey.IsEmpty() && !m_Lanes.empty())
+			break;
+
+		Dictionary::Ptr message (std::move(decoded.Message));
+		String key (std::move(decoded.OrderingKey));
+
+		m_DecodedMessages.erase(next);
+		m_NextDispatchSequence++;
+
+		if (m_PipelineFailed || !message) {
+			if (!m_PipelineFailed) {
+				m_PipelineFailed = true;
+				Disconnect();
+			}
+
+			MessageProcessed();
+			continue;
+		}
+
+		lock.unlock();
+
+		bool done = true;
+
+		try {
+			if (m_Endpoint && message->Contains("ts")) {
+				double ts = message->Get("ts");
+
+				/* ignore old messages */
+				if (ts < m_Endpoint->GetRemoteLogPosition()) {
+					MessageProcessed();
+					lock.lock();
+					continue;
+				}
+
+				m_Endpoint->SetRemoteLogPosition(ts);
+			}
+
+			if (key.IsEmpty())
+				MessageHandler(message);
+			else
+				done = false;
+		} catch (const std::exception& ex) {
+			MessageFailed(ex);
+		}
+
+		if (done) {
+			MessageProcessed();
+			lock.lock();
+		} else {
+			lock.lock();
+
+			auto& lane (m_Lanes[key]);
+
+			lane.emplace_back(std::move(message));
+
+			if (lane.size() == 1u) {
+				Ptr keepAlive (this);
+
+				Utility::QueueAsyncCallback([this, keepAlive, key]() { ProcessLane(key); });
+			}
+		}
+	}
+}
+
+/**
+ * Processes the messages about one checkable in order.
+ *
+ * @param key The ordering key, see GetOrderingKey()
+ */
+void JsonRpcConnection::ProcessLane(const String& key)
+{
+	boost::mutex::scoped_lock lock (m_PipelineMutex);
+
+	auto lane (m_Lanes.find(key));
+
+	/* The message stays in the lane while it's being processed so that
+	 * DispatchMessages() doesn't start another worker for the same key.
+	 */
+	while (!lane->second.empty()) {
+		Dictionary::Ptr message (lane->second.front());
+
+		/* Once the connection failed, the remaining messages are only accounted for. */
+		if (!m_PipelineFailed) {
+			lock.unlock();
+
+			try {
+				MessageHandler(message);
+			} catch (const std::exception& ex) {
+				MessageFailed(ex);
+			}
+
+			lock.lock();
+		}
+
+		lane->second.pop_front();
+		MessageProcessed();
+	}
+
+	m_Lanes.erase(lane);
+
+	bool resume = m_Lanes.empty() && !m_DecodedMessages.empty();
+
+	lock.unlock();
+
+	if (resume)
+		DispatchMessages();
+}
+
+/**
+ * Stops processing further messages from a peer after one of them couldn't be
+ * processed and closes the connection, just like a read error would.
+ *
+ * @param ex The exception which was thrown while processing the message
+ */
+void JsonRpcConnection::MessageFailed(const std::exception& ex)
+{
+	boost::mutex::scoped_lock lock (m_PipelineMutex);
+
+	if (m_PipelineFailed)
+		return;
+
+	m_PipelineFailed = true;
+
+	if (!m_ShuttingDown) {
+		Log(LogWarning, "JsonRpcConnection")
+			<< "Error while processing JSON-RPC message for identity '" << m_Identity
+			<< "': " << DiagnosticInformation(ex);
+	}
+
+	Disconnect();
+}
+
+void JsonRpcConnection::MessageProcessed()
+{
+	l_TaskStats.InsertValue(Utility::GetTime(), 1);
+
+	if (m_PendingMessages.fetch_sub(1) == l_MaxPendingMessages) {
+		Ptr keepAlive (this);
+
+		m_IoStrand.post([this, keepAlive]() { m_PendingMessagesDrained.Set(); });
+	}
+}
+
+size_t JsonRpcConnection::GetPendingMessages() const
+{
+	return m_PendingMessages.load();
+}
+
+double JsonRpcConnection::GetDecodeLatency()
+{
+	boost::mutex::scoped_lock lock (m_PipelineMutex);
+
+	return m_DecodeLatency;
+}
+
+void JsonRpcConnection::MessageHandler(const Dictionary::Ptr& message)
+{
 	MessageOrigin::Ptr origin = new MessageOrigin();
 	origin->FromClient = this;
 
@@ -262,8 +521,6 @@ void JsonRpcConnection::MessageHandler(const String& jsonString)
 			origin->FromZone = m_Endpoint->GetZone();
 		else
 			origin->FromZone = Zone::GetByName(message->Get("originZone"));
-
-		m_Endpoint->AddMessageReceived(jsonString.GetLength());
 	}
 
 	Value vmethod;
@@ -312,7 +569,7 @@ void JsonRpcConnection::MessageHandler(const String& jsonString)
 		resultMessage->Set("jsonrpc", "2.0");
 		resultMessage->Set("id", message->Get("id"));
 
-		SendMessageInternal(resultMessage);
+		SendMessage(resultMessage);
 	}
 }
 
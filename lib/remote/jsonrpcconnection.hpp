@@ -9,11 +9,16 @@
 #include "base/tlsstream.hpp"
 #include "base/timer.hpp"
 #include "base/workqueue.hpp"
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <map>
 #include <memory>
 #include <vector>
 #include <boost/asio/io_context.hpp>
 #include <boost/asio/io_context_strand.hpp>
 #include <boost/asio/spawn.hpp>
+#include <boost/thread/mutex.hpp>
 
 namespace icinga
 {
@@ -57,14 +62,27 @@ public:
 
 	void SendMessage(const Dictionary::Ptr& request);
 	void SendRawMessage(const String& request);
+	void SendRawMessage(const std::shared_ptr<const String>& request);
 
 	static Value HeartbeatAPIHandler(const intrusive_ptr<MessageOrigin>& origin, const Dictionary::Ptr& params);
 
 	static double GetWorkQueueRate();
 
+	size_t GetPendingMessages() const;
+	double GetDecodeLatency();
+
 	static void SendCertificateRequest(const JsonRpcConnection::Ptr& aclient, const intrusive_ptr<MessageOrigin>& origin, const String& path);
 
 private:
+	/**
+	 * An incoming message after JSON decoding.
+	 */
+	struct DecodedMessage
+	{
+		Dictionary::Ptr Message;
+		String OrderingKey;
+	};
+
 	String m_Identity;
 	bool m_Authenticated;
 	Endpoint::Ptr m_Endpoint;
@@ -72,14 +90,30 @@ private:
 	ConnectionRole m_Role;
 	double m_Timestamp;
 	double m_Seen;
-	double m_NextHeartbeat;
+	std::atomic<double> m_NextHeartbeat;
 	boost::asio::io_context::strand m_IoStrand;
-	std::vector<String> m_OutgoingMessagesQueue;
+	std::vector<std::shared_ptr<const String>> m_OutgoingMessagesQueue;
 	AsioConditionVariable m_OutgoingMessagesQueued;
 	AsioConditionVariable m_WriterDone;
-	bool m_ShuttingDown;
+	AsioConditionVariable m_PendingMessagesDrained;
+
+	/* Written on the strand, but also read by the threads processing messages. */
+	std::atomic<bool> m_ShuttingDown;
+
 	boost::asio::deadline_timer m_CheckLivenessTimer, m_HeartbeatTimer;
 
+	/* Incoming messages which have been read, but not processed yet. */
+	std::atomic<size_t> m_PendingMessages;
+	uint_fast64_t m_NextReadSequence;
+
+	boost::mutex m_PipelineMutex;
+	std::map<uint_fast64_t, DecodedMessage> m_DecodedMessages;
+	uint_fast64_t m_NextDispatchSequence;
+	bool m_Dispatching;
+	bool m_PipelineFailed;
+	std::map<String, std::deque<Dictionary::Ptr>> m_Lanes;
+	double m_DecodeLatency;
+
 	JsonRpcConnection(const String& identity, bool authenticated, const Shared<AsioTlsStream>::Ptr& stream, ConnectionRole role, boost::asio::io_context& io);
 
 	void HandleIncomingMessages(boost::asio::yield_context yc);
@@ -87,8 +121,12 @@ private:
 	void HandleAndWriteHeartbeats(boost::asio::yield_context yc);
 	void CheckLiveness(boost::asio::yield_context yc);
 
-	bool ProcessMessage();
-	void MessageHandler(const String& jsonString);
+	void DecodeMessage(uint_fast64_t sequence, const String& jsonString, double received);
+	void DispatchMessages();
+	void ProcessLane(const String& key);
+	void MessageFailed(const std::exception& ex);
+	void MessageProcessed();
+	void MessageHandler(const Dictionary::Ptr& message);
 
 	void CertificateRequestResponseHandler(const Dictionary::Ptr& message);
 
@@ -6,6 +6,7 @@
 #include "base/serializer.hpp"
 #include "base/dependencygraph.hpp"
 #include "base/configtype.hpp"
+#include "base/json.hpp"
 #include <boost/algorithm/string/case_conv.hpp>
 #include <set>
 
@@ -87,6 +88,81 @@ Dictionary::Ptr ObjectQueryHandler::SerializeObjectAttrs(const Object::Ptr& obje
 	return new Dictionary(std::move(resultAttrs));
 }
 
+/**
+ * Serializes an object the way it's returned by the API.
+ *
+ * Throws a ScriptError if the requested attributes, joins or meta data are invalid.
+ */
+Dictionary::Ptr ObjectQueryHandler::SerializeObject(const ConfigObject::Ptr& obj, const Type::Ptr& type, const Array::Ptr& uattrs,
+	const Array::Ptr& ujoins, const Array::Ptr& umetas, const std::set<String>& joinAttrs, bool allJoins)
+{
+	DictionaryData result1{
+		{ "name", obj->GetName() },
+		{ "type", obj->GetReflectionType()->GetName() }
+	};
+
+	DictionaryData metaAttrs;
+
+	if (umetas) {
+		ObjectLock olock(umetas);
+		for (const String& meta : umetas) {
+			if (meta == "used_by") {
+				Array::Ptr used_by = new Array();
+				metaAttrs.emplace_back("used_by", used_by);
+
+				for (const Object::Ptr& pobj : DependencyGraph::GetParents((obj)))
+				{
+					ConfigObject::Ptr configObj = dynamic_pointer_cast<ConfigObject>(pobj);
+
+					if (!configObj)
+						continue;
+
+					used_by->Add(new Dictionary({
+						{ "type", configObj->GetReflectionType()->GetName() },
+						{ "name", configObj->GetName() }
+					}));
+				}
+			} else if (meta == "location") {
+				metaAttrs.emplace_back("location", obj->GetSourceLocation());
+			} else {
+				BOOST_THROW_EXCEPTION(ScriptError("Invalid field specified for meta: " + meta));
+			}
+		}
+	}
+
+	result1.emplace_back("meta", new Dictionary(std::move(metaAttrs)));
+
+	result1.emplace_back("attrs", SerializeObjectAttrs(obj, String(), uattrs, false, false));
+
+	DictionaryData joins;
+
+	for (const String& joinAttr : joinAttrs) {
+		Object::Ptr joinedObj;
+		int fid = type->GetFieldId(joinAttr);
+
+		if (fid < 0)
+			BOOST_THROW_EXCEPTION(ScriptError("Invalid field specified for join: " + joinAttr));
+
+		Field field = type->GetFieldInfo(fid);
+
+		if (!(field.Attributes & FANavigation))
+			BOOST_THROW_EXCEPTION(ScriptError("Not a joinable field: " + joinAttr));
+
+		joinedObj = obj->NavigateField(fid);
+
+		if (!joinedObj)
+			continue;
+
+		String prefix = field.NavigationName;
+
+		joins.emplace_back(prefix, SerializeObjectAttrs(joinedObj, prefix, ujoins, true, allJoins));
+	}
+
+	result1.emplace_back("joins", new Dictionary(std::move(joins)));
+
+	return new Dictionary(std::move(result1));
+}
+
 bool ObjectQueryHandler::HandleRequest(
 	AsioTlsStream& stream,
 	const ApiUser::Ptr& user,
@@ -164,9 +240,6 @@ bool ObjectQueryHandler::HandleRequest(
 		return true;
 	}
 
-	ArrayData results;
-	results.reserve(objs.size());
-
 	std::set<String> joinAttrs;
 	std::set<String> userJoinAttrs;
 
@@ -189,95 +262,65 @@ bool ObjectQueryHandler::HandleRequest(
 		joinAttrs.insert(field.Name);
 	}
 
-	for (const ConfigObject::Ptr& obj : objs) {
-		DictionaryData result1{
-			{ "name", obj->GetName() },
-			{ "type", obj->GetReflectionType()->GetName() }
-		};
-
-		DictionaryData metaAttrs;
-
-		if (umetas) {
-			ObjectLock olock(umetas);
-			for (const String& meta : umetas) {
-				if (meta == "used_by") {
-					Array::Ptr used_by = new Array();
-					metaAttrs.emplace_back("used_by", used_by);
-
-					for (const Object::Ptr& pobj : DependencyGraph::GetParents((obj)))
-					{
-						ConfigObject::Ptr configObj = dynamic_pointer_cast<ConfigObject>(pobj);
-
-						if (!configObj)
-							continue;
-
-						used_by->Add(new Dictionary({
-							{ "type", configObj->GetReflectionType()->GetName() },
-							{ "name", configObj->GetName() }
-						}));
-					}
-				} else if (meta == "location") {
-					metaAttrs.emplace_back("location", obj->GetSourceLocation());
-				} else {
-					HttpUtility::SendJsonError(response, params, 400, "Invalid field specified for meta: " + meta);
-					return true;
-				}
-			}
-		}
+	if (objs.empty() || request.version() != 11) {
+		ArrayData results;
+		results.reserve(objs.size());
 
-		result1.emplace_back("meta", new Dictionary(std::move(metaAttrs)));
-
-		try {
-			result1.emplace_back("attrs", SerializeObjectAttrs(obj, String(), uattrs, false, false));
-		} catch (const ScriptError& ex) {
-			HttpUtility::SendJsonError(response, params, 400, ex.what());
-			return true;
+		for (const ConfigObject::Ptr& obj : objs) {
+			try {
+				results.push_back(SerializeObject(obj, type, uattrs, ujoins, umetas, joinAttrs, allJoins));
+			} catch (const ScriptError& ex) {
+				HttpUtility::SendJsonError(response, params, 400, ex.what());
+				return true;
+			}
 		}
 
-		DictionaryData joins;
+		Dictionary::Ptr result = new Dictionary({
+			{ "results", new Array(std::move(results)) }
+		});
 
-		for (const String& joinAttr : joinAttrs) {
-			Object::Ptr joinedObj;
-			int fid = type->GetFieldId(joinAttr);
+		response.result(http::status::ok);
+		HttpUtility::SendJsonBody(response, params, result);
 
-			if (fid < 0) {
-				HttpUtility::SendJsonError(response, params, 400, "Invalid field specified for join: " + joinAttr);
-				return true;
-			}
+		return true;
+	}
 
-			Field field = type->GetFieldInfo(fid);
+	/* The parameters are the same for all objects, so once the first object has been
+	 * serialized successfully the response can be streamed without running into errors.
+	 */
+	Dictionary::Ptr first;
 
-			if (!(field.Attributes & FANavigation)) {
-				HttpUtility::SendJsonError(response, params, 400, "Not a joinable field: " + joinAttr);
-				return true;
-			}
+	try {
+		first = SerializeObject(objs[0], type, uattrs, ujoins, umetas, joinAttrs, allJoins);
+	} catch (const ScriptError& ex) {
+		HttpUtility::SendJsonError(response, params, 400, ex.what());
+		return true;
+	}
 
-			joinedObj = obj->NavigateField(fid);
+	HttpChunkedJsonWriter writer (stream, server, params, yc);
+	JsonEncoder& encoder (writer.GetEncoder());
 
-			if (!joinedObj)
-				continue;
+	writer.Start(response);
 
-			String prefix = field.NavigationName;
+	encoder.StartObject();
+	encoder.Key("results");
+	encoder.StartArray();
 
-			try {
-				joins.emplace_back(prefix, SerializeObjectAttrs(joinedObj, prefix, ujoins, true, allJoins));
-			} catch (const ScriptError& ex) {
-				HttpUtility::SendJsonError(response, params, 400, ex.what());
-				return true;
-			}
+	for (decltype(objs.size()) i = 0; i < objs.size(); i++) {
+		if (i == 0) {
+			encoder.Encode(first);
+			first = nullptr;
+		} else {
+			encoder.Encode(SerializeObject(objs[i], type, uattrs, ujoins, umetas, joinAttrs, allJoins));
 		}
 
-		result1.emplace_back("joins", new Dictionary(std::move(joins)));
-
-		results.push_back(new Dictionary(std::move(result1)));
+		writer.Flush();
 	}
 
-	Dictionary::Ptr result = new Dictionary({
-		{ "results", new Array(std::move(results)) }
-	});
+	encoder.EndArray();
+	encoder.EndObject();
 
-	response.result(http::status::ok);
-	HttpUtility::SendJsonBody(response, params, result);
+	writer.Finish();
 
 	return true;
 }
@@ -159,4 +159,34 @@ BOOST_AUTO_TEST_CASE(json)
 	BOOST_CHECK(deserialized->Get(2) == 5);
 }
 
+BOOST_AUTO_TEST_CASE(snapshot)
+{
+	Array::Ptr array = new Array({ 7, 2, 5 });
+
+	Array::Snapshot first = array->GetSnapshot();
+
+	array->Sort();
+	array->Add(9);
+
+	BOOST_CHECK(first.GetLength() == 3);
+	BOOST_CHECK(first.GetData()[0] == 7);
+
+	Array::Snapshot second = array->GetSnapshot();
+
+	BOOST_CHECK(second.GetLength() == 4);
+	BOOST_CHECK(second.GetData()[0] == 2);
+	BOOST_CHECK(second.GetData()[3] == 9);
+
+	Array::Ptr copy = new Array();
+	BOOST_CHECK(copy->GetSnapshot().GetLength() == 0);
+
+	array->CopyTo(copy);
+	BOOST_CHECK(copy->GetSnapshot().GetLength() == 4);
+
+	Array::Snapshot frozen = array->Freeze();
+
+	BOOST_CHECK(frozen.GetLength() == 4);
+	BOOST_CHECK_THROW(array->Add(1), std::invalid_argument);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
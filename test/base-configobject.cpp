@@ -0,0 +1,165 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "base/configobject.hpp"
+#include "base/configuration.hpp"
+#include "base/utility.hpp"
+#include "remote/endpoint.hpp"
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <BoostTestTargetConfig.h>
+
+using namespace icinga;
+
+/**
+ * Provides two registered objects with state attributes and a temporary state file path.
+ */
+struct StateJournalFixture
+{
+	StateJournalFixture()
+		: m_TempDir(boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("icinga2-state-%%%%-%%%%"))
+	{
+		boost::filesystem::create_directories(m_TempDir);
+
+		StateFile = (m_TempDir / "icinga2.state").string();
+		JournalFile = StateFile + ".journal";
+
+		A = new Endpoint();
+		A->SetName("a");
+		A->Register();
+
+		B = new Endpoint();
+		B->SetName("b");
+		B->Register();
+	}
+
+	~StateJournalFixture()
+	{
+		A->Unregister();
+		B->Unregister();
+
+		Configuration::StateFormat = "json";
+
+		boost::system::error_code ec;
+		boost::filesystem::remove_all(m_TempDir, ec);
+	}
+
+	void Reset()
+	{
+		A->SetLocalLogPosition(0);
+		B->SetLocalLogPosition(0);
+	}
+
+	String StateFile;
+	String JournalFile;
+	Endpoint::Ptr A;
+	Endpoint::Ptr B;
+
+private:
+	boost::filesystem::path m_TempDir;
+};
+
+BOOST_FIXTURE_TEST_SUITE(base_configobject, StateJournalFixture)
+
+BOOST_AUTO_TEST_CASE(journal_replay)
+{
+	A->SetLocalLogPosition(10);
+	B->SetLocalLogPosition(20);
+	ConfigObject::DumpObjects(StateFile);
+
+	BOOST_CHECK(!Utility::PathExists(JournalFile));
+
+	A->SetLocalLogPosition(11);
+	ConfigObject::DumpDirtyObjects(StateFile);
+
+	A->SetLocalLogPosition(12);
+	ConfigObject::DumpDirtyObjects(StateFile);
+
+	BOOST_CHECK(Utility::PathExists(JournalFile));
+
+	Reset();
+	ConfigObject::RestoreObjects(StateFile);
+
+	BOOST_CHECK_EQUAL(A->GetLocalLogPosition(), 12);
+	BOOST_CHECK_EQUAL(B->GetLocalLogPosition(), 20);
+
+	ConfigObject::DumpObjects(StateFile);
+
+	BOOST_CHECK(!Utility::PathExists(JournalFile));
+}
+
+BOOST_AUTO_TEST_CASE(journal_binary)
+{
+	Configuration::StateFormat = "binary";
+
+	A->SetLocalLogPosition(10);
+	B->SetLocalLogPosition(20);
+	ConfigObject::DumpObjects(StateFile);
+
+	B->SetLocalLogPosition(21);
+	ConfigObject::DumpDirtyObjects(StateFile);
+
+	Reset();
+	ConfigObject::RestoreObjects(StateFile);
+
+	BOOST_CHECK_EQUAL(A->GetLocalLogPosition(), 10);
+	BOOST_CHECK_EQUAL(B->GetLocalLogPosition(), 21);
+}
+
+BOOST_AUTO_TEST_CASE(journal_truncated)
+{
+	A->SetLocalLogPosition(10);
+	B->SetLocalLogPosition(20);
+	ConfigObject::DumpObjects(StateFile);
+
+	A->SetLocalLogPosition(11);
+	B->SetLocalLogPosition(21);
+	ConfigObject::DumpDirtyObjects(StateFile);
+
+	/* A crash while appending the next entry. */
+	{
+		std::ofstream fp (JournalFile.CStr(), std::ios_base::out | std::ios_base::app);
+		fp << "80:{\"name\":\"a\",\"type\":\"Endpoint\",\"upd";
+	}
+
+	Reset();
+	ConfigObject::RestoreObjects(StateFile);
+
+	BOOST_CHECK_EQUAL(A->GetLocalLogPosition(), 11);
+	BOOST_CHECK_EQUAL(B->GetLocalLogPosition(), 21);
+
+	/* Entries appended after the replay must not get lost behind the partial one. */
+	A->SetLocalLogPosition(12);
+	ConfigObject::DumpDirtyObjects(StateFile);
+
+	Reset();
+	ConfigObject::RestoreObjects(StateFile);
+
+	BOOST_CHECK_EQUAL(A->GetLocalLogPosition(), 12);
+	BOOST_CHECK_EQUAL(B->GetLocalLogPosition(), 21);
+}
+
+BOOST_AUTO_TEST_CASE(journal_outdated)
+{
+	A->SetLocalLogPosition(10);
+	ConfigObject::DumpObjects(StateFile);
+
+	A->SetLocalLogPosition(11);
+	ConfigObject::DumpDirtyObjects(StateFile);
+
+	String oldJournal = JournalFile + ".old";
+	Utility::CopyFile(JournalFile, oldJournal);
+
+	A->SetLocalLogPosition(15);
+	ConfigObject::DumpObjects(StateFile);
+
+	/* A crash after the new state file has been renamed into place, but before the journal was removed. */
+	Utility::RenameFile(oldJournal, JournalFile);
+
+	Reset();
+	ConfigObject::RestoreObjects(StateFile);
+
+	BOOST_CHECK_EQUAL(A->GetLocalLogPosition(), 15);
+	BOOST_CHECK(!Utility::PathExists(JournalFile));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
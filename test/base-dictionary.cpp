@@ -3,7 +3,17 @@
 #include "base/dictionary.hpp"
 #include "base/objectlock.hpp"
 #include "base/json.hpp"
+#include "base/convert.hpp"
 #include <BoostTestTargetConfig.h>
+#include <boost/thread/thread.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <random>
+#ifdef __GLIBC__
+#	include <malloc.h>
+#endif /* __GLIBC__ */
 
 using namespace icinga;
 
@@ -183,4 +193,242 @@ BOOST_AUTO_TEST_CASE(json)
 	BOOST_CHECK(deserialized->Get("test2") == "hello world");
 }
 
+BOOST_AUTO_TEST_CASE(concurrent_readers)
+{
+	Dictionary::Ptr dictionary = new Dictionary({ { "test1", 7 } });
+	std::atomic<bool> read (false);
+
+	{
+		/* Readers don't wait for other threads which merely iterate. */
+		ObjectLock olock(dictionary);
+
+		boost::thread reader ([&dictionary, &read]() {
+			read = dictionary->Get("test1") == 7 && dictionary->Contains("test1") && dictionary->GetLength() == 1;
+		});
+
+		reader.join();
+	}
+
+	BOOST_CHECK(read);
+
+	std::atomic<bool> stop (false), consistent (true);
+	boost::thread_group readers;
+
+	for (int i = 0; i < 4; i++) {
+		readers.create_thread([&dictionary, &stop, &consistent]() {
+			while (!stop) {
+				Value value = dictionary->Get("counter");
+
+				if (value.IsEmpty())
+					continue;
+
+				/* The key may already have been removed again, but never holds another value. */
+				Value key = dictionary->Get("key" + Convert::ToString(value));
+
+				if (!key.IsEmpty() && key != value)
+					consistent = false;
+			}
+		});
+	}
+
+	for (int i = 0; i < 20000; i++) {
+		dictionary->Set("key" + Convert::ToString(i), i);
+		dictionary->Set("counter", i);
+
+		if (i % 100 == 0)
+			dictionary->Remove("key" + Convert::ToString(i - 200));
+	}
+
+	stop = true;
+	readers.join_all();
+
+	BOOST_CHECK(consistent);
+	BOOST_CHECK(dictionary->Get("counter") == 19999);
+}
+
+BOOST_AUTO_TEST_CASE(snapshot)
+{
+	Dictionary::Ptr dictionary = new Dictionary({
+		{ "a", 1 },
+		{ "b", 2 }
+	});
+
+	Dictionary::Snapshot first = dictionary->GetSnapshot();
+
+	BOOST_CHECK(first.GetLength() == 2);
+	BOOST_CHECK(first.begin()->first == "a");
+
+	dictionary->Set("a", 3);
+	dictionary->Set("c", 4);
+
+	/* Earlier snapshots aren't affected by later writes. */
+	BOOST_CHECK(first.GetLength() == 2);
+	BOOST_CHECK(first.begin()->second == 1);
+
+	Dictionary::Snapshot second = dictionary->GetSnapshot();
+
+	BOOST_CHECK(&second.GetData() != &first.GetData());
+	BOOST_CHECK(second.GetLength() == 3);
+	BOOST_CHECK(second.begin()->second == 3);
+
+	{
+		ObjectLock olock(dictionary);
+
+		for (auto& kv : dictionary)
+			kv.second = 5;
+	}
+
+	BOOST_CHECK(dictionary->GetSnapshot().begin()->second == 5);
+
+	Dictionary::Snapshot frozen = dictionary->Freeze();
+
+	BOOST_CHECK(frozen.GetLength() == 3);
+	BOOST_CHECK_THROW(dictionary->Set("d", 6), std::invalid_argument);
+
+	BOOST_CHECK(Dictionary::Snapshot().GetLength() == 0);
+}
+
+BOOST_AUTO_TEST_CASE(large)
+{
+	std::vector<int> numbers;
+
+	for (int i = 0; i < 100; i++)
+		numbers.push_back(i);
+
+	std::shuffle(numbers.begin(), numbers.end(), std::mt19937(42));
+
+	Dictionary::Ptr dictionary = new Dictionary();
+
+	for (int i : numbers) {
+		dictionary->Set("key" + Convert::ToString(i), i);
+
+		BOOST_CHECK(dictionary->Get("key" + Convert::ToString(i)) == i);
+	}
+
+	BOOST_CHECK(dictionary->GetLength() == 100);
+	BOOST_CHECK(dictionary->Get("key100").IsEmpty());
+
+	std::vector<String> keys = dictionary->GetKeys();
+	BOOST_CHECK(std::is_sorted(keys.begin(), keys.end()));
+
+	{
+		ObjectLock olock(dictionary);
+
+		for (auto it = dictionary->Begin(); it != dictionary->End();) {
+			if (static_cast<int>(it->second) % 2)
+				it = dictionary->Remove(it);
+			else
+				++it;
+		}
+	}
+
+	BOOST_CHECK(dictionary->GetLength() == 50);
+	BOOST_CHECK(!dictionary->Contains("key1"));
+	BOOST_CHECK(dictionary->Contains("key2"));
+
+	Dictionary::Ptr clone = dictionary->ShallowClone();
+	BOOST_CHECK(clone->GetLength() == 50);
+	BOOST_CHECK(clone->Get("key98") == 98);
+
+	dictionary->Clear();
+	BOOST_CHECK(dictionary->GetLength() == 0);
+
+	dictionary->Set("key", 1);
+	BOOST_CHECK(dictionary->Get("key") == 1);
+}
+
+BOOST_AUTO_TEST_CASE(duplicate_keys)
+{
+	Dictionary::Ptr dictionary = new Dictionary({
+		{ "b", 1 },
+		{ "a", 2 },
+		{ "b", 3 }
+	});
+
+	BOOST_CHECK(dictionary->GetLength() == 2);
+	BOOST_CHECK(dictionary->Get("b") == 1);
+	BOOST_CHECK(dictionary->GetKeys().front() == "a");
+}
+
+#ifdef __GLIBC__
+static size_t GetAllocatedBytes()
+{
+#if __GLIBC_PREREQ(2, 33)
+	return mallinfo2().uordblks;
+#else /* __GLIBC_PREREQ(2, 33) */
+	return mallinfo().uordblks;
+#endif /* __GLIBC_PREREQ(2, 33) */
+}
+#endif /* __GLIBC__ */
+
+/* Compares memory and lookup times only, so it runs on demand (--run_test=base_dictionary/benchmark). */
+BOOST_AUTO_TEST_CASE(benchmark, *boost::unit_test::disabled())
+{
+	/* Many small dictionaries sharing a few keys, like the custom variables of hosts. */
+	const int count = 10000;
+	const std::vector<String> keys { "address", "check_interval", "http_vhosts", "notification", "os", "zone" };
+
+	std::vector<Dictionary::Ptr> dictionaries;
+	dictionaries.reserve(count);
+
+	for (int i = 0; i < count; i++)
+		dictionaries.emplace_back(new Dictionary());
+
+	std::vector<std::map<String, Value> > maps (count);
+
+#ifdef __GLIBC__
+	size_t before = GetAllocatedBytes();
+#endif /* __GLIBC__ */
+
+	for (int i = 0; i < count; i++) {
+		for (const String& key : keys)
+			dictionaries[i]->Set(key, i);
+	}
+
+#ifdef __GLIBC__
+	size_t dictionaryBytes = GetAllocatedBytes() - before;
+	before = GetAllocatedBytes();
+#endif /* __GLIBC__ */
+
+	for (int i = 0; i < count; i++) {
+		for (const String& key : keys)
+			maps[i][key] = i;
+	}
+
+#ifdef __GLIBC__
+	size_t mapBytes = GetAllocatedBytes() - before;
+
+	BOOST_CHECK(dictionaryBytes < mapBytes);
+
+	BOOST_TEST_MESSAGE("Memory per dictionary: " << dictionaryBytes / count << " bytes for " << keys.size()
+		<< " items, std::map: " << mapBytes / count << " bytes (excluding the containers themselves)");
+#endif /* __GLIBC__ */
+
+	double sum = 0;
+	auto start (std::chrono::steady_clock::now());
+
+	for (const Dictionary::Ptr& dictionary : dictionaries) {
+		for (const String& key : keys)
+			sum += dictionary->Get(key);
+	}
+
+	auto looked (std::chrono::steady_clock::now());
+
+	for (const std::map<String, Value>& map : maps) {
+		for (const String& key : keys)
+			sum -= map.find(key)->second;
+	}
+
+	auto reference (std::chrono::steady_clock::now());
+
+	BOOST_CHECK_EQUAL(sum, 0);
+
+	auto us ([](std::chrono::steady_clock::duration duration) {
+		return std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+	});
+
+	BOOST_TEST_MESSAGE("Dictionary::Get(): " << us(looked - start) << "us, std::map::find(): "
+		<< us(reference - looked) << "us for " << count * keys.size() << " lookups");
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,138 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "base/eventbus.hpp"
+#include "base/utility.hpp"
+#include <BoostTestTargetConfig.h>
+#include <boost/thread/thread.hpp>
+#include <stdexcept>
+#include <utility>
+
+using namespace icinga;
+
+BOOST_AUTO_TEST_SUITE(base_eventbus)
+
+BOOST_AUTO_TEST_CASE(ordering)
+{
+	EventBus<int> bus;
+	std::vector<int> received;
+	size_t maxBatch = 0;
+
+	auto subscriber = bus.Subscribe("ordering", [&received, &maxBatch](const std::vector<int>& events) {
+		received.insert(received.end(), events.begin(), events.end());
+		maxBatch = std::max(maxBatch, events.size());
+	}, 100000, 64);
+
+	for (int i = 0; i < 10000; i++)
+		bus.Publish(i);
+
+	bus.Unsubscribe(subscriber);
+
+	BOOST_CHECK_EQUAL(bus.GetSubscriberCount(), 0);
+	BOOST_REQUIRE_EQUAL(received.size(), 10000);
+
+	for (int i = 0; i < 10000; i++)
+		BOOST_REQUIRE_EQUAL(received[i], i);
+
+	BOOST_CHECK(maxBatch <= 64);
+	BOOST_CHECK_EQUAL(static_cast<long>(subscriber->GetStats()->Get("delivered")), 10000);
+}
+
+BOOST_AUTO_TEST_CASE(producers)
+{
+	const int producers = 4;
+	const int count = 20000;
+
+	EventBus<std::pair<int, int> > bus;
+	std::vector<int> last (producers, -1);
+	bool ordered = true;
+	int received = 0;
+
+	auto subscriber = bus.Subscribe("producers", [&last, &ordered, &received](const std::vector<std::pair<int, int> >& events) {
+		for (auto& event : events) {
+			if (event.second != last[event.first] + 1)
+				ordered = false;
+
+			last[event.first] = event.second;
+			received++;
+		}
+	});
+
+	boost::thread_group threads;
+
+	for (int p = 0; p < producers; p++) {
+		threads.create_thread([&bus, p, count]() {
+			for (int i = 0; i < count; i++)
+				bus.Publish(std::make_pair(p, i));
+		});
+	}
+
+	threads.join_all();
+	bus.Unsubscribe(subscriber);
+
+	BOOST_CHECK_EQUAL(received, producers * count);
+	BOOST_CHECK(ordered);
+}
+
+BOOST_AUTO_TEST_CASE(back_pressure)
+{
+	EventBus<int> bus;
+	int received = 0;
+
+	auto subscriber = bus.Subscribe("back_pressure", [&received](const std::vector<int>& events) {
+		Utility::Sleep(0.01);
+		received += events.size();
+	}, 10);
+
+	for (int i = 0; i < 200; i++)
+		bus.Publish(i);
+
+	bus.Unsubscribe(subscriber);
+
+	Dictionary::Ptr stats = subscriber->GetStats();
+
+	BOOST_CHECK_EQUAL(received, 200);
+	BOOST_CHECK(static_cast<long>(stats->Get("blocked")) > 0);
+	BOOST_CHECK(stats->Get("blocked_time") > 0);
+	BOOST_CHECK_EQUAL(static_cast<long>(stats->Get("pending")), 0);
+}
+
+BOOST_AUTO_TEST_CASE(handler_exception)
+{
+	EventBus<int> bus;
+	int received = 0;
+
+	auto subscriber = bus.Subscribe("handler_exception", [&received](const std::vector<int>& events) {
+		received += events.size();
+
+		if (received == 1)
+			throw std::runtime_error("first batch fails");
+	}, 100, 1);
+
+	for (int i = 0; i < 3; i++)
+		bus.Publish(i);
+
+	bus.Unsubscribe(subscriber);
+
+	BOOST_CHECK_EQUAL(received, 3);
+	BOOST_CHECK_EQUAL(static_cast<long>(subscriber->GetStats()->Get("errors")), 1);
+}
+
+BOOST_AUTO_TEST_CASE(stats)
+{
+	EventBus<int> bus;
+
+	auto subscriber = bus.Subscribe("stats", [](const std::vector<int>&) { });
+
+	BOOST_CHECK(EventSubscriberBase::GetAllStats()->Contains("stats"));
+
+	bus.Publish(1);
+	bus.Unsubscribe(subscriber);
+
+	BOOST_CHECK(!EventSubscriberBase::GetAllStats()->Contains("stats"));
+
+	Dictionary::Ptr latency = subscriber->GetStats()->Get("latency");
+
+	BOOST_CHECK_EQUAL(static_cast<long>(latency->Get("count")), 1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
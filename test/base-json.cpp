@@ -3,10 +3,14 @@
 #include "base/dictionary.hpp"
 #include "base/namespace.hpp"
 #include "base/array.hpp"
+#include "base/convert.hpp"
 #include "base/objectlock.hpp"
 #include "base/json.hpp"
+#include "base/utility.hpp"
 #include <boost/algorithm/string/replace.hpp>
 #include <BoostTestTargetConfig.h>
+#include <chrono>
+#include <json.hpp>
 
 using namespace icinga;
 
@@ -46,6 +50,146 @@ BOOST_AUTO_TEST_CASE(encode)
 	BOOST_CHECK(JsonEncode(input, false) == output);
 }
 
+BOOST_AUTO_TEST_CASE(encode_incremental)
+{
+	JsonEncoder encoder;
+	std::string output;
+
+	encoder.StartObject();
+	encoder.Key("results");
+	encoder.StartArray();
+
+	for (int i = 0; i < 3; i++) {
+		encoder.Encode(new Dictionary({ { "name", "obj" + Convert::ToString(i) } }));
+
+		auto& buf (encoder.GetBuffer());
+		output.append(buf.begin(), buf.end());
+		buf.clear();
+	}
+
+	encoder.EndArray();
+	encoder.EndObject();
+
+	output += encoder.GetResult().GetData();
+
+	BOOST_CHECK(output == R"EOF({"results":[{"name":"obj0"},{"name":"obj1"},{"name":"obj2"}]})EOF");
+}
+
+/* Encodes a value the way JsonEncode() used to, i.e. by building a nlohmann::json tree. */
+static nlohmann::json ReferenceEncode(const Value& value)
+{
+	switch (value.GetType()) {
+		case ValueNumber:
+			return value.Get<double>();
+		case ValueBoolean:
+			return value.ToBool();
+		case ValueString:
+			return Utility::ValidateUTF8(value.Get<String>()).GetData();
+		case ValueObject:
+			if (value.IsObjectType<Dictionary>()) {
+				nlohmann::json result = nlohmann::json::object();
+				Dictionary::Ptr dict = value;
+				ObjectLock olock(dict);
+
+				for (const Dictionary::Pair& kv : dict) {
+					result[Utility::ValidateUTF8(kv.first).GetData()] = ReferenceEncode(kv.second);
+				}
+
+				return result;
+			}
+
+			if (value.IsObjectType<Array>()) {
+				nlohmann::json result = nlohmann::json::array();
+				Array::Ptr arr = value;
+				ObjectLock olock(arr);
+
+				for (const Value& item : arr) {
+					result.push_back(ReferenceEncode(item));
+				}
+
+				return result;
+			}
+
+			return nullptr;
+		default:
+			return nullptr;
+	}
+}
+
+static Dictionary::Ptr MakeCheckResult(int i)
+{
+	return new Dictionary({
+		{ "type", "CheckResult" },
+		{ "active", true },
+		{ "check_source", "satellite" + Convert::ToString(i % 7) + ".example.com" },
+		{ "command", new Array({ "/usr/lib/nagios/plugins/check_disk", "-w", "20%", "-c", "10%", "-p", "/var" }) },
+		{ "execution_start", 1589285120.123456 + i },
+		{ "execution_end", 1589285120.654321 + i },
+		{ "exit_status", i % 3 },
+		{ "output", "DISK WARNING - free space: /var 2048 MiB (18% inode=97%); \"quoted\"\tTAB\nSecond line \xC3\xA4\xE2\x82\xAC\xF0\x9F\x98\x80" },
+		{ "performance_data", new Array({ "/var=9216MiB;9011;10137;0;11264", "load1=0.120;5.000;10.000;0;", 0.5, -1e-7 }) },
+		{ "schedule_start", 1589285119.999 + i },
+		{ "schedule_end", 1589285120.7 + i },
+		{ "state", (double)(i % 4) },
+		{ "ttl", 0 },
+		{ "vars_after", new Dictionary({ { "attempt", 1 }, { "reachable", true }, { "state", 1 }, { "state_type", 1 } }) },
+		{ "vars_before", Value() }
+	});
+}
+
+BOOST_AUTO_TEST_CASE(encode_reference)
+{
+	Array::Ptr input (new Array({
+		"", "\x7F\x1F\x01\b\f\r/\\", "\xF0\x9F\x98\x80", "Ill\xC3", "\xC3Ill\xE2\x82", "\xED\xA0\x80\xC3\xA4",
+		0, 1, -1, 0.1, -1.25, 1e15, 1e14, 123456789012345.0, 1e-5, 1.7976931348623157e308, 4.9e-324,
+		new Dictionary({ { "K\xC3\xA4y\n", "v" }, { "Inv\xFF", 2 } })
+	}));
+
+	for (int i = 0; i < 4; i++) {
+		input->Add(MakeCheckResult(i));
+	}
+
+	BOOST_CHECK_EQUAL(JsonEncode(input), ReferenceEncode(input).dump(-1, ' ', true));
+	BOOST_CHECK_EQUAL(JsonEncode(input, true), ReferenceEncode(input).dump(4, ' ', true));
+	BOOST_CHECK_EQUAL(JsonEncode(-0.0), "-0.0");
+	BOOST_CHECK_EQUAL(JsonEncode(std::numeric_limits<double>::infinity()), "null");
+}
+
+/* Only run on demand (--run_test=base_json/benchmark), encode_reference checks the output. */
+BOOST_AUTO_TEST_CASE(benchmark, *boost::unit_test::disabled())
+{
+	std::vector<Value> checkResults;
+
+	for (int i = 0; i < 1000; i++) {
+		checkResults.emplace_back(MakeCheckResult(i));
+	}
+
+	size_t encodedBytes = 0, referenceBytes = 0;
+	auto start (std::chrono::steady_clock::now());
+
+	for (int round = 0; round < 10; round++) {
+		for (const Value& cr : checkResults) {
+			encodedBytes += JsonEncode(cr).GetLength();
+		}
+	}
+
+	auto encoded (std::chrono::steady_clock::now());
+
+	for (int round = 0; round < 10; round++) {
+		for (const Value& cr : checkResults) {
+			referenceBytes += ReferenceEncode(cr).dump(-1, ' ', true).size();
+		}
+	}
+
+	auto reference (std::chrono::steady_clock::now());
+
+	BOOST_CHECK_EQUAL(encodedBytes, referenceBytes);
+
+	BOOST_TEST_MESSAGE("JsonEncode(): " << std::chrono::duration_cast<std::chrono::microseconds>(encoded - start).count()
+		<< "us, nlohmann::json: " << std::chrono::duration_cast<std::chrono::microseconds>(reference - encoded).count()
+		<< "us for 10000 check results (" << encodedBytes << " bytes)");
+}
+
 BOOST_AUTO_TEST_CASE(decode)
 {
 	String input (R"EOF({
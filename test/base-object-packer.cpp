@@ -5,11 +5,16 @@
 #include "base/string.hpp"
 #include "base/array.hpp"
 #include "base/dictionary.hpp"
+#include "base/tlsutility.hpp"
+#include "base/convert.hpp"
 #include <BoostTestTargetConfig.h>
+#include <chrono>
 #include <climits>
 #include <initializer_list>
 #include <iomanip>
 #include <sstream>
+#include <string>
+#include <stdexcept>
 
 using namespace icinga;
 
@@ -261,4 +266,108 @@ BOOST_AUTO_TEST_CASE(pack_object)
 	));
 }
 
+BOOST_AUTO_TEST_CASE(unpack)
+{
+	Dictionary::Ptr input = new Dictionary({
+		{ "array", new Array({ Empty, false, true, -1.5, "", String(std::string("\0bin\xFF", 5)) }) },
+		{ "dictionary", new Dictionary({ { "nested", new Dictionary() } }) },
+		{ "number", 42 }
+	});
+
+	String packed = PackObject(input);
+	Value output = UnpackObject(packed);
+
+	BOOST_CHECK(output.IsObjectType<Dictionary>());
+	BOOST_CHECK(PackObject(output) == packed);
+
+	Array::Ptr arr = ((Dictionary::Ptr)output)->Get("array");
+	BOOST_CHECK(arr->Get(0).IsEmpty());
+	BOOST_CHECK(arr->Get(1).IsBoolean() && !arr->Get(1).ToBool());
+	BOOST_CHECK(arr->Get(3) == -1.5);
+	BOOST_CHECK(arr->Get(5) == String(std::string("\0bin\xFF", 5)));
+
+	BOOST_CHECK_THROW(UnpackObject(packed.SubStr(0, packed.GetLength() - 1)), std::invalid_argument);
+	BOOST_CHECK_THROW(UnpackObject(packed + String(1, '\0')), std::invalid_argument);
+	BOOST_CHECK_THROW(UnpackObject(String("\7")), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(hash)
+{
+	Dictionary::Ptr input = new Dictionary({
+		{ "array", new Array({ Empty, false, true, -1.5, "" }) },
+		{ "long", String(2000, 'x') },
+		{ "number", 42 }
+	});
+
+	SHA1Hasher hasher;
+	PackObject(input, hasher);
+	BOOST_CHECK_EQUAL(hasher.Finish(), SHA1(PackObject(input)));
+
+	SHA1Hasher binaryHasher;
+	PackObject(input, binaryHasher);
+	BOOST_CHECK(binaryHasher.Finish(true) == SHA1(PackObject(input), true));
+
+	Dictionary::Ptr nested = new Dictionary({
+		{ "groups", new Array({ "linux-servers", "web" }) },
+		{ "vars", new Dictionary({ { "os", "Linux" }, { "http_vhosts", new Dictionary({ { "/", new Dictionary() } }) } }) }
+	});
+
+	SHA1Hasher nestedHasher;
+	PackObject(nested, nestedHasher);
+	BOOST_CHECK_EQUAL(nestedHasher.Finish(), SHA1(PackObject(nested)));
+
+	SHA1Hasher arrayHasher;
+	PackObject(ArrayData({ "env", String(600, 'y'), 1 }), arrayHasher);
+	BOOST_CHECK_EQUAL(arrayHasher.Finish(), SHA1(PackObject(new Array({ "env", String(600, 'y'), 1 }))));
+
+	BOOST_CHECK_EQUAL(SHA1Hasher().Finish(), SHA1(""));
+}
+
+/* Only run on demand (--run_test=base_object_packer/benchmark), hash checks the results. */
+BOOST_AUTO_TEST_CASE(benchmark, *boost::unit_test::disabled())
+{
+	/* Roughly the attributes of a host as hashed for its checksum by the IcingaDB config dump. */
+	std::vector<Dictionary::Ptr> objects;
+
+	for (int i = 0; i < 1000; i++) {
+		objects.emplace_back(new Dictionary({
+			{ "address", "192.0.2." + Convert::ToString(i % 256) },
+			{ "check_command", "hostalive" },
+			{ "check_interval", 60 },
+			{ "display_name", "host-" + Convert::ToString(i) },
+			{ "groups", new Array({ "linux-servers", "web" }) },
+			{ "max_check_attempts", 3 },
+			{ "vars", new Dictionary({ { "os", "Linux" }, { "http_vhosts", new Dictionary({ { "/", new Dictionary() } }) } }) },
+			{ "zone", "master" }
+		}));
+	}
+
+	std::vector<String> packed, streamed;
+	auto start (std::chrono::steady_clock::now());
+
+	for (int round = 0; round < 10; round++) {
+		for (const Dictionary::Ptr& object : objects) {
+			packed.emplace_back(SHA1(PackObject(object)));
+		}
+	}
+
+	auto pack (std::chrono::steady_clock::now());
+
+	for (int round = 0; round < 10; round++) {
+		for (const Dictionary::Ptr& object : objects) {
+			SHA1Hasher hasher;
+			PackObject(object, hasher);
+			streamed.emplace_back(hasher.Finish());
+		}
+	}
+
+	auto stream (std::chrono::steady_clock::now());
+
+	BOOST_CHECK(packed == streamed);
+
+	BOOST_TEST_MESSAGE("SHA1(PackObject()): " << std::chrono::duration_cast<std::chrono::microseconds>(pack - start).count()
+		<< "us, PackObject() into SHA1Hasher: " << std::chrono::duration_cast<std::chrono::microseconds>(stream - pack).count()
+		<< "us for 10000 objects");
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,149 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "base/process.hpp"
+#include "base/utility.hpp"
+#include <BoostTestTargetConfig.h>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+
+using namespace icinga;
+
+BOOST_AUTO_TEST_SUITE(base_process)
+
+#ifndef _WIN32
+static ProcessResult RunAndWait(const Process::Ptr& process)
+{
+	/* The callback may still run after we've given up waiting for it. */
+	auto result (std::make_shared<std::promise<ProcessResult>>());
+	std::future<ProcessResult> future = result->get_future();
+
+	process->Run([result](const ProcessResult& pr) {
+		result->set_value(pr);
+	});
+
+	BOOST_REQUIRE(future.wait_for(std::chrono::seconds(30)) == std::future_status::ready);
+
+	return future.get();
+}
+
+BOOST_AUTO_TEST_CASE(output)
+{
+	Process::Ptr process = new Process(Process::Arguments({ "/bin/sh", "-c", "echo foo; echo bar >&2; exit 3" }));
+	ProcessResult pr = RunAndWait(process);
+
+	BOOST_CHECK_EQUAL(pr.ExitStatus, 3);
+	BOOST_CHECK(pr.Output == "foo\nbar\n");
+}
+
+BOOST_AUTO_TEST_CASE(timeout)
+{
+	Process::Ptr process = new Process(Process::Arguments({ "/bin/sleep", "30" }));
+	process->SetTimeout(1);
+
+	double start = Utility::GetTime();
+	ProcessResult pr = RunAndWait(process);
+
+	BOOST_CHECK_EQUAL(pr.ExitStatus, 128);
+	BOOST_CHECK(pr.Output.Find("<Timeout exceeded.>") != String::NPos);
+	BOOST_CHECK(Utility::GetTime() - start < 5);
+}
+
+BOOST_AUTO_TEST_CASE(detached_output)
+{
+	/* The child closes its output long before it exits. */
+	Process::Ptr process = new Process(Process::Arguments({ "/bin/sh", "-c", "exec >/dev/null 2>&1; sleep 1; exit 2" }));
+	ProcessResult pr = RunAndWait(process);
+
+	BOOST_CHECK_EQUAL(pr.ExitStatus, 2);
+	BOOST_CHECK(pr.ExecutionEnd - pr.ExecutionStart >= 0.9);
+}
+
+BOOST_AUTO_TEST_CASE(spawn_latency)
+{
+	long count = Process::GetSpawnLatencyStats()->Get("count");
+
+	Process::Ptr process = new Process(Process::Arguments({ "/bin/true" }));
+	ProcessResult pr = RunAndWait(process);
+
+	BOOST_CHECK_EQUAL(pr.ExitStatus, 0);
+
+	Dictionary::Ptr stats = Process::GetSpawnLatencyStats();
+
+	BOOST_CHECK_EQUAL(static_cast<long>(stats->Get("count")), count + 1);
+	BOOST_CHECK(stats->Get("max") >= stats->Get("avg"));
+}
+
+BOOST_AUTO_TEST_CASE(exec_failure)
+{
+	Process::Ptr process = new Process(Process::Arguments({ "/nonexistent/plugin" }));
+	ProcessResult pr = RunAndWait(process);
+
+	BOOST_CHECK_EQUAL(pr.ExitStatus, 128);
+	BOOST_CHECK(pr.Output.Find("execvpe(/nonexistent/plugin) failed") != String::NPos);
+}
+
+/**
+ * Runs /bin/true count times, at most concurrency processes at once.
+ *
+ * @returns The time in seconds until all of them have finished
+ */
+static double RunConcurrently(int count, int concurrency)
+{
+	struct Counters
+	{
+		std::atomic<int> Running{0}, Finished{0}, Failed{0};
+	};
+
+	/* Outlives this function in case some processes don't finish in time. */
+	auto counters (std::make_shared<Counters>());
+
+	auto start (std::chrono::steady_clock::now());
+
+	for (int i = 0; i < count; i++) {
+		while (counters->Running >= concurrency)
+			Utility::Sleep(0.001);
+
+		counters->Running++;
+
+		Process::Ptr process = new Process(Process::Arguments({ "/bin/true" }));
+		process->Run([counters](const ProcessResult& pr) {
+			if (pr.ExitStatus != 0)
+				counters->Failed++;
+
+			counters->Finished++;
+			counters->Running--;
+		});
+	}
+
+	for (int i = 0; i < 6000 && counters->Finished < count; i++)
+		Utility::Sleep(0.01);
+
+	auto end (std::chrono::steady_clock::now());
+
+	BOOST_CHECK_EQUAL(counters->Finished, count);
+	BOOST_CHECK_EQUAL(counters->Failed, 0);
+
+	return std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() / 1000.0;
+}
+
+BOOST_AUTO_TEST_CASE(concurrent)
+{
+	RunConcurrently(200, 50);
+}
+
+/* Spawns 10000 processes, so this only runs on demand (--run_test=base_process/benchmark). */
+BOOST_AUTO_TEST_CASE(benchmark, *boost::unit_test::disabled())
+{
+	const int count = 10000;
+	const int concurrency = 500;
+
+	double seconds = RunConcurrently(count, concurrency);
+
+	BOOST_TEST_MESSAGE("Ran " << count << " processes (at most " << concurrency << " at once) in "
+		<< seconds << "s: " << count / seconds << " processes/s");
+}
+#endif /* _WIN32 */
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -101,4 +101,44 @@ BOOST_AUTO_TEST_CASE(find)
 	BOOST_CHECK(s.FindFirstOf("xl") == 2);
 }
 
+BOOST_AUTO_TEST_CASE(intern)
+{
+	String name = "/usr/lib/nagios/plugins/check_ping";
+
+#ifdef ICINGA2_STRING_INTERNING
+	String a = name.Intern();
+	String b = String(name.GetData()).Intern();
+
+	BOOST_CHECK(!name.IsShared());
+	BOOST_CHECK(a.IsShared());
+	BOOST_CHECK(a == name);
+	BOOST_CHECK(a.CStr() == b.CStr());
+
+	String copy = a;
+	BOOST_CHECK(copy.IsShared());
+	BOOST_CHECK(copy.CStr() == a.CStr());
+	BOOST_CHECK(copy.Intern().CStr() == a.CStr());
+
+	copy += "6";
+	BOOST_CHECK(!copy.IsShared());
+	BOOST_CHECK(copy == "/usr/lib/nagios/plugins/check_ping6");
+	BOOST_CHECK(a == name);
+
+	copy = b;
+	copy[0] = '.';
+	BOOST_CHECK(copy == ".usr/lib/nagios/plugins/check_ping");
+	BOOST_CHECK(b == name);
+
+	String moved = std::move(b);
+	BOOST_CHECK(moved.IsShared());
+	BOOST_CHECK(moved.CStr() == a.CStr());
+
+	/* Short strings are stored inline. */
+	BOOST_CHECK(!String("check_ping").Intern().IsShared());
+#else /* ICINGA2_STRING_INTERNING */
+	BOOST_CHECK(name.Intern() == name);
+	BOOST_CHECK(!name.Intern().IsShared());
+#endif /* ICINGA2_STRING_INTERNING */
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -4,6 +4,9 @@
 #include "base/utility.hpp"
 #include "base/application.hpp"
 #include <BoostTestTargetConfig.h>
+#include <atomic>
+#include <chrono>
+#include <vector>
 
 using namespace icinga;
 
@@ -58,4 +61,130 @@ BOOST_AUTO_TEST_CASE(scope)
 	BOOST_CHECK(counter >= 4 && counter <= 6);
 }
 
+BOOST_AUTO_TEST_CASE(schedule)
+{
+	/* Spread over the first two levels of the timer wheel. */
+	std::vector<Timer::Ptr> timers;
+	std::vector<double> due, fired (500, 0);
+	std::atomic<int> remaining (500);
+	double now = Utility::GetTime();
+
+	for (int i = 0; i < 500; i++) {
+		Timer::Ptr timer = new Timer();
+		timer->SetInterval(3600);
+		timer->OnTimerExpired.connect([i, &fired, &remaining](const Timer * const&) {
+			fired[i] = Utility::GetTime();
+			remaining--;
+		});
+
+		timer->Start();
+		timer->Reschedule(now + 0.1 + (i % 50) * 0.07);
+
+		timers.push_back(timer);
+		due.push_back(timer->GetNext());
+	}
+
+	for (int i = 0; i < 100 && remaining > 0; i++)
+		Utility::Sleep(0.1);
+
+	for (const Timer::Ptr& timer : timers)
+		timer->Stop(true);
+
+	BOOST_CHECK_EQUAL(remaining, 0);
+
+	for (int i = 0; i < 500; i++) {
+		BOOST_CHECK(fired[i] >= due[i] - 0.01);
+		BOOST_CHECK(fired[i] < due[i] + 1);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(stop)
+{
+	std::vector<Timer::Ptr> timers;
+	std::atomic<int> calls (0);
+	double now = Utility::GetTime();
+
+	for (int i = 0; i < 100; i++) {
+		Timer::Ptr timer = new Timer();
+		timer->SetInterval(3600);
+		timer->OnTimerExpired.connect([&calls](const Timer * const&) { calls++; });
+		timer->Start();
+		timer->Reschedule(now + 0.5);
+
+		timers.push_back(timer);
+	}
+
+	/* Every other timer is stopped before it's due. */
+	for (int i = 0; i < 100; i += 2)
+		timers[i]->Stop();
+
+	for (int i = 0; i < 30 && calls < 50; i++)
+		Utility::Sleep(0.1);
+
+	Utility::Sleep(0.5);
+
+	for (const Timer::Ptr& timer : timers)
+		timer->Stop(true);
+
+	BOOST_CHECK_EQUAL(calls, 50);
+}
+
+/* A million timers take a while, so this only runs on demand (--run_test=base_timer/benchmark). */
+BOOST_AUTO_TEST_CASE(benchmark, *boost::unit_test::disabled())
+{
+	const int count = 1000000;
+	std::atomic<int> calls (0);
+
+	std::vector<Timer::Ptr> timers;
+	timers.reserve(count);
+
+	for (int i = 0; i < count; i++) {
+		Timer::Ptr timer = new Timer();
+		timer->SetInterval(3600);
+		timer->OnTimerExpired.connect([&calls](const Timer * const&) { calls++; });
+		timers.emplace_back(std::move(timer));
+	}
+
+	auto start (std::chrono::steady_clock::now());
+
+	for (const Timer::Ptr& timer : timers)
+		timer->Start();
+
+	auto inserted (std::chrono::steady_clock::now());
+
+	for (const Timer::Ptr& timer : timers)
+		timer->Stop();
+
+	auto cancelled (std::chrono::steady_clock::now());
+
+	BOOST_CHECK_EQUAL(calls, 0);
+
+	double now = Utility::GetTime();
+
+	for (const Timer::Ptr& timer : timers) {
+		timer->Start();
+		timer->Reschedule(now);
+	}
+
+	auto scheduled (std::chrono::steady_clock::now());
+
+	for (int i = 0; i < 600 && calls < count; i++)
+		Utility::Sleep(0.1);
+
+	auto fired (std::chrono::steady_clock::now());
+
+	for (const Timer::Ptr& timer : timers)
+		timer->Stop(true);
+
+	BOOST_CHECK_EQUAL(calls, count);
+
+	auto ms ([](std::chrono::steady_clock::duration duration) {
+		return std::chrono::duration_cast<std::chrono::milliseconds>(duration).count();
+	});
+
+	BOOST_TEST_MESSAGE("Timer::Start(): " << ms(inserted - start) << "ms, Timer::Stop(): " << ms(cancelled - inserted)
+		<< "ms, Timer::Start()/Reschedule(): " << ms(scheduled - cancelled) << "ms, firing: "
+		<< ms(fired - scheduled) << "ms for " << count << " timers");
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,70 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "config/applyrule.hpp"
+#include "config/configcompiler.hpp"
+#include "base/array.hpp"
+#include <BoostTestTargetConfig.h>
+
+using namespace icinga;
+
+static std::vector<String> GetCandidateNames(const Dictionary::Ptr& host)
+{
+	std::vector<String> names;
+
+	for (ApplyRule *rule : ApplyRule::GetCandidateRules("ConfigApplyTest", "", new Dictionary({ { "host", host } })))
+		names.push_back(rule->GetName());
+
+	return names;
+}
+
+BOOST_AUTO_TEST_SUITE(config_apply)
+
+BOOST_AUTO_TEST_CASE(candidates)
+{
+	ApplyRule::RegisterType("ConfigApplyTest", { "Host" });
+
+	ScriptFrame frame(true);
+	std::unique_ptr<Expression> expr = ConfigCompiler::CompileText("<test>",
+		"apply ConfigApplyTest \"equal\" { assign where host.vars.os == \"Linux\" }\n"
+		"apply ConfigApplyTest \"in\" { assign where \"web\" in host.groups }\n"
+		"apply ConfigApplyTest \"match\" { assign where match(\"db-*\", host.name) }\n"
+		"apply ConfigApplyTest \"unindexed\" { assign where host.vars.os == \"Linux\" || host.vars.linux }\n"
+		"apply ConfigApplyTest \"ignore\" {\n"
+		"  assign where host.vars.os in [ \"Linux\", \"FreeBSD\" ]\n"
+		"  ignore where host.name == \"db-1\"\n"
+		"}\n"
+	);
+	expr->Evaluate(frame);
+
+	BOOST_CHECK(ApplyRule::GetRules("ConfigApplyTest").size() == 5);
+
+	Dictionary::Ptr host = new Dictionary({
+		{ "name", "db-1" },
+		{ "groups", new Array({ "web" }) },
+		{ "vars", new Dictionary({ { "os", "Linux" } }) }
+	});
+	BOOST_CHECK(GetCandidateNames(host) == std::vector<String>({ "equal", "in", "match", "unindexed", "ignore" }));
+
+	host = new Dictionary({
+		{ "name", "app-1" },
+		{ "groups", new Array() },
+		{ "vars", new Dictionary({ { "os", "Windows" } }) }
+	});
+	BOOST_CHECK(GetCandidateNames(host) == std::vector<String>({ "unindexed" }));
+
+	host = new Dictionary({
+		{ "name", "DB-2" },
+		{ "groups", new Array({ "web" }) },
+		{ "vars", new Dictionary({ { "os", "FreeBSD" } }) }
+	});
+	BOOST_CHECK(GetCandidateNames(host) == std::vector<String>({ "in", "match", "unindexed", "ignore" }));
+
+	/* Values which can't be looked up in the index select all rules for that attribute. */
+	host = new Dictionary({
+		{ "name", "app-2" },
+		{ "vars", new Dictionary({ { "os", 42 } }) }
+	});
+	BOOST_CHECK(GetCandidateNames(host) == std::vector<String>({ "equal", "unindexed", "ignore" }));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -2,7 +2,12 @@
 
 #include "config/configcompiler.hpp"
 #include "base/exception.hpp"
+#include "base/configuration.hpp"
+#include "base/convert.hpp"
+#include "base/utility.hpp"
 #include <BoostTestTargetConfig.h>
+#include <boost/filesystem/operations.hpp>
+#include <fstream>
 
 using namespace icinga;
 
@@ -243,4 +248,39 @@ BOOST_AUTO_TEST_CASE(advanced)
 	BOOST_CHECK(func->Invoke() == 3);
 }
 
+BOOST_AUTO_TEST_CASE(include_order)
+{
+	String dir = boost::filesystem::unique_path(boost::filesystem::temp_directory_path() / "icinga2-include-order-%%%%-%%%%").string();
+	Utility::MkDirP(dir + "/sub", 0700);
+
+	for (int i = 0; i < 50; i++) {
+		std::ofstream fp ((dir + (i % 2 ? "/sub/" : "/") + Convert::ToString(i) + ".conf").CStr());
+		fp << i << "\n";
+	}
+
+	std::vector<String> files;
+	Utility::GlobRecursive(dir, "*.conf", [&files](const String& file) { files.emplace_back(file); }, GlobFile);
+
+	int concurrency = Configuration::Concurrency;
+	Configuration::Concurrency = 4;
+
+	std::vector<std::unique_ptr<Expression> > expressions;
+	size_t found = ConfigCompiler::CollectIncludesRecursive(expressions, dir, "*.conf", "", "");
+
+	Configuration::Concurrency = concurrency;
+	Utility::RemoveDirRecursive(dir);
+
+	BOOST_CHECK_EQUAL(found, 50u);
+	BOOST_REQUIRE_EQUAL(expressions.size(), 50u);
+
+	/* The expressions keep the order in which the files were found. */
+	size_t next = 0;
+
+	for (const String& file : files) {
+		String name = Utility::BaseName(file);
+		ScriptFrame frame(true);
+		BOOST_CHECK_EQUAL(Convert::ToLong(expressions[next++]->Evaluate(frame).GetValue()), Convert::ToLong(name.SubStr(0, name.GetLength() - 5)));
+	}
+}
+
 BOOST_AUTO_TEST_SUITE_END()
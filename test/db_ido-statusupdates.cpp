@@ -0,0 +1,205 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "db_ido/dbconnection.hpp"
+#include "db_ido/hostdbobject.hpp"
+#include <BoostTestTargetConfig.h>
+
+using namespace icinga;
+
+/**
+ * Records the queries it would have written instead of talking to a database.
+ */
+class MockDbConnection final : public DbConnection
+{
+public:
+	DECLARE_PTR_TYPEDEFS(MockDbConnection);
+
+	MockDbConnection()
+	{
+		SetPaused(false);
+	}
+
+	/* Like DbConnection::QueryHandler(). */
+	void Query(const DbQuery& query)
+	{
+		if (!CoalesceStatusUpdate(query))
+			ExecuteQuery(query);
+	}
+
+	using DbConnection::FlushStatusUpdates;
+
+	int GetPendingQueryCount() const override
+	{
+		return 0;
+	}
+
+	std::vector<DbQuery> Executed;
+
+protected:
+	void ExecuteQuery(const DbQuery& query) override
+	{
+		Executed.push_back(query);
+	}
+
+	void ExecuteMultipleQueries(const std::vector<DbQuery>& queries) override
+	{
+		Executed.insert(Executed.end(), queries.begin(), queries.end());
+	}
+
+	void ActivateObject(const DbObject::Ptr& dbobj) override
+	{
+	}
+
+	void DeactivateObject(const DbObject::Ptr& dbobj) override
+	{
+	}
+
+	void FillIDCache(const DbType::Ptr& type) override
+	{
+	}
+
+	void NewTransaction() override
+	{
+		FlushStatusUpdates();
+	}
+};
+
+struct DbIdoStatusUpdatesFixture
+{
+	DbIdoStatusUpdatesFixture()
+	{
+		Connection = new MockDbConnection();
+	}
+
+	static DbObject::Ptr MakeObject(const String& name)
+	{
+		return new HostDbObject(DbType::GetByName("Host"), name, "");
+	}
+
+	static DbQuery MakeStatusUpdate(const DbObject::Ptr& object, const Dictionary::Ptr& fields)
+	{
+		DbQuery query;
+		query.Table = "hoststatus";
+		query.Type = DbQueryInsert | DbQueryUpdate;
+		query.Category = DbCatState;
+		query.Fields = fields;
+		query.WhereCriteria = new Dictionary({ { "host_object_id", object } });
+		query.Object = object;
+		query.StatusUpdate = true;
+		return query;
+	}
+
+	static DbQuery MakeHistoryInsert(const DbObject::Ptr& object, int state)
+	{
+		DbQuery query;
+		query.Table = "statehistory";
+		query.Type = DbQueryInsert;
+		query.Category = DbCatStateHistory;
+		query.Fields = new Dictionary({ { "object_id", object }, { "state", state } });
+		query.Object = object;
+		return query;
+	}
+
+	MockDbConnection::Ptr Connection;
+};
+
+BOOST_FIXTURE_TEST_SUITE(db_ido_statusupdates, DbIdoStatusUpdatesFixture)
+
+BOOST_AUTO_TEST_CASE(same_row)
+{
+	DbObject::Ptr object = MakeObject("first");
+
+	Connection->Query(MakeStatusUpdate(object, new Dictionary({ { "current_state", 1 }, { "output", "warning" } })));
+	Connection->Query(MakeStatusUpdate(object, new Dictionary({ { "current_state", 2 } })));
+	Connection->Query(MakeStatusUpdate(object, new Dictionary({ { "is_flapping", 0 } })));
+
+	/* Nothing is written before the next transaction... */
+	BOOST_CHECK(Connection->Executed.empty());
+
+	Connection->FlushStatusUpdates();
+
+	/* ...and then only one row with the latest value of each column. */
+	BOOST_REQUIRE_EQUAL(Connection->Executed.size(), 1);
+
+	const DbQuery& query = Connection->Executed[0];
+
+	BOOST_CHECK_EQUAL(query.Table, "hoststatus");
+	BOOST_CHECK_EQUAL(query.Type, DbQueryInsert | DbQueryUpdate);
+	BOOST_CHECK_EQUAL(query.Fields->GetLength(), 3);
+	BOOST_CHECK_EQUAL(query.Fields->Get("current_state"), 2);
+	BOOST_CHECK_EQUAL(query.Fields->Get("output"), "warning");
+	BOOST_CHECK_EQUAL(query.Fields->Get("is_flapping"), 0);
+
+	/* The connection's queue is empty again. */
+	Connection->FlushStatusUpdates();
+
+	BOOST_CHECK_EQUAL(Connection->Executed.size(), 1);
+}
+
+BOOST_AUTO_TEST_CASE(objects)
+{
+	DbObject::Ptr first = MakeObject("first");
+	DbObject::Ptr second = MakeObject("second");
+
+	Connection->Query(MakeStatusUpdate(first, new Dictionary({ { "current_state", 1 } })));
+	Connection->Query(MakeStatusUpdate(second, new Dictionary({ { "current_state", 2 } })));
+
+	Connection->FlushStatusUpdates();
+
+	BOOST_REQUIRE_EQUAL(Connection->Executed.size(), 2);
+
+	for (const DbQuery& query : Connection->Executed) {
+		BOOST_CHECK_EQUAL(query.Fields->GetLength(), 1);
+		BOOST_CHECK_EQUAL(query.Fields->Get("current_state"), query.Object == first ? 1 : 2);
+	}
+
+	BOOST_CHECK(Connection->Executed[0].Object != Connection->Executed[1].Object);
+}
+
+BOOST_AUTO_TEST_CASE(history)
+{
+	DbObject::Ptr object = MakeObject("first");
+
+	Connection->Query(MakeHistoryInsert(object, 0));
+	Connection->Query(MakeStatusUpdate(object, new Dictionary({ { "current_state", 1 } })));
+	Connection->Query(MakeHistoryInsert(object, 1));
+	Connection->Query(MakeStatusUpdate(object, new Dictionary({ { "current_state", 2 } })));
+	Connection->Query(MakeHistoryInsert(object, 2));
+
+	/* Every history row is written right away, in order... */
+	BOOST_REQUIRE_EQUAL(Connection->Executed.size(), 3);
+
+	for (int i = 0; i < 3; i++) {
+		BOOST_CHECK_EQUAL(Connection->Executed[i].Table, "statehistory");
+		BOOST_CHECK_EQUAL(Connection->Executed[i].Fields->Get("state"), i);
+	}
+
+	/* ...while the status updates still wait for the transaction. */
+	Connection->FlushStatusUpdates();
+
+	BOOST_REQUIRE_EQUAL(Connection->Executed.size(), 4);
+	BOOST_CHECK_EQUAL(Connection->Executed[3].Table, "hoststatus");
+	BOOST_CHECK_EQUAL(Connection->Executed[3].Fields->Get("current_state"), 2);
+}
+
+BOOST_AUTO_TEST_CASE(counters)
+{
+	DbObject::Ptr first = MakeObject("first");
+	DbObject::Ptr second = MakeObject("second");
+
+	Connection->Query(MakeStatusUpdate(first, new Dictionary({ { "current_state", 1 } })));
+	Connection->Query(MakeStatusUpdate(first, new Dictionary({ { "current_state", 2 } })));
+	Connection->Query(MakeStatusUpdate(first, new Dictionary({ { "current_state", 0 } })));
+	Connection->Query(MakeStatusUpdate(second, new Dictionary({ { "current_state", 1 } })));
+	Connection->Query(MakeHistoryInsert(second, 1));
+
+	BOOST_CHECK_EQUAL(Connection->GetCoalescedStatusUpdateCount(60), 2);
+	BOOST_CHECK_EQUAL(Connection->GetEmittedStatusUpdateCount(60), 0);
+
+	Connection->FlushStatusUpdates();
+
+	BOOST_CHECK_EQUAL(Connection->GetCoalescedStatusUpdateCount(60), 2);
+	BOOST_CHECK_EQUAL(Connection->GetEmittedStatusUpdateCount(60), 2);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
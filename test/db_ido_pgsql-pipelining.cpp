@@ -0,0 +1,290 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "db_ido_pgsql/idopgsqlconnection.hpp"
+#include <deque>
+#include <BoostTestTargetConfig.h>
+
+using namespace icinga;
+
+/* Any distinct addresses do, the connection only passes them back to the interface. */
+static char l_Results[3];
+static PGresult * const l_Succeeded = reinterpret_cast<PGresult *>(&l_Results[0]);
+static PGresult * const l_Failed = reinterpret_cast<PGresult *>(&l_Results[1]);
+static PGresult * const l_NoRows = reinterpret_cast<PGresult *>(&l_Results[2]);
+
+/**
+ * Pretends to be a server which runs the statements of a query string in
+ * order and skips the remaining ones after the first which contains "fail".
+ * UPDATE statements never find a row.
+ */
+struct MockPgsqlInterface final : PgsqlInterface
+{
+	void Destroy() override
+	{
+	}
+
+	void clear(PGresult *res) const override
+	{
+		Cleared++;
+	}
+
+	char *cmdTuples(PGresult *res) const override
+	{
+		return const_cast<char *>(res == l_NoRows ? "0" : "1");
+	}
+
+	char *errorMessage(const PGconn *conn) const override
+	{
+		return const_cast<char *>("");
+	}
+
+	size_t escapeStringConn(PGconn *conn, char *to, const char *from, size_t length, int *error) const override
+	{
+		return 0;
+	}
+
+	PGresult *exec(PGconn *conn, const char *query) const override
+	{
+		return nullptr;
+	}
+
+	void finish(PGconn *conn) const override
+	{
+		Finished = true;
+	}
+
+	char *fname(const PGresult *res, int field_num) const override
+	{
+		return nullptr;
+	}
+
+	int getisnull(const PGresult *res, int tup_num, int field_num) const override
+	{
+		return 1;
+	}
+
+	char *getvalue(const PGresult *res, int tup_num, int field_num) const override
+	{
+		return nullptr;
+	}
+
+	int isthreadsafe() const override
+	{
+		return 1;
+	}
+
+	int nfields(const PGresult *res) const override
+	{
+		return 0;
+	}
+
+	int ntuples(const PGresult *res) const override
+	{
+		return 0;
+	}
+
+	char *resultErrorMessage(const PGresult *res) const override
+	{
+		return const_cast<char *>("syntax error");
+	}
+
+	ExecStatusType resultStatus(const PGresult *res) const override
+	{
+		return res == l_Failed ? PGRES_FATAL_ERROR : PGRES_COMMAND_OK;
+	}
+
+	int serverVersion(const PGconn *conn) const override
+	{
+		return 90500;
+	}
+
+	PGconn *setdbLogin(const char *pghost, const char *pgport, const char *pgoptions, const char *pgtty, const char *dbName, const char *login, const char *pwd) const override
+	{
+		return nullptr;
+	}
+
+	PGconn *connectdb(const char *conninfo) const override
+	{
+		return nullptr;
+	}
+
+	ConnStatusType status(const PGconn *conn) const override
+	{
+		return CONNECTION_OK;
+	}
+
+	int sendQuery(PGconn *conn, const char *query) const override
+	{
+		Sent++;
+
+		std::vector<String> statements = String(query).Split(";");
+
+		for (const String& statement : statements) {
+			Statements.push_back(statement);
+
+			if (statement.Contains("fail")) {
+				Pending.push_back(l_Failed);
+				break;
+			}
+
+			Pending.push_back(statement.Contains("UPDATE") ? l_NoRows : l_Succeeded);
+		}
+
+		/* The end of the results for this query string. */
+		Pending.push_back(nullptr);
+
+		return 1;
+	}
+
+	PGresult *getResult(PGconn *conn) const override
+	{
+		if (Pending.empty())
+			return nullptr;
+
+		PGresult *result = Pending.front();
+		Pending.pop_front();
+		return result;
+	}
+
+	int setnonblocking(PGconn *conn, int arg) const override
+	{
+		return 0;
+	}
+
+	int flush(PGconn *conn) const override
+	{
+		return 0;
+	}
+
+	int consumeInput(PGconn *conn) const override
+	{
+		return 1;
+	}
+
+	int socket(const PGconn *conn) const override
+	{
+		return -1;
+	}
+
+	mutable std::deque<PGresult *> Pending;
+	mutable std::vector<String> Statements;
+	mutable int Sent = 0;
+	mutable int Cleared = 0;
+	mutable bool Finished = false;
+};
+
+struct IdoPgsqlPipeliningFixture
+{
+	IdoPgsqlPipeliningFixture()
+	{
+		Connection = new IdoPgsqlConnection();
+		Connection->SetEnablePipelining(true);
+		Connection->SetPgsqlInterface(&Pgsql, reinterpret_cast<PGconn *>(&Pgsql));
+	}
+
+	/**
+	 * @returns The index of the first statement sent which starts with the given prefix.
+	 */
+	size_t FindStatement(const String& prefix)
+	{
+		for (size_t i = 0; i < Pgsql.Statements.size(); i++) {
+			if (Pgsql.Statements[i].Find(prefix) == 0)
+				return i;
+		}
+
+		BOOST_FAIL("Statement '" + prefix + "' hasn't been sent.");
+		return 0;
+	}
+
+	/**
+	 * Builds the statements "INSERT 0", "INSERT 1", ... and records which
+	 * of them got their result passed to the callback.
+	 */
+	std::vector<IdoPgsqlAsyncQuery> MakeQueries(int count, int failing = -1)
+	{
+		std::vector<IdoPgsqlAsyncQuery> queries;
+
+		for (int i = 0; i < count; i++) {
+			IdoPgsqlAsyncQuery aq;
+			aq.Query = i == failing ? "fail" : "INSERT " + std::to_string(i);
+			aq.Callback = [this, i](const IdoPgsqlResult&) { Processed.push_back(i); };
+			queries.emplace_back(std::move(aq));
+		}
+
+		return queries;
+	}
+
+	MockPgsqlInterface Pgsql;
+	IdoPgsqlConnection::Ptr Connection;
+	std::vector<int> Processed;
+};
+
+BOOST_FIXTURE_TEST_SUITE(db_ido_pgsql_pipelining, IdoPgsqlPipeliningFixture)
+
+BOOST_AUTO_TEST_CASE(batch)
+{
+	Connection->ExecuteAsyncQueries(MakeQueries(4));
+
+	BOOST_CHECK_EQUAL(Pgsql.Sent, 1);
+	BOOST_CHECK_EQUAL(Processed.size(), 4);
+	BOOST_CHECK_EQUAL(Pgsql.Cleared, 4);
+	BOOST_CHECK(Pgsql.Pending.empty());
+	BOOST_CHECK(Connection->GetConnected());
+}
+
+BOOST_AUTO_TEST_CASE(failed_statement)
+{
+	Connection->ExecuteAsyncQueries(MakeQueries(5, 2));
+
+	BOOST_CHECK_EQUAL(Pgsql.Sent, 1);
+
+	/* Only the statements before the failed one have been processed... */
+	BOOST_REQUIRE_EQUAL(Processed.size(), 2);
+	BOOST_CHECK_EQUAL(Processed[0], 0);
+	BOOST_CHECK_EQUAL(Processed[1], 1);
+
+	/* ...all results have been fetched and freed... */
+	BOOST_CHECK_EQUAL(Pgsql.Cleared, 3);
+	BOOST_CHECK(Pgsql.Pending.empty());
+
+	/* ...and the connection has been given up. */
+	BOOST_CHECK(Pgsql.Finished);
+	BOOST_CHECK(!Connection->GetConnected());
+}
+
+BOOST_AUTO_TEST_CASE(upsert_order)
+{
+	Connection->SetPaused(false);
+	Connection->SetCategoryFilter(DbCatEverything);
+
+	/* Without an object the update never counts as done before, so it's an upsert. */
+	DbQuery status;
+	status.Table = "hoststatus";
+	status.Type = DbQueryInsert | DbQueryUpdate;
+	status.Category = DbCatState;
+	status.Fields = new Dictionary({ { "current_state", 1 } });
+	status.WhereCriteria = new Dictionary({ { "host_object_id", 1 } });
+	status.StatusUpdate = true;
+
+	DbQuery history;
+	history.Table = "statehistory";
+	history.Type = DbQueryInsert;
+	history.Category = DbCatStateHistory;
+	history.Fields = new Dictionary({ { "state", 1 } });
+
+	Connection->ExecuteQueries({ status, history });
+
+	/* The update didn't find the row, so it has been replaced before the next query was sent. */
+	size_t update = FindStatement("UPDATE icinga_hoststatus");
+	size_t remove = FindStatement("DELETE FROM icinga_hoststatus");
+	size_t insert = FindStatement("INSERT INTO icinga_hoststatus");
+	size_t next = FindStatement("INSERT INTO icinga_statehistory");
+
+	BOOST_CHECK(update < remove);
+	BOOST_CHECK(remove < insert);
+	BOOST_CHECK(insert < next);
+	BOOST_CHECK(Pgsql.Pending.empty());
+	BOOST_CHECK(Connection->GetConnected());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
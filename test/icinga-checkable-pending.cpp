@@ -0,0 +1,56 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "icinga/checkable.hpp"
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <BoostTestTargetConfig.h>
+
+using namespace icinga;
+
+BOOST_AUTO_TEST_SUITE(icinga_checkable_pending)
+
+BOOST_AUTO_TEST_CASE(reserve)
+{
+	int before = Checkable::GetPendingChecks();
+
+	BOOST_CHECK_EQUAL(Checkable::ReservePendingChecks(8, before + 10), 8);
+	BOOST_CHECK_EQUAL(Checkable::ReservePendingChecks(8, before + 10), 2);
+	BOOST_CHECK_EQUAL(Checkable::ReservePendingChecks(8, before + 10), 0);
+	BOOST_CHECK_EQUAL(Checkable::GetPendingChecks(), before + 10);
+
+	Checkable::DecreasePendingChecks(10);
+
+	BOOST_CHECK_EQUAL(Checkable::GetPendingChecks(), before);
+}
+
+BOOST_AUTO_TEST_CASE(shards)
+{
+	/* Like the checker's scheduler threads, each one taking a batch at once. */
+	const int shards = 16, maxPendingChecks = 100;
+	int before = Checkable::GetPendingChecks();
+	std::atomic<int> exceeded (0);
+	std::vector<std::thread> threads;
+
+	for (int i = 0; i < shards; i++) {
+		threads.emplace_back([before, &exceeded]() {
+			for (int j = 0; j < 1000; j++) {
+				int reserved = Checkable::ReservePendingChecks(128, before + maxPendingChecks);
+
+				if (Checkable::GetPendingChecks() > before + maxPendingChecks)
+					exceeded++;
+
+				for (int k = 0; k < reserved; k++)
+					Checkable::DecreasePendingChecks();
+			}
+		});
+	}
+
+	for (auto& thread : threads)
+		thread.join();
+
+	BOOST_CHECK_EQUAL(exceeded.load(), 0);
+	BOOST_CHECK_EQUAL(Checkable::GetPendingChecks(), before);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,260 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "icinga/pluginworker.hpp"
+#include "base/convert.hpp"
+#include "base/utility.hpp"
+#include <boost/filesystem.hpp>
+#include <BoostTestTargetConfig.h>
+#include <atomic>
+#include <cerrno>
+#include <fstream>
+#include <set>
+#include <signal.h>
+
+using namespace icinga;
+
+#ifndef _WIN32
+/* Answers each request with the last argument, its PID and the number of requests
+ * it has answered so far. The first argument may ask it to sleep or to crash.
+ */
+static const char l_WorkerScript[] = R"(
+import json, os, sys, time
+
+count = 0
+
+while True:
+    length = b""
+
+    while True:
+        c = sys.stdin.buffer.read(1)
+
+        if not c:
+            sys.exit(0)
+
+        if c == b":":
+            break
+
+        length += c
+
+    request = json.loads(sys.stdin.buffer.read(int(length)))
+    sys.stdin.buffer.read(1)
+    count += 1
+
+    arguments = request["arguments"]
+
+    if arguments[0] == "crash":
+        os._exit(3)
+
+    if arguments[0] == "sleep":
+        time.sleep(float(arguments[1]))
+
+    response = json.dumps({
+        "exit_status": int(request["env"].get("STATUS", "0")),
+        "output": "%s pid=%d n=%d" % (arguments[-1], os.getpid(), count)
+    }).encode()
+
+    sys.stdout.buffer.write(b"%d:%s," % (len(response), response))
+    sys.stdout.buffer.flush()
+)";
+
+/**
+ * Provides check commands which run their plugins through the worker script.
+ */
+struct PluginWorkerFixture
+{
+	PluginWorkerFixture()
+		: m_TempDir(boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("icinga2-pluginworker-%%%%-%%%%"))
+	{
+		boost::filesystem::create_directories(m_TempDir);
+
+		WorkerScript = (m_TempDir / "worker.py").string();
+
+		std::ofstream fp (WorkerScript.CStr());
+		fp << l_WorkerScript;
+	}
+
+	~PluginWorkerFixture()
+	{
+		boost::system::error_code ec;
+		boost::filesystem::remove_all(m_TempDir, ec);
+	}
+
+	/**
+	 * @returns A check command with a unique name, so that it gets a pool of its own
+	 */
+	CheckCommand::Ptr MakeCommand(int poolSize = 1, int maxChecks = 0)
+	{
+		static int id = 0;
+
+		CheckCommand::Ptr command = new CheckCommand();
+		command->SetName("pluginworker-" + std::to_string(++id));
+		command->SetWorkerCommand(new Array({ "python3", WorkerScript }));
+		command->SetWorkerPoolSize(poolSize);
+		command->SetWorkerMaxChecks(maxChecks);
+
+		return command;
+	}
+
+	/**
+	 * Runs the checks at once and waits for all of their results.
+	 */
+	static std::vector<ProcessResult> ExecuteAll(const CheckCommand::Ptr& command, const std::vector<Process::Arguments>& checks,
+		double timeout = 60, const Dictionary::Ptr& env = new Dictionary())
+	{
+		std::vector<ProcessResult> results (checks.size());
+		std::atomic<size_t> done (0);
+
+		for (size_t i = 0; i < checks.size(); i++) {
+			PluginWorker::ExecuteCommand(command, checks[i], env, timeout, [&results, &done, i](const ProcessResult& pr) {
+				results[i] = pr;
+				done++;
+			});
+		}
+
+		for (int i = 0; i < 300 && done < checks.size(); i++)
+			Utility::Sleep(0.1);
+
+		BOOST_REQUIRE_EQUAL(done.load(), checks.size());
+
+		return results;
+	}
+
+	static ProcessResult Execute(const CheckCommand::Ptr& command, const Process::Arguments& check, double timeout = 60)
+	{
+		return ExecuteAll(command, { check }, timeout)[0];
+	}
+
+	/**
+	 * @returns The PID of the worker which has answered the check
+	 */
+	static String WorkerPID(const ProcessResult& pr)
+	{
+		std::vector<String> tokens = pr.Output.Split(" ");
+
+		for (const String& token : tokens) {
+			if (token.SubStr(0, 4) == "pid=")
+				return token.SubStr(4);
+		}
+
+		return "";
+	}
+
+	String WorkerScript;
+
+private:
+	boost::filesystem::path m_TempDir;
+};
+
+BOOST_FIXTURE_TEST_SUITE(icinga_pluginworker, PluginWorkerFixture)
+
+BOOST_AUTO_TEST_CASE(result)
+{
+	CheckCommand::Ptr command = MakeCommand();
+
+	ProcessResult first = Execute(command, { "check_foo", "OK" });
+
+	BOOST_CHECK_EQUAL(first.ExitStatus, 0);
+	BOOST_CHECK_EQUAL(first.Output.SubStr(0, 7), "OK pid=");
+	BOOST_CHECK(first.ExecutionEnd >= first.ExecutionStart);
+
+	Dictionary::Ptr env = new Dictionary({ { "STATUS", "2" } });
+	ProcessResult second = ExecuteAll(command, { { "check_foo", "CRITICAL" } }, 60, env)[0];
+
+	/* The worker is kept running between checks. */
+	BOOST_CHECK_EQUAL(second.ExitStatus, 2);
+	BOOST_CHECK_EQUAL(WorkerPID(second), WorkerPID(first));
+	BOOST_CHECK(second.Output.Contains("n=2"));
+}
+
+BOOST_AUTO_TEST_CASE(crash)
+{
+	CheckCommand::Ptr command = MakeCommand();
+
+	ProcessResult first = Execute(command, { "check_foo", "OK" });
+	ProcessResult crashed = Execute(command, { "crash" });
+
+	BOOST_CHECK_EQUAL(crashed.ExitStatus, 128);
+	BOOST_CHECK(crashed.Output.Contains("exited unexpectedly"));
+
+	/* The next check gets a new worker. */
+	ProcessResult next = Execute(command, { "check_foo", "OK" });
+
+	BOOST_CHECK_EQUAL(next.ExitStatus, 0);
+	BOOST_CHECK(WorkerPID(next) != WorkerPID(first));
+	BOOST_CHECK(next.Output.Contains("n=1"));
+}
+
+BOOST_AUTO_TEST_CASE(timeout)
+{
+	CheckCommand::Ptr command = MakeCommand();
+
+	double start = Utility::GetTime();
+	ProcessResult pr = Execute(command, { "sleep", "30" }, 1);
+
+	BOOST_CHECK_EQUAL(pr.ExitStatus, 128);
+	BOOST_CHECK(pr.Output.Contains("<Timeout exceeded.>"));
+	BOOST_CHECK(Utility::GetTime() - start < 5);
+
+	/* The worker has been terminated. */
+	bool terminated = false;
+
+	for (int i = 0; i < 100 && !terminated; i++) {
+		terminated = kill(pr.PID, 0) < 0 && errno == ESRCH;
+
+		if (!terminated)
+			Utility::Sleep(0.1);
+	}
+
+	BOOST_CHECK(terminated);
+
+	ProcessResult next = Execute(command, { "check_foo", "OK" });
+
+	BOOST_CHECK_EQUAL(next.ExitStatus, 0);
+	BOOST_CHECK(WorkerPID(next) != Convert::ToString(pr.PID));
+}
+
+BOOST_AUTO_TEST_CASE(recycle)
+{
+	CheckCommand::Ptr command = MakeCommand(1, 2);
+	std::vector<String> pids;
+
+	for (int i = 0; i < 4; i++)
+		pids.push_back(WorkerPID(Execute(command, { "check_foo", "OK" })));
+
+	BOOST_CHECK_EQUAL(pids[0], pids[1]);
+	BOOST_CHECK(pids[1] != pids[2]);
+	BOOST_CHECK_EQUAL(pids[2], pids[3]);
+}
+
+BOOST_AUTO_TEST_CASE(pool_size)
+{
+	CheckCommand::Ptr command = MakeCommand(2);
+
+	double start = Utility::GetTime();
+	std::vector<ProcessResult> results = ExecuteAll(command, std::vector<Process::Arguments>(6, { "sleep", "0.5", "OK" }));
+	std::set<String> pids;
+
+	for (const ProcessResult& pr : results) {
+		BOOST_CHECK_EQUAL(pr.ExitStatus, 0);
+		pids.insert(WorkerPID(pr));
+	}
+
+	/* Two workers have run three checks each. */
+	BOOST_CHECK_EQUAL(pids.size(), 2);
+	BOOST_CHECK(Utility::GetTime() - start >= 1.4);
+}
+
+BOOST_AUTO_TEST_CASE(fallback)
+{
+	CheckCommand::Ptr command = MakeCommand();
+	command->SetWorkerCommand(new Array({ "/nonexistent/worker" }));
+
+	/* The plugin is executed directly instead. */
+	ProcessResult pr = Execute(command, { "/bin/sh", "-c", "echo direct; exit 2" });
+
+	BOOST_CHECK_EQUAL(pr.ExitStatus, 2);
+	BOOST_CHECK_EQUAL(pr.Output, "direct\n");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+#endif /* _WIN32 */
@@ -0,0 +1,130 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "icingadb/redisconnection.hpp"
+#include "base/objectlock.hpp"
+#include "base/utility.hpp"
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/local/stream_protocol.hpp>
+#include <boost/asio/read_until.hpp>
+#include <boost/asio/streambuf.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/filesystem.hpp>
+#include <istream>
+#include <thread>
+#include <BoostTestTargetConfig.h>
+
+using namespace icinga;
+
+using Prio = RedisConnection::QueryPriority;
+using Unix = boost::asio::local::stream_protocol;
+
+/**
+ * @returns The comma-separated priorities of each lane
+ */
+static std::vector<String> GetLanePriorities(int lanes)
+{
+	RedisConnection::Ptr rcon = new RedisConnection("127.0.0.1", 6380, "", "", 0, lanes);
+	Array::Ptr stats = rcon->GetLaneStats();
+	std::vector<String> priorities;
+
+	ObjectLock olock(stats);
+
+	for (Dictionary::Ptr lane : stats) {
+		Array::Ptr lanePriorities = lane->Get("priorities");
+		priorities.emplace_back(lanePriorities->Join(","));
+	}
+
+	return priorities;
+}
+
+/**
+ * Pretends to be a Redis server which answers the given amount of queries
+ * with their (zero-based) number.
+ */
+static void ServeQueries(Unix::acceptor& acceptor, int queries)
+{
+	Unix::socket socket (acceptor.get_executor());
+	acceptor.accept(socket);
+
+	boost::asio::streambuf buf;
+	std::istream in (&buf);
+	std::string line;
+
+	auto readLine ([&]() {
+		boost::asio::read_until(socket, buf, "\r\n");
+		std::getline(in, line);
+	});
+
+	for (int i = 0; i < queries; i++) {
+		readLine();
+
+		/* "*<args>", then "$<length>" and the value per argument */
+		for (int args = std::stoi(line.substr(1)); args; args--) {
+			readLine();
+			readLine();
+		}
+
+		std::string reply = ":" + std::to_string(i) + "\r\n";
+		boost::asio::write(socket, boost::asio::buffer(reply));
+	}
+}
+
+BOOST_AUTO_TEST_SUITE(icingadb_redisconnection)
+
+BOOST_AUTO_TEST_CASE(lanes)
+{
+	/* One connection for everything... */
+	BOOST_CHECK(GetLanePriorities(1) == std::vector<String>({ "heartbeat,config,state,history,check_result" }));
+
+	/* ...the config dump on a connection of its own... */
+	BOOST_CHECK(GetLanePriorities(2) == std::vector<String>({ "config", "heartbeat,state,history,check_result" }));
+
+	/* ...and the remaining priorities spread over the other ones. */
+	BOOST_CHECK(GetLanePriorities(3) == std::vector<String>({ "config", "state,check_result", "heartbeat,history" }));
+}
+
+BOOST_AUTO_TEST_CASE(write_loop)
+{
+	boost::filesystem::path path = boost::filesystem::unique_path(boost::filesystem::temp_directory_path() / "icinga2-redis-%%%%-%%%%.sock");
+
+	boost::asio::io_context io;
+	Unix::acceptor acceptor (io, Unix::endpoint(path.string()));
+	std::thread server ([&acceptor]() { ServeQueries(acceptor, 6); });
+
+	RedisConnection::Ptr rcon = new RedisConnection("", 0, path.string());
+	rcon->Start();
+
+	for (int i = 0; i < 100 && !rcon->IsConnected(); i++)
+		Utility::Sleep(0.1);
+
+	BOOST_REQUIRE(rcon->IsConnected());
+
+	RedisConnection::Queries queries;
+
+	for (int i = 0; i < 5; i++)
+		queries.push_back({ "SET", "key" + std::to_string(i), "value" });
+
+	rcon->FireAndForgetQueries(std::move(queries), Prio::History);
+
+	/* The responses to the queries sent before have been skipped. */
+	RedisConnection::Reply reply = rcon->GetResultOfQuery({ "GET", "key0" }, Prio::History);
+
+	BOOST_CHECK_EQUAL(reply, 5);
+
+	server.join();
+
+	Array::Ptr stats = rcon->GetLaneStats();
+
+	BOOST_REQUIRE_EQUAL(stats->GetLength(), 1);
+
+	Dictionary::Ptr lane = stats->Get(0);
+
+	BOOST_CHECK_EQUAL(lane->Get("pending_queries"), 0);
+	BOOST_CHECK_EQUAL(lane->Get("pending_responses"), 0);
+	BOOST_CHECK(lane->Get("round_trip_time") > 0);
+
+	boost::system::error_code ec;
+	boost::filesystem::remove(path, ec);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
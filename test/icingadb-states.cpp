@@ -0,0 +1,150 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "icingadb/icingadb.hpp"
+#include "icinga/checkcommand.hpp"
+#include "icinga/host.hpp"
+#include <set>
+#include <BoostTestTargetConfig.h>
+
+using namespace icinga;
+
+/**
+ * Provides an IcingaDB feature which isn't connected to Redis, its queued states are only serialized.
+ */
+struct IcingaDBStatesFixture
+{
+	IcingaDBStatesFixture()
+	{
+		Feature = new IcingaDB();
+	}
+
+	/**
+	 * @returns A host which can be serialized without a check command
+	 */
+	static Host::Ptr MakeHost(const String& name)
+	{
+		Host::Ptr host = new Host();
+		host->SetName(name);
+		host->SetCheckTimeout(60);
+
+		return host;
+	}
+
+	/**
+	 * @returns The queries with the given command
+	 */
+	static std::vector<std::vector<String>> Filter(const std::vector<std::vector<String>>& queries, const String& command)
+	{
+		std::vector<std::vector<String>> filtered;
+
+		for (auto& query : queries) {
+			if (query.at(0) == command)
+				filtered.push_back(query);
+		}
+
+		return filtered;
+	}
+
+	IcingaDB::Ptr Feature;
+};
+
+BOOST_FIXTURE_TEST_SUITE(icingadb_states, IcingaDBStatesFixture)
+
+BOOST_AUTO_TEST_CASE(coalesce)
+{
+	Host::Ptr first = MakeHost("first");
+	Host::Ptr second = MakeHost("second");
+
+	Feature->QueueStateUpdate(first, true, false);
+	Feature->QueueStateUpdate(second, true, false);
+	Feature->QueueStateUpdate(first, false, true);
+	Feature->QueueStateUpdate(second, true, false);
+
+	std::vector<std::vector<String>> queries = Feature->GetStateFlushQueries();
+
+	BOOST_CHECK_EQUAL(queries.size(), 2);
+
+	/* Both hosts share one HMSET, each one only once... */
+	std::vector<std::vector<String>> hMSets = Filter(queries, "HMSET");
+
+	BOOST_REQUIRE_EQUAL(hMSets.size(), 1);
+	BOOST_CHECK_EQUAL(hMSets[0][1], "icinga:config:state:host");
+	BOOST_CHECK_EQUAL(hMSets[0].size(), 2u + 2u * 2u);
+
+	/* ...and only the first one also got its state streamed. */
+	std::vector<std::vector<String>> xAdds = Filter(queries, "XADD");
+
+	BOOST_REQUIRE_EQUAL(xAdds.size(), 1);
+	BOOST_CHECK_EQUAL(xAdds[0][1], "icinga:state:stream:host");
+
+	std::set<String> streamed (xAdds[0].begin(), xAdds[0].end());
+
+	BOOST_CHECK_EQUAL(streamed.count(hMSets[0][2]) + streamed.count(hMSets[0][4]), 1);
+
+	/* The queue has been emptied. */
+	BOOST_CHECK(Feature->GetStateFlushQueries().empty());
+}
+
+BOOST_AUTO_TEST_CASE(chunks)
+{
+	std::vector<Host::Ptr> hosts;
+
+	for (int i = 0; i < 250; i++) {
+		hosts.push_back(MakeHost("host" + std::to_string(i)));
+		Feature->QueueStateUpdate(hosts.back(), true, false);
+	}
+
+	std::vector<std::vector<String>> queries = Feature->GetStateFlushQueries();
+	std::multiset<size_t> sizes;
+	std::set<String> ids;
+
+	for (auto& query : queries) {
+		BOOST_REQUIRE_EQUAL(query.at(0), "HMSET");
+		BOOST_CHECK_EQUAL(query.at(1), "icinga:config:state:host");
+
+		sizes.insert(query.size());
+
+		for (size_t i = 2; i < query.size(); i += 2)
+			ids.insert(query[i]);
+	}
+
+	/* At most 100 objects per HMSET, but all of them written. */
+	BOOST_CHECK(sizes == std::multiset<size_t>({ 2u + 50u * 2u, 2u + 100u * 2u, 2u + 100u * 2u }));
+	BOOST_CHECK_EQUAL(ids.size(), 250);
+}
+
+BOOST_AUTO_TEST_CASE(config_update)
+{
+	CheckCommand::Ptr command = new CheckCommand();
+	command->SetName("icingadb-states");
+	command->Register();
+
+	Host::Ptr host = MakeHost("updated");
+	host->SetCheckCommandRaw(command->GetName());
+
+	std::vector<std::vector<String>> queries = Feature->GetConfigUpdateQueries(host, true);
+	size_t state = 0, publish = 0;
+
+	for (size_t i = 0; i < queries.size(); i++) {
+		if (queries[i].at(0) == "HMSET" && queries[i].at(1) == "icinga:config:state:host")
+			state = i;
+
+		if (queries[i].at(0) == "PUBLISH" && queries[i].at(1) == "icinga:config:update:state:host")
+			publish = i;
+	}
+
+	/* The state is written in the same transaction, before subscribers are told about it... */
+	BOOST_REQUIRE(queries.size() > 2);
+	BOOST_CHECK_EQUAL(queries.front().at(0), "MULTI");
+	BOOST_CHECK_EQUAL(queries.back().at(0), "EXEC");
+	BOOST_CHECK(state > 0);
+	BOOST_CHECK(publish > state);
+	BOOST_CHECK_EQUAL(queries[publish].at(2), queries[state].at(2));
+
+	/* ...rather than by the next flush. */
+	BOOST_CHECK(Feature->GetStateFlushQueries().empty());
+
+	command->Unregister();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,157 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "remote/apilistener.hpp"
+#include "remote/endpoint.hpp"
+#include "remote/jsonrpcconnection.hpp"
+#include "base/configuration.hpp"
+#include "base/io-engine.hpp"
+#include "base/netstring.hpp"
+#include "base/scriptglobal.hpp"
+#include "base/shared.hpp"
+#include "base/tlsstream.hpp"
+#include "base/tlsutility.hpp"
+#include "base/utility.hpp"
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/filesystem.hpp>
+#include <chrono>
+#include <future>
+#include <BoostTestTargetConfig.h>
+
+using namespace icinga;
+
+namespace asio = boost::asio;
+
+/**
+ * Provides an ApiListener with a self-signed certificate and an endpoint
+ * which the test connections are authenticated as.
+ */
+struct JsonRpcConnectionFixture
+{
+	JsonRpcConnectionFixture()
+		: m_DataDir(Configuration::DataDir),
+		m_TempDir(boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("icinga2-jsonrpc-%%%%-%%%%"))
+	{
+		Configuration::DataDir = m_TempDir.string();
+		ScriptGlobal::Set("NodeName", "master");
+
+		Utility::MkDirP(ApiListener::GetCertsDir(), 0700);
+		MakeX509CSR("master", ApiListener::GetDefaultKeyPath(), String(), ApiListener::GetDefaultCertPath());
+		Utility::CopyFile(ApiListener::GetDefaultCertPath(), ApiListener::GetDefaultCaPath());
+
+		SslContext = MakeAsioSslContext(ApiListener::GetDefaultCertPath(), ApiListener::GetDefaultKeyPath(), ApiListener::GetDefaultCaPath());
+
+		/* There can only be one ApiListener per process. */
+		if (!ApiListener::GetInstance()) {
+			ApiListener::Ptr listener = new ApiListener();
+			static_pointer_cast<ConfigObject>(listener)->OnConfigLoaded();
+		}
+
+		Peer = new Endpoint();
+		Peer->SetName("peer");
+		Peer->Register();
+	}
+
+	~JsonRpcConnectionFixture()
+	{
+		Peer->Unregister();
+
+		boost::system::error_code ec;
+		boost::filesystem::remove_all(m_TempDir, ec);
+
+		Configuration::DataDir = m_DataDir;
+	}
+
+	/**
+	 * Connects a JSON-RPC connection for the "peer" endpoint to a TLS client stream.
+	 *
+	 * @returns The client end of the connection
+	 */
+	Shared<AsioTlsStream>::Ptr Connect()
+	{
+		auto& io (IoEngine::Get().GetIoContext());
+
+		asio::ip::tcp::acceptor acceptor (io, asio::ip::tcp::endpoint(asio::ip::address_v4::loopback(), 0));
+
+		auto server (Shared<AsioTlsStream>::Make(io, *SslContext));
+		auto client (Shared<AsioTlsStream>::Make(io, *SslContext));
+
+		client->lowest_layer().connect(acceptor.local_endpoint());
+		acceptor.accept(server->lowest_layer());
+
+		auto clientHandshake (std::async(std::launch::async, [client]() {
+			client->next_layer().handshake(asio::ssl::stream_base::client);
+		}));
+
+		server->next_layer().handshake(asio::ssl::stream_base::server);
+		clientHandshake.get();
+
+		JsonRpcConnection::Ptr connection = new JsonRpcConnection("peer", true, server, RoleServer);
+		BOOST_REQUIRE(connection->GetEndpoint() == Peer);
+
+		connection->Start();
+
+		return client;
+	}
+
+	Shared<asio::ssl::context>::Ptr SslContext;
+	Endpoint::Ptr Peer;
+
+private:
+	String m_DataDir;
+	boost::filesystem::path m_TempDir;
+};
+
+/**
+ * Reads from the client end until the server closes the connection.
+ *
+ * @returns Whether the connection was closed within the timeout
+ */
+static bool WaitForDisconnect(const Shared<AsioTlsStream>::Ptr& client, std::chrono::seconds timeout)
+{
+	auto closed (std::async(std::launch::async, [client]() {
+		char buffer[512];
+		boost::system::error_code ec;
+
+		while (!ec)
+			client->read_some(asio::buffer(buffer), ec);
+	}));
+
+	if (closed.wait_for(timeout) == std::future_status::ready)
+		return true;
+
+	boost::system::error_code ec;
+	client->lowest_layer().shutdown(asio::ip::tcp::socket::shutdown_both, ec);
+	closed.wait();
+
+	return false;
+}
+
+BOOST_FIXTURE_TEST_SUITE(remote_jsonrpcconnection, JsonRpcConnectionFixture)
+
+BOOST_AUTO_TEST_CASE(malformed_ts)
+{
+	auto client (Connect());
+
+	/* Processed by the dispatching thread itself, it has no ordering key. */
+	NetString::WriteStringToStream(client, R"({"jsonrpc":"2.0","method":"log::SetLogPosition","params":{},"ts":"garbage"})");
+	NetString::WriteStringToStream(client, R"({"jsonrpc":"2.0","method":"log::SetLogPosition","params":{},"ts":1})");
+	client->flush();
+
+	BOOST_CHECK(WaitForDisconnect(client, std::chrono::seconds(30)));
+	BOOST_CHECK(Peer->GetRemoteLogPosition() == 0);
+}
+
+BOOST_AUTO_TEST_CASE(malformed_ts_lane)
+{
+	auto client (Connect());
+
+	/* Checkable messages go through a per-checkable lane. */
+	NetString::WriteStringToStream(client, R"({"jsonrpc":"2.0","method":"event::SetNextCheck","params":{"host":"h1","next_check":1},"ts":{}})");
+	NetString::WriteStringToStream(client, R"({"jsonrpc":"2.0","method":"event::SetNextCheck","params":{"host":"h1","next_check":2},"ts":1})");
+	client->flush();
+
+	BOOST_CHECK(WaitForDisconnect(client, std::chrono::seconds(30)));
+	BOOST_CHECK(Peer->GetRemoteLogPosition() == 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,270 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "remote/apilistener.hpp"
+#include "remote/endpoint.hpp"
+#include "base/configuration.hpp"
+#include "base/convert.hpp"
+#include "base/json.hpp"
+#include "base/netstring.hpp"
+#include "base/stdiostream.hpp"
+#include "base/utility.hpp"
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <BoostTestTargetConfig.h>
+
+using namespace icinga;
+
+struct ReplayedMessage
+{
+	double Ts;
+	String Type;
+	String Name;
+	String Message;
+};
+
+/**
+ * Provides an ApiListener which writes its replay log into a temporary directory.
+ */
+struct ReplayLogFixture
+{
+	ReplayLogFixture()
+		: m_DataDir(Configuration::DataDir),
+		m_TempDir(boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("icinga2-replaylog-%%%%-%%%%"))
+	{
+		Configuration::DataDir = m_TempDir.string();
+
+		Listener = new ApiListener();
+
+		Peer = new Endpoint();
+		Peer->SetName("peer");
+		Peer->Register();
+	}
+
+	~ReplayLogFixture()
+	{
+		Peer->Unregister();
+
+		boost::system::error_code ec;
+		boost::filesystem::remove_all(m_TempDir, ec);
+
+		Configuration::DataDir = m_DataDir;
+	}
+
+	/**
+	 * Persists the messages with the timestamps 100, 200 and 300, the second one
+	 * is about the "peer" endpoint, and rotates the log.
+	 *
+	 * @returns The rotated log file
+	 */
+	String WriteLog()
+	{
+		Listener->StartLogging();
+
+		for (int i = 1; i <= 3; i++) {
+			Dictionary::Ptr message = new Dictionary({
+				{ "jsonrpc", "2.0" },
+				{ "method", "event::Test" },
+				{ "params", new Dictionary({ { "i", i } }) },
+				{ "ts", i * 100 }
+			});
+
+			String json = JsonEncode(message);
+			Messages.push_back(json);
+
+			ConfigObject::Ptr secobj;
+
+			if (i == 2)
+				secobj = Peer;
+
+			Listener->PersistMessage(message, json, secobj);
+		}
+
+		Listener->StopLogging();
+
+		return ApiListener::GetApiDir() + "log/301";
+	}
+
+	/**
+	 * @returns The messages in the log file after peerTs
+	 */
+	static std::vector<ReplayedMessage> Replay(const String& path, double peerTs = 0)
+	{
+		std::vector<ReplayedMessage> messages;
+
+		ApiListener::ReplayLogFile(path, peerTs, [&messages](double ts, const String& type, const String& name, const char *message, size_t length) -> bool {
+			messages.push_back({ ts, type, name, String(message, message + length) });
+			return true;
+		});
+
+		return messages;
+	}
+
+	/**
+	 * Checks that all messages written by WriteLog() have been replayed.
+	 */
+	void CheckReplayed(const std::vector<ReplayedMessage>& messages)
+	{
+		BOOST_REQUIRE_EQUAL(messages.size(), 3);
+
+		for (int i = 0; i < 3; i++) {
+			BOOST_CHECK_EQUAL(messages[i].Ts, (i + 1) * 100);
+			BOOST_CHECK_EQUAL(messages[i].Message, Messages[i]);
+		}
+
+		BOOST_CHECK_EQUAL(messages[0].Type, "");
+		BOOST_CHECK_EQUAL(messages[1].Type, "Endpoint");
+		BOOST_CHECK_EQUAL(messages[1].Name, "peer");
+	}
+
+	ApiListener::Ptr Listener;
+	Endpoint::Ptr Peer;
+	std::vector<String> Messages;
+
+private:
+	String m_DataDir;
+	boost::filesystem::path m_TempDir;
+};
+
+BOOST_FIXTURE_TEST_SUITE(remote_replaylog, ReplayLogFixture)
+
+BOOST_AUTO_TEST_CASE(indexed)
+{
+	String path = WriteLog();
+
+	BOOST_REQUIRE(Utility::PathExists(path + ".idx"));
+
+	CheckReplayed(Replay(path));
+
+	std::vector<ReplayedMessage> messages = Replay(path, 200);
+
+	BOOST_REQUIRE_EQUAL(messages.size(), 1);
+	BOOST_CHECK_EQUAL(messages[0].Message, Messages[2]);
+}
+
+BOOST_AUTO_TEST_CASE(index_byte_order)
+{
+	String path = WriteLog();
+
+	std::ifstream fp (path.CStr(), std::ios_base::binary);
+	std::string header;
+	std::getline(fp, header, ',');
+
+	std::ifstream ifp ((path + ".idx").CStr(), std::ios_base::binary);
+	char magic[8], entry[40];
+
+	BOOST_REQUIRE(ifp.read(magic, sizeof(magic)));
+	BOOST_CHECK_EQUAL(magic[7], 2);
+
+	/* The first entry refers to the record after the version header,
+	 * its timestamp is 100.0 as big-endian IEEE 754 binary64.
+	 */
+	BOOST_REQUIRE(ifp.read(entry, sizeof(entry)));
+
+	uint_least64_t recordOffset = 0;
+
+	for (int i = 0; i < 8; i++)
+		recordOffset = (recordOffset << 8u) | (unsigned char)entry[i];
+
+	BOOST_CHECK_EQUAL(recordOffset, header.size() + 1u);
+	BOOST_CHECK_EQUAL(std::string(entry + 24, 8), std::string("\x40\x59\x00\x00\x00\x00\x00\x00", 8));
+}
+
+BOOST_AUTO_TEST_CASE(without_index)
+{
+	String path = WriteLog();
+
+	(void)unlink((path + ".idx").CStr());
+
+	CheckReplayed(Replay(path));
+}
+
+BOOST_AUTO_TEST_CASE(truncated_index)
+{
+	String path = WriteLog();
+
+	/* Only the first entry and a part of the second one made it to the disk. */
+	boost::filesystem::resize_file((path + ".idx").CStr(), 8 + 40 + 40);
+
+	CheckReplayed(Replay(path));
+}
+
+BOOST_AUTO_TEST_CASE(stale_index)
+{
+	/* A crash between renaming a rotated log file and its index leaves the index behind.
+	 * Its entry points to the version record of the next log file.
+	 */
+	String version = JsonEncode(new Dictionary({ { "version", 2 } }));
+	uint_least64_t fields[4] = { 0, Convert::ToString(version.GetLength()).GetLength() + 1u, version.GetLength(), 0x4049000000000000u };
+	std::string entry;
+
+	for (uint_least64_t field : fields) {
+		for (int i = 7; i >= 0; i--)
+			entry += (char)((field >> (i * 8u)) & 0xFFu);
+	}
+
+	entry += std::string(8, '\0');
+
+	Utility::MkDirP(ApiListener::GetApiDir() + "log", 0750);
+
+	std::ofstream fp ((ApiListener::GetApiDir() + "log/current.idx").CStr(), std::ios_base::binary);
+	fp << std::string("I2RLIDX\x02", 8) << entry;
+	fp.close();
+
+	String path = WriteLog();
+
+	BOOST_CHECK_EQUAL(boost::filesystem::file_size((path + ".idx").CStr()), 8u + 3u * 40u + 8u + 4u);
+
+	CheckReplayed(Replay(path));
+}
+
+BOOST_AUTO_TEST_CASE(old_format)
+{
+	String path = ApiListener::GetApiDir() + "log/301";
+
+	Utility::MkDirP(Utility::DirName(path), 0750);
+
+	{
+		auto *fp = new std::fstream(path.CStr(), std::fstream::out | std::fstream::binary);
+		StdioStream::Ptr stream = new StdioStream(fp, true);
+
+		for (int i = 1; i <= 3; i++) {
+			String json = JsonEncode(new Dictionary({
+				{ "jsonrpc", "2.0" },
+				{ "method", "event::Test" },
+				{ "params", new Dictionary({ { "i", i } }) },
+				{ "ts", i * 100 }
+			}));
+
+			Messages.push_back(json);
+
+			Dictionary::Ptr pmessage = new Dictionary({
+				{ "timestamp", i * 100 },
+				{ "message", json }
+			});
+
+			if (i == 2)
+				pmessage->Set("secobj", new Dictionary({ { "type", "Endpoint" }, { "name", "peer" } }));
+
+			NetString::WriteStringToStream(stream, JsonEncode(pmessage));
+		}
+
+		stream->Close();
+	}
+
+	CheckReplayed(Replay(path));
+}
+
+BOOST_AUTO_TEST_CASE(newer_format)
+{
+	String path = WriteLog();
+
+	(void)unlink((path + ".idx").CStr());
+
+	std::ofstream fp (path.CStr(), std::ios_base::binary | std::ios_base::trunc);
+	fp << "13:{\"version\":3}," << "10:{\"ts\":100},2:{},";
+	fp.close();
+
+	BOOST_CHECK(Replay(path).empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -849,6 +849,11 @@ void ClassCompiler::HandleClass(const Klass& klass, const ClassDebugInfo&)
 					m_Impl << "\t" << "Track" << field.GetFriendlyName() << "(oldValue, value);" << std::endl;
 				}
 
+				/* All classes with a parent class derive from ConfigObject, the others
+				 * (e.g. CheckResult) aren't persisted in the state file on their own. */
+				if ((field.Attributes & FAState) && !klass.Parent.empty())
+					m_Impl << "\t" << "static_cast<ConfigObject *>(this)->MarkStateDirty();" << std::endl;
+
 				m_Impl << "\t" << "if (!suppress_events)" << std::endl
 					<< "\t\t" << "Notify" << field.GetFriendlyName() << "(cookie);" << std::endl
 					<< "}" << std::endl << std::endl;